@@ -3050,6 +3050,42 @@ virNWFilterRuleDefFormat(virBufferPtr buf,
 }
 
 
+/**
+ * virNWFilterRuleDefEqual:
+ * @a: first rule
+ * @b: second rule
+ *
+ * Returns true if both rules have the same XML representation, meaning
+ * they instantiate to the same firewall rules for equal variables.
+ */
+bool
+virNWFilterRuleDefEqual(virNWFilterRuleDefPtr a,
+                        virNWFilterRuleDefPtr b)
+{
+    virBuffer bufa = VIR_BUFFER_INITIALIZER;
+    virBuffer bufb = VIR_BUFFER_INITIALIZER;
+    bool ret = false;
+
+    if (a == b)
+        return true;
+
+    virNWFilterRuleDefFormat(&bufa, a);
+    virNWFilterRuleDefFormat(&bufb, b);
+
+    if (virBufferCheckError(&bufa) < 0 ||
+        virBufferCheckError(&bufb) < 0)
+        goto cleanup;
+
+    ret = STREQ(virBufferCurrentContent(&bufa),
+                virBufferCurrentContent(&bufb));
+
+ cleanup:
+    virBufferFreeAndReset(&bufa);
+    virBufferFreeAndReset(&bufb);
+    return ret;
+}
+
+
 static int
 virNWFilterEntryFormat(virBufferPtr buf,
                        virNWFilterEntryPtr entry)
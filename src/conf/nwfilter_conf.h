@@ -565,6 +565,10 @@ virNWFilterDefParseNode(xmlDocPtr xml,
 char *
 virNWFilterDefFormat(const virNWFilterDef *def);
 
+bool
+virNWFilterRuleDefEqual(virNWFilterRuleDefPtr a,
+                        virNWFilterRuleDefPtr b);
+
 int
 virNWFilterSaveConfig(const char *configDir,
                       virNWFilterDefPtr def);
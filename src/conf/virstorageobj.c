@@ -42,6 +42,7 @@ static virClassPtr virStoragePoolObjClass;
 static virClassPtr virStoragePoolObjListClass;
 static virClassPtr virStorageVolObjClass;
 static virClassPtr virStorageVolObjListClass;
+static virClassPtr virStorageVolObjIndexClass;
 
 static void
 virStoragePoolObjDispose(void *opaque);
@@ -51,6 +52,8 @@ static void
 virStorageVolObjDispose(void *opaque);
 static void
 virStorageVolObjListDispose(void *opaque);
+static void
+virStorageVolObjIndexDispose(void *opaque);
 
 
 
@@ -80,6 +83,23 @@ struct _virStorageVolObjList {
     virHashTable *objsPath;
 };
 
+/* Index of the volumes of all pools in a virStoragePoolObjList, so that
+ * a volume can be found by key or path without locking and searching
+ * every pool. */
+typedef struct _virStorageVolObjIndex virStorageVolObjIndex;
+typedef virStorageVolObjIndex *virStorageVolObjIndexPtr;
+struct _virStorageVolObjIndex {
+    virObjectLockable parent;
+
+    /* key string -> NULL terminated list of uuid strings of the
+     * pools containing a volume with that key */
+    virHashTable *objsKey;
+
+    /* path string -> NULL terminated list of uuid strings of the
+     * pools containing a volume with that path */
+    virHashTable *objsPath;
+};
+
 struct _virStoragePoolObj {
     virObjectLockable parent;
 
@@ -93,6 +113,9 @@ struct _virStoragePoolObj {
     virStoragePoolDefPtr newDef;
 
     virStorageVolObjListPtr volumes;
+
+    /* index of the list the pool is in, NULL if not in any */
+    virStorageVolObjIndexPtr volIndex;
 };
 
 struct _virStoragePoolObjList {
@@ -105,6 +128,9 @@ struct _virStoragePoolObjList {
     /* name string -> virStoragePoolObj mapping
      * for (1), lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* volumes of all pools in the list */
+    virStorageVolObjIndexPtr volIndex;
 };
 
 
@@ -202,12 +228,165 @@ virStoragePoolObjOnceInit(void)
     if (!VIR_CLASS_NEW(virStoragePoolObjList, virClassForObjectRWLockable()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virStorageVolObjIndex, virClassForObjectLockable()))
+        return -1;
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virStoragePoolObj);
 
 
+static void
+virStorageVolObjIndexDataFree(void *payload,
+                              const void *name ATTRIBUTE_UNUSED)
+{
+    virStringListFree(payload);
+}
+
+
+static virStorageVolObjIndexPtr
+virStorageVolObjIndexNew(void)
+{
+    virStorageVolObjIndexPtr idx;
+
+    if (!(idx = virObjectLockableNew(virStorageVolObjIndexClass)))
+        return NULL;
+
+    if (!(idx->objsKey = virHashCreate(50, virStorageVolObjIndexDataFree)) ||
+        !(idx->objsPath = virHashCreate(50, virStorageVolObjIndexDataFree))) {
+        virObjectUnref(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+
+static void
+virStorageVolObjIndexDispose(void *opaque)
+{
+    virStorageVolObjIndexPtr idx = opaque;
+
+    virHashFree(idx->objsKey);
+    virHashFree(idx->objsPath);
+}
+
+
+static int
+virStorageVolObjIndexAddOne(virHashTablePtr table,
+                            const char *name,
+                            const char *uuidstr)
+{
+    char **uuids = virHashSteal(table, name);
+
+    if (virStringListAdd(&uuids, uuidstr) < 0 ||
+        virHashAddEntry(table, name, uuids) < 0) {
+        virStringListFree(uuids);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+virStorageVolObjIndexRemoveOne(virHashTablePtr table,
+                               const char *name,
+                               const char *uuidstr)
+{
+    char **uuids = virHashSteal(table, name);
+
+    virStringListRemove(&uuids, uuidstr);
+
+    /* Re-adding a stolen entry only fails on OOM and would drop the
+     * other pools' entry for @name; they fall back to searching all
+     * pools then. */
+    if (uuids && virHashAddEntry(table, name, uuids) < 0)
+        virStringListFree(uuids);
+}
+
+
+/* Add @voldef of the pool @obj to the index of its pool list */
+static int
+virStorageVolObjIndexAdd(virStoragePoolObjPtr obj,
+                         virStorageVolDefPtr voldef)
+{
+    virStorageVolObjIndexPtr idx = obj->volIndex;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int ret = -1;
+
+    if (!idx)
+        return 0;
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    virObjectLock(idx);
+
+    if (virStorageVolObjIndexAddOne(idx->objsKey, voldef->key, uuidstr) < 0)
+        goto cleanup;
+
+    if (virStorageVolObjIndexAddOne(idx->objsPath,
+                                    voldef->target.path, uuidstr) < 0) {
+        virStorageVolObjIndexRemoveOne(idx->objsKey, voldef->key, uuidstr);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(idx);
+    return ret;
+}
+
+
+/* Remove @voldef of the pool @obj from the index of its pool list */
+static void
+virStorageVolObjIndexRemove(virStoragePoolObjPtr obj,
+                            virStorageVolDefPtr voldef)
+{
+    virStorageVolObjIndexPtr idx = obj->volIndex;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (!idx)
+        return;
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    virObjectLock(idx);
+    virStorageVolObjIndexRemoveOne(idx->objsKey, voldef->key, uuidstr);
+    virStorageVolObjIndexRemoveOne(idx->objsPath, voldef->target.path, uuidstr);
+    virObjectUnlock(idx);
+}
+
+
+static int
+virStorageVolObjIndexRemoveAllCb(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED,
+                                 void *opaque)
+{
+    virStorageVolObjPtr volobj = payload;
+    virStoragePoolObjPtr obj = opaque;
+
+    virStorageVolObjIndexRemove(obj, volobj->voldef);
+    return 0;
+}
+
+
+/* Remove all volumes of the pool @obj from the index of its pool list */
+static void
+virStorageVolObjIndexRemoveAll(virStoragePoolObjPtr obj)
+{
+    if (!obj->volIndex || !obj->volumes)
+        return;
+
+    virObjectRWLockRead(obj->volumes);
+    virHashForEach(obj->volumes->objsKey,
+                   virStorageVolObjIndexRemoveAllCb, obj);
+    virObjectRWUnlock(obj->volumes);
+}
+
+
 virStoragePoolObjPtr
 virStoragePoolObjNew(void)
 {
@@ -358,6 +537,7 @@ virStoragePoolObjDispose(void *opaque)
 
     virStoragePoolObjClearVols(obj);
     virObjectUnref(obj->volumes);
+    virObjectUnref(obj->volIndex);
 
     virStoragePoolDefFree(obj->def);
     virStoragePoolDefFree(obj->newDef);
@@ -374,6 +554,7 @@ virStoragePoolObjListDispose(void *opaque)
 
     virHashFree(pools->objs);
     virHashFree(pools->objsName);
+    virObjectUnref(pools->volIndex);
 }
 
 
@@ -389,7 +570,8 @@ virStoragePoolObjListNew(void)
         return NULL;
 
     if (!(pools->objs = virHashCreate(20, virObjectFreeHashData)) ||
-        !(pools->objsName = virHashCreate(20, virObjectFreeHashData))) {
+        !(pools->objsName = virHashCreate(20, virObjectFreeHashData)) ||
+        !(pools->volIndex = virStorageVolObjIndexNew())) {
         virObjectUnref(pools);
         return NULL;
     }
@@ -501,6 +683,95 @@ virStoragePoolObjListSearch(virStoragePoolObjListPtr pools,
 }
 
 
+static virStoragePoolObjPtr
+virStoragePoolObjListFindVolIndexed(virStoragePoolObjListPtr pools,
+                                    bool byPath,
+                                    const char *name,
+                                    virStorageVolDefPtr *voldef)
+{
+    virStoragePoolObjPtr obj;
+    virHashTablePtr table;
+    size_t i;
+    int rc;
+    VIR_AUTOSTRINGLIST uuids = NULL;
+
+    *voldef = NULL;
+
+    virObjectLock(pools->volIndex);
+    table = byPath ? pools->volIndex->objsPath : pools->volIndex->objsKey;
+    rc = virStringListCopy(&uuids, virHashLookup(table, name));
+    virObjectUnlock(pools->volIndex);
+
+    if (rc < 0)
+        return NULL;
+
+    for (i = 0; uuids && uuids[i]; i++) {
+        virObjectRWLockRead(pools);
+        obj = virObjectRef(virHashLookup(pools->objs, uuids[i]));
+        virObjectRWUnlock(pools);
+
+        if (!obj)
+            continue;
+
+        virObjectLock(obj);
+        if (virStoragePoolObjIsActive(obj)) {
+            if (byPath)
+                *voldef = virStorageVolDefFindByPath(obj, name);
+            else
+                *voldef = virStorageVolDefFindByKey(obj, name);
+
+            if (*voldef)
+                return obj;
+        }
+        virStoragePoolObjEndAPI(&obj);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * virStoragePoolObjListFindVolByKey
+ * @pools: Storage pool object list pointer
+ * @key: Volume key to find
+ * @voldef: Filled with the found volume definition
+ *
+ * Find an active pool in @pools containing a volume with @key using
+ * the index of volumes of all pools, without searching each pool.
+ *
+ * Returns: Locked and reffed storage pool object or NULL if not found
+ */
+virStoragePoolObjPtr
+virStoragePoolObjListFindVolByKey(virStoragePoolObjListPtr pools,
+                                  const char *key,
+                                  virStorageVolDefPtr *voldef)
+{
+    return virStoragePoolObjListFindVolIndexed(pools, false, key, voldef);
+}
+
+
+/**
+ * virStoragePoolObjListFindVolByPath
+ * @pools: Storage pool object list pointer
+ * @path: Target path of the volume to find
+ * @voldef: Filled with the found volume definition
+ *
+ * Find an active pool in @pools containing a volume whose target path
+ * is exactly @path using the index of volumes of all pools. Paths which
+ * only resolve to a volume's path, e.g. via a pool's stable path, are
+ * not found.
+ *
+ * Returns: Locked and reffed storage pool object or NULL if not found
+ */
+virStoragePoolObjPtr
+virStoragePoolObjListFindVolByPath(virStoragePoolObjListPtr pools,
+                                   const char *path,
+                                   virStorageVolDefPtr *voldef)
+{
+    return virStoragePoolObjListFindVolIndexed(pools, true, path, voldef);
+}
+
+
 void
 virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
                         virStoragePoolObjPtr obj)
@@ -514,6 +785,9 @@ virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
     virObjectLock(obj);
     virHashRemoveEntry(pools->objs, uuidstr);
     virHashRemoveEntry(pools->objsName, obj->def->name);
+    virStorageVolObjIndexRemoveAll(obj);
+    virObjectUnref(obj->volIndex);
+    obj->volIndex = NULL;
     virObjectUnlock(obj);
     virObjectUnref(obj);
     virObjectRWUnlock(pools);
@@ -613,6 +887,8 @@ virStoragePoolObjClearVols(virStoragePoolObjPtr obj)
     if (!obj->volumes)
         return;
 
+    virStorageVolObjIndexRemoveAll(obj);
+
     virHashRemoveAll(obj->volumes->objsKey);
     virHashRemoveAll(obj->volumes->objsName);
     virHashRemoveAll(obj->volumes->objsPath);
@@ -648,6 +924,13 @@ virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
     }
     virObjectRef(volobj);
 
+    if (virStorageVolObjIndexAdd(obj, voldef) < 0) {
+        virHashRemoveEntry(volumes->objsKey, voldef->key);
+        virHashRemoveEntry(volumes->objsName, voldef->name);
+        virHashRemoveEntry(volumes->objsPath, voldef->target.path);
+        goto error;
+    }
+
     volobj->voldef = voldef;
     virObjectRWUnlock(volumes);
     virStorageVolObjEndAPI(&volobj);
@@ -680,6 +963,7 @@ virStoragePoolObjRemoveVol(virStoragePoolObjPtr obj,
 
     virObjectRef(volobj);
     virObjectLock(volobj);
+    virStorageVolObjIndexRemove(obj, voldef);
     virHashRemoveEntry(volumes->objsKey, voldef->key);
     virHashRemoveEntry(volumes->objsName, voldef->name);
     virHashRemoveEntry(volumes->objsPath, voldef->target.path);
@@ -1557,6 +1841,7 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
     }
     virObjectRef(obj);
     obj->def = def;
+    obj->volIndex = virObjectRef(pools->volIndex);
     virObjectRWUnlock(pools);
     return obj;
 
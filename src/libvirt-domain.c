@@ -11474,6 +11474,11 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                          from virVcpuState enum.
  *     "vcpu.<num>.time" - virtual cpu time spent by virtual CPU <num>
  *                         as unsigned long long.
+ *     "vcpu.<num>.wait" - time the virtual CPU <num> was runnable but
+ *                         waiting for a host CPU in nanoseconds, as
+ *                         unsigned long long. This is what guests see
+ *                         as steal time.
+ *     "vcpu.<num>.halted" - virtual CPU <num> is halted, as boolean.
  *
  * VIR_DOMAIN_STATS_INTERFACE:
  *     Return network interface statistics (from domain point of view).
@@ -11665,6 +11670,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_HOST_ONLY in @flags limits the
+ * statistics to those the host can provide without talking to the
+ * hypervisor, so that a busy guest cannot delay the reply.  Some values,
+ * such as "vcpu.<num>.halted", are then sampled from the host scheduler
+ * and are only an approximation of the guest state.
+ *
  * Similarly to virConnectListAllDomains, @flags can contain various flags to
  * filter the list of domains to provide stats for.
  *
@@ -11755,6 +11766,12 @@ virConnectGetAllDomainStats(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_HOST_ONLY in @flags limits the
+ * statistics to those the host can provide without talking to the
+ * hypervisor, so that a busy guest cannot delay the reply.  Some values,
+ * such as "vcpu.<num>.halted", are then sampled from the host scheduler
+ * and are only an approximation of the guest state.
+ *
  * Note that any of the domain list filtering flags in @flags may be rejected
  * by this function.
  *
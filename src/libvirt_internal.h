@@ -123,6 +123,11 @@ typedef enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Support for compact encoding of typed parameters in bulk stats
+     */
+    VIR_DRV_FEATURE_REMOTE_COMPACT_TYPED_PARAMS = 16,
 } virDrvFeature;
 
 
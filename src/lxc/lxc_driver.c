@@ -1734,6 +1734,7 @@ lxcConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_TYPED_PARAMS:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     default:
         return 0;
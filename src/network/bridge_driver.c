@@ -66,7 +66,7 @@
 #include "viraccessapicheck.h"
 #include "network_event.h"
 #include "virhook.h"
-#include "virjson.h"
+#include "virlease.h"
 #include "virnetworkportdef.h"
 
 #include <libxml/xpathInternals.h>
@@ -74,13 +74,6 @@
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 #define MAX_BRIDGE_ID 256
 
-/**
- * VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX:
- *
- * Macro providing the upper limit on the size of leases file
- */
-#define VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX (32 * 1024 * 1024)
-
 #define SYSCTL_PATH "/proc/sys"
 
 VIR_LOG_INIT("network.bridge_driver");
@@ -407,6 +400,18 @@ networkDnsmasqLeaseFileNameCustom(virNetworkDriverStatePtr driver,
 }
 
 
+static char *
+networkDnsmasqLeaseDBFileName(virNetworkDriverStatePtr driver,
+                              const char *bridge)
+{
+    char *leasefile;
+
+    ignore_value(virAsprintf(&leasefile, "%s/%s.leasedb",
+                             driver->dnsmasqStateDir, bridge));
+    return leasefile;
+}
+
+
 static char *
 networkDnsmasqConfigFileName(virNetworkDriverStatePtr driver,
                              const char *netname)
@@ -449,6 +454,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
 {
     char *leasefile = NULL;
     char *customleasefile = NULL;
+    char *leasedbfile = NULL;
     char *radvdconfigfile = NULL;
     char *configfile = NULL;
     char *radvdpidbase = NULL;
@@ -471,6 +477,9 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     if (!(customleasefile = networkDnsmasqLeaseFileNameCustom(driver, def->bridge)))
         goto cleanup;
 
+    if (!(leasedbfile = networkDnsmasqLeaseDBFileName(driver, def->bridge)))
+        goto cleanup;
+
     if (!(radvdconfigfile = networkRadvdConfigFileName(driver, def->name)))
         goto cleanup;
 
@@ -490,6 +499,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     dnsmasqDelete(dctx);
     unlink(leasefile);
     unlink(customleasefile);
+    unlink(leasedbfile);
     unlink(configfile);
 
     /* MAC map manager */
@@ -511,6 +521,7 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     VIR_FREE(leasefile);
     VIR_FREE(configfile);
     VIR_FREE(customleasefile);
+    VIR_FREE(leasedbfile);
     VIR_FREE(radvdconfigfile);
     VIR_FREE(radvdpidbase);
     VIR_FREE(statusfile);
@@ -1562,18 +1573,29 @@ networkDnsmasqConfContents(virNetworkObjPtr obj,
 
     /* Even if there are currently no static hosts, if we're
      * listening for DHCP, we should write a 0-length hosts
-     * file to allow for runtime additions.
+     * file to allow for runtime additions. If dnsmasq supports
+     * it, every host gets a file of its own in a directory
+     * instead, so hosts can be added without touching the others.
      */
-    if (ipv4def || ipv6def)
-        virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
-                          dctx->hostsfile->path);
+    if (ipv4def || ipv6def) {
+        if (dnsmasqCapsGet(caps, DNSMASQ_CAPS_HOSTSDIR))
+            virBufferAsprintf(&configbuf, "dhcp-hostsdir=%s\n",
+                              dctx->hostsfile->dir);
+        else
+            virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
+                              dctx->hostsfile->path);
+    }
 
     /* Likewise, always create this file and put it on the
      * commandline, to allow for runtime additions.
      */
     if (wantDNS) {
-        virBufferAsprintf(&configbuf, "addn-hosts=%s\n",
-                          dctx->addnhostsfile->path);
+        if (dnsmasqCapsGet(caps, DNSMASQ_CAPS_HOSTSDIR))
+            virBufferAsprintf(&configbuf, "hostsdir=%s\n",
+                              dctx->addnhostsfile->dir);
+        else
+            virBufferAsprintf(&configbuf, "addn-hosts=%s\n",
+                              dctx->addnhostsfile->path);
     }
 
     /* Configure DHCP to tell clients about the MTU. */
@@ -1692,6 +1714,7 @@ networkStartDhcpDaemon(virNetworkDriverStatePtr driver,
     pid_t dnsmasqPid;
     int ret = -1;
     dnsmasqContext *dctx = NULL;
+    dnsmasqCapsPtr dnsmasq_caps = NULL;
 
     /* see if there are any IP addresses that need a dhcp server */
     i = 0;
@@ -1741,7 +1764,11 @@ networkStartDhcpDaemon(virNetworkDriverStatePtr driver,
     if (ret < 0)
         goto cleanup;
 
-    ret = dnsmasqSave(dctx);
+    dnsmasq_caps = networkGetDnsmasqCaps(driver);
+    if (dnsmasqCapsGet(dnsmasq_caps, DNSMASQ_CAPS_HOSTSDIR))
+        ret = dnsmasqSaveHostsDirs(dctx, NULL, NULL);
+    else
+        ret = dnsmasqSave(dctx);
     if (ret < 0)
         goto cleanup;
 
@@ -1767,42 +1794,28 @@ networkStartDhcpDaemon(virNetworkDriverStatePtr driver,
     VIR_FREE(pidfile);
     virCommandFree(cmd);
     dnsmasqContextFree(dctx);
+    virObjectUnref(dnsmasq_caps);
     return ret;
 }
 
 
-/* networkRefreshDhcpDaemon:
- *  Update dnsmasq config files, then send a SIGHUP so that it rereads
- *  them.   This only works for the dhcp-hostsfile and the
- *  addn-hosts file.
+/* networkDnsmasqHostsContextNew:
+ *  Build the lists of static DHCP and DNS hosts of @def, which are
+ *  kept outside the dnsmasq .conf file.
  *
- *  Returns 0 on success, -1 on failure.
+ *  Returns the new context or NULL on failure.
  */
-static int
-networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
-                         virNetworkObjPtr obj)
+static dnsmasqContext *
+networkDnsmasqHostsContextNew(virNetworkDriverStatePtr driver,
+                              virNetworkDefPtr def)
 {
-    virNetworkDefPtr def = virNetworkObjGetDef(obj);
-    int ret = -1;
     size_t i;
-    pid_t dnsmasqPid;
     virNetworkIPDefPtr ipdef, ipv4def, ipv6def;
     dnsmasqContext *dctx = NULL;
 
-    /* if no IP addresses specified, nothing to do */
-    if (!virNetworkDefGetIPByIndex(def, AF_UNSPEC, 0))
-        return 0;
-
-    /* if there's no running dnsmasq, just start it */
-    dnsmasqPid = virNetworkObjGetDnsmasqPid(obj);
-    if (dnsmasqPid <= 0 || (kill(dnsmasqPid, 0) < 0))
-        return networkStartDhcpDaemon(driver, obj);
-
-    VIR_INFO("Refreshing dnsmasq for network %s", def->bridge);
     if (!(dctx = dnsmasqContextNew(def->name,
-                                   driver->dnsmasqStateDir))) {
-        goto cleanup;
-    }
+                                   driver->dnsmasqStateDir)))
+        return NULL;
 
     /* Look for first IPv4 address that has dhcp defined.
      * We only support dhcp-host config on one IPv4 subnetwork
@@ -1824,17 +1837,93 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
             ipv6def = ipdef;
     }
 
-    if (ipv4def && (networkBuildDnsmasqDhcpHostsList(dctx, ipv4def) < 0))
-        goto cleanup;
+    if ((ipv4def && (networkBuildDnsmasqDhcpHostsList(dctx, ipv4def) < 0)) ||
+        (ipv6def && (networkBuildDnsmasqDhcpHostsList(dctx, ipv6def) < 0)) ||
+        networkBuildDnsmasqHostsList(dctx, &def->dns) < 0) {
+        dnsmasqContextFree(dctx);
+        return NULL;
+    }
+
+    return dctx;
+}
+
+
+/* networkDnsmasqUsesHostsDirs:
+ *  Check whether the running dnsmasq was told to read the hosts from
+ *  directories, which depends on the dnsmasq it was started with.
+ *
+ *  Returns 1 if it does, 0 if it does not, -1 on failure.
+ */
+static int
+networkDnsmasqUsesHostsDirs(virNetworkDriverStatePtr driver,
+                            virNetworkDefPtr def)
+{
+    VIR_AUTOFREE(char *) configfile = NULL;
+    VIR_AUTOFREE(char *) configstr = NULL;
+
+    if (!(configfile = networkDnsmasqConfigFileName(driver, def->name)))
+        return -1;
+
+    if (virFileReadAll(configfile, 1024 * 1024, &configstr) < 0)
+        return -1;
+
+    return strstr(configstr, "\ndhcp-hostsdir=") ||
+           strstr(configstr, "\nhostsdir=");
+}
+
+
+/* networkRefreshDhcpDaemon:
+ *  Update dnsmasq config files, then send a SIGHUP so that it rereads
+ *  them.   This only works for the dhcp-hostsfile and the
+ *  addn-hosts file, or their directory variants.
+ *
+ *  If dnsmasq reads the hosts from directories, only the files of
+ *  hosts which differ from @prevctx (if given) are touched, and
+ *  dnsmasq is only told to reload if a host it knows changed or was
+ *  removed. New hosts are picked up by dnsmasq itself.
+ *
+ *  Returns 0 on success, -1 on failure.
+ */
+static int
+networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
+                         virNetworkObjPtr obj,
+                         const dnsmasqContext *prevctx)
+{
+    virNetworkDefPtr def = virNetworkObjGetDef(obj);
+    int ret = -1;
+    int rc;
+    pid_t dnsmasqPid;
+    dnsmasqContext *dctx = NULL;
+
+    /* if no IP addresses specified, nothing to do */
+    if (!virNetworkDefGetIPByIndex(def, AF_UNSPEC, 0))
+        return 0;
 
-    if (ipv6def && (networkBuildDnsmasqDhcpHostsList(dctx, ipv6def) < 0))
+    /* if there's no running dnsmasq, just start it */
+    dnsmasqPid = virNetworkObjGetDnsmasqPid(obj);
+    if (dnsmasqPid <= 0 || (kill(dnsmasqPid, 0) < 0))
+        return networkStartDhcpDaemon(driver, obj);
+
+    VIR_INFO("Refreshing dnsmasq for network %s", def->bridge);
+    if (!(dctx = networkDnsmasqHostsContextNew(driver, def)))
         goto cleanup;
 
-    if (networkBuildDnsmasqHostsList(dctx, &def->dns) < 0)
+    if ((rc = networkDnsmasqUsesHostsDirs(driver, def)) < 0)
         goto cleanup;
 
-    if ((ret = dnsmasqSave(dctx)) < 0)
+    if (rc > 0) {
+        bool reload = false;
+
+        if (dnsmasqSaveHostsDirs(dctx, prevctx, &reload) < 0)
+            goto cleanup;
+
+        if (!reload) {
+            ret = 0;
+            goto cleanup;
+        }
+    } else if ((ret = dnsmasqSave(dctx)) < 0) {
         goto cleanup;
+    }
 
     dnsmasqPid = virNetworkObjGetDnsmasqPid(obj);
     ret = kill(dnsmasqPid, SIGHUP);
@@ -2180,7 +2269,7 @@ networkRefreshDaemonsHelper(virNetworkObjPtr obj,
              * dnsmasq and/or radvd, or restart them if they've
              * disappeared.
              */
-            networkRefreshDhcpDaemon(driver, obj);
+            networkRefreshDhcpDaemon(driver, obj, NULL);
             networkRefreshRadvd(driver, obj);
             break;
 
@@ -3865,7 +3954,7 @@ networkUpdate(virNetworkPtr net,
     virNetworkIPDefPtr ipdef;
     bool oldDhcpActive = false;
     bool needFirewallRefresh = false;
-
+    dnsmasqContext *prevctx = NULL;
 
     virCheckFlags(VIR_NETWORK_UPDATE_AFFECT_LIVE |
                   VIR_NETWORK_UPDATE_AFFECT_CONFIG,
@@ -3940,6 +4029,13 @@ networkUpdate(virNetworkPtr net,
             virReportEnumRangeError(virNetworkForwardType, def->forward.type);
             goto cleanup;
         }
+
+        /* remember the hosts dnsmasq knows about, so that only the
+         * ones which change need to be rewritten afterwards */
+        if ((section == VIR_NETWORK_SECTION_IP_DHCP_HOST ||
+             section == VIR_NETWORK_SECTION_DNS_HOST) &&
+            !(prevctx = networkDnsmasqHostsContextNew(driver, def)))
+            goto cleanup;
     }
 
     /* update the network config in memory/on disk */
@@ -4003,9 +4099,11 @@ networkUpdate(virNetworkPtr net,
                 }
             }
 
-            if ((newDhcpActive != oldDhcpActive &&
-                 networkRestartDhcpDaemon(driver, obj) < 0) ||
-                networkRefreshDhcpDaemon(driver, obj) < 0) {
+            if (newDhcpActive != oldDhcpActive) {
+                if (networkRestartDhcpDaemon(driver, obj) < 0 ||
+                    networkRefreshDhcpDaemon(driver, obj, NULL) < 0)
+                    goto cleanup;
+            } else if (networkRefreshDhcpDaemon(driver, obj, prevctx) < 0) {
                 goto cleanup;
             }
 
@@ -4014,7 +4112,7 @@ networkUpdate(virNetworkPtr net,
              * (not the .conf file) so we can just update the config
              * files and send SIGHUP to dnsmasq.
              */
-            if (networkRefreshDhcpDaemon(driver, obj) < 0)
+            if (networkRefreshDhcpDaemon(driver, obj, prevctx) < 0)
                 goto cleanup;
 
         }
@@ -4040,6 +4138,7 @@ networkUpdate(virNetworkPtr net,
 
     ret = 0;
  cleanup:
+    dnsmasqContextFree(prevctx);
     virNetworkObjEndAPI(&obj);
     return ret;
 }
@@ -4280,6 +4379,68 @@ networkSetAutostart(virNetworkPtr net,
 }
 
 
+/* Read the leases of @bridge, only those of @mac if it's given */
+static int
+networkReadDHCPLeases(virNetworkDriverStatePtr driver,
+                      const char *bridge,
+                      const virMacAddr *mac,
+                      virLeaseDBEntryPtr *leases,
+                      size_t *nleases)
+{
+    VIR_AUTOFREE(char *) custom_lease_file = NULL;
+    VIR_AUTOFREE(char *) lease_db_file = NULL;
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+    char macstr[VIR_MAC_STRING_BUFLEN];
+    ssize_t idx = -1;
+
+    *leases = NULL;
+    *nleases = 0;
+
+    if (!(custom_lease_file = networkDnsmasqLeaseFileNameCustom(driver, bridge)) ||
+        !(lease_db_file = networkDnsmasqLeaseDBFileName(driver, bridge)))
+        return -1;
+
+    /* Not all networks are guaranteed to have leases. Only those
+     * which run dnsmasq. A missing database has no leases. Networks
+     * which were started before the lease database was introduced
+     * have their leases in the custom lease file until the next
+     * change. */
+    if (!virFileExists(lease_db_file))
+        return virLeaseReadLeases(lease_db_file, custom_lease_file,
+                                  NULL, NULL, leases, nleases);
+
+    if (!(db = virLeaseDBOpen(lease_db_file)))
+        return -1;
+
+    if (!mac) {
+        if (VIR_ALLOC_N(*leases, virLeaseDBGetCount(db)) < 0)
+            return -1;
+
+        for (; *nleases < virLeaseDBGetCount(db); (*nleases)++) {
+            if (virLeaseDBGetEntry(db, *nleases, &(*leases)[*nleases]) < 0)
+                goto error;
+        }
+
+        return 0;
+    }
+
+    virMacAddrFormat(mac, macstr);
+    while ((idx = virLeaseDBFindMAC(db, macstr, idx)) >= 0) {
+        if (VIR_EXPAND_N(*leases, *nleases, 1) < 0 ||
+            virLeaseDBGetEntry(db, idx, &(*leases)[*nleases - 1]) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ error:
+    virLeaseDBEntryListFree(*leases, *nleases);
+    *leases = NULL;
+    *nleases = 0;
+    return -1;
+}
+
+
 static int
 networkGetDHCPLeases(virNetworkPtr net,
                      const char *mac,
@@ -4291,17 +4452,11 @@ networkGetDHCPLeases(virNetworkPtr net,
     size_t nleases = 0;
     int rv = -1;
     size_t size = 0;
-    int custom_lease_file_len = 0;
     bool need_results = !!leases;
     long long currtime = 0;
-    long long expirytime_tmp = -1;
     bool ipv6 = false;
-    char *lease_entries = NULL;
-    char *custom_lease_file = NULL;
-    const char *ip_tmp = NULL;
-    const char *mac_tmp = NULL;
-    virJSONValuePtr lease_tmp = NULL;
-    virJSONValuePtr leases_array = NULL;
+    virLeaseDBEntryPtr entries = NULL;
+    virLeaseDBEntryPtr lease_tmp = NULL;
     virNetworkIPDefPtr ipdef_tmp = NULL;
     virNetworkDHCPLeasePtr lease = NULL;
     virNetworkDHCPLeasePtr *leases_ret = NULL;
@@ -4324,52 +4479,16 @@ networkGetDHCPLeases(virNetworkPtr net,
     if (virNetworkGetDHCPLeasesEnsureACL(net->conn, def) < 0)
         goto cleanup;
 
-    /* Retrieve custom leases file location */
-    custom_lease_file = networkDnsmasqLeaseFileNameCustom(driver, def->bridge);
-
-    /* Read entire contents */
-    if ((custom_lease_file_len = virFileReadAllQuiet(custom_lease_file,
-                                                     VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
-                                                     &lease_entries)) < 0) {
-        /* Not all networks are guaranteed to have leases file.
-         * Only those which run dnsmasq. Therefore, if we failed
-         * to read the leases file, don't report error. Return 0
-         * leases instead. */
-        if (errno == ENOENT) {
-            rv = 0;
-        } else {
-            virReportSystemError(errno,
-                                 _("Unable to read leases file: %s"),
-                                 custom_lease_file);
-        }
+    if (networkReadDHCPLeases(driver, def->bridge, mac ? &mac_addr : NULL,
+                              &entries, &size) < 0)
         goto error;
-    }
-
-    if (custom_lease_file_len) {
-        if (!(leases_array = virJSONValueFromString(lease_entries))) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("invalid json in file: %s"), custom_lease_file);
-            goto error;
-        }
-
-        if (!virJSONValueIsArray(leases_array)) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Malformed lease_entries array"));
-            goto error;
-        }
-        size = virJSONValueArraySize(leases_array);
-    }
 
     currtime = (long long)time(NULL);
 
     for (i = 0; i < size; i++) {
-        if (!(lease_tmp = virJSONValueArrayGet(leases_array, i))) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("failed to parse json"));
-            goto error;
-        }
+        lease_tmp = &entries[i];
 
-        if (!(mac_tmp = virJSONValueObjectGetString(lease_tmp, "mac-address"))) {
+        if (!lease_tmp->mac) {
             /* leaseshelper program guarantees that lease will be stored only if
              * mac-address is known otherwise not */
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -4377,10 +4496,10 @@ networkGetDHCPLeases(virNetworkPtr net,
             goto error;
         }
 
-        if (mac && virMacAddrCompare(mac, mac_tmp))
+        if (mac && virMacAddrCompare(mac, lease_tmp->mac))
             continue;
 
-        if (virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time", &expirytime_tmp) < 0) {
+        if (!lease_tmp->expirytime) {
             /* A lease cannot be present without expiry-time */
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("found lease without expiry-time"));
@@ -4388,16 +4507,16 @@ networkGetDHCPLeases(virNetworkPtr net,
         }
 
         /* Do not report expired lease */
-        if (expirytime_tmp < currtime)
+        if (lease_tmp->expirytime < currtime)
             continue;
 
         if (need_results) {
             if (VIR_ALLOC(lease) < 0)
                 goto error;
 
-            lease->expirytime = expirytime_tmp;
+            lease->expirytime = lease_tmp->expirytime;
 
-            if (!(ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address"))) {
+            if (!lease_tmp->ip) {
                 /* A lease without ip-address makes no sense */
                 virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                                _("found lease without ip-address"));
@@ -4405,7 +4524,7 @@ networkGetDHCPLeases(virNetworkPtr net,
             }
 
             /* Unlike IPv4, IPv6 uses ':' instead of '.' as separator */
-            ipv6 = strchr(ip_tmp, ':') ? true : false;
+            ipv6 = strchr(lease_tmp->ip, ':') ? true : false;
             lease->type = ipv6 ? VIR_IP_ADDR_TYPE_IPV6 : VIR_IP_ADDR_TYPE_IPV4;
 
             /* Obtain prefix */
@@ -4426,19 +4545,16 @@ networkGetDHCPLeases(virNetworkPtr net,
                 }
             }
 
-            if ((VIR_STRDUP(lease->mac, mac_tmp) < 0) ||
-                (VIR_STRDUP(lease->ipaddr, ip_tmp) < 0) ||
-                (VIR_STRDUP(lease->iface, def->bridge) < 0))
+            if (VIR_STRDUP(lease->iface, def->bridge) < 0)
                 goto error;
 
+            VIR_STEAL_PTR(lease->mac, lease_tmp->mac);
+            VIR_STEAL_PTR(lease->ipaddr, lease_tmp->ip);
+
             /* Fields that can be NULL */
-            if ((VIR_STRDUP(lease->iaid,
-                            virJSONValueObjectGetString(lease_tmp, "iaid")) < 0) ||
-                (VIR_STRDUP(lease->clientid,
-                            virJSONValueObjectGetString(lease_tmp, "client-id")) < 0) ||
-                (VIR_STRDUP(lease->hostname,
-                            virJSONValueObjectGetString(lease_tmp, "hostname")) < 0))
-                goto error;
+            VIR_STEAL_PTR(lease->iaid, lease_tmp->iaid);
+            VIR_STEAL_PTR(lease->clientid, lease_tmp->clientid);
+            VIR_STEAL_PTR(lease->hostname, lease_tmp->hostname);
 
             if (VIR_INSERT_ELEMENT(leases_ret, nleases, nleases, lease) < 0)
                 goto error;
@@ -4460,10 +4576,8 @@ networkGetDHCPLeases(virNetworkPtr net,
     rv = nleases;
 
  cleanup:
-    VIR_FREE(lease);
-    VIR_FREE(lease_entries);
-    VIR_FREE(custom_lease_file);
-    virJSONValueFree(leases_array);
+    virNetworkDHCPLeaseFree(lease);
+    virLeaseDBEntryListFree(entries, size);
 
     virNetworkObjEndAPI(&obj);
 
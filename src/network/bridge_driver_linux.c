@@ -21,6 +21,7 @@
 
 #include <config.h>
 
+#include "c-ctype.h"
 #include "viralloc.h"
 #include "virfile.h"
 #include "viriptables.h"
@@ -130,6 +131,11 @@ void networkPreReloadFirewallRules(virNetworkDriverStatePtr driver, bool startup
      * of starting the network though as that makes them
      * more likely to be seen by a human
      */
+    if (virFirewallUseNftables()) {
+        VIR_DEBUG("No global rules needed with nftables");
+        return;
+    }
+
     if (!networkHasRunningNetworks(driver)) {
         VIR_DEBUG("Delayed global rule setup as no networks are running");
         return;
@@ -759,6 +765,418 @@ networkRemoveIPSpecificFirewallRules(virFirewallPtr fw,
 }
 
 
+/*
+ * With nftables each network gets tables of its own, one per address
+ * family, so that starting or stopping a network is a single atomic
+ * transaction which never touches rules of other networks.
+ */
+static char *
+networkNftablesTableName(virNetworkDefPtr def)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    const char *tmp;
+
+    /* Table names are identifiers, so escape anything
+     * but letters and digits from the bridge name */
+    virBufferAddLit(&buf, "libvirt_");
+    for (tmp = def->bridge; *tmp; tmp++) {
+        if (c_isalnum(*tmp))
+            virBufferAddChar(&buf, *tmp);
+        else
+            virBufferAsprintf(&buf, "_%02x", (unsigned char)*tmp);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static char *
+networkNftablesQuote(const char *str)
+{
+    char *ret;
+
+    if (strpbrk(str, "\"\\\n")) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Interface name '%s' can't be used with nftables"),
+                       str);
+        return NULL;
+    }
+
+    ignore_value(virAsprintf(&ret, "\"%s\"", str));
+    return ret;
+}
+
+
+static void
+networkNftablesAddChain(virFirewallPtr fw,
+                        const char *family,
+                        const char *table,
+                        const char *chain,
+                        const char *type,
+                        const char *priority)
+{
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "chain", family, table, chain,
+                       "{", "type", type, "hook", chain,
+                       "priority", priority, ";",
+                       "policy", "accept", ";", "}", NULL);
+}
+
+
+static virFirewallRulePtr
+networkNftablesAddRule(virFirewallPtr fw,
+                       const char *family,
+                       const char *table,
+                       const char *chain)
+{
+    return virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                              "add", "rule", family, table, chain, NULL);
+}
+
+
+/* Remove the tables of the network, whether they exist or not */
+static void
+networkNftablesDeleteTables(virFirewallPtr fw,
+                            const char *table)
+{
+    const char *families[] = { "ip", "ip6" };
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(families); i++) {
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "add", "table", families[i], table, NULL);
+        virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                           "delete", "table", families[i], table, NULL);
+    }
+}
+
+
+static int
+networkNftablesAddNetworks(virFirewallPtr fw,
+                           virNetworkDefPtr def,
+                           const char *table,
+                           int family)
+{
+    const char *nftFamily = family == AF_INET ? "ip" : "ip6";
+    virNetworkIPDefPtr ipdef;
+    virFirewallRulePtr rule;
+    size_t i;
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "set", nftFamily, table, "networks",
+                       "{", "type",
+                       family == AF_INET ? "ipv4_addr" : "ipv6_addr", ";",
+                       "flags", "interval", ";", "}", NULL);
+
+    rule = virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                              "add", "element", nftFamily, table, "networks",
+                              "{", NULL);
+
+    for (i = 0; (ipdef = virNetworkDefGetIPByIndex(def, family, i)); i++) {
+        int prefix = virNetworkIPDefPrefix(ipdef);
+        virSocketAddr network;
+        VIR_AUTOFREE(char *) netstr = NULL;
+
+        if (prefix < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Invalid prefix or netmask for '%s'"),
+                           def->bridge);
+            return -1;
+        }
+
+        if (virSocketAddrMaskByPrefix(&ipdef->address, prefix, &network) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Failure to mask address"));
+            return -1;
+        }
+
+        if (!(netstr = virSocketAddrFormat(&network)))
+            return -1;
+
+        virFirewallRuleAddArgFormat(fw, rule, "%s/%d%s", netstr, prefix,
+                                    virNetworkDefGetIPByIndex(def, family, i + 1) ?
+                                    "," : "");
+    }
+    virFirewallRuleAddArg(fw, rule, "}");
+
+    return 0;
+}
+
+
+static int
+networkNftablesAddMasquerade(virFirewallPtr fw,
+                             virNetworkDefPtr def,
+                             const char *table,
+                             const char *physdev,
+                             const char *protocol)
+{
+    virSocketAddrRangePtr addr = &def->forward.addr;
+    virPortRangePtr port = &def->forward.port;
+    VIR_AUTOFREE(char *) addrStartStr = NULL;
+    VIR_AUTOFREE(char *) addrEndStr = NULL;
+    VIR_AUTOFREE(char *) portRangeStr = NULL;
+    virFirewallRulePtr rule;
+
+    if (VIR_SOCKET_ADDR_IS_FAMILY(&addr->start, AF_INET)) {
+        if (!(addrStartStr = virSocketAddrFormat(&addr->start)))
+            return -1;
+        if (VIR_SOCKET_ADDR_IS_FAMILY(&addr->end, AF_INET) &&
+            !(addrEndStr = virSocketAddrFormat(&addr->end)))
+            return -1;
+    }
+
+    if (protocol) {
+        unsigned int start = port->start;
+        unsigned int end = port->end;
+
+        /* Keep guests from using privileged source ports, see
+         * networkAddMasqueradingFirewallRules */
+        if (start == 0 && end == 0) {
+            start = 1024;
+            end = 65535;
+        }
+
+        if (start < end && end < 65536 &&
+            virAsprintf(&portRangeStr, ":%u-%u", start, end) < 0)
+            return -1;
+    }
+
+    rule = networkNftablesAddRule(fw, "ip", table, "postrouting");
+    virFirewallRuleAddArgList(fw, rule,
+                              "ip", "saddr", "@networks",
+                              "ip", "daddr", "!=", "@networks", NULL);
+    if (physdev)
+        virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+    if (protocol)
+        virFirewallRuleAddArgList(fw, rule, "meta", "l4proto", protocol, NULL);
+
+    if (addrStartStr) {
+        virFirewallRuleAddArgList(fw, rule, "snat", "to", NULL);
+        virFirewallRuleAddArgFormat(fw, rule, "%s%s%s%s",
+                                    addrStartStr,
+                                    addrEndStr ? "-" : "",
+                                    NULLSTR_EMPTY(addrEndStr),
+                                    NULLSTR_EMPTY(portRangeStr));
+    } else {
+        virFirewallRuleAddArg(fw, rule, "masquerade");
+        if (portRangeStr)
+            virFirewallRuleAddArgList(fw, rule, "to", portRangeStr, NULL);
+    }
+
+    return 0;
+}
+
+
+/* Create the table of @family for the network, mirroring what the
+ * iptables rules above do in the shared LIBVIRT_* chains */
+static int
+networkNftablesAddTable(virFirewallPtr fw,
+                        virNetworkDefPtr def,
+                        const char *table,
+                        int family)
+{
+    const char *nftFamily = family == AF_INET ? "ip" : "ip6";
+    const char *forwardIf = virNetworkDefForwardIf(def, 0);
+    VIR_AUTOFREE(char *) bridge = NULL;
+    VIR_AUTOFREE(char *) physdev = NULL;
+    virNetworkIPDefPtr ipdef;
+    virFirewallRulePtr rule;
+    bool haveIP = !!virNetworkDefGetIPByIndex(def, family, 0);
+    bool forward = false;
+    bool nat = false;
+    size_t i;
+
+    if (family == AF_INET6 && !haveIP && !def->ipv6nogw)
+        return 0;
+
+    /* NB: with IPv6 the NAT forward mode only sets up routing */
+    if (haveIP) {
+        if (def->forward.type == VIR_NETWORK_FORWARD_NAT) {
+            forward = true;
+            nat = family == AF_INET;
+        } else if (def->forward.type == VIR_NETWORK_FORWARD_ROUTE) {
+            forward = true;
+        }
+    }
+
+    if (!(bridge = networkNftablesQuote(def->bridge)))
+        return -1;
+    if (forwardIf && forwardIf[0] &&
+        !(physdev = networkNftablesQuote(forwardIf)))
+        return -1;
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "table", nftFamily, table, NULL);
+
+    if (forward &&
+        networkNftablesAddNetworks(fw, def, table, family) < 0)
+        return -1;
+
+    /* allow DHCP, DNS and TFTP requests through to dnsmasq */
+    networkNftablesAddChain(fw, nftFamily, table, "input", "filter", "0");
+    if (family == AF_INET) {
+        for (i = 0; (ipdef = virNetworkDefGetIPByIndex(def, AF_INET, i)); i++) {
+            if (ipdef->nranges || ipdef->nhosts || ipdef->tftproot)
+                break;
+        }
+
+        rule = networkNftablesAddRule(fw, nftFamily, table, "input");
+        virFirewallRuleAddArgList(fw, rule, "iifname", bridge,
+                                  "tcp", "dport", "{", "53,", "67", "}",
+                                  "accept", NULL);
+        rule = networkNftablesAddRule(fw, nftFamily, table, "input");
+        virFirewallRuleAddArgList(fw, rule, "iifname", bridge,
+                                  "udp", "dport", "{", "53,", "67", NULL);
+        if (ipdef && ipdef->tftproot)
+            virFirewallRuleAddArgList(fw, rule, ",", "69", NULL);
+        virFirewallRuleAddArgList(fw, rule, "}", "accept", NULL);
+
+        networkNftablesAddChain(fw, nftFamily, table, "output", "filter", "0");
+        rule = networkNftablesAddRule(fw, nftFamily, table, "output");
+        virFirewallRuleAddArgList(fw, rule, "oifname", bridge,
+                                  "udp", "dport", "68", "accept", NULL);
+    } else if (haveIP) {
+        rule = networkNftablesAddRule(fw, nftFamily, table, "input");
+        virFirewallRuleAddArgList(fw, rule, "iifname", bridge,
+                                  "tcp", "dport", "53", "accept", NULL);
+        rule = networkNftablesAddRule(fw, nftFamily, table, "input");
+        virFirewallRuleAddArgList(fw, rule, "iifname", bridge,
+                                  "udp", "dport", "{", "53,", "547", "}",
+                                  "accept", NULL);
+    }
+
+    networkNftablesAddChain(fw, nftFamily, table, "forward", "filter", "0");
+
+    /* Allow traffic between guests on the same bridge */
+    rule = networkNftablesAddRule(fw, nftFamily, table, "forward");
+    virFirewallRuleAddArgList(fw, rule, "iifname", bridge,
+                              "oifname", bridge, "accept", NULL);
+
+    /* Allow traffic to the guests, only for existing connections if NATed */
+    if (forward) {
+        rule = networkNftablesAddRule(fw, nftFamily, table, "forward");
+        if (physdev)
+            virFirewallRuleAddArgList(fw, rule, "iifname", physdev, NULL);
+        virFirewallRuleAddArgList(fw, rule, "oifname", bridge,
+                                  nftFamily, "daddr", "@networks", NULL);
+        if (nat)
+            virFirewallRuleAddArgList(fw, rule, "ct", "state",
+                                      "established,related", NULL);
+        virFirewallRuleAddArg(fw, rule, "accept");
+    }
+    rule = networkNftablesAddRule(fw, nftFamily, table, "forward");
+    virFirewallRuleAddArgList(fw, rule, "oifname", bridge, "reject", NULL);
+
+    /* Allow traffic from the guests */
+    if (forward) {
+        rule = networkNftablesAddRule(fw, nftFamily, table, "forward");
+        virFirewallRuleAddArgList(fw, rule, "iifname", bridge, NULL);
+        if (physdev)
+            virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+        virFirewallRuleAddArgList(fw, rule, nftFamily, "saddr", "@networks",
+                                  "accept", NULL);
+    }
+    rule = networkNftablesAddRule(fw, nftFamily, table, "forward");
+    virFirewallRuleAddArgList(fw, rule, "iifname", bridge, "reject", NULL);
+
+    if (!nat)
+        return 0;
+
+    /* The same exemptions and ordering as with iptables, see
+     * networkAddMasqueradingFirewallRules */
+    networkNftablesAddChain(fw, nftFamily, table, "postrouting", "nat", "100");
+
+    rule = networkNftablesAddRule(fw, nftFamily, table, "postrouting");
+    virFirewallRuleAddArgList(fw, rule, "ip", "saddr", "@networks",
+                              "ip", "daddr", networkLocalMulticast, NULL);
+    if (physdev)
+        virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+    virFirewallRuleAddArg(fw, rule, "return");
+
+    rule = networkNftablesAddRule(fw, nftFamily, table, "postrouting");
+    virFirewallRuleAddArgList(fw, rule, "ip", "saddr", "@networks",
+                              "ip", "daddr", networkLocalBroadcast, NULL);
+    if (physdev)
+        virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+    virFirewallRuleAddArg(fw, rule, "return");
+
+    if (networkNftablesAddMasquerade(fw, def, table, physdev, "tcp") < 0 ||
+        networkNftablesAddMasquerade(fw, def, table, physdev, "udp") < 0 ||
+        networkNftablesAddMasquerade(fw, def, table, physdev, NULL) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+networkAddNftablesFirewallRules(virNetworkDefPtr def)
+{
+    VIR_AUTOFREE(char *) table = NULL;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+
+    if (def->bridgeZone) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("zone %s requested for network %s "
+                         "but firewalld is not active"),
+                       def->bridgeZone, def->name);
+        return -1;
+    }
+
+    if (!(table = networkNftablesTableName(def)))
+        return -1;
+
+    fw = virFirewallNew();
+
+    /* Tables left behind by a previous run are replaced atomically.
+     * There is no nftables equivalent of the DHCP checksum fixup. */
+    virFirewallStartTransaction(fw, 0);
+
+    networkNftablesDeleteTables(fw, table);
+
+    if (networkNftablesAddTable(fw, def, table, AF_INET) < 0 ||
+        networkNftablesAddTable(fw, def, table, AF_INET6) < 0)
+        goto cleanup;
+
+    virFirewallStartRollback(fw, 0);
+
+    networkNftablesDeleteTables(fw, table);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virFirewallFree(fw);
+    return ret;
+}
+
+
+static void
+networkRemoveNftablesFirewallRules(virNetworkDefPtr def)
+{
+    VIR_AUTOFREE(char *) table = NULL;
+    virFirewallPtr fw = NULL;
+
+    if (!(table = networkNftablesTableName(def)))
+        return;
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+
+    networkNftablesDeleteTables(fw, table);
+
+    virFirewallApply(fw);
+
+    virFirewallFree(fw);
+}
+
+
 /* Add all rules for all ip addresses (and general rules) on a network */
 int networkAddFirewallRules(virNetworkDefPtr def)
 {
@@ -767,6 +1185,9 @@ int networkAddFirewallRules(virNetworkDefPtr def)
     virFirewallPtr fw = NULL;
     int ret = -1;
 
+    if (virFirewallUseNftables())
+        return networkAddNftablesFirewallRules(def);
+
     if (virOnce(&createdOnce, networkSetupPrivateChains) < 0)
         return -1;
 
@@ -893,6 +1314,11 @@ void networkRemoveFirewallRules(virNetworkDefPtr def)
     virNetworkIPDefPtr ipdef;
     virFirewallPtr fw = NULL;
 
+    if (virFirewallUseNftables()) {
+        networkRemoveNftablesFirewallRules(def);
+        return;
+    }
+
     fw = virFirewallNew();
 
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
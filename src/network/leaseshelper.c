@@ -30,7 +30,6 @@
 #include "virstring.h"
 #include "virerror.h"
 #include "viralloc.h"
-#include "virjson.h"
 #include "virlease.h"
 #include "virenum.h"
 #include "configmake.h"
@@ -83,9 +82,9 @@ main(int argc, char **argv)
 {
     char *pid_file = NULL;
     char *custom_lease_file = NULL;
+    char *lease_db_file = NULL;
     const char *ip = NULL;
     const char *mac = NULL;
-    const char *leases_str = NULL;
     const char *iaid = getenv("DNSMASQ_IAID");
     const char *clientid = getenv("DNSMASQ_CLIENT_ID");
     const char *interface = getenv("DNSMASQ_INTERFACE");
@@ -95,8 +94,9 @@ main(int argc, char **argv)
     int pid_file_fd = -1;
     int rv = EXIT_FAILURE;
     bool delete = false;
-    virJSONValuePtr lease_new = NULL;
-    virJSONValuePtr leases_array_new = NULL;
+    virLeaseDBEntryPtr lease_new = NULL;
+    virLeaseDBEntryPtr leases = NULL;
+    size_t nleases = 0;
 
     virSetErrorFunc(NULL, NULL);
     virSetErrorLogPriorityFunc(NULL);
@@ -157,6 +157,9 @@ main(int argc, char **argv)
 
     if (virAsprintf(&custom_lease_file,
                     LOCALSTATEDIR "/lib/libvirt/dnsmasq/%s.status",
+                    interface) < 0 ||
+        virAsprintf(&lease_db_file,
+                    LOCALSTATEDIR "/lib/libvirt/dnsmasq/%s.leasedb",
                     interface) < 0)
         goto cleanup;
 
@@ -167,11 +170,6 @@ main(int argc, char **argv)
     if ((pid_file_fd = virPidFileAcquirePath(pid_file, false, getpid())) < 0)
         goto cleanup;
 
-    /* Since interfaces can be hot plugged, we need to make sure that the
-     * corresponding custom lease file exists. If not, 'touch' it */
-    if (virFileTouch(custom_lease_file, 0644) < 0)
-        goto cleanup;
-
     switch ((enum virLeaseActionFlags) action) {
     case VIR_LEASE_ACTION_ADD:
     case VIR_LEASE_ACTION_OLD:
@@ -205,43 +203,38 @@ main(int argc, char **argv)
         break;
     }
 
-    if (!(leases_array_new = virJSONValueNewArray())) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("failed to create json"));
-        goto cleanup;
-    }
-
-    if (virLeaseReadCustomLeaseFile(leases_array_new, custom_lease_file,
-                                    delete ? ip : NULL, &server_duid) < 0)
+    /* The leases of networks which were running when the lease database
+     * was introduced are taken over from the custom lease file */
+    if (virLeaseReadLeases(lease_db_file, custom_lease_file,
+                           delete ? ip : NULL, &server_duid,
+                           &leases, &nleases) < 0)
         goto cleanup;
 
     switch ((enum virLeaseActionFlags) action) {
     case VIR_LEASE_ACTION_INIT:
-        if (virLeasePrintLeases(leases_array_new, server_duid) < 0)
+        if (virLeasePrintLeases(leases, nleases, server_duid) < 0)
             goto cleanup;
 
         break;
 
     case VIR_LEASE_ACTION_OLD:
     case VIR_LEASE_ACTION_ADD:
-        if (lease_new && virJSONValueArrayAppend(leases_array_new, lease_new) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("failed to create json"));
+        if (lease_new &&
+            VIR_APPEND_ELEMENT(leases, nleases, *lease_new) < 0)
             goto cleanup;
-        }
-        lease_new = NULL;
 
         ATTRIBUTE_FALLTHROUGH;
     case VIR_LEASE_ACTION_DEL:
-        if (!(leases_str = virJSONValueToString(leases_array_new, true))) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("empty json array"));
+        /* Write to file */
+        if (virLeaseDBSave(lease_db_file, leases, nleases) < 0)
             goto cleanup;
-        }
 
-        /* Write to file */
-        if (virFileRewriteStr(custom_lease_file, 0644, leases_str) < 0)
+        /* The database replaces the custom lease file */
+        if (unlink(custom_lease_file) < 0 && errno != ENOENT) {
+            virReportSystemError(errno, _("cannot remove '%s'"),
+                                 custom_lease_file);
             goto cleanup;
+        }
         break;
 
     case VIR_LEASE_ACTION_LAST:
@@ -257,8 +250,9 @@ main(int argc, char **argv)
     VIR_FREE(pid_file);
     VIR_FREE(server_duid);
     VIR_FREE(custom_lease_file);
-    virJSONValueFree(lease_new);
-    virJSONValueFree(leases_array_new);
+    VIR_FREE(lease_db_file);
+    virLeaseDBEntryFree(lease_new);
+    virLeaseDBEntryListFree(leases, nleases);
 
     return rv;
 }
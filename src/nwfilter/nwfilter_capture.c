@@ -0,0 +1,602 @@
+/*
+ * nwfilter_capture.c: capture packets of many interfaces in one thread
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * IP address learning and DHCP snooping used to run one or two pcap
+ * handles along with a thread per interface. Here every interface gets
+ * a single AF_PACKET socket, with the pcap filter attached as a socket
+ * filter so that the kernel only queues the few packets of interest,
+ * and one thread polls the sockets of all interfaces and passes the
+ * packets to the callbacks of the respective capture.
+ */
+
+#include <config.h>
+
+#if defined(HAVE_LIBPCAP) && defined(__linux__)
+# include <pcap.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <linux/filter.h>
+# include <linux/if_ether.h>
+# include <linux/if_packet.h>
+#endif
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virnetdev.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virutil.h"
+#include "nwfilter_capture.h"
+
+#define VIR_FROM_THIS VIR_FROM_NWFILTER
+
+VIR_LOG_INIT("nwfilter.nwfilter_capture");
+
+#if defined(HAVE_LIBPCAP) && defined(__linux__)
+
+/* socket buffer of each capture; the filters let only few packets pass */
+# define CAPTURE_RCVBUF          (64 * 1024)
+/* packets read from one socket before turning to the next one */
+# define CAPTURE_READ_BATCH      16
+/* consecutive read errors before giving up on a socket */
+# define CAPTURE_READ_MAXERRS    25
+# define CAPTURE_MAX_SNAPLEN     65535
+
+struct _virNWFilterCapture {
+    int fd;
+    char *ifname;
+    int ifindex;
+    virNWFilterCaptureCallbacks cbs;
+    void *opaque;
+
+    bool stopped; /* no more callbacks */
+    unsigned int errcount;
+};
+
+struct virNWFilterCaptureState {
+    virMutex lock; /* protects everything but thread */
+    virThread thread;
+    bool running;
+    bool quit;
+
+    int wakeupfd[2];
+
+    virNWFilterCapturePtr *captures;
+    size_t ncaptures;
+    bool changed; /* captures were added, removed or stopped */
+
+    unsigned char packet[CAPTURE_MAX_SNAPLEN];
+};
+
+static struct virNWFilterCaptureState virNWFilterCaptureState = {
+    .lock = VIR_MUTEX_INITIALIZER,
+    .wakeupfd = { -1, -1 },
+};
+
+
+static void
+virNWFilterCaptureWakeup(void)
+{
+    char c = 0;
+
+    /* a full pipe has woken up the thread already */
+    ignore_value(safewrite(virNWFilterCaptureState.wakeupfd[1], &c, 1));
+}
+
+
+static void
+virNWFilterCaptureStop(virNWFilterCapturePtr capture)
+{
+    capture->stopped = true;
+    virNWFilterCaptureState.changed = true;
+}
+
+
+/*
+ * The socket of @capture reported an error; stop the capture unless
+ * its interface merely went down
+ */
+static void
+virNWFilterCaptureCheck(virNWFilterCapturePtr capture)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    /* fetching the error clears it */
+    ignore_value(getsockopt(capture->fd, SOL_SOCKET, SO_ERROR, &err, &len));
+
+    if (virNetDevValidateConfig(capture->ifname, NULL, capture->ifindex) > 0)
+        return;
+
+    virResetLastError();
+
+    VIR_DEBUG("Interface '%s' disappeared", capture->ifname);
+    virNWFilterCaptureStop(capture);
+    capture->cbs.error(ENODEV, capture->opaque);
+}
+
+
+static void
+virNWFilterCaptureRead(virNWFilterCapturePtr capture)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+    size_t i;
+
+    for (i = 0; i < CAPTURE_READ_BATCH && !capture->stopped; i++) {
+        struct sockaddr_ll sll;
+        socklen_t slen = sizeof(sll);
+        ssize_t len;
+
+        len = recvfrom(capture->fd, state->packet, sizeof(state->packet),
+                       0, (struct sockaddr *)&sll, &slen);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR)
+                continue;
+            if (errno == ENETDOWN || errno == ENODEV || errno == ENXIO) {
+                virNWFilterCaptureCheck(capture);
+                return;
+            }
+
+            if (++capture->errcount > CAPTURE_READ_MAXERRS) {
+                char ebuf[1024];
+
+                VIR_WARN("Failed to read packets on interface '%s': %s",
+                         capture->ifname,
+                         virStrerror(errno, ebuf, sizeof(ebuf)));
+                virNWFilterCaptureStop(capture);
+                capture->cbs.error(errno, capture->opaque);
+            }
+            return;
+        }
+
+        capture->errcount = 0;
+
+        /* packets sent by the host on the interface of a VM go to it */
+        if (capture->cbs.packet(state->packet, len,
+                                sll.sll_pkttype != PACKET_OUTGOING,
+                                capture->opaque) < 0)
+            virNWFilterCaptureStop(capture);
+    }
+}
+
+
+static void
+virNWFilterCaptureTick(void)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+    size_t i;
+
+    for (i = 0; i < state->ncaptures; i++) {
+        virNWFilterCapturePtr capture = state->captures[i];
+
+        if (!capture->stopped && capture->cbs.tick)
+            capture->cbs.tick(capture->opaque);
+    }
+}
+
+
+static void
+virNWFilterCaptureThread(void *opaque ATTRIBUTE_UNUSED)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+    VIR_AUTOFREE(struct pollfd *) fds = NULL;
+    VIR_AUTOFREE(virNWFilterCapturePtr *) captures = NULL;
+    size_t nfds = 0;
+    unsigned long long now = 0;
+    unsigned long long nextTick = 0;
+    size_t i;
+
+    if (virTimeMillisNow(&now) == 0)
+        nextTick = now + VIR_NWFILTER_CAPTURE_TICK_MS;
+
+    virMutexLock(&state->lock);
+
+    while (!state->quit) {
+        int timeout = VIR_NWFILTER_CAPTURE_TICK_MS;
+        int n;
+
+        if (state->changed) {
+            VIR_FREE(fds);
+            VIR_FREE(captures);
+            nfds = 0;
+
+            if (VIR_ALLOC_N_QUIET(fds, state->ncaptures + 1) < 0 ||
+                VIR_ALLOC_N_QUIET(captures, state->ncaptures + 1) < 0) {
+                /* try again later */
+                virMutexUnlock(&state->lock);
+                usleep(100 * 1000);
+                virMutexLock(&state->lock);
+                continue;
+            }
+
+            state->changed = false;
+
+            fds[nfds].fd = state->wakeupfd[0];
+            fds[nfds++].events = POLLIN;
+
+            for (i = 0; i < state->ncaptures; i++) {
+                if (state->captures[i]->stopped)
+                    continue;
+                captures[nfds] = state->captures[i];
+                fds[nfds].fd = state->captures[i]->fd;
+                fds[nfds++].events = POLLIN;
+            }
+        }
+
+        if (nextTick && virTimeMillisNow(&now) == 0)
+            timeout = nextTick > now ? MIN(nextTick - now, timeout) : 0;
+
+        virMutexUnlock(&state->lock);
+        n = poll(fds, nfds, timeout);
+        virMutexLock(&state->lock);
+
+        if (n < 0 && errno != EINTR && errno != EAGAIN) {
+            char ebuf[1024];
+
+            VIR_WARN("Failed to poll capture sockets: %s",
+                     virStrerror(errno, ebuf, sizeof(ebuf)));
+            state->changed = true;
+            continue;
+        }
+
+        if (n > 0 && fds[0].revents) {
+            char buf[64];
+
+            while (saferead(state->wakeupfd[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+
+        /* the sockets may belong to other captures by now */
+        if (n > 0 && !state->changed) {
+            for (i = 1; i < nfds; i++) {
+                virNWFilterCapturePtr capture = captures[i];
+
+                if (!fds[i].revents || capture->stopped)
+                    continue;
+
+                if (fds[i].revents & POLLIN) {
+                    virNWFilterCaptureRead(capture);
+                } else {
+                    /* the interface went down or disappeared */
+                    virNWFilterCaptureCheck(capture);
+                }
+            }
+        }
+
+        if (nextTick && virTimeMillisNow(&now) == 0 && now >= nextTick) {
+            virNWFilterCaptureTick();
+            nextTick = now + VIR_NWFILTER_CAPTURE_TICK_MS;
+        }
+    }
+
+    virMutexUnlock(&state->lock);
+}
+
+
+/**
+ * virNWFilterCaptureInit:
+ *
+ * Start the thread serving all captures.
+ *
+ * Returns 0 on success, -1 on failure with an error reported
+ */
+int
+virNWFilterCaptureInit(void)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+    int ret = -1;
+
+    virMutexLock(&state->lock);
+
+    if (state->running) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (pipe2(state->wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create capture wakeup pipe"));
+        goto cleanup;
+    }
+
+    state->quit = false;
+    state->changed = true;
+
+    if (virThreadCreate(&state->thread, true,
+                        virNWFilterCaptureThread, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create packet capture thread"));
+        VIR_FORCE_CLOSE(state->wakeupfd[0]);
+        VIR_FORCE_CLOSE(state->wakeupfd[1]);
+        goto cleanup;
+    }
+
+    state->running = true;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&state->lock);
+    return ret;
+}
+
+
+/**
+ * virNWFilterCaptureShutdown:
+ *
+ * Stop the thread serving the captures. All captures must have been
+ * freed before.
+ */
+void
+virNWFilterCaptureShutdown(void)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+
+    virMutexLock(&state->lock);
+
+    if (!state->running) {
+        virMutexUnlock(&state->lock);
+        return;
+    }
+
+    state->quit = true;
+    virNWFilterCaptureWakeup();
+
+    virMutexUnlock(&state->lock);
+
+    virThreadJoin(&state->thread);
+
+    virMutexLock(&state->lock);
+
+    if (state->ncaptures)
+        VIR_WARN("%zu packet captures still active", state->ncaptures);
+
+    VIR_FORCE_CLOSE(state->wakeupfd[0]);
+    VIR_FORCE_CLOSE(state->wakeupfd[1]);
+    state->running = false;
+
+    virMutexUnlock(&state->lock);
+}
+
+
+static int
+virNWFilterCaptureOpen(const char *ifname,
+                       const char *filter,
+                       size_t snaplen,
+                       int *ifindexp)
+{
+    pcap_t *handle = NULL;
+    struct bpf_program prog = { 0 };
+    struct sock_fprog fprog;
+    struct sockaddr_ll sll = { 0 };
+    int rcvbuf = CAPTURE_RCVBUF;
+    int ifindex;
+    int fd = -1;
+    int ret = -1;
+
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
+        return -1;
+
+    if (!(handle = pcap_open_dead(DLT_EN10MB, snaplen))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("pcap_open_dead failed"));
+        return -1;
+    }
+
+    if (pcap_compile(handle, &prog, filter, 1, PCAP_NETMASK_UNKNOWN) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("pcap_compile: %s"), pcap_geterr(handle));
+        goto cleanup;
+    }
+
+    /* no packets are queued before the socket is bound, i.e. filtered */
+    if ((fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                     0)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create packet socket"));
+        goto cleanup;
+    }
+
+    fprog.len = prog.bf_len;
+    fprog.filter = (struct sock_filter *)prog.bf_insns;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &fprog, sizeof(fprog)) < 0) {
+        virReportSystemError(errno,
+                             _("unable to attach filter '%s' to packet "
+                               "socket of interface '%s'"),
+                             filter, ifname);
+        goto cleanup;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                   &rcvbuf, sizeof(rcvbuf)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to set size of packet socket buffer"));
+        goto cleanup;
+    }
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        virReportSystemError(errno,
+                             _("unable to bind packet socket to "
+                               "interface '%s'"), ifname);
+        goto cleanup;
+    }
+
+    *ifindexp = ifindex;
+    ret = fd;
+    fd = -1;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    pcap_freecode(&prog);
+    pcap_close(handle);
+    return ret;
+}
+
+
+/**
+ * virNWFilterCaptureNew:
+ * @ifname: the interface to capture packets on
+ * @filter: pcap filter expression selecting the packets of interest
+ * @snaplen: maximum number of bytes passed of a packet
+ * @cbs: the callbacks to run for the captured packets
+ * @opaque: data passed to the callbacks
+ *
+ * Start capturing packets on @ifname matching @filter. The callbacks
+ * are run until the capture stops or is freed.
+ *
+ * Returns the capture on success, NULL on failure with an error reported
+ */
+virNWFilterCapturePtr
+virNWFilterCaptureNew(const char *ifname,
+                      const char *filter,
+                      size_t snaplen,
+                      const virNWFilterCaptureCallbacks *cbs,
+                      void *opaque)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+    virNWFilterCapturePtr capture;
+    virNWFilterCapturePtr ret = NULL;
+
+    if (VIR_ALLOC(capture) < 0)
+        return NULL;
+
+    capture->fd = -1;
+    capture->cbs = *cbs;
+    capture->opaque = opaque;
+
+    if (VIR_STRDUP(capture->ifname, ifname) < 0)
+        goto cleanup;
+
+    if ((capture->fd = virNWFilterCaptureOpen(ifname, filter,
+                                              MIN(snaplen,
+                                                  CAPTURE_MAX_SNAPLEN),
+                                              &capture->ifindex)) < 0)
+        goto cleanup;
+
+    virMutexLock(&state->lock);
+
+    if (!state->running) {
+        virMutexUnlock(&state->lock);
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("packet capture thread is not running"));
+        goto cleanup;
+    }
+
+    if (VIR_APPEND_ELEMENT_COPY(state->captures, state->ncaptures,
+                                capture) < 0) {
+        virMutexUnlock(&state->lock);
+        goto cleanup;
+    }
+
+    state->changed = true;
+    virNWFilterCaptureWakeup();
+
+    virMutexUnlock(&state->lock);
+
+    VIR_DEBUG("Capturing packets on '%s' matching '%s'", ifname, filter);
+
+    VIR_STEAL_PTR(ret, capture);
+
+ cleanup:
+    virNWFilterCaptureFree(capture);
+    return ret;
+}
+
+
+/**
+ * virNWFilterCaptureFree:
+ * @capture: the capture to stop
+ *
+ * Stop capturing and free @capture. None of its callbacks is running
+ * or will run once this function returns.
+ */
+void
+virNWFilterCaptureFree(virNWFilterCapturePtr capture)
+{
+    struct virNWFilterCaptureState *state = &virNWFilterCaptureState;
+    size_t i;
+
+    if (!capture)
+        return;
+
+    virMutexLock(&state->lock);
+
+    for (i = 0; i < state->ncaptures; i++) {
+        if (state->captures[i] == capture) {
+            VIR_DELETE_ELEMENT(state->captures, i, state->ncaptures);
+            state->changed = true;
+            virNWFilterCaptureWakeup();
+            break;
+        }
+    }
+
+    virMutexUnlock(&state->lock);
+
+    VIR_FORCE_CLOSE(capture->fd);
+    VIR_FREE(capture->ifname);
+    VIR_FREE(capture);
+}
+
+#else /* !(HAVE_LIBPCAP && __linux__) */
+
+int
+virNWFilterCaptureInit(void)
+{
+    return 0;
+}
+
+
+void
+virNWFilterCaptureShutdown(void)
+{
+}
+
+
+virNWFilterCapturePtr
+virNWFilterCaptureNew(const char *ifname ATTRIBUTE_UNUSED,
+                      const char *filter ATTRIBUTE_UNUSED,
+                      size_t snaplen ATTRIBUTE_UNUSED,
+                      const virNWFilterCaptureCallbacks *cbs ATTRIBUTE_UNUSED,
+                      void *opaque ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("packet capture is not supported on this platform"));
+    return NULL;
+}
+
+
+void
+virNWFilterCaptureFree(virNWFilterCapturePtr capture ATTRIBUTE_UNUSED)
+{
+}
+
+#endif /* !(HAVE_LIBPCAP && __linux__) */
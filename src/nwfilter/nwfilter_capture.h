@@ -0,0 +1,65 @@
+/*
+ * nwfilter_capture.h: capture packets of many interfaces in one thread
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+
+/* interval of the tick callbacks */
+#define VIR_NWFILTER_CAPTURE_TICK_MS  (10 * 1000)
+
+typedef struct _virNWFilterCapture virNWFilterCapture;
+typedef virNWFilterCapture *virNWFilterCapturePtr;
+
+/*
+ * The callbacks of all captures are run by a single thread, one at a
+ * time, so they must hand any time-consuming work over to a worker.
+ * They must not call any of the virNWFilterCapture functions.
+ */
+typedef struct _virNWFilterCaptureCallbacks virNWFilterCaptureCallbacks;
+typedef virNWFilterCaptureCallbacks *virNWFilterCaptureCallbacksPtr;
+struct _virNWFilterCaptureCallbacks {
+    /* A packet passed the filter; @fromVM tells whether it was received
+     * on the interface rather than sent out of it. Returning -1 stops
+     * the capture. */
+    int (*packet)(const unsigned char *packet,
+                  size_t len,
+                  bool fromVM,
+                  void *opaque);
+
+    /* The capture failed with errno @err; no more callbacks follow. */
+    void (*error)(int err, void *opaque);
+
+    /* Optional; called about every VIR_NWFILTER_CAPTURE_TICK_MS while
+     * the capture is running. */
+    void (*tick)(void *opaque);
+};
+
+int virNWFilterCaptureInit(void);
+void virNWFilterCaptureShutdown(void);
+
+virNWFilterCapturePtr
+virNWFilterCaptureNew(const char *ifname,
+                      const char *filter,
+                      size_t snaplen,
+                      const virNWFilterCaptureCallbacks *cbs,
+                      void *opaque)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4);
+void virNWFilterCaptureFree(virNWFilterCapturePtr capture);
@@ -36,12 +36,7 @@
  */
 #include <config.h>
 
-#ifdef HAVE_LIBPCAP
-# include <pcap.h>
-#endif
-
 #include <fcntl.h>
-#include <poll.h>
 
 #include <arpa/inet.h>
 #include <netinet/ip.h>
@@ -54,6 +49,7 @@
 #include "virerror.h"
 #include "conf/domain_conf.h"
 #include "nwfilter_gentech_driver.h"
+#include "nwfilter_capture.h"
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_ipaddrmap.h"
 #include "virnetdev.h"
@@ -62,7 +58,6 @@
 #include "virsocketaddr.h"
 #include "virthreadpool.h"
 #include "configmake.h"
-#include "virtime.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
@@ -80,8 +75,9 @@ struct virNWFilterSnoopState {
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
-    int                  nThreads; /* number of running threads */
-    /* thread management */
+    int                  nThreads; /* number of running sessions */
+    virThreadPoolPtr     workers; /* run the jobs of all sessions */
+    /* session management */
     virHashTablePtr      snoopReqs;
     virHashTablePtr      ifnameToKey;
     virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
@@ -114,12 +110,6 @@ typedef virNWFilterSnoopReq *virNWFilterSnoopReqPtr;
 typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
 typedef virNWFilterSnoopIPLease *virNWFilterSnoopIPLeasePtr;
 
-typedef enum {
-    THREAD_STATUS_NONE,
-    THREAD_STATUS_OK,
-    THREAD_STATUS_FAIL,
-} virNWFilterSnoopThreadStatus;
-
 struct _virNWFilterSnoopReq {
     /*
      * reference counter: while the req is on the
@@ -137,10 +127,6 @@ struct _virNWFilterSnoopReq {
     virNWFilterSnoopIPLeasePtr           start;
     virNWFilterSnoopIPLeasePtr           end;
     char                                *threadkey;
-    virErrorPtr                          threadError;
-
-    virNWFilterSnoopThreadStatus         threadStatus;
-    virCond                              threadStatusCond;
 
     int                                  jobCompletionStatus;
     /* the number of submitted jobs in the worker's queue */
@@ -153,7 +139,6 @@ struct _virNWFilterSnoopReq {
      * - start
      * - end
      * - a lease while it is on the list
-     * - threadStatus
      * (for refctr, see above)
      */
     virMutex                             lock;
@@ -228,8 +213,6 @@ verify(sizeof(struct _virNWFilterSnoopDHCPHdr) == 236);
      offsetof(virNWFilterSnoopDHCPHdr, d_opts))
 
 # define PCAP_PBUFSIZE              576 /* >= IP/TCP/DHCP headers */
-# define PCAP_READ_MAXERRS          25 /* retries on failing device */
-# define PCAP_FLOOD_TIMEOUT_MS      10 /* ms */
 
 typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
 typedef virNWFilterDHCPDecodeJob *virNWFilterDHCPDecodeJobPtr;
@@ -238,32 +221,17 @@ struct _virNWFilterDHCPDecodeJob {
     unsigned char packet[PCAP_PBUFSIZE];
     int caplen;
     bool fromVM;
-    int *qCtr;
 };
 
 # define DHCP_PKT_RATE          10 /* pkts/sec */
 # define DHCP_PKT_BURST         50 /* pkts/sec */
 # define DHCP_BURST_INTERVAL_S  10 /* sec */
 
-/*
- * NB: Any libpcap built with HAVE_TPACKET3 will require
- * PCAP_BUFFERSIZE to be at least 262144 (although
- * pcap_set_buffer_size() with a lower value will succeed, and the
- * error will only show up later when pcap_setfilter() is called).
- *
- * It is possible that in the future libpcap could increase the
- * minimum size even further, but due to the fact that each guest
- * using dhcp snooping keeps 2 pcap sockets open (and thus 2 buffers
- * allocated) for the life of the guest, we want to minimize the
- * length of the buffer, so instead of leaving it at the default size
- * (2MB), we are setting it to the minimum viable size and including
- * this clue in the source to help quickly resolve the problem when/if
- * it reoccurs.
- */
-# define PCAP_BUFFERSIZE        (256 * 1024)
-
 # define MAX_QUEUED_JOBS        (DHCP_PKT_BURST + 2 * DHCP_PKT_RATE)
 
+/* threads running the jobs of all snooping sessions */
+# define SNOOP_WORKERS_MAX      4
+
 typedef struct _virNWFilterSnoopRateLimitConf virNWFilterSnoopRateLimitConf;
 typedef virNWFilterSnoopRateLimitConf *virNWFilterSnoopRateLimitConfPtr;
 
@@ -271,23 +239,36 @@ struct _virNWFilterSnoopRateLimitConf {
     time_t prev;
     unsigned int pkt_ctr;
     time_t burst;
-    const unsigned int rate;
-    const unsigned int burstRate;
-    const unsigned int burstInterval;
+    unsigned int rate;
+    unsigned int burstRate;
+    unsigned int burstInterval;
 };
-# define SNOOP_POLL_MAX_TIMEOUT_MS  (10 * 1000) /* milliseconds */
-
-typedef struct _virNWFilterSnoopPcapConf virNWFilterSnoopPcapConf;
-typedef virNWFilterSnoopPcapConf *virNWFilterSnoopPcapConfPtr;
-
-struct _virNWFilterSnoopPcapConf {
-    pcap_t *handle;
-    const pcap_direction_t dir;
-    const char *filter;
-    virNWFilterSnoopRateLimitConf rateLimit; /* indep. rate limiters */
-    int qCtr; /* number of jobs in the worker's queue */
-    const unsigned int maxQSize;
-    unsigned long long penaltyTimeoutAbs;
+
+/*
+ * The snooping of an interface. The packets are captured by the shared
+ * capture thread, which hands them over to the session; its jobs are
+ * then run one after another by one of the shared workers.
+ */
+typedef struct _virNWFilterSnoopSession virNWFilterSnoopSession;
+typedef virNWFilterSnoopSession *virNWFilterSnoopSessionPtr;
+
+struct _virNWFilterSnoopSession {
+    virNWFilterSnoopReqPtr req; /* holds a reference */
+    virNWFilterCapturePtr capture;
+    char *threadkey;
+
+    /* only used by the capture thread */
+    virNWFilterSnoopRateLimitConf rateLimit[2]; /* from VM, to VM */
+    time_t last_displayed;
+    time_t last_displayed_queue;
+
+    virMutex lock; /* protects the members below */
+    virNWFilterDHCPDecodeJobPtr *jobs;
+    size_t njobs;
+    unsigned int qCtr[2]; /* queued jobs from VM, to VM */
+    bool tick; /* the lease timers need to be run */
+    bool end; /* the session ends */
+    bool scheduled; /* queued on or run by a worker */
 };
 
 /* local function prototypes */
@@ -587,22 +568,14 @@ virNWFilterSnoopReqNew(const char *ifkey)
     if (VIR_ALLOC(req) < 0)
         return NULL;
 
-    req->threadStatus = THREAD_STATUS_NONE;
-
     if (virStrcpyStatic(req->ifkey, ifkey) < 0||
         virMutexInitRecursive(&req->lock) < 0)
         goto err_free_req;
 
-    if (virCondInit(&req->threadStatusCond) < 0)
-        goto err_destroy_mutex;
-
     virNWFilterSnoopReqGet(req);
 
     return req;
 
- err_destroy_mutex:
-    virMutexDestroy(&req->lock);
-
  err_free_req:
     VIR_FREE(req);
 
@@ -633,8 +606,6 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReqPtr req)
     virNWFilterBindingDefFree(req->binding);
 
     virMutexDestroy(&req->lock);
-    virCondDestroy(&req->threadStatusCond);
-    virFreeError(req->threadError);
 
     VIR_FREE(req);
 }
@@ -1062,105 +1033,14 @@ virNWFilterSnoopDHCPDecode(virNWFilterSnoopReqPtr req,
     return 0;
 }
 
-static pcap_t *
-virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
-                         const char *filter, pcap_direction_t dir)
-{
-    pcap_t *handle = NULL;
-    struct bpf_program fp;
-    char pcap_errbuf[PCAP_ERRBUF_SIZE];
-    char *ext_filter = NULL;
-    char macaddr[VIR_MAC_STRING_BUFLEN];
-
-    virMacAddrFormat(mac, macaddr);
-
-    if (dir == PCAP_D_IN /* from VM */) {
-        /*
-         * don't want to hear about another VM's DHCP requests
-         *
-         * extend the filter with the macaddr of the VM; filter the
-         * more unlikely parameters first, then go for the MAC
-         */
-        if (virAsprintf(&ext_filter,
-                        "%s and ether src %s", filter, macaddr) < 0)
-            return NULL;
-    } else {
-        /*
-         * Some DHCP servers respond via MAC broadcast; we rely on later
-         * filtering of responses by comparing the MAC address inside the
-         * DHCP response against the one of the VM. Assuming that the
-         * bridge learns the VM's MAC address quickly this should not
-         * generate much more traffic than if we filtered by VM and
-         * braodcast MAC as well
-         */
-        if (VIR_STRDUP(ext_filter, filter) < 0)
-            return NULL;
-    }
-
-    handle = pcap_create(ifname, pcap_errbuf);
-
-    if (handle == NULL) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("pcap_create failed"));
-        goto cleanup_nohandle;
-    }
-
-    /* IMPORTANT: If there is any failure of *any* pcap_* function
-     * during setup of the socket, look to the comment where
-     * PCAP_BUFFERSIZE is defined. It may be too small, even if the
-     * generated error doesn't imply that.
-     */
-    if (pcap_set_snaplen(handle, PCAP_PBUFSIZE) < 0 ||
-        pcap_set_buffer_size(handle, PCAP_BUFFERSIZE) < 0 ||
-        pcap_activate(handle) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("setup of pcap handle failed: %s"),
-                       pcap_geterr(handle));
-        goto cleanup;
-    }
-
-    if (pcap_compile(handle, &fp, ext_filter, 1, PCAP_NETMASK_UNKNOWN) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_compile: %s"), pcap_geterr(handle));
-        goto cleanup;
-    }
-
-    if (pcap_setfilter(handle, &fp) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_setfilter: %s"), pcap_geterr(handle));
-        goto cleanup_freecode;
-    }
-
-    if (pcap_setdirection(handle, dir) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("pcap_setdirection: %s"),
-                       pcap_geterr(handle));
-        goto cleanup_freecode;
-    }
-
-    pcap_freecode(&fp);
-    VIR_FREE(ext_filter);
-
-    return handle;
-
- cleanup_freecode:
-    pcap_freecode(&fp);
- cleanup:
-    pcap_close(handle);
- cleanup_nohandle:
-    VIR_FREE(ext_filter);
-
-    return NULL;
-}
-
 /*
- * Worker function to decode the DHCP message and with that
- * also do the time-consuming work of instantiating the filters
+ * Decode the DHCP message and with that also do the time-consuming
+ * work of instantiating the filters
  */
-static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
+static void
+virNWFilterSnoopDHCPDecodeJobRun(virNWFilterSnoopReqPtr req,
+                                 virNWFilterDHCPDecodeJobPtr job)
 {
-    virNWFilterSnoopReqPtr req = opaque;
-    virNWFilterDHCPDecodeJobPtr job = jobdata;
     virNWFilterSnoopEthHdrPtr packet = (virNWFilterSnoopEthHdrPtr)job->packet;
 
     if (virNWFilterSnoopDHCPDecode(req, packet,
@@ -1171,41 +1051,6 @@ static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
                        _("Instantiation of rules failed on "
                          "interface '%s'"), req->binding->portdevname);
     }
-    virAtomicIntDecAndTest(job->qCtr);
-    VIR_FREE(job);
-}
-
-/*
- * Submit a job to the worker thread doing the time-consuming work...
- */
-static int
-virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
-                                    virNWFilterSnoopEthHdrPtr pep,
-                                    int len, pcap_direction_t dir,
-                                    int *qCtr)
-{
-    virNWFilterDHCPDecodeJobPtr job;
-    int ret;
-
-    if (len <= MIN_VALID_DHCP_PKT_SIZE || len > sizeof(job->packet))
-        return 0;
-
-    if (VIR_ALLOC(job) < 0)
-        return -1;
-
-    memcpy(job->packet, pep, len);
-    job->caplen = len;
-    job->fromVM = (dir == PCAP_D_IN);
-    job->qCtr = qCtr;
-
-    ret = virThreadPoolSendJob(pool, 0, job);
-
-    if (ret == 0)
-        virAtomicIntInc(qCtr);
-    else
-        VIR_FREE(job);
-
-    return ret;
 }
 
 /*
@@ -1255,294 +1100,193 @@ virNWFilterSnoopRateLimit(virNWFilterSnoopRateLimitConfPtr rl)
 }
 
 /*
- * virNWFilterSnoopRatePenalty
- *
- * @pc: pointer to the virNWFilterSnoopPcapConf
- * @diff: the amount of pkts beyond the rate, i.e., if the rate is 10
- *        and 13 pkts have been received now in one seconds, then
- *        this should be 3.
- *
- * Adjusts the timeout the virNWFilterSnooPcapConf will be penalized for
- * sending too many packets.
+ * Have a worker run the jobs of @session unless one already does.
+ * The session lock must be held.
  */
 static void
-virNWFilterSnoopRatePenalty(virNWFilterSnoopPcapConfPtr pc,
-                            unsigned int diff, unsigned int limit)
+virNWFilterSnoopSessionSchedule(virNWFilterSnoopSessionPtr session)
 {
-    if (diff > limit) {
-        unsigned long long now;
+    if (session->scheduled)
+        return;
 
-        if (virTimeMillisNowRaw(&now) < 0) {
-            usleep(PCAP_FLOOD_TIMEOUT_MS); /* 1 ms */
-            pc->penaltyTimeoutAbs = 0;
-        } else {
-            /* don't listen to the fd for 1 ms */
-            pc->penaltyTimeoutAbs = now + PCAP_FLOOD_TIMEOUT_MS;
-        }
+    if (virThreadPoolSendJob(virNWFilterSnoopState.workers, 0, session) < 0) {
+        VIR_ERROR(_("Failed to schedule DHCP snooping on interface '%s'"),
+                  session->req->binding->portdevname);
+        return;
     }
+
+    session->scheduled = true;
 }
 
-static int
-virNWFilterSnoopAdjustPoll(virNWFilterSnoopPcapConfPtr pc,
-                           size_t nPc, struct pollfd *pfd,
-                           int *pollTo)
+
+/*
+ * The filter passes DHCP packets in both directions; accept only the
+ * requests from the VM and the replies going to it
+ */
+static bool
+virNWFilterSnoopDHCPDirIsValid(const unsigned char *packet,
+                               size_t len,
+                               bool fromVM)
 {
-    int ret = 0;
-    size_t i;
-    int tmp;
-    unsigned long long now = 0;
+    const struct iphdr *pip;
+    const struct udphdr *pup;
+    size_t off = offsetof(virNWFilterSnoopEthHdr, eh_data);
 
-    *pollTo = -1;
+    if (len < off + sizeof(*pip))
+        return false;
 
-    for (i = 0; i < nPc; i++) {
-        if (pc[i].penaltyTimeoutAbs != 0) {
-            if (now == 0) {
-                if (virTimeMillisNow(&now) < 0) {
-                    ret = -1;
-                    break;
-                }
-            }
+    VIR_WARNINGS_NO_CAST_ALIGN
+    pip = (const struct iphdr *)(packet + off);
+    VIR_WARNINGS_RESET
+    off += pip->ihl << 2;
 
-            if (now < pc[i].penaltyTimeoutAbs) {
-                /* don't listen to incoming data on the fd for some time */
-                pfd[i].events &= ~POLLIN;
-                /*
-                 * calc the max. time to spend in poll() until adjustments
-                 * to the pollfd array are needed again.
-                 */
-                tmp = pc[i].penaltyTimeoutAbs - now;
-                if (*pollTo == -1 || tmp < *pollTo)
-                    *pollTo = tmp;
-            } else {
-                /* listen again to the fd */
-                pfd[i].events |= POLLIN;
-
-                pc[i].penaltyTimeoutAbs = 0;
-            }
-        }
-    }
+    if (len < off + sizeof(*pup))
+        return false;
 
-    return ret;
+    VIR_WARNINGS_NO_CAST_ALIGN
+    pup = (const struct udphdr *)(packet + off);
+    VIR_WARNINGS_RESET
+
+    return ntohs(pup->dest) == (fromVM ? 67 : 68);
 }
 
-/*
- * The DHCP snooping thread. It spends most of its time in the pcap
- * library and if it gets suitable packets, it submits them to the worker
- * thread for processing.
- */
-static void
-virNWFilterDHCPSnoopThread(void *req0)
+
+static int
+virNWFilterSnoopSessionPacket(const unsigned char *packet,
+                              size_t len,
+                              bool fromVM,
+                              void *opaque)
 {
-    virNWFilterSnoopReqPtr req = req0;
-    struct pcap_pkthdr *hdr;
-    virNWFilterSnoopEthHdrPtr packet;
-    int ifindex = 0;
-    int errcount = 0;
-    int tmp = -1, rv, n, pollTo;
-    size_t i;
-    char *threadkey = NULL;
-    virThreadPoolPtr worker = NULL;
-    time_t last_displayed = 0, last_displayed_queue = 0;
-    virNWFilterSnoopPcapConf pcapConf[] = {
-        {
-            .dir = PCAP_D_IN, /* from VM */
-            .filter = "dst port 67 and src port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        }, {
-            .dir = PCAP_D_OUT, /* to VM */
-            .filter = "src port 67 and dst port 68",
-            .rateLimit = {
-                .prev = time(0),
-                .rate = DHCP_PKT_RATE,
-                .burstRate = DHCP_PKT_BURST,
-                .burstInterval = DHCP_BURST_INTERVAL_S,
-            },
-            .maxQSize = MAX_QUEUED_JOBS,
-        },
-    };
-    struct pollfd fds[] = {
-        {
-            /* get a POLLERR if interface goes down or disappears */
-            .events = POLLIN | POLLERR,
-        }, {
-            .events = POLLIN | POLLERR,
-        },
-    };
-    bool error = false;
-
-    /* whoever started us increased the reference counter for the req for us */
+    virNWFilterSnoopSessionPtr session = opaque;
+    virNWFilterSnoopReqPtr req = session->req;
+    virNWFilterDHCPDecodeJobPtr job = NULL;
+    unsigned int dir = fromVM ? 0 : 1;
+    bool full;
+
+    if (len <= MIN_VALID_DHCP_PKT_SIZE || len > sizeof(job->packet) ||
+        !virNWFilterSnoopDHCPDirIsValid(packet, len, fromVM))
+        return 0;
 
-    /* protect req->binding->portdevname & req->threadkey */
-    virNWFilterSnoopReqLock(req);
+    virMutexLock(&session->lock);
+    full = session->qCtr[dir] > MAX_QUEUED_JOBS;
+    virMutexUnlock(&session->lock);
 
-    if (req->binding->portdevname && req->threadkey) {
-        for (i = 0; i < ARRAY_CARDINALITY(pcapConf); i++) {
-            pcapConf[i].handle =
-                virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                         &req->binding->mac,
-                                         pcapConf[i].filter,
-                                         pcapConf[i].dir);
-            if (!pcapConf[i].handle) {
-                error = true;
-                break;
-            }
-            fds[i].fd = pcap_fileno(pcapConf[i].handle);
+    if (full) {
+        if (time(0) - session->last_displayed_queue > 10) {
+            session->last_displayed_queue = time(0);
+            VIR_WARN("Worker thread for interface '%s' has a "
+                     "job queue that is too long",
+                     req->binding->portdevname);
         }
-        tmp = virNetDevGetIndex(req->binding->portdevname, &ifindex);
-        ignore_value(VIR_STRDUP(threadkey, req->threadkey));
-        worker = virThreadPoolNew(1, 1, 0,
-                                  virNWFilterDHCPDecodeWorker,
-                                  req);
+        return 0;
     }
 
-    /* let creator know how well we initialized */
-    if (error || !threadkey || tmp < 0 || !worker ||
-        ifindex != req->ifindex) {
-        virErrorPreserveLast(&req->threadError);
-        req->threadStatus = THREAD_STATUS_FAIL;
-    } else {
-        req->threadStatus = THREAD_STATUS_OK;
+    if (virNWFilterSnoopRateLimit(&session->rateLimit[dir]) > 0) {
+        /* rate-limited warnings */
+        if (time(0) - session->last_displayed > 10) {
+            session->last_displayed = time(0);
+            VIR_WARN("Too many DHCP packets on interface '%s'",
+                     req->binding->portdevname);
+        }
+        return 0;
     }
 
-    virCondSignal(&req->threadStatusCond);
+    if (VIR_ALLOC_QUIET(job) < 0)
+        goto error;
 
-    virNWFilterSnoopReqUnlock(req);
+    memcpy(job->packet, packet, len);
+    job->caplen = len;
+    job->fromVM = fromVM;
 
-    if (req->threadStatus != THREAD_STATUS_OK)
-        goto exit;
+    virMutexLock(&session->lock);
 
-    while (!error) {
-        if (virNWFilterSnoopAdjustPoll(pcapConf,
-                                       ARRAY_CARDINALITY(pcapConf),
-                                       fds, &pollTo) < 0) {
-            break;
-        }
+    if (VIR_APPEND_ELEMENT_QUIET(session->jobs, session->njobs, job) < 0) {
+        virMutexUnlock(&session->lock);
+        goto error;
+    }
 
-        /* cap pollTo so we don't hold up the join for too long */
-        if (pollTo < 0 || pollTo > SNOOP_POLL_MAX_TIMEOUT_MS)
-            pollTo = SNOOP_POLL_MAX_TIMEOUT_MS;
+    session->qCtr[dir]++;
+    virNWFilterSnoopSessionSchedule(session);
 
-        n = poll(fds, ARRAY_CARDINALITY(fds), pollTo);
+    virMutexUnlock(&session->lock);
 
-        if (n < 0) {
-            if (errno != EAGAIN && errno != EINTR)
-                error = true;
-        }
+    return 0;
 
-        virNWFilterSnoopReqLeaseTimerRun(req);
+ error:
+    VIR_ERROR(_("Job submission failed on interface '%s'"),
+              req->binding->portdevname);
+    VIR_FREE(job);
 
-        /*
-         * Check whether we were cancelled or whether
-         * a previously submitted job failed.
-         */
-        if (!virNWFilterSnoopIsActive(threadkey) ||
-            req->jobCompletionStatus != 0)
-            goto exit;
+    virMutexLock(&session->lock);
+    session->end = true;
+    virNWFilterSnoopSessionSchedule(session);
+    virMutexUnlock(&session->lock);
 
-        for (i = 0; n > 0 && i < ARRAY_CARDINALITY(fds); i++) {
-            if (!fds[i].revents)
-                continue;
+    return -1;
+}
 
-            fds[i].revents = 0;
-            n--;
 
-            rv = pcap_next_ex(pcapConf[i].handle, &hdr,
-                              (const u_char **)&packet);
+static void
+virNWFilterSnoopSessionError(int err ATTRIBUTE_UNUSED,
+                             void *opaque)
+{
+    virNWFilterSnoopSessionPtr session = opaque;
 
-            if (rv < 0) {
-                /* error reading from socket */
-                tmp = -1;
+    virMutexLock(&session->lock);
+    session->end = true;
+    virNWFilterSnoopSessionSchedule(session);
+    virMutexUnlock(&session->lock);
+}
 
-                /* protect req->binding->portdevname */
-                virNWFilterSnoopReqLock(req);
 
-                if (req->binding->portdevname)
-                    tmp = virNetDevValidateConfig(req->binding->portdevname, NULL, ifindex);
+static void
+virNWFilterSnoopSessionTick(void *opaque)
+{
+    virNWFilterSnoopSessionPtr session = opaque;
 
-                virNWFilterSnoopReqUnlock(req);
+    virMutexLock(&session->lock);
+    session->tick = true;
+    virNWFilterSnoopSessionSchedule(session);
+    virMutexUnlock(&session->lock);
+}
 
-                if (tmp <= 0) {
-                    error = true;
-                    break;
-                }
 
-                if (++errcount > PCAP_READ_MAXERRS) {
-                    pcap_close(pcapConf[i].handle);
-                    pcapConf[i].handle = NULL;
+static virNWFilterCaptureCallbacks virNWFilterSnoopSessionCallbacks = {
+    .packet = virNWFilterSnoopSessionPacket,
+    .error = virNWFilterSnoopSessionError,
+    .tick = virNWFilterSnoopSessionTick,
+};
 
-                    /* protect req->binding->portdevname */
-                    virNWFilterSnoopReqLock(req);
 
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("interface '%s' failing; "
-                                     "reopening"),
-                                   req->binding->portdevname);
-                    if (req->binding->portdevname)
-                        pcapConf[i].handle =
-                            virNWFilterSnoopDHCPOpen(req->binding->portdevname,
-                                                     &req->binding->mac,
-                                                     pcapConf[i].filter,
-                                                     pcapConf[i].dir);
+static void
+virNWFilterSnoopSessionFree(virNWFilterSnoopSessionPtr session)
+{
+    size_t i;
 
-                    virNWFilterSnoopReqUnlock(req);
+    if (!session)
+        return;
 
-                    if (!pcapConf[i].handle) {
-                        error = true;
-                        break;
-                    }
-                }
-                continue;
-            }
+    for (i = 0; i < session->njobs; i++)
+        VIR_FREE(session->jobs[i]);
+    VIR_FREE(session->jobs);
+    VIR_FREE(session->threadkey);
+    virMutexDestroy(&session->lock);
+    VIR_FREE(session);
+}
 
-            errcount = 0;
-
-            if (rv) {
-                unsigned int diff;
-
-                /* submit packet to worker thread */
-                if (virAtomicIntGet(&pcapConf[i].qCtr) >
-                    pcapConf[i].maxQSize) {
-                    if (last_displayed_queue - time(0) > 10) {
-                        last_displayed_queue = time(0);
-                        VIR_WARN("Worker thread for interface '%s' has a "
-                                 "job queue that is too long",
-                                 req->binding->portdevname);
-                    }
-                    continue;
-                }
-
-                diff = virNWFilterSnoopRateLimit(&pcapConf[i].rateLimit);
-                if (diff > 0) {
-                    virNWFilterSnoopRatePenalty(&pcapConf[i], diff,
-                                                DHCP_PKT_RATE);
-                    /* rate-limited warnings */
-                    if (time(0) - last_displayed > 10) {
-                         last_displayed = time(0);
-                         VIR_WARN("Too many DHCP packets on interface '%s'",
-                                  req->binding->portdevname);
-                    }
-                    continue;
-                }
-
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
-                                                      hdr->caplen,
-                                                      pcapConf[i].dir,
-                                                      &pcapConf[i].qCtr) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("Job submission failed on "
-                                     "interface '%s'"), req->binding->portdevname);
-                    error = true;
-                    break;
-                }
-            }
-        } /* for all fds */
-    } /* while (!error) */
+
+/*
+ * Stop capturing on the interface of @session and drop the interface
+ * association of its request
+ */
+static void
+virNWFilterSnoopSessionEnd(virNWFilterSnoopSessionPtr session)
+{
+    virNWFilterSnoopReqPtr req = session->req;
+
+    /* no more callbacks of the session after this */
+    virNWFilterCaptureFree(session->capture);
+    session->capture = NULL;
 
     /* protect IfNameToKey */
     virNWFilterSnoopLock();
@@ -1560,21 +1304,139 @@ virNWFilterDHCPSnoopThread(void *req0)
     virNWFilterSnoopReqUnlock(req);
     virNWFilterSnoopUnlock();
 
- exit:
-    virThreadPoolFree(worker);
+    virNWFilterSnoopSessionFree(session);
 
     virNWFilterSnoopReqPut(req);
 
-    VIR_FREE(threadkey);
+    virAtomicIntDecAndTest(&virNWFilterSnoopState.nThreads);
+}
+
+
+/*
+ * Worker running the jobs of a session in the order they were queued
+ */
+static void
+virNWFilterSnoopSessionRun(void *jobdata,
+                           void *opaque ATTRIBUTE_UNUSED)
+{
+    virNWFilterSnoopSessionPtr session = jobdata;
+    virNWFilterSnoopReqPtr req = session->req;
+
+    virMutexLock(&session->lock);
+
+    while (!session->end) {
+        if (session->njobs > 0) {
+            virNWFilterDHCPDecodeJobPtr job = session->jobs[0];
+
+            VIR_DELETE_ELEMENT(session->jobs, 0, session->njobs);
+            session->qCtr[job->fromVM ? 0 : 1]--;
+            virMutexUnlock(&session->lock);
+
+            virNWFilterSnoopDHCPDecodeJobRun(req, job);
+            VIR_FREE(job);
+
+            virMutexLock(&session->lock);
+        } else if (session->tick) {
+            session->tick = false;
+            virMutexUnlock(&session->lock);
+
+            virNWFilterSnoopReqLeaseTimerRun(req);
+
+            virMutexLock(&session->lock);
+        } else {
+            break;
+        }
+
+        /*
+         * Check whether we were cancelled or whether
+         * a previously submitted job failed.
+         */
+        if (!virNWFilterSnoopIsActive(session->threadkey) ||
+            req->jobCompletionStatus != 0)
+            session->end = true;
+    }
+
+    if (session->end) {
+        virMutexUnlock(&session->lock);
+        virNWFilterSnoopSessionEnd(session);
+        return;
+    }
 
-    for (i = 0; i < ARRAY_CARDINALITY(pcapConf); i++) {
-        if (pcapConf[i].handle)
-            pcap_close(pcapConf[i].handle);
+    session->scheduled = false;
+
+    virMutexUnlock(&session->lock);
+}
+
+
+/*
+ * Start snooping DHCP traffic on the interface of @req, handing the
+ * reference to @req held by the caller over to the session.
+ * The request lock must be held.
+ */
+static int
+virNWFilterSnoopSessionStart(virNWFilterSnoopReqPtr req)
+{
+    virNWFilterSnoopSessionPtr session;
+    char macaddr[VIR_MAC_STRING_BUFLEN];
+    VIR_AUTOFREE(char *) filter = NULL;
+    size_t i;
+
+    if (VIR_ALLOC(session) < 0)
+        return -1;
+
+    if (virMutexInit(&session->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize mutex"));
+        VIR_FREE(session);
+        return -1;
     }
 
-    virAtomicIntDecAndTest(&virNWFilterSnoopState.nThreads);
+    session->req = req;
 
-    return;
+    for (i = 0; i < ARRAY_CARDINALITY(session->rateLimit); i++) {
+        session->rateLimit[i].prev = time(0);
+        session->rateLimit[i].rate = DHCP_PKT_RATE;
+        session->rateLimit[i].burstRate = DHCP_PKT_BURST;
+        session->rateLimit[i].burstInterval = DHCP_BURST_INTERVAL_S;
+    }
+
+    if (VIR_STRDUP(session->threadkey, req->threadkey) < 0)
+        goto error;
+
+    virMacAddrFormat(&req->binding->mac, macaddr);
+
+    /*
+     * Don't want to hear about another VM's DHCP requests; filter the
+     * more unlikely parameters first, then go for the MAC.
+     *
+     * Some DHCP servers respond via MAC broadcast; we rely on later
+     * filtering of responses by comparing the MAC address inside the
+     * DHCP response against the one of the VM. Assuming that the
+     * bridge learns the VM's MAC address quickly this should not
+     * generate much more traffic than if we filtered by VM and
+     * braodcast MAC as well
+     */
+    if (virAsprintf(&filter,
+                    "(dst port 67 and src port 68 and ether src %s) or "
+                    "(src port 67 and dst port 68)", macaddr) < 0)
+        goto error;
+
+    virAtomicIntInc(&virNWFilterSnoopState.nThreads);
+
+    if (!(session->capture =
+          virNWFilterCaptureNew(req->binding->portdevname, filter,
+                                PCAP_PBUFSIZE,
+                                &virNWFilterSnoopSessionCallbacks,
+                                session))) {
+        virAtomicIntDecAndTest(&virNWFilterSnoopState.nThreads);
+        goto error;
+    }
+
+    return 0;
+
+ error:
+    virNWFilterSnoopSessionFree(session);
+    return -1;
 }
 
 static void
@@ -1595,9 +1457,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     bool isnewreq;
     char ifkey[VIR_IFKEY_LEN];
     int tmp;
-    virThread thread;
     virNWFilterVarValuePtr dhcpsrvrs;
-    bool threadPuts = false;
 
     virNWFilterSnoopIFKeyFMT(ifkey, binding->owneruuid, &binding->mac);
 
@@ -1665,21 +1525,9 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_rem_ifnametokey;
     }
 
-    /* prevent thread from holding req */
+    /* prevent the session from holding req */
     virNWFilterSnoopReqLock(req);
 
-    if (virThreadCreate(&thread, false, virNWFilterDHCPSnoopThread,
-                        req) != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("virNWFilterDHCPSnoopReq virThreadCreate "
-                         "failed on interface '%s'"), binding->portdevname);
-        goto exit_snoopreq_unlock;
-    }
-
-    threadPuts = true;
-
-    virAtomicIntInc(&virNWFilterSnoopState.nThreads);
-
     req->threadkey = virNWFilterSnoopActivate(req);
     if (!req->threadkey) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1695,23 +1543,14 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
         goto exit_snoop_cancel;
     }
 
-    /* sync with thread */
-    if (virCondWait(&req->threadStatusCond, &req->lock) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("unable to wait on dhcp snoop thread"));
-        goto exit_snoop_cancel;
-    }
-
-    if (req->threadStatus != THREAD_STATUS_OK) {
-        virErrorRestore(&req->threadError);
+    if (virNWFilterSnoopSessionStart(req) < 0)
         goto exit_snoop_cancel;
-    }
 
     virNWFilterSnoopReqUnlock(req);
 
     virNWFilterSnoopUnlock();
 
-    /* do not 'put' the req -- the thread will do this */
+    /* do not 'put' the req -- the session will do this */
 
     return 0;
 
@@ -1724,8 +1563,7 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
  exit_snoopunlock:
     virNWFilterSnoopUnlock();
  exit_snoopreqput:
-    if (!threadPuts)
-        virNWFilterSnoopReqPut(req);
+    virNWFilterSnoopReqPut(req);
 
     return -1;
 }
@@ -2087,6 +1925,12 @@ virNWFilterDHCPSnoopInit(void)
         !virNWFilterSnoopState.active)
         goto err_exit;
 
+    virNWFilterSnoopState.workers =
+        virThreadPoolNew(0, SNOOP_WORKERS_MAX, 0,
+                         virNWFilterSnoopSessionRun, NULL);
+    if (!virNWFilterSnoopState.workers)
+        goto err_exit;
+
     virNWFilterSnoopLeaseFileLoad();
     virNWFilterSnoopLeaseFileOpen();
 
@@ -2102,6 +1946,9 @@ virNWFilterDHCPSnoopInit(void)
     virHashFree(virNWFilterSnoopState.active);
     virNWFilterSnoopState.active = NULL;
 
+    virThreadPoolFree(virNWFilterSnoopState.workers);
+    virNWFilterSnoopState.workers = NULL;
+
     return -1;
 }
 
@@ -2177,6 +2024,9 @@ virNWFilterDHCPSnoopShutdown(void)
     virNWFilterSnoopEndThreads();
     virNWFilterSnoopJoinThreads();
 
+    virThreadPoolFree(virNWFilterSnoopState.workers);
+    virNWFilterSnoopState.workers = NULL;
+
     virNWFilterSnoopLock();
 
     virNWFilterSnoopLeaseFileClose();
@@ -43,6 +43,7 @@
 #include "viraccessapicheck.h"
 
 #include "nwfilter_ipaddrmap.h"
+#include "nwfilter_capture.h"
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_learnipaddr.h"
 
@@ -220,8 +221,10 @@ nwfilterStateInitialize(bool privileged,
 
     if (virNWFilterIPAddrMapInit() < 0)
         goto err_free_driverstate;
-    if (virNWFilterLearnInit() < 0)
+    if (virNWFilterCaptureInit() < 0)
         goto err_exit_ipaddrmapshutdown;
+    if (virNWFilterLearnInit() < 0)
+        goto err_exit_captureshutdown;
     if (virNWFilterDHCPSnoopInit() < 0)
         goto err_exit_learnshutdown;
 
@@ -295,6 +298,8 @@ nwfilterStateInitialize(bool privileged,
     virNWFilterDHCPSnoopShutdown();
  err_exit_learnshutdown:
     virNWFilterLearnShutdown();
+ err_exit_captureshutdown:
+    virNWFilterCaptureShutdown();
  err_exit_ipaddrmapshutdown:
     virNWFilterIPAddrMapShutdown();
 
@@ -354,6 +359,7 @@ nwfilterStateCleanup(void)
         virNWFilterConfLayerShutdown();
         virNWFilterDHCPSnoopShutdown();
         virNWFilterLearnShutdown();
+        virNWFilterCaptureShutdown();
         virNWFilterIPAddrMapShutdown();
         virNWFilterTechDriversShutdown();
 
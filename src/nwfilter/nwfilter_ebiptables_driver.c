@@ -99,6 +99,7 @@ static int ebiptablesDriverInit(bool privileged);
 static void ebiptablesDriverShutdown(void);
 static int ebtablesCleanAll(const char *ifname);
 static int ebiptablesAllTeardown(const char *ifname);
+static void ebiptablesRuleSetsDrop(const char *ifname);
 
 struct ushort_map {
     unsigned short attr;
@@ -3135,6 +3136,8 @@ ebtablesCleanAll(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    ebiptablesRuleSetsDrop(ifname);
+
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     ebtablesUnlinkRootChainFW(fw, true, ifname);
@@ -3393,23 +3396,29 @@ ebtablesGetSubChainInsts(virHashTablePtr chains,
 
 }
 
+/*
+ * Add the commands creating the temporary chains of @ifname filled
+ * with @rules to the current transaction of @fw.
+ */
 static int
-ebiptablesApplyNewRules(const char *ifname,
-                        virNWFilterRuleInstPtr *rules,
-                        size_t nrules)
+ebiptablesAddRulesFW(virFirewallPtr fw,
+                     const char *ifname,
+                     virNWFilterRuleInstPtr *rules,
+                     size_t nrules,
+                     bool *haveIptables,
+                     bool *haveIp6tables)
 {
     size_t i, j;
-    virFirewallPtr fw = virFirewallNew();
     virHashTablePtr chains_in_set  = virHashCreate(10, NULL);
     virHashTablePtr chains_out_set = virHashCreate(10, NULL);
     bool haveEbtables = false;
-    bool haveIptables = false;
-    bool haveIp6tables = false;
-    char *errmsg = NULL;
     struct ebtablesSubChainInst **subchains = NULL;
     size_t nsubchains = 0;
     int ret = -1;
 
+    *haveIptables = false;
+    *haveIp6tables = false;
+
     if (!chains_in_set || !chains_out_set)
         goto cleanup;
 
@@ -3417,16 +3426,6 @@ ebiptablesApplyNewRules(const char *ifname,
         qsort(rules, nrules, sizeof(rules[0]),
               virNWFilterRuleInstSortPtr);
 
-    /* cleanup whatever may exist */
-    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
-    ebtablesUnlinkTmpRootChainFW(fw, true, ifname);
-    ebtablesUnlinkTmpRootChainFW(fw, false, ifname);
-    ebtablesRemoveTmpSubChainsFW(fw, ifname);
-    ebtablesRemoveTmpRootChainFW(fw, true, ifname);
-    ebtablesRemoveTmpRootChainFW(fw, false, ifname);
-
-    virFirewallStartTransaction(fw, 0);
-
     /* walk the list of rules and increase the priority
      * of rules in case the chain priority is of higher value;
      * this preserves the order of the rules and ensures that
@@ -3449,11 +3448,12 @@ ebiptablesApplyNewRules(const char *ifname,
             haveEbtables = true;
         } else {
             if (virNWFilterRuleIsProtocolIPv4(rules[i]->def))
-                haveIptables = true;
+                *haveIptables = true;
             else if (virNWFilterRuleIsProtocolIPv6(rules[i]->def))
-                haveIp6tables = true;
+                *haveIp6tables = true;
         }
     }
+
     /* process ebtables commands; interleave commands from filters with
        commands for creating and connecting ebtables chains */
     if (haveEbtables) {
@@ -3526,7 +3526,7 @@ ebiptablesApplyNewRules(const char *ifname,
         }
     }
 
-    if (haveIptables) {
+    if (*haveIptables) {
         iptablesUnlinkTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
         iptablesRemoveTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV4, ifname);
 
@@ -3548,7 +3548,7 @@ ebiptablesApplyNewRules(const char *ifname,
         iptablesCheckBridgeNFCallEnabled(false);
     }
 
-    if (haveIp6tables) {
+    if (*haveIp6tables) {
         iptablesUnlinkTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV6, ifname);
         iptablesRemoveTmpRootChainsFW(fw, VIR_FIREWALL_LAYER_IPV6, ifname);
 
@@ -3575,6 +3575,527 @@ ebiptablesApplyNewRules(const char *ifname,
     if (virHashSize(chains_out_set) != 0)
         ebtablesLinkTmpRootChainFW(fw, false, ifname);
 
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nsubchains; i++)
+        VIR_FREE(subchains[i]);
+    VIR_FREE(subchains);
+    virHashFree(chains_in_set);
+    virHashFree(chains_out_set);
+    return ret;
+}
+
+
+/*
+ * The rules last applied to the chains of an interface. Rules applied
+ * late, i.e. after an IP address of the VM was learned, usually differ
+ * from the current ones in a few rules only, which are then changed in
+ * place rather than building and switching to a new set of chains.
+ */
+typedef struct _ebiptablesRuleLine ebiptablesRuleLine;
+typedef ebiptablesRuleLine *ebiptablesRuleLinePtr;
+struct _ebiptablesRuleLine {
+    virFirewallLayer layer;
+    char **prefix; /* arguments before -A, i.e. the table */
+    char *chain;   /* final name of the chain of the interface */
+    char **spec;   /* arguments following the chain */
+};
+
+typedef struct _ebiptablesRuleSet ebiptablesRuleSet;
+typedef ebiptablesRuleSet *ebiptablesRuleSetPtr;
+struct _ebiptablesRuleSet {
+    char *layout; /* all commands but rules in chains of the interface */
+    ebiptablesRuleLinePtr lines;
+    size_t nlines;
+};
+
+/* Largest amount of differing rules compared in one chain */
+#define EBIPTABLES_DIFF_MAX (1024 * 1024)
+
+static virMutex rulesetLock = VIR_MUTEX_INITIALIZER;
+/* rule sets of the temporary and of the final chains, by interface */
+static virHashTablePtr newRulesets;
+static virHashTablePtr curRulesets;
+
+
+static void
+ebiptablesRuleSetFree(ebiptablesRuleSetPtr set)
+{
+    size_t i;
+
+    if (!set)
+        return;
+
+    for (i = 0; i < set->nlines; i++) {
+        virStringListFree(set->lines[i].prefix);
+        VIR_FREE(set->lines[i].chain);
+        virStringListFree(set->lines[i].spec);
+    }
+    VIR_FREE(set->lines);
+    VIR_FREE(set->layout);
+    VIR_FREE(set);
+}
+
+
+static void
+ebiptablesRuleSetHashFree(void *payload,
+                          const void *name ATTRIBUTE_UNUSED)
+{
+    ebiptablesRuleSetFree(payload);
+}
+
+
+/*
+ * Returns the index of the character telling a temporary chain of
+ * @ifname from the final one in @chain, or -1 if @chain is none of the
+ * temporary chains of @ifname.
+ */
+static int
+ebiptablesTmpChainPrefixIdx(const char *chain,
+                            const char *ifname)
+{
+    size_t len = strlen(ifname);
+    const char *rest;
+
+#define IS_TMP_PREFIX(c) \
+    ((c) == CHAINPREFIX_HOST_IN_TEMP || (c) == CHAINPREFIX_HOST_OUT_TEMP)
+
+    /* ebtables root chain, e.g. libvirt-J-vnet0 */
+    if ((rest = STRSKIP(chain, "libvirt-")) &&
+        IS_TMP_PREFIX(rest[0]) && rest[1] == '-' && STREQ(rest + 2, ifname))
+        return rest - chain;
+
+    /* ebtables sub chain, e.g. J-vnet0-ipv4 */
+    if (IS_TMP_PREFIX(chain[0]) && chain[1] == '-' &&
+        STREQLEN(chain + 2, ifname, len) && chain[2 + len] == '-')
+        return 0;
+
+    /* ip(6)tables root chains, e.g. FJ-vnet0 */
+    if ((chain[0] == 'F' || chain[0] == 'H') &&
+        IS_TMP_PREFIX(chain[1]) && chain[2] == '-' && STREQ(chain + 3, ifname))
+        return 1;
+
+#undef IS_TMP_PREFIX
+
+    return -1;
+}
+
+
+/* Store @arg in @res, with temporary chain names replaced by final ones */
+static int
+ebiptablesFinalArg(const char *arg,
+                   const char *ifname,
+                   char **res)
+{
+    int idx = ebiptablesTmpChainPrefixIdx(arg, ifname);
+
+    if (VIR_STRDUP(*res, arg) < 0)
+        return -1;
+
+    if (idx >= 0)
+        (*res)[idx] = arg[idx] == CHAINPREFIX_HOST_IN_TEMP
+                      ? CHAINPREFIX_HOST_IN : CHAINPREFIX_HOST_OUT;
+    return 0;
+}
+
+
+static int
+ebiptablesRuleSetAddRule(ebiptablesRuleSetPtr set,
+                         virBufferPtr layout,
+                         virFirewallRulePtr fwrule,
+                         const char *ifname)
+{
+    ebiptablesRuleLine line = { .layer = virFirewallRuleGetLayer(fwrule) };
+    size_t nargs = virFirewallRuleGetArgCount(fwrule);
+    const char *arg = virFirewallRuleGetArg(fwrule, 0);
+    size_t first = 0;
+    size_t cmd;
+    size_t i;
+    int ret = -1;
+
+    /* skip the lock option virFirewall added */
+    if (arg && (STREQ(arg, "-w") || STREQ(arg, "--concurrent")))
+        first = 1;
+
+    cmd = first;
+    if (cmd + 1 < nargs && STREQ(virFirewallRuleGetArg(fwrule, cmd), "-t"))
+        cmd += 2;
+
+    if (cmd + 1 >= nargs ||
+        STRNEQ(virFirewallRuleGetArg(fwrule, cmd), "-A") ||
+        ebiptablesTmpChainPrefixIdx(virFirewallRuleGetArg(fwrule, cmd + 1),
+                                    ifname) < 0) {
+        virBufferAsprintf(layout, "%d", line.layer);
+        for (i = first; i < nargs; i++) {
+            VIR_AUTOFREE(char *) final = NULL;
+
+            if (ebiptablesFinalArg(virFirewallRuleGetArg(fwrule, i),
+                                   ifname, &final) < 0)
+                return -1;
+            virBufferAsprintf(layout, " %s", final);
+        }
+        virBufferAddLit(layout, "\n");
+        return 0;
+    }
+
+    if (VIR_ALLOC_N(line.prefix, cmd - first + 1) < 0 ||
+        VIR_ALLOC_N(line.spec, nargs - cmd - 2 + 1) < 0)
+        goto cleanup;
+
+    for (i = first; i < cmd; i++) {
+        if (VIR_STRDUP(line.prefix[i - first],
+                       virFirewallRuleGetArg(fwrule, i)) < 0)
+            goto cleanup;
+    }
+
+    if (ebiptablesFinalArg(virFirewallRuleGetArg(fwrule, cmd + 1),
+                           ifname, &line.chain) < 0)
+        goto cleanup;
+
+    for (i = cmd + 2; i < nargs; i++) {
+        if (ebiptablesFinalArg(virFirewallRuleGetArg(fwrule, i),
+                               ifname, &line.spec[i - cmd - 2]) < 0)
+            goto cleanup;
+    }
+
+    if (VIR_APPEND_ELEMENT(set->lines, set->nlines, line) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virStringListFree(line.prefix);
+    VIR_FREE(line.chain);
+    virStringListFree(line.spec);
+    return ret;
+}
+
+
+/*
+ * Record the commands of the current transaction of @fw, which are
+ * expected to be the ones built by ebiptablesAddRulesFW for @ifname.
+ */
+static ebiptablesRuleSetPtr
+ebiptablesRuleSetNew(virFirewallPtr fw,
+                     const char *ifname)
+{
+    virBuffer layout = VIR_BUFFER_INITIALIZER;
+    ebiptablesRuleSetPtr set;
+    size_t i;
+
+    if (VIR_ALLOC(set) < 0)
+        return NULL;
+
+    for (i = 0; i < virFirewallGetRuleCount(fw); i++) {
+        if (ebiptablesRuleSetAddRule(set, &layout,
+                                     virFirewallGetRule(fw, i), ifname) < 0)
+            goto error;
+    }
+
+    if (virBufferCheckError(&layout) < 0)
+        goto error;
+
+    /* an empty layout must still compare equal */
+    if (!(set->layout = virBufferContentAndReset(&layout)) &&
+        VIR_STRDUP(set->layout, "") < 0)
+        goto error;
+
+    return set;
+
+ error:
+    virBufferFreeAndReset(&layout);
+    ebiptablesRuleSetFree(set);
+    return NULL;
+}
+
+
+/* Replace the rule set of @ifname in @table, taking ownership of @set,
+ * which may be NULL to just drop the current one */
+static int
+ebiptablesRuleSetPut(virHashTablePtr *table,
+                     const char *ifname,
+                     ebiptablesRuleSetPtr set)
+{
+    int ret = -1;
+
+    virMutexLock(&rulesetLock);
+
+    if (!set) {
+        if (*table)
+            virHashRemoveEntry(*table, ifname);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!*table &&
+        !(*table = virHashCreate(0, ebiptablesRuleSetHashFree)))
+        goto cleanup;
+
+    if (virHashUpdateEntry(*table, ifname, set) < 0)
+        goto cleanup;
+    set = NULL;
+
+    ret = 0;
+ cleanup:
+    virMutexUnlock(&rulesetLock);
+    ebiptablesRuleSetFree(set);
+    return ret;
+}
+
+
+static ebiptablesRuleSetPtr
+ebiptablesRuleSetSteal(virHashTablePtr *table,
+                       const char *ifname)
+{
+    ebiptablesRuleSetPtr set = NULL;
+
+    virMutexLock(&rulesetLock);
+    if (*table)
+        set = virHashSteal(*table, ifname);
+    virMutexUnlock(&rulesetLock);
+
+    return set;
+}
+
+
+static void
+ebiptablesRuleSetsDrop(const char *ifname)
+{
+    virMutexLock(&rulesetLock);
+    if (newRulesets)
+        virHashRemoveEntry(newRulesets, ifname);
+    if (curRulesets)
+        virHashRemoveEntry(curRulesets, ifname);
+    virMutexUnlock(&rulesetLock);
+}
+
+
+static bool
+ebiptablesArgsEqual(char **a,
+                    char **b)
+{
+    size_t i;
+
+    for (i = 0; a[i] && b[i]; i++) {
+        if (STRNEQ(a[i], b[i]))
+            return false;
+    }
+    return !a[i] && !b[i];
+}
+
+
+static bool
+ebiptablesRuleLineEqual(ebiptablesRuleLinePtr a,
+                        ebiptablesRuleLinePtr b)
+{
+    return a->layer == b->layer &&
+        STREQ(a->chain, b->chain) &&
+        ebiptablesArgsEqual(a->prefix, b->prefix) &&
+        ebiptablesArgsEqual(a->spec, b->spec);
+}
+
+
+static void
+ebiptablesRuleLineToFW(virFirewallPtr fw,
+                       ebiptablesRuleLinePtr line,
+                       const char *command,
+                       size_t pos,
+                       bool withSpec)
+{
+    virFirewallRulePtr fwrule = virFirewallAddRule(fw, line->layer, NULL);
+
+    virFirewallRuleAddArgSet(fw, fwrule, (const char *const *)line->prefix);
+    virFirewallRuleAddArgList(fw, fwrule, command, line->chain, NULL);
+    if (pos)
+        virFirewallRuleAddArgFormat(fw, fwrule, "%zu", pos);
+    if (withSpec)
+        virFirewallRuleAddArgSet(fw, fwrule, (const char *const *)line->spec);
+}
+
+
+/*
+ * Add the commands turning the rules @cur of a chain into @next to @fw,
+ * keeping the longest common subsequence of both in place. Returns 1
+ * if the rules differ too much to do so, 0 on success, -1 on error.
+ */
+static int
+ebiptablesDiffChainFW(virFirewallPtr fw,
+                      ebiptablesRuleLinePtr *cur,
+                      size_t ncur,
+                      ebiptablesRuleLinePtr *next,
+                      size_t nnext,
+                      size_t *nchanges)
+{
+    VIR_AUTOFREE(size_t *) lcs = NULL;
+    VIR_AUTOFREE(bool *) keepCur = NULL;
+    VIR_AUTOFREE(bool *) keepNext = NULL;
+    size_t pre = 0;
+    size_t post = 0;
+    size_t m, n, i, j;
+    size_t len;
+
+    while (pre < ncur && pre < nnext &&
+           ebiptablesRuleLineEqual(cur[pre], next[pre]))
+        pre++;
+    while (post < ncur - pre && post < nnext - pre &&
+           ebiptablesRuleLineEqual(cur[ncur - 1 - post],
+                                   next[nnext - 1 - post]))
+        post++;
+
+    m = ncur - pre - post;
+    n = nnext - pre - post;
+    if (m == 0 && n == 0)
+        return 0;
+
+    if ((m + 1) * (n + 1) > EBIPTABLES_DIFF_MAX)
+        return 1;
+
+#define LCS(i, j) lcs[(i) * (n + 1) + (j)]
+
+    if (VIR_ALLOC_N(lcs, (m + 1) * (n + 1)) < 0 ||
+        VIR_ALLOC_N(keepCur, m + 1) < 0 ||
+        VIR_ALLOC_N(keepNext, n + 1) < 0)
+        return -1;
+
+    /* LCS(i, j) is the length of the longest common subsequence of the
+     * rules from i on in @cur and from j on in @next */
+    for (i = m; i-- > 0;) {
+        for (j = n; j-- > 0;) {
+            if (ebiptablesRuleLineEqual(cur[pre + i], next[pre + j]))
+                LCS(i, j) = LCS(i + 1, j + 1) + 1;
+            else
+                LCS(i, j) = MAX(LCS(i + 1, j), LCS(i, j + 1));
+        }
+    }
+
+    for (i = 0, j = 0; i < m && j < n;) {
+        if (ebiptablesRuleLineEqual(cur[pre + i], next[pre + j])) {
+            keepCur[i++] = true;
+            keepNext[j++] = true;
+        } else if (LCS(i + 1, j) >= LCS(i, j + 1)) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+
+#undef LCS
+
+    /* delete from the end so the positions of the others don't change */
+    len = ncur;
+    for (i = m; i-- > 0;) {
+        if (keepCur[i])
+            continue;
+        ebiptablesRuleLineToFW(fw, cur[pre + i], "-D", pre + i + 1, false);
+        (*nchanges)++;
+        len--;
+    }
+
+    /* every rule before the inserted one is in place already */
+    for (j = 0; j < n; j++) {
+        if (keepNext[j])
+            continue;
+        if (pre + j + 1 > len)
+            ebiptablesRuleLineToFW(fw, next[pre + j], "-A", 0, true);
+        else
+            ebiptablesRuleLineToFW(fw, next[pre + j], "-I", pre + j + 1, true);
+        (*nchanges)++;
+        len++;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Add the commands turning the rules @cur of the chains of an interface
+ * into @next to @fw, one chain at a time.
+ */
+static int
+ebiptablesRuleSetDiffFW(virFirewallPtr fw,
+                        ebiptablesRuleSetPtr cur,
+                        ebiptablesRuleSetPtr next,
+                        size_t *nchanges)
+{
+    VIR_AUTOFREE(ebiptablesRuleLinePtr *) curLines = NULL;
+    VIR_AUTOFREE(ebiptablesRuleLinePtr *) nextLines = NULL;
+    VIR_AUTOFREE(ebiptablesRuleLinePtr *) chains = NULL;
+    size_t nchains = 0;
+    size_t i, j;
+    int rc;
+
+    if (VIR_ALLOC_N(curLines, cur->nlines + 1) < 0 ||
+        VIR_ALLOC_N(nextLines, next->nlines + 1) < 0 ||
+        VIR_ALLOC_N(chains, cur->nlines + next->nlines + 1) < 0)
+        return -1;
+
+    /* the chains are identified by the first rule found in them */
+    for (i = 0; i < cur->nlines + next->nlines; i++) {
+        ebiptablesRuleLinePtr line = i < cur->nlines ? &cur->lines[i]
+                                     : &next->lines[i - cur->nlines];
+
+        for (j = 0; j < nchains; j++) {
+            if (chains[j]->layer == line->layer &&
+                STREQ(chains[j]->chain, line->chain))
+                break;
+        }
+        if (j == nchains)
+            chains[nchains++] = line;
+    }
+
+    for (i = 0; i < nchains; i++) {
+        size_t ncurLines = 0;
+        size_t nnextLines = 0;
+
+        for (j = 0; j < cur->nlines; j++) {
+            if (cur->lines[j].layer == chains[i]->layer &&
+                STREQ(cur->lines[j].chain, chains[i]->chain))
+                curLines[ncurLines++] = &cur->lines[j];
+        }
+        for (j = 0; j < next->nlines; j++) {
+            if (next->lines[j].layer == chains[i]->layer &&
+                STREQ(next->lines[j].chain, chains[i]->chain))
+                nextLines[nnextLines++] = &next->lines[j];
+        }
+
+        if ((rc = ebiptablesDiffChainFW(fw, curLines, ncurLines,
+                                        nextLines, nnextLines,
+                                        nchanges)) != 0)
+            return rc;
+    }
+
+    return 0;
+}
+
+
+static int
+ebiptablesApplyNewRules(const char *ifname,
+                        virNWFilterRuleInstPtr *rules,
+                        size_t nrules)
+{
+    virFirewallPtr fw = virFirewallNew();
+    bool haveIptables = false;
+    bool haveIp6tables = false;
+    ebiptablesRuleSetPtr ruleset = NULL;
+    int ret = -1;
+
+    /* cleanup whatever may exist */
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    ebtablesUnlinkTmpRootChainFW(fw, true, ifname);
+    ebtablesUnlinkTmpRootChainFW(fw, false, ifname);
+    ebtablesRemoveTmpSubChainsFW(fw, ifname);
+    ebtablesRemoveTmpRootChainFW(fw, true, ifname);
+    ebtablesRemoveTmpRootChainFW(fw, false, ifname);
+
+    virFirewallStartTransaction(fw, 0);
+
+    if (ebiptablesAddRulesFW(fw, ifname, rules, nrules,
+                             &haveIptables, &haveIp6tables) < 0)
+        goto cleanup;
+
+    if (!(ruleset = ebiptablesRuleSetNew(fw, ifname)))
+        goto cleanup;
+
     virFirewallStartRollback(fw, 0);
     ebtablesUnlinkTmpRootChainFW(fw, true, ifname);
     ebtablesUnlinkTmpRootChainFW(fw, false, ifname);
@@ -3595,17 +4116,85 @@ ebiptablesApplyNewRules(const char *ifname,
     if (virFirewallApply(fw) < 0)
         goto cleanup;
 
-    ret = 0;
+    ret = ebiptablesRuleSetPut(&newRulesets, ifname, ruleset);
+    ruleset = NULL;
 
  cleanup:
-    for (i = 0; i < nsubchains; i++)
-        VIR_FREE(subchains[i]);
-    VIR_FREE(subchains);
+    ebiptablesRuleSetFree(ruleset);
     virFirewallFree(fw);
-    virHashFree(chains_in_set);
-    virHashFree(chains_out_set);
+    return ret;
+}
+
 
-    VIR_FREE(errmsg);
+/*
+ * Change the rules in the chains of @ifname into @rules by deleting
+ * and inserting the rules which differ, provided the chains and the
+ * way they are linked stay the same.
+ */
+static int
+ebiptablesUpdateRules(const char *ifname,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules)
+{
+    virFirewallPtr scratch = NULL;
+    virFirewallPtr fw = NULL;
+    ebiptablesRuleSetPtr cur;
+    ebiptablesRuleSetPtr next = NULL;
+    bool haveIptables;
+    bool haveIp6tables;
+    size_t nchanges = 0;
+    int ret = -1;
+    int rc;
+
+    if (!(cur = ebiptablesRuleSetSteal(&curRulesets, ifname)))
+        return 1;
+
+    scratch = virFirewallNew();
+    virFirewallStartTransaction(scratch, 0);
+
+    if (ebiptablesAddRulesFW(scratch, ifname, rules, nrules,
+                             &haveIptables, &haveIp6tables) < 0 ||
+        !(next = ebiptablesRuleSetNew(scratch, ifname)))
+        goto cleanup;
+
+    if (STRNEQ(cur->layout, next->layout)) {
+        VIR_DEBUG("Chains of %s changed, can't update rules in place",
+                  ifname);
+        ret = 1;
+        goto cleanup;
+    }
+
+    fw = virFirewallNew();
+    virFirewallStartTransaction(fw, 0);
+
+    if ((rc = ebiptablesRuleSetDiffFW(fw, cur, next, &nchanges)) != 0) {
+        ret = rc;
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Updating %zu rules of %s in place", nchanges, ifname);
+
+    if (nchanges > 0 && virFirewallApply(fw) < 0) {
+        /* the chains are in an unknown state, have them rebuilt */
+        VIR_WARN("Failed to update rules of %s in place: %s",
+                 ifname, virGetLastErrorMessage());
+        virResetLastError();
+        ret = 1;
+        goto cleanup;
+    }
+
+    rc = ebiptablesRuleSetPut(&curRulesets, ifname, next);
+    next = NULL;
+    if (rc < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    ebiptablesRuleSetFree(cur);
+    ebiptablesRuleSetFree(next);
+    virFirewallFree(fw);
+    virFirewallFree(scratch);
     return ret;
 }
 
@@ -3633,6 +4222,8 @@ ebiptablesTearNewRules(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    ignore_value(ebiptablesRuleSetPut(&newRulesets, ifname, NULL));
+
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     ebiptablesTearNewRulesFW(fw, ifname);
@@ -3646,6 +4237,7 @@ static int
 ebiptablesTearOldRules(const char *ifname)
 {
     virFirewallPtr fw = virFirewallNew();
+    ebiptablesRuleSetPtr ruleset;
     int ret = -1;
 
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
@@ -3667,6 +4259,16 @@ ebiptablesTearOldRules(const char *ifname)
 
     ret = virFirewallApply(fw);
     virFirewallFree(fw);
+
+    /* the rules of the temporary chains are the current ones now */
+    ruleset = ebiptablesRuleSetSteal(&newRulesets, ifname);
+    if (ret < 0) {
+        ebiptablesRuleSetFree(ruleset);
+        ruleset = NULL;
+    }
+    if (ebiptablesRuleSetPut(&curRulesets, ifname, ruleset) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -3686,6 +4288,8 @@ ebiptablesAllTeardown(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    ebiptablesRuleSetsDrop(ifname);
+
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     ebiptablesTearNewRulesFW(fw, ifname);
@@ -3723,6 +4327,7 @@ virNWFilterTechDriver ebiptables_driver = {
     .tearNewRules        = ebiptablesTearNewRules,
     .tearOldRules        = ebiptablesTearOldRules,
     .allTeardown         = ebiptablesAllTeardown,
+    .updateRules         = ebiptablesUpdateRules,
 
     .canApplyBasicRules  = ebiptablesCanApplyBasicRules,
     .applyBasicRules     = ebtablesApplyBasicRules,
@@ -3837,4 +4442,11 @@ static void
 ebiptablesDriverShutdown(void)
 {
     ebiptables_driver.flags = 0;
+
+    virMutexLock(&rulesetLock);
+    virHashFree(newRulesets);
+    newRulesets = NULL;
+    virHashFree(curRulesets);
+    curRulesets = NULL;
+    virMutexUnlock(&rulesetLock);
 }
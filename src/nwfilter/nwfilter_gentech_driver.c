@@ -34,6 +34,7 @@
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_learnipaddr.h"
 #include "virnetdev.h"
+#include "virhostcpu.h"
 #include "datatypes.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
@@ -47,6 +48,9 @@ VIR_LOG_INIT("nwfilter.nwfilter_gentech_driver");
 
 #define NWFILTER_DFLT_LEARN  "any"
 
+/* Upper limit of threads applying rules while rebuilding all bindings */
+#define NWFILTER_BUILD_WORKERS_MAX 8
+
 static int _virNWFilterTeardownFilter(const char *ifname);
 
 
@@ -242,9 +246,57 @@ virNWFilterInstReset(virNWFilterInstPtr inst)
     for (i = 0; i < inst->nrules; i++)
         virNWFilterRuleInstFree(inst->rules[i]);
     VIR_FREE(inst->rules);
+    inst->nrules = 0;
+}
+
+
+/*
+ * Compare the rule instances of two instantiations of the filters of
+ * a binding. Returns true if they lead to the same firewall rules.
+ */
+static bool
+virNWFilterInstEqual(virNWFilterInstPtr a,
+                     virNWFilterInstPtr b)
+{
+    size_t i;
+
+    if (a->nrules != b->nrules)
+        return false;
+
+    for (i = 0; i < a->nrules; i++) {
+        virNWFilterRuleInstPtr ra = a->rules[i];
+        virNWFilterRuleInstPtr rb = b->rules[i];
+
+        if (ra->priority != rb->priority ||
+            ra->chainPriority != rb->chainPriority ||
+            STRNEQ_NULLABLE(ra->chainSuffix, rb->chainSuffix) ||
+            !virNWFilterHashTableEqual(ra->vars, rb->vars) ||
+            !virNWFilterRuleDefEqual(ra->def, rb->def))
+            return false;
+    }
+
+    return true;
 }
 
 
+/*
+ * Rules of one binding prepared by virNWFilterBuildAll, which are
+ * applied later on from a pool of worker threads
+ */
+typedef struct _virNWFilterBuildJob virNWFilterBuildJob;
+typedef virNWFilterBuildJob *virNWFilterBuildJobPtr;
+struct _virNWFilterBuildJob {
+    virNWFilterBindingObjPtr binding;
+    virNWFilterTechDriverPtr techdriver; /* NULL if nothing to apply */
+    int ifindex;
+    virNWFilterRuleInstPtr *rules;
+    size_t nrules;
+    bool skip; /* rules of the binding are not affected by the update */
+    int ret;
+    virErrorPtr err;
+};
+
+
 
 static int
 virNWFilterDefToInst(virNWFilterDriverStatePtr driver,
@@ -492,6 +544,50 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
 }
 
 
+/*
+ * Apply the instantiated @rules to the interface of @binding. With
+ * @update and @teardownOld the technology driver may change the rules
+ * already applied in place instead of building a new set of them.
+ *
+ * Call this function while holding the NWFilter filter update lock
+ */
+static int
+virNWFilterApplyRules(virNWFilterTechDriverPtr techdriver,
+                      virNWFilterBindingDefPtr binding,
+                      int ifindex,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules,
+                      bool teardownOld,
+                      bool update)
+{
+    int rc = 1;
+
+    if (virNWFilterLockIface(binding->portdevname) < 0)
+        return -1;
+
+    if (update && teardownOld && techdriver->updateRules)
+        rc = techdriver->updateRules(binding->portdevname, rules, nrules);
+
+    if (rc > 0) {
+        rc = techdriver->applyNewRules(binding->portdevname, rules, nrules);
+
+        if (teardownOld && rc == 0)
+            techdriver->tearOldRules(binding->portdevname);
+    }
+
+    if (rc == 0 && (virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0)) {
+        virResetLastError();
+        /* interface changed/disappeared */
+        techdriver->allTeardown(binding->portdevname);
+        rc = -1;
+    }
+
+    virNWFilterUnlockIface(binding->portdevname);
+
+    return rc;
+}
+
+
 /**
  * virNWFilterDoInstantiate:
  * @techdriver: The driver to use for instantiation
@@ -499,6 +595,10 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
  * @filter: The filter to instantiate
  * @forceWithPendingReq: Ignore the check whether a pending learn request
  *  is active; 'true' only when the rules are applied late
+ * @curFilter: The filter as it is currently instantiated; with
+ *  INSTANTIATE_FOLLOW_NEWFILTER the rules are not applied again if they
+ *  turn out to be the same as the ones of @curFilter
+ * @job: If not NULL, the rules are stored in @job instead of being applied
  *
  * Returns 0 on success, a value otherwise.
  *
@@ -518,10 +618,14 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
                          bool *foundNewFilter,
                          bool teardownOld,
                          virNWFilterDriverStatePtr driver,
-                         bool forceWithPendingReq)
+                         bool forceWithPendingReq,
+                         virNWFilterDefPtr curFilter,
+                         virNWFilterBuildJobPtr job)
 {
     int rc;
     virNWFilterInst inst;
+    virNWFilterInst curInst;
+    bool curFoundNewFilter = false;
     bool instantiate = true;
     char *buf;
     virNWFilterVarValuePtr lv;
@@ -531,6 +635,7 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     virHashTablePtr missing_vars = virNWFilterHashTableCreate(0);
 
     memset(&inst, 0, sizeof(inst));
+    memset(&curInst, 0, sizeof(curInst));
 
     if (!missing_vars) {
         rc = -1;
@@ -605,6 +710,25 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     switch (useNewFilter) {
     case INSTANTIATE_FOLLOW_NEWFILTER:
         instantiate = *foundNewFilter;
+
+        /* a filter of the tree changed, but maybe not in a way
+         * which affects the rules of this binding */
+        if (instantiate && curFilter) {
+            rc = virNWFilterDefToInst(driver,
+                                      curFilter,
+                                      binding->filterparams,
+                                      INSTANTIATE_ALWAYS, &curFoundNewFilter,
+                                      &curInst);
+            if (rc < 0)
+                goto err_exit;
+
+            if (virNWFilterInstEqual(&inst, &curInst)) {
+                VIR_DEBUG("Rules for portdev=%s are unchanged",
+                          binding->portdevname);
+                *foundNewFilter = false;
+                instantiate = false;
+            }
+        }
         break;
     case INSTANTIATE_ALWAYS:
         instantiate = true;
@@ -612,25 +736,21 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     }
 
     if (instantiate) {
-        if (virNWFilterLockIface(binding->portdevname) < 0)
-            goto err_exit;
-
-        rc = techdriver->applyNewRules(binding->portdevname, inst.rules, inst.nrules);
-
-        if (teardownOld && rc == 0)
-            techdriver->tearOldRules(binding->portdevname);
-
-        if (rc == 0 && (virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0)) {
-            virResetLastError();
-            /* interface changed/disappeared */
-            techdriver->allTeardown(binding->portdevname);
-            rc = -1;
+        if (job) {
+            job->techdriver = techdriver;
+            job->ifindex = ifindex;
+            VIR_STEAL_PTR(job->rules, inst.rules);
+            job->nrules = inst.nrules;
+            inst.nrules = 0;
+        } else {
+            rc = virNWFilterApplyRules(techdriver, binding, ifindex,
+                                       inst.rules, inst.nrules,
+                                       teardownOld, forceWithPendingReq);
         }
-
-        virNWFilterUnlockIface(binding->portdevname);
     }
 
  err_exit:
+    virNWFilterInstReset(&curInst);
     virNWFilterInstReset(&inst);
     virHashFree(missing_vars);
 
@@ -683,7 +803,8 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
                                    int ifindex,
                                    enum instCase useNewFilter,
                                    bool forceWithPendingReq,
-                                   bool *foundNewFilter)
+                                   bool *foundNewFilter,
+                                   virNWFilterBuildJobPtr job)
 {
     int rc = -1;
     const char *drvname = EBIPTABLES_DRIVER_ID;
@@ -742,7 +863,8 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterDoInstantiate(techdriver, binding, filter,
                                   ifindex, useNewFilter, foundNewFilter,
                                   teardownOld, driver,
-                                  forceWithPendingReq);
+                                  forceWithPendingReq,
+                                  virNWFilterObjGetDef(obj), job);
 
  err_exit:
     virNWFilterObjUnlock(obj);
@@ -779,7 +901,7 @@ virNWFilterInstantiateFilterInternal(virNWFilterDriverStatePtr driver,
                                             binding,
                                             ifindex,
                                             useNewFilter,
-                                            false, foundNewFilter);
+                                            false, foundNewFilter, NULL);
 
  cleanup:
     virMutexUnlock(&updateMutex);
@@ -802,7 +924,7 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
     rc = virNWFilterInstantiateFilterUpdate(driver, true,
                                             binding, ifindex,
                                             INSTANTIATE_ALWAYS, true,
-                                            &foundNewFilter);
+                                            &foundNewFilter, NULL);
     if (rc < 0) {
         /* something went wrong... 'DOWN' the interface */
         if ((virNetDevValidateConfig(binding->portdevname, NULL, ifindex) <= 0) ||
@@ -833,22 +955,6 @@ virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
 }
 
 
-int
-virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
-                                   virNWFilterBindingDefPtr binding,
-                                   bool *skipIface)
-{
-    bool foundNewFilter = false;
-
-    int rc = virNWFilterInstantiateFilterInternal(driver, binding,
-                                                  0,
-                                                  INSTANTIATE_FOLLOW_NEWFILTER,
-                                                  &foundNewFilter);
-
-    *skipIface = !foundNewFilter;
-    return rc;
-}
-
 static int
 virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 {
@@ -950,65 +1056,194 @@ enum {
     STEP_APPLY_CURRENT,
 };
 
+
+struct virNWFilterBuildData {
+    virNWFilterDriverStatePtr driver;
+    virMutex lock;
+    virNWFilterBuildJobPtr jobs;
+    size_t njobs;
+    size_t next;
+    int step;
+};
+
+
+static void
+virNWFilterBuildJobClear(virNWFilterBuildJobPtr job)
+{
+    size_t i;
+
+    for (i = 0; i < job->nrules; i++)
+        virNWFilterRuleInstFree(job->rules[i]);
+    VIR_FREE(job->rules);
+    job->nrules = 0;
+    job->techdriver = NULL;
+    virFreeError(job->err);
+    job->err = NULL;
+    job->ret = 0;
+}
+
+
 static int
-virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
-                    virNWFilterBindingDefPtr binding,
-                    virHashTablePtr skipInterfaces,
-                    int step)
+virNWFilterBuildCollectIter(virNWFilterBindingObjPtr binding, void *opaque)
 {
-    bool skipIface;
-    int ret = 0;
-    VIR_DEBUG("Building filter for portdev=%s step=%d", binding->portdevname, step);
-
-    switch (step) {
-    case STEP_APPLY_NEW:
-        ret = virNWFilterUpdateInstantiateFilter(driver,
-                                                 binding,
-                                                 &skipIface);
-        if (ret == 0 && skipIface) {
-            /* filter tree unchanged -- no update needed */
-            ret = virHashAddEntry(skipInterfaces,
-                                  binding->portdevname,
-                                  (void *)~0);
-        }
-        break;
+    struct virNWFilterBuildData *data = opaque;
+    virNWFilterBuildJob job = { .binding = virObjectRef(binding) };
 
-    case STEP_ROLLBACK:
-        if (!virHashLookup(skipInterfaces, binding->portdevname))
-            ret = virNWFilterRollbackUpdateFilter(binding);
-        break;
+    if (VIR_APPEND_ELEMENT(data->jobs, data->njobs, job) < 0) {
+        virObjectUnref(binding);
+        return -1;
+    }
 
-    case STEP_SWITCH:
-        if (!virHashLookup(skipInterfaces, binding->portdevname))
-            ret = virNWFilterTearOldFilter(binding);
-        break;
+    return 0;
+}
 
-    case STEP_APPLY_CURRENT:
-        ret = virNWFilterInstantiateFilter(driver,
-                                           binding);
-        break;
+
+/*
+ * Instantiate the filters of a binding, leaving the resulting rules
+ * in @job for the worker threads to apply.
+ *
+ * Call this function while holding the NWFilter filter update lock
+ */
+static int
+virNWFilterBuildPrepare(virNWFilterDriverStatePtr driver,
+                        virNWFilterBuildJobPtr job,
+                        enum instCase useNewFilter)
+{
+    virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(job->binding);
+    bool foundNewFilter = false;
+    int rc;
+
+    VIR_DEBUG("Preparing filter for portdev=%s", def->portdevname);
+
+    /* interfaces / VMs can disappear during filter instantiation;
+       don't mark it as an error */
+    if (virNetDevExists(def->portdevname) != 1 ||
+        virNetDevGetIndex(def->portdevname, &job->ifindex) < 0) {
+        virResetLastError();
+        job->skip = true;
+        return 0;
     }
 
-    return ret;
+    rc = virNWFilterInstantiateFilterUpdate(driver,
+                                            useNewFilter == INSTANTIATE_ALWAYS,
+                                            def, job->ifindex,
+                                            useNewFilter,
+                                            false, &foundNewFilter, job);
+
+    /* filter tree or its rules unchanged -- no update needed */
+    if (rc == 0 && !foundNewFilter)
+        job->skip = true;
+
+    return rc;
 }
 
 
-struct virNWFilterBuildData {
-    virNWFilterDriverStatePtr driver;
-    virHashTablePtr skipInterfaces;
-    int step;
-};
+static void
+virNWFilterBuildWorker(void *opaque)
+{
+    struct virNWFilterBuildData *data = opaque;
+    virNWFilterBuildJobPtr job;
+    virNWFilterBindingDefPtr def;
+    size_t i;
+
+    while (true) {
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->njobs)
+            break;
+
+        job = &data->jobs[i];
+        def = virNWFilterBindingObjGetDef(job->binding);
+
+        VIR_DEBUG("Building filter for portdev=%s step=%d",
+                  def->portdevname, data->step);
+
+        switch (data->step) {
+        case STEP_APPLY_NEW:
+        case STEP_APPLY_CURRENT:
+            if (job->techdriver)
+                job->ret = virNWFilterApplyRules(job->techdriver, def,
+                                                 job->ifindex,
+                                                 job->rules, job->nrules,
+                                                 data->step == STEP_APPLY_CURRENT,
+                                                 false);
+            break;
+
+        case STEP_ROLLBACK:
+            if (!job->skip)
+                job->ret = virNWFilterRollbackUpdateFilter(def);
+            break;
+
+        case STEP_SWITCH:
+            if (!job->skip)
+                job->ret = virNWFilterTearOldFilter(def);
+            break;
+        }
+
+        if (job->ret < 0 && !job->err) {
+            job->err = virSaveLastError();
+            virResetLastError();
+        }
+    }
+}
 
+
+/*
+ * Run @step for all bindings using up to @nworkers threads in parallel.
+ * The rules of different bindings are independent of each other, and
+ * each of them is applied while holding its interface lock. Returns -1
+ * and reports the first error found if any binding failed so far.
+ */
 static int
-virNWFilterBuildIter(virNWFilterBindingObjPtr binding, void *opaque)
+virNWFilterBuildRun(struct virNWFilterBuildData *data,
+                    int step,
+                    size_t nworkers)
 {
-    struct virNWFilterBuildData *data = opaque;
-    virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(binding);
+    virThreadPtr workers = NULL;
+    size_t nworkersStarted = 0;
+    size_t i;
+    int ret = 0;
+
+    data->step = step;
+    data->next = 0;
+
+    nworkers = MAX(1, MIN(nworkers, data->njobs));
+    if (VIR_ALLOC_N(workers, nworkers - 1) < 0)
+        return -1;
+
+    /* The calling thread works too, so one thread less is needed */
+    for (i = 0; i < nworkers - 1; i++) {
+        if (virThreadCreate(&workers[i], true,
+                            virNWFilterBuildWorker, data) < 0) {
+            VIR_WARN("Failed to start filter build worker");
+            break;
+        }
+        nworkersStarted++;
+    }
+
+    virNWFilterBuildWorker(data);
+
+    for (i = 0; i < nworkersStarted; i++)
+        virThreadJoin(&workers[i]);
+
+    for (i = 0; i < data->njobs; i++) {
+        virNWFilterBuildJobPtr job = &data->jobs[i];
+
+        if (job->ret < 0) {
+            if (ret == 0 && job->err)
+                virSetError(job->err);
+            ret = -1;
+        }
+        virNWFilterBuildJobClear(job);
+    }
 
-    return virNWFilterBuildOne(data->driver, def,
-                               data->skipInterfaces, data->step);
+    VIR_FREE(workers);
+    return ret;
 }
 
+
 int
 virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
                     bool newFilters)
@@ -1016,39 +1251,76 @@ virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
     struct virNWFilterBuildData data = {
         .driver = driver,
     };
+    enum instCase useNewFilter = INSTANTIATE_ALWAYS;
+    size_t nworkers = NWFILTER_BUILD_WORKERS_MAX;
+    int ncpus;
+    size_t i;
     int ret = 0;
 
     VIR_DEBUG("Build all filters newFilters=%d", newFilters);
 
-    if (newFilters) {
-        if (!(data.skipInterfaces = virHashCreate(0, NULL)))
-            return -1;
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
 
-        data.step = STEP_APPLY_NEW;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
+    if ((ncpus = virHostCPUGetCount()) > 0)
+        nworkers = MIN(ncpus, NWFILTER_BUILD_WORKERS_MAX);
+    else
+        virResetLastError();
+
+    if (newFilters)
+        useNewFilter = INSTANTIATE_FOLLOW_NEWFILTER;
+
+    /* Rules are instantiated one binding after another as doing so
+     * locks the filter objects, only applying them to the interfaces
+     * is spread over the worker threads. Keep holding the lock until
+     * all of them are done so that bindings created or torn down
+     * meanwhile wait for the rebuild to finish. */
+    virMutexLock(&updateMutex);
+
+    if (virNWFilterBindingObjListForEach(driver->bindings,
+                                         virNWFilterBuildCollectIter,
+                                         &data) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < data.njobs; i++) {
+        virNWFilterBuildJobPtr job = &data.jobs[i];
+
+        if (virNWFilterBuildPrepare(driver, job, useNewFilter) < 0) {
+            job->ret = -1;
+            job->err = virSaveLastError();
+            virResetLastError();
+        }
+    }
+
+    if (newFilters) {
+        if (virNWFilterBuildRun(&data, STEP_APPLY_NEW, nworkers) < 0)
             ret = -1;
 
         if (ret == -1) {
-            data.step = STEP_ROLLBACK;
-            virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data);
-        } else  {
-            data.step = STEP_SWITCH;
-            virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data);
-        }
+            VIR_AUTOPTR(virError) saved_error = virSaveLastError();
 
-        virHashFree(data.skipInterfaces);
+            ignore_value(virNWFilterBuildRun(&data, STEP_ROLLBACK, nworkers));
+            virSetError(saved_error);
+        } else {
+            ignore_value(virNWFilterBuildRun(&data, STEP_SWITCH, nworkers));
+        }
     } else {
-        data.step = STEP_APPLY_CURRENT;
-        if (virNWFilterBindingObjListForEach(driver->bindings,
-                                             virNWFilterBuildIter,
-                                             &data) < 0)
+        if (virNWFilterBuildRun(&data, STEP_APPLY_CURRENT, nworkers) < 0)
             ret = -1;
     }
+
+ cleanup:
+    virMutexUnlock(&updateMutex);
+
+    for (i = 0; i < data.njobs; i++) {
+        virNWFilterBuildJobClear(&data.jobs[i]);
+        virObjectUnref(data.jobs[i].binding);
+    }
+    VIR_FREE(data.jobs);
+    virMutexDestroy(&data.lock);
     return ret;
 }
@@ -39,9 +39,6 @@ enum instCase {
 
 int virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                  virNWFilterBindingDefPtr binding);
-int virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
-                                       virNWFilterBindingDefPtr binding,
-                                       bool *skipIface);
 
 int virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
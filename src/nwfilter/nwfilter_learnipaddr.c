@@ -23,13 +23,8 @@
 
 #include <config.h>
 
-#ifdef HAVE_LIBPCAP
-# include <pcap.h>
-#endif
-
 #include <fcntl.h>
 #include <sys/ioctl.h>
-#include <poll.h>
 
 #include <arpa/inet.h>
 #include <net/ethernet.h>
@@ -47,10 +42,13 @@
 #include "virnetdev.h"
 #include "virerror.h"
 #include "virthread.h"
+#include "virthreadpool.h"
+#include "viratomic.h"
 #include "conf/nwfilter_params.h"
 #include "conf/domain_conf.h"
 #include "nwfilter_gentech_driver.h"
 #include "nwfilter_ebiptables_driver.h"
+#include "nwfilter_capture.h"
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_learnipaddr.h"
 #include "virstring.h"
@@ -65,6 +63,9 @@ VIR_LOG_INIT("nwfilter.nwfilter_learnipaddr");
 
 #define PKT_TIMEOUT_MS 500 /* ms */
 
+/* threads instantiating the filters once the IP address was learned */
+#define LEARN_WORKERS_MAX 4
+
 /* structure of an ARP request/reply message */
 struct f_arphdr {
     struct arphdr arphdr;
@@ -141,12 +142,23 @@ struct _virNWFilterIPAddrLearnReq {
     virNWFilterDriverStatePtr driver;
     int howDetect; /* bitmask of enum howDetect */
 
+    virNWFilterCapturePtr capture;
+    int finished; /* the capture ended; only ever set once */
+    uint32_t vmaddr;
     int status;
-    volatile bool terminate;
+    bool showError;
 };
 
 
 static bool threadsTerminate;
+static virThreadPoolPtr learnWorkers;
+
+#ifdef HAVE_LIBPCAP
+static void learnIPAddressFinish(virNWFilterIPAddrLearnReqPtr req,
+                                 int status,
+                                 bool showError,
+                                 uint32_t vmaddr);
+#endif
 
 
 int
@@ -262,7 +274,7 @@ virNWFilterTerminateLearnReq(const char *ifname)
     virNWFilterIPAddrLearnReqPtr req;
 
     /* It's possible that it's already been removed as a result of
-     * virNWFilterDeregisterLearnReq during learnIPAddressThread() exit
+     * virNWFilterDeregisterLearnReq during learnIPAddressDone()
      */
     if (virNetDevExists(ifname) != 1) {
         virResetLastError();
@@ -281,7 +293,9 @@ virNWFilterTerminateLearnReq(const char *ifname)
     req = virHashLookup(pendingLearnReq, ifindex_str);
     if (req) {
         rc = 0;
-        req->terminate = true;
+#ifdef HAVE_LIBPCAP
+        learnIPAddressFinish(req, ECANCELED, false, 0);
+#endif
     }
 
     virMutexUnlock(&pendingLearnReqLock);
@@ -372,9 +386,199 @@ procDHCPOpts(struct dhcp *dhcp, int dhcp_opts_len,
 }
 
 
+/*
+ * Look for the IP address used by the VM in @packet, according to the
+ * methods in req->howDetect. Returns the address or 0.
+ */
+static uint32_t
+learnIPAddressParse(virNWFilterIPAddrLearnReqPtr req,
+                    const unsigned char *packet,
+                    size_t len)
+{
+    struct ether_header *ether_hdr;
+    struct ether_vlan_header *vlan_hdr;
+    uint32_t vmaddr = 0, bcastaddr = 0;
+    unsigned int ethHdrSize;
+    int dhcp_opts_len;
+    uint16_t etherType;
+    enum howDetect howDetected = 0;
+
+    if (len < sizeof(struct ether_header))
+        return 0;
+
+    ether_hdr = (struct ether_header*)packet;
+
+    switch (ntohs(ether_hdr->ether_type)) {
+
+    case ETHERTYPE_IP:
+        ethHdrSize = sizeof(struct ether_header);
+        etherType = ntohs(ether_hdr->ether_type);
+        break;
+
+    case ETHERTYPE_VLAN:
+        ethHdrSize = sizeof(struct ether_vlan_header);
+        vlan_hdr = (struct ether_vlan_header *)packet;
+        if (ntohs(vlan_hdr->ether_type) != ETHERTYPE_IP ||
+            len < ethHdrSize)
+            return 0;
+        etherType = ntohs(vlan_hdr->ether_type);
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (virMacAddrCmpRaw(&req->binding->mac, ether_hdr->ether_shost) == 0) {
+        /* packets from the VM */
+
+        if (etherType == ETHERTYPE_IP &&
+            (len >= ethHdrSize +
+                    sizeof(struct iphdr))) {
+            VIR_WARNINGS_NO_CAST_ALIGN
+            struct iphdr *iphdr = (struct iphdr*)(packet +
+                                                  ethHdrSize);
+            VIR_WARNINGS_RESET
+            vmaddr = iphdr->saddr;
+            /* skip mcast addresses (224.0.0.0 - 239.255.255.255),
+             * class E (240.0.0.0 - 255.255.255.255, includes eth.
+             * bcast) and zero address in DHCP Requests */
+            if ((ntohl(vmaddr) & 0xe0000000) == 0xe0000000 ||
+                vmaddr == 0)
+                return 0;
+
+            howDetected = DETECT_STATIC;
+        } else if (etherType == ETHERTYPE_ARP &&
+                   (len >= ethHdrSize +
+                           sizeof(struct f_arphdr))) {
+            VIR_WARNINGS_NO_CAST_ALIGN
+            struct f_arphdr *arphdr = (struct f_arphdr*)(packet +
+                                                 ethHdrSize);
+            VIR_WARNINGS_RESET
+            switch (ntohs(arphdr->arphdr.ar_op)) {
+            case ARPOP_REPLY:
+                vmaddr = arphdr->ar_sip;
+                howDetected = DETECT_STATIC;
+            break;
+            case ARPOP_REQUEST:
+                vmaddr = arphdr->ar_tip;
+                howDetected = DETECT_STATIC;
+            break;
+            }
+        }
+    } else if (virMacAddrCmpRaw(&req->binding->mac,
+                                ether_hdr->ether_dhost) == 0 ||
+               /* allow Broadcast replies from DHCP server */
+               virMacAddrIsBroadcastRaw(ether_hdr->ether_dhost)) {
+        /* packets to the VM */
+        if (etherType == ETHERTYPE_IP &&
+            (len >= ethHdrSize +
+                    sizeof(struct iphdr))) {
+            VIR_WARNINGS_NO_CAST_ALIGN
+            struct iphdr *iphdr = (struct iphdr*)(packet +
+                                                  ethHdrSize);
+            VIR_WARNINGS_RESET
+            if ((iphdr->protocol == IPPROTO_UDP) &&
+                (len >= ethHdrSize +
+                        iphdr->ihl * 4 +
+                        sizeof(struct udphdr))) {
+                VIR_WARNINGS_NO_CAST_ALIGN
+                struct udphdr *udphdr = (struct udphdr *)
+                                  ((char *)iphdr + iphdr->ihl * 4);
+                VIR_WARNINGS_RESET
+                if (ntohs(udphdr->source) == 67 &&
+                    ntohs(udphdr->dest)   == 68 &&
+                    len >= ethHdrSize +
+                           iphdr->ihl * 4 +
+                           sizeof(struct udphdr) +
+                           sizeof(struct dhcp)) {
+                    struct dhcp *dhcp = (struct dhcp *)
+                                ((char *)udphdr + sizeof(udphdr));
+                    if (dhcp->op == 2 /* BOOTREPLY */ &&
+                        virMacAddrCmpRaw(
+                                &req->binding->mac,
+                                &dhcp->chaddr[0]) == 0) {
+                        dhcp_opts_len = len -
+                            (ethHdrSize + iphdr->ihl * 4 +
+                             sizeof(struct udphdr) +
+                             sizeof(struct dhcp));
+                        procDHCPOpts(dhcp, dhcp_opts_len,
+                                     &vmaddr,
+                                     &bcastaddr,
+                                     &howDetected);
+                    }
+                }
+            }
+        }
+    }
+
+    if (vmaddr && (req->howDetect & howDetected) == 0)
+        return 0;
+
+    return vmaddr;
+}
+
+
+/*
+ * End learning the IP address on the interface of @req with @status
+ * and have a worker apply the rules according to the outcome. Only the
+ * first call has an effect.
+ */
+static void
+learnIPAddressFinish(virNWFilterIPAddrLearnReqPtr req,
+                     int status,
+                     bool showError,
+                     uint32_t vmaddr)
+{
+    if (!virAtomicIntCompareExchange(&req->finished, 0, 1))
+        return;
+
+    req->status = status;
+    req->showError = showError;
+    req->vmaddr = vmaddr;
+
+    if (virThreadPoolSendJob(learnWorkers, 0, req) < 0)
+        VIR_ERROR(_("Failed to finish learning the IP address on "
+                    "interface %s"), req->binding->portdevname);
+}
+
+
+static int
+learnIPAddressPacket(const unsigned char *packet,
+                     size_t len,
+                     bool fromVM ATTRIBUTE_UNUSED,
+                     void *opaque)
+{
+    virNWFilterIPAddrLearnReqPtr req = opaque;
+    uint32_t vmaddr;
+
+    if (!(vmaddr = learnIPAddressParse(req, packet, len)))
+        return 0;
+
+    learnIPAddressFinish(req, 0, false, vmaddr);
+    return -1;
+}
+
+
+static void
+learnIPAddressError(int err,
+                    void *opaque)
+{
+    virNWFilterIPAddrLearnReqPtr req = opaque;
+
+    VIR_DEBUG("Error from FD probably dev deleted");
+    learnIPAddressFinish(req, err, err != ENODEV, 0);
+}
+
+
+static virNWFilterCaptureCallbacks learnIPAddressCallbacks = {
+    .packet = learnIPAddressPacket,
+    .error = learnIPAddressError,
+};
+
+
 /**
- * learnIPAddressThread
- * arg: pointer to virNWFilterIPAddrLearnReq structure
+ * learnIPAddressStart
+ * @req: the IP address learning request
  *
  * Learn the IP address being used on an interface. Use ARP Request and
  * Reply messages, DHCP offers and the first IP packet being sent from
@@ -384,56 +588,35 @@ procDHCPOpts(struct dhcp *dhcp, int dhcp_opts_len,
  * require that the IP address is detected from a DHCP OFFER, DETECT_STATIC
  * will require that the IP address was taken from an ARP packet or an IPv4
  * packet. Both flags can be set at the same time.
+ *
+ * Apply the rules letting only the packets needed for this through and
+ * start capturing them, with learnIPAddressDone run once the address
+ * was found or capturing failed.
+ *
+ * Returns 0 on success, -1 on failure with the drop-all rules applied
  */
-static void
-learnIPAddressThread(void *arg)
+static int
+learnIPAddressStart(virNWFilterIPAddrLearnReqPtr req)
 {
-    char errbuf[PCAP_ERRBUF_SIZE] = {0};
-    pcap_t *handle = NULL;
-    struct bpf_program fp;
-    struct pcap_pkthdr header;
-    const u_char *packet;
-    struct ether_header *ether_hdr;
-    struct ether_vlan_header *vlan_hdr;
-    virNWFilterIPAddrLearnReqPtr req = arg;
-    uint32_t vmaddr = 0, bcastaddr = 0;
-    unsigned int ethHdrSize;
     char *listen_if = (req->binding->linkdevname ?
                        req->binding->linkdevname :
                        req->binding->portdevname);
-    int dhcp_opts_len;
     char macaddr[VIR_MAC_STRING_BUFLEN];
     virBuffer buf = VIR_BUFFER_INITIALIZER;
-    char *filter = NULL;
-    uint16_t etherType;
-    bool showError = true;
-    enum howDetect howDetected = 0;
+    VIR_AUTOFREE(char *) filter = NULL;
     virNWFilterTechDriverPtr techdriver = req->techdriver;
-    struct pollfd fds[1];
+    int status = 0;
 
     if (virNWFilterLockIface(req->binding->portdevname) < 0)
-       goto err_no_lock;
-
-    req->status = 0;
+        return -1;
 
     /* anything change to the VM's interface -- check at least once */
     if (virNetDevValidateConfig(req->binding->portdevname, NULL, req->ifindex) <= 0) {
         virResetLastError();
-        req->status = ENODEV;
-        goto done;
+        status = ENODEV;
+        goto error;
     }
 
-    handle = pcap_open_live(listen_if, BUFSIZ, 0, PKT_TIMEOUT_MS, errbuf);
-
-    if (handle == NULL) {
-        VIR_DEBUG("Couldn't open device %s: %s", listen_if, errbuf);
-        req->status = ENODEV;
-        goto done;
-    }
-
-    fds[0].fd = pcap_fileno(handle);
-    fds[0].events = POLLIN | POLLERR;
-
     virMacAddrFormat(&req->binding->mac, macaddr);
 
     if (req->howDetect == DETECT_DHCP) {
@@ -441,210 +624,76 @@ learnIPAddressThread(void *arg)
                                            &req->binding->mac,
                                            NULL, false) < 0) {
             VIR_DEBUG("Unable to apply DHCP only rules");
-            req->status = EINVAL;
-            goto done;
+            status = EINVAL;
+            goto error;
         }
         virBufferAddLit(&buf, "src port 67 and dst port 68");
     } else {
         if (techdriver->applyBasicRules(req->binding->portdevname,
                                         &req->binding->mac) < 0) {
             VIR_DEBUG("Unable to apply basic rules");
-            req->status = EINVAL;
-            goto done;
+            status = EINVAL;
+            goto error;
         }
         virBufferAsprintf(&buf, "ether host %s or ether dst ff:ff:ff:ff:ff:ff",
                           macaddr);
     }
 
-    if (virBufferError(&buf)) {
-        req->status = ENOMEM;
-        goto done;
-    }
+    if (virBufferCheckError(&buf) < 0)
+        goto error;
 
     filter = virBufferContentAndReset(&buf);
 
-    if (pcap_compile(handle, &fp, filter, 1, 0) != 0) {
-        VIR_DEBUG("Couldn't compile filter '%s'", filter);
-        req->status = EINVAL;
-        goto done;
-    }
-
-    if (pcap_setfilter(handle, &fp) != 0) {
-        VIR_DEBUG("Couldn't set filter '%s'", filter);
-        req->status = EINVAL;
-        pcap_freecode(&fp);
-        goto done;
-    }
-
-    pcap_freecode(&fp);
-
-    while (req->status == 0 && vmaddr == 0) {
-        int n = poll(fds, ARRAY_CARDINALITY(fds), PKT_TIMEOUT_MS);
+    if (!(req->capture = virNWFilterCaptureNew(listen_if, filter, BUFSIZ,
+                                               &learnIPAddressCallbacks,
+                                               req)))
+        goto error;
 
-        if (threadsTerminate || req->terminate) {
-            req->status = ECANCELED;
-            showError = false;
-            break;
-        }
-
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EINTR)
-                continue;
-
-            req->status = errno;
-            showError = true;
-            break;
-        }
-
-        if (n == 0)
-            continue;
-
-        if (fds[0].revents & (POLLHUP | POLLERR)) {
-            VIR_DEBUG("Error from FD probably dev deleted");
-            req->status = ENODEV;
-            showError = false;
-            break;
-        }
+    virNWFilterUnlockIface(req->binding->portdevname);
 
-        packet = pcap_next(handle, &header);
-
-        if (!packet) {
-            /* Again, already handled above, but lets be sure */
-            if (virNetDevValidateConfig(req->binding->portdevname, NULL, req->ifindex) <= 0) {
-                virResetLastError();
-                req->status = ENODEV;
-                showError = false;
-                break;
-            }
-            continue;
-        }
+    return 0;
 
-        if (header.len >= sizeof(struct ether_header)) {
-            ether_hdr = (struct ether_header*)packet;
+ error:
+    if (status)
+        virReportSystemError(status,
+                             _("encountered an error on interface %s "
+                               "index %d"),
+                             req->binding->portdevname, req->ifindex);
 
-            switch (ntohs(ether_hdr->ether_type)) {
+    techdriver->applyDropAllRules(req->binding->portdevname);
+    virNWFilterUnlockIface(req->binding->portdevname);
 
-            case ETHERTYPE_IP:
-                ethHdrSize = sizeof(struct ether_header);
-                etherType = ntohs(ether_hdr->ether_type);
-                break;
+    return -1;
+}
 
-            case ETHERTYPE_VLAN:
-                ethHdrSize = sizeof(struct ether_vlan_header);
-                vlan_hdr = (struct ether_vlan_header *)packet;
-                if (ntohs(vlan_hdr->ether_type) != ETHERTYPE_IP ||
-                    header.len < ethHdrSize)
-                    continue;
-                etherType = ntohs(vlan_hdr->ether_type);
-                break;
 
-            default:
-                continue;
-            }
-
-            if (virMacAddrCmpRaw(&req->binding->mac, ether_hdr->ether_shost) == 0) {
-                /* packets from the VM */
-
-                if (etherType == ETHERTYPE_IP &&
-                    (header.len >= ethHdrSize +
-                                   sizeof(struct iphdr))) {
-                    VIR_WARNINGS_NO_CAST_ALIGN
-                    struct iphdr *iphdr = (struct iphdr*)(packet +
-                                                          ethHdrSize);
-                    VIR_WARNINGS_RESET
-                    vmaddr = iphdr->saddr;
-                    /* skip mcast addresses (224.0.0.0 - 239.255.255.255),
-                     * class E (240.0.0.0 - 255.255.255.255, includes eth.
-                     * bcast) and zero address in DHCP Requests */
-                    if ((ntohl(vmaddr) & 0xe0000000) == 0xe0000000 ||
-                        vmaddr == 0) {
-                        vmaddr = 0;
-                        continue;
-                    }
+/*
+ * Worker applying the rules once learning the IP address of an
+ * interface ended
+ */
+static void
+learnIPAddressDone(void *jobdata,
+                   void *opaque ATTRIBUTE_UNUSED)
+{
+    virNWFilterIPAddrLearnReqPtr req = jobdata;
+    virNWFilterTechDriverPtr techdriver = req->techdriver;
+    bool locked;
 
-                    howDetected = DETECT_STATIC;
-                } else if (etherType == ETHERTYPE_ARP &&
-                           (header.len >= ethHdrSize +
-                                          sizeof(struct f_arphdr))) {
-                    VIR_WARNINGS_NO_CAST_ALIGN
-                    struct f_arphdr *arphdr = (struct f_arphdr*)(packet +
-                                                         ethHdrSize);
-                    VIR_WARNINGS_RESET
-                    switch (ntohs(arphdr->arphdr.ar_op)) {
-                    case ARPOP_REPLY:
-                        vmaddr = arphdr->ar_sip;
-                        howDetected = DETECT_STATIC;
-                    break;
-                    case ARPOP_REQUEST:
-                        vmaddr = arphdr->ar_tip;
-                        howDetected = DETECT_STATIC;
-                    break;
-                    }
-                }
-            } else if (virMacAddrCmpRaw(&req->binding->mac,
-                                        ether_hdr->ether_dhost) == 0 ||
-                       /* allow Broadcast replies from DHCP server */
-                       virMacAddrIsBroadcastRaw(ether_hdr->ether_dhost)) {
-                /* packets to the VM */
-                if (etherType == ETHERTYPE_IP &&
-                    (header.len >= ethHdrSize +
-                                   sizeof(struct iphdr))) {
-                    VIR_WARNINGS_NO_CAST_ALIGN
-                    struct iphdr *iphdr = (struct iphdr*)(packet +
-                                                          ethHdrSize);
-                    VIR_WARNINGS_RESET
-                    if ((iphdr->protocol == IPPROTO_UDP) &&
-                        (header.len >= ethHdrSize +
-                                       iphdr->ihl * 4 +
-                                       sizeof(struct udphdr))) {
-                        VIR_WARNINGS_NO_CAST_ALIGN
-                        struct udphdr *udphdr = (struct udphdr *)
-                                          ((char *)iphdr + iphdr->ihl * 4);
-                        VIR_WARNINGS_RESET
-                        if (ntohs(udphdr->source) == 67 &&
-                            ntohs(udphdr->dest)   == 68 &&
-                            header.len >= ethHdrSize +
-                                          iphdr->ihl * 4 +
-                                          sizeof(struct udphdr) +
-                                          sizeof(struct dhcp)) {
-                            struct dhcp *dhcp = (struct dhcp *)
-                                        ((char *)udphdr + sizeof(udphdr));
-                            if (dhcp->op == 2 /* BOOTREPLY */ &&
-                                virMacAddrCmpRaw(
-                                        &req->binding->mac,
-                                        &dhcp->chaddr[0]) == 0) {
-                                dhcp_opts_len = header.len -
-                                    (ethHdrSize + iphdr->ihl * 4 +
-                                     sizeof(struct udphdr) +
-                                     sizeof(struct dhcp));
-                                procDHCPOpts(dhcp, dhcp_opts_len,
-                                             &vmaddr,
-                                             &bcastaddr,
-                                             &howDetected);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-        if (vmaddr && (req->howDetect & howDetected) == 0) {
-            vmaddr = 0;
-            howDetected = 0;
-        }
-    } /* while */
+    /* learnIPAddressStart may still be about to return */
+    locked = virNWFilterLockIface(req->binding->portdevname) == 0;
 
- done:
-    VIR_FREE(filter);
+    virNWFilterCaptureFree(req->capture);
+    req->capture = NULL;
 
-    if (handle)
-        pcap_close(handle);
+    if (!locked)
+        goto err_no_lock;
 
     if (req->status == 0) {
         int ret;
         virSocketAddr sa;
         sa.len = sizeof(sa.data.inet4);
         sa.data.inet4.sin_family = AF_INET;
-        sa.data.inet4.sin_addr.s_addr = vmaddr;
+        sa.data.inet4.sin_addr.s_addr = req->vmaddr;
         char *inetaddr;
 
         /* It is necessary to unlock interface here to avoid updateMutex and
@@ -671,7 +720,7 @@ learnIPAddressThread(void *arg)
             VIR_FREE(inetaddr);
         }
     } else {
-        if (showError)
+        if (req->showError)
             virReportSystemError(req->status,
                                  _("encountered an error on interface %s "
                                    "index %d"),
@@ -681,8 +730,7 @@ learnIPAddressThread(void *arg)
         virNWFilterUnlockIface(req->binding->portdevname);
     }
 
-    VIR_DEBUG("pcap thread terminating for interface %s", req->binding->portdevname);
-
+    VIR_DEBUG("IP address learning ended for interface %s", req->binding->portdevname);
 
  err_no_lock:
     virNWFilterDeregisterLearnReq(req->ifindex);
@@ -715,7 +763,6 @@ virNWFilterLearnIPAddress(virNWFilterTechDriverPtr techdriver,
                           int howDetect)
 {
     int rc;
-    virThread thread;
     virNWFilterIPAddrLearnReqPtr req = NULL;
 
     if (howDetect == 0)
@@ -745,16 +792,21 @@ virNWFilterLearnIPAddress(virNWFilterTechDriverPtr techdriver,
     if (rc < 0)
         goto err_free_req;
 
-    if (virThreadCreate(&thread,
-                        false,
-                        learnIPAddressThread,
-                        req) != 0)
-        goto err_dereg_req;
+    if (learnIPAddressStart(req) < 0) {
+        /* unless virNWFilterTerminateLearnReq already handed the request
+         * over to a worker */
+        if (virAtomicIntCompareExchange(&req->finished, 0, 1)) {
+            virNWFilterDeregisterLearnReq(ifindex);
+            virNWFilterIPAddrLearnReqFree(req);
+        }
+        return -1;
+    }
+
+    if (threadsTerminate)
+        learnIPAddressFinish(req, ECANCELED, false, 0);
 
     return 0;
 
- err_dereg_req:
-    virNWFilterDeregisterLearnReq(ifindex);
  err_free_req:
     virNWFilterIPAddrLearnReqFree(req);
  err_no_req:
@@ -802,15 +854,42 @@ virNWFilterLearnInit(void)
         return -1;
     }
 
+#ifdef HAVE_LIBPCAP
+    learnWorkers = virThreadPoolNew(0, LEARN_WORKERS_MAX, 0,
+                                    learnIPAddressDone, NULL);
+    if (!learnWorkers) {
+        virNWFilterLearnShutdown();
+        return -1;
+    }
+#endif
+
     return 0;
 }
 
 
+#ifdef HAVE_LIBPCAP
+static int
+virNWFilterLearnReqCancel(void *payload,
+                          const void *name ATTRIBUTE_UNUSED,
+                          void *data ATTRIBUTE_UNUSED)
+{
+    learnIPAddressFinish(payload, ECANCELED, false, 0);
+    return 0;
+}
+#endif
+
+
 void
 virNWFilterLearnThreadsTerminate(bool allowNewThreads)
 {
     threadsTerminate = true;
 
+#ifdef HAVE_LIBPCAP
+    virMutexLock(&pendingLearnReqLock);
+    virHashForEach(pendingLearnReq, virNWFilterLearnReqCancel, NULL);
+    virMutexUnlock(&pendingLearnReqLock);
+#endif
+
     while (virHashSize(pendingLearnReq) != 0)
         usleep((PKT_TIMEOUT_MS * 1000) / 3);
 
@@ -830,6 +909,9 @@ virNWFilterLearnShutdown(void)
 
     virNWFilterLearnThreadsTerminate(false);
 
+    virThreadPoolFree(learnWorkers);
+    learnWorkers = NULL;
+
     virHashFree(pendingLearnReq);
     pendingLearnReq = NULL;
 
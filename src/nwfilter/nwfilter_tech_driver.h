@@ -53,6 +53,13 @@ typedef int (*virNWFilterRuleTeardownOldRules)(const char *ifname);
 
 typedef int (*virNWFilterRuleAllTeardown)(const char *ifname);
 
+/* Change the rules currently applied to @ifname into @rules in place.
+ * Returns 1 if this can't be done and new rules must be applied
+ * instead, 0 on success, -1 on error. */
+typedef int (*virNWFilterRuleUpdateRules)(const char *ifname,
+                                          virNWFilterRuleInstPtr *rules,
+                                          size_t nrules);
+
 typedef int (*virNWFilterCanApplyBasicRules)(void);
 
 typedef int (*virNWFilterApplyBasicRules)(const char *ifname,
@@ -82,6 +89,7 @@ struct _virNWFilterTechDriver {
     virNWFilterRuleTeardownNewRules tearNewRules;
     virNWFilterRuleTeardownOldRules tearOldRules;
     virNWFilterRuleAllTeardown allTeardown;
+    virNWFilterRuleUpdateRules updateRules;
 
     virNWFilterCanApplyBasicRules canApplyBasicRules;
     virNWFilterApplyBasicRules applyBasicRules;
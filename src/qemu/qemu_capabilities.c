@@ -57,6 +57,9 @@
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
+/* Upper bound of QEMU processes started at once to probe capabilities */
+#define QEMU_CAPS_PREFETCH_WORKERS_MAX 8
+
 VIR_LOG_INIT("qemu.qemu_capabilities");
 
 /* While not public, these strings must not change. They
@@ -620,6 +623,8 @@ struct virQEMUCapsSearchData {
 
 static virClassPtr virQEMUCapsClass;
 static void virQEMUCapsDispose(void *obj);
+static int virQEMUCapsCachePrefetch(virFileCachePtr cache,
+                                    virArch hostarch);
 
 static int virQEMUCapsOnceInit(void)
 {
@@ -767,27 +772,39 @@ virQEMUCapsFindBinaryForArch(virArch hostarch,
 }
 
 static int
-virQEMUCapsInitGuest(virCapsPtr caps,
-                     virFileCachePtr cache,
-                     virArch hostarch,
-                     virArch guestarch)
+virQEMUCapsFindGuestBinary(virArch hostarch,
+                           virArch guestarch,
+                           char **binary)
 {
-    char *binary = NULL;
-    virQEMUCapsPtr qemuCaps = NULL;
-    int ret = -1;
-
     /* Check for existence of base emulator, or alternate base
      * which can be used with magic cpu choice
      */
-    binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
+    *binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
 
     /* RHEL doesn't follow the usual naming for QEMU binaries and ships
      * a single binary named qemu-kvm outside of $PATH instead */
-    if (virQEMUCapsGuestIsNative(hostarch, guestarch) && !binary) {
-        if (VIR_STRDUP(binary, "/usr/libexec/qemu-kvm") < 0)
+    if (virQEMUCapsGuestIsNative(hostarch, guestarch) && !*binary) {
+        if (VIR_STRDUP(*binary, "/usr/libexec/qemu-kvm") < 0)
             return -1;
     }
 
+    return 0;
+}
+
+
+static int
+virQEMUCapsInitGuest(virCapsPtr caps,
+                     virFileCachePtr cache,
+                     virArch hostarch,
+                     virArch guestarch)
+{
+    char *binary = NULL;
+    virQEMUCapsPtr qemuCaps = NULL;
+    int ret = -1;
+
+    if (virQEMUCapsFindGuestBinary(hostarch, guestarch, &binary) < 0)
+        return -1;
+
     /* Ignore binary if extracting version info fails */
     if (binary) {
         if (!(qemuCaps = virQEMUCapsCacheLookup(cache, binary))) {
@@ -941,6 +958,11 @@ virQEMUCapsInit(virFileCachePtr cache)
     virCapabilitiesAddHostMigrateTransport(caps, "tcp");
     virCapabilitiesAddHostMigrateTransport(caps, "rdma");
 
+    /* Probing a binary means starting QEMU and talking to it for a while,
+     * so populate the cache for all binaries in parallel first. */
+    if (virQEMUCapsCachePrefetch(cache, hostarch) < 0)
+        goto error;
+
     /* QEMU can support pretty much every arch that exists,
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
@@ -4868,6 +4890,44 @@ virQEMUCapsCacheLookup(virFileCachePtr cache,
 }
 
 
+/* Loads or probes capabilities of all QEMU binaries usable on this host
+ * at once, running up to QEMU_CAPS_PREFETCH_WORKERS_MAX probes in parallel. */
+static int
+virQEMUCapsCachePrefetch(virFileCachePtr cache,
+                         virArch hostarch)
+{
+    VIR_AUTOSTRINGLIST binaries = NULL;
+    virQEMUCapsCachePrivPtr priv = virFileCacheGetPriv(cache);
+    int ncpus;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        VIR_AUTOFREE(char *) binary = NULL;
+
+        if (virQEMUCapsFindGuestBinary(hostarch, i, &binary) < 0)
+            return -1;
+
+        if (binary &&
+            !virStringListHasString((const char **)binaries, binary) &&
+            virStringListAdd(&binaries, binary) < 0)
+            return -1;
+    }
+
+    if (!binaries)
+        return 0;
+
+    if ((ncpus = virHostCPUGetCount()) <= 0) {
+        virResetLastError();
+        ncpus = 1;
+    }
+
+    priv->microcodeVersion = virHostCPUGetMicrocodeVersion();
+
+    return virFileCachePrefetch(cache, (const char **)binaries,
+                                MIN(ncpus, QEMU_CAPS_PREFETCH_WORKERS_MAX));
+}
+
+
 virQEMUCapsPtr
 virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
                            const char *binary,
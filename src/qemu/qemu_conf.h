@@ -169,6 +169,7 @@ struct _virQEMUDriverConfig {
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
+    unsigned int reconnectWorkers;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -1339,6 +1339,7 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_TYPED_PARAMS:
     default:
         return 0;
     }
@@ -1435,6 +1436,39 @@ static char *qemuConnectGetCapabilities(virConnectPtr conn) {
 }
 
 
+static int
+qemuGetSchedstatDelay(unsigned long long *cpuDelay,
+                      pid_t pid, pid_t tid)
+{
+    char *proc = NULL;
+    FILE *fp = NULL;
+
+    *cpuDelay = 0;
+
+    if (tid) {
+        if (virAsprintf(&proc, "/proc/%d/task/%d/schedstat",
+                        (int)pid, (int)tid) < 0)
+            return -1;
+    } else {
+        if (virAsprintf(&proc, "/proc/%d/schedstat", (int)pid) < 0)
+            return -1;
+    }
+
+    /* The file is not guaranteed to exist (needs CONFIG_SCHED_INFO).
+     * The second field is the time spent runnable but waiting for a
+     * host CPU, which is the same as wait_sum in the sched file. */
+    if ((fp = fopen(proc, "r")) &&
+        fscanf(fp, "%*u %llu", cpuDelay) != 1) {
+        VIR_WARN("cannot parse scheduler statistics in '%s'", proc);
+        *cpuDelay = 0;
+    }
+
+    VIR_FORCE_FCLOSE(fp);
+    VIR_FREE(proc);
+    return 0;
+}
+
+
 static int
 qemuGetSchedInfo(unsigned long long *cpuWait,
                  pid_t pid, pid_t tid)
@@ -1460,7 +1494,7 @@ qemuGetSchedInfo(unsigned long long *cpuWait,
 
     /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
     if (access(proc, R_OK) < 0) {
-        ret = 0;
+        ret = qemuGetSchedstatDelay(cpuWait, pid, tid);
         goto cleanup;
     }
 
@@ -1501,6 +1535,14 @@ qemuGetSchedInfo(unsigned long long *cpuWait,
         }
     }
 
+    /* Without CONFIG_SCHEDSTATS, or with kernel.sched_schedstats
+     * disabled, wait_sum is missing or stays zero, but the run delay
+     * from schedstat is still available */
+    if (*cpuWait == 0) {
+        ret = qemuGetSchedstatDelay(cpuWait, pid, tid);
+        goto cleanup;
+    }
+
     ret = 0;
 
  cleanup:
@@ -1513,13 +1555,14 @@ qemuGetSchedInfo(unsigned long long *cpuWait,
 
 static int
 qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
-                   pid_t pid, int tid)
+                   char *state, pid_t pid, int tid)
 {
     char *proc;
     FILE *pidinfo;
     unsigned long long usertime = 0, systime = 0;
     long rss = 0;
     int cpu = 0;
+    char st = '?';
     int ret;
 
     /* In general, we cannot assume pid_t fits in int; but /proc parsing
@@ -1539,12 +1582,12 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
     if (!pidinfo ||
         fscanf(pidinfo,
                /* pid -> stime */
-               "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
+               "%*d (%*[^)]) %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
                /* cutime -> endcode */
                "%*d %*d %*d %*d %*d %*d %*u %*u %ld %*u %*u %*u"
                /* startstack -> processor */
                "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
-               &usertime, &systime, &rss, &cpu) != 4) {
+               &st, &usertime, &systime, &rss, &cpu) != 5) {
         VIR_WARN("cannot parse process status data");
     }
 
@@ -1562,9 +1605,11 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
     if (vm_rss)
         *vm_rss = rss * virGetSystemPageSizeKB();
 
+    if (state)
+        *state = st;
 
-    VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
-              (int)pid, tid, usertime, systime, cpu, rss);
+    VIR_DEBUG("Got status for %d/%d state=%c user=%llu sys=%llu cpu=%d rss=%ld",
+              (int)pid, tid, st, usertime, systime, cpu, rss);
 
     VIR_FORCE_FCLOSE(pidinfo);
 
@@ -1572,10 +1617,22 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
 }
 
 
+/**
+ * qemuDomainHelperGetVcpus:
+ *
+ * Fills the arrays passed in with data about online vCPUs gathered from
+ * the host kernel. Any of @info, @cpuwait, @cpuhalted and @cpumaps
+ * may be NULL if the caller is not interested in them. The
+ * halted state is sampled from the state of the vCPU thread, which is
+ * sleeping in the kernel while the guest CPU is idle.
+ *
+ * Returns the number of filled entries or -1 on error.
+ */
 static int
 qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          virVcpuInfoPtr info,
                          unsigned long long *cpuwait,
+                         bool *cpuhalted,
                          int maxinfo,
                          unsigned char *cpumaps,
                          int maplen)
@@ -1606,17 +1663,26 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
         if (!vcpu->online)
             continue;
 
-        if (info) {
+        if (info || cpuhalted) {
+            char state = '?';
+            virVcpuInfo dummy;
+
+            if (!info)
+                vcpuinfo = &dummy;
+
             vcpuinfo->number = i;
             vcpuinfo->state = VIR_VCPU_RUNNING;
 
             if (qemuGetProcessInfo(&vcpuinfo->cpuTime,
-                                   &vcpuinfo->cpu, NULL,
+                                   &vcpuinfo->cpu, NULL, &state,
                                    vm->pid, vcpupid) < 0) {
                 virReportSystemError(errno, "%s",
                                      _("cannot get vCPU placement & pCPU time"));
                 return -1;
             }
+
+            if (cpuhalted)
+                cpuhalted[ncpuinfo] = state == 'S';
         }
 
         if (cpumaps) {
@@ -2747,7 +2813,7 @@ qemuDomainGetInfo(virDomainPtr dom,
     }
 
     if (virDomainObjIsActive(vm)) {
-        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
+        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, NULL, vm->pid, 0) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                            _("cannot read cputime for domain"));
             goto cleanup;
@@ -5618,7 +5684,8 @@ qemuDomainGetVcpus(virDomainPtr dom,
         goto cleanup;
     }
 
-    ret = qemuDomainHelperGetVcpus(vm, info, NULL, maxinfo, cpumaps, maplen);
+    ret = qemuDomainHelperGetVcpus(vm, info, NULL, NULL,
+                                   maxinfo, cpumaps, maplen);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -12042,7 +12109,7 @@ qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
         ret = 0;
     }
 
-    if (qemuGetProcessInfo(NULL, NULL, &rss, vm->pid, 0) < 0) {
+    if (qemuGetProcessInfo(NULL, NULL, &rss, NULL, vm->pid, 0) < 0) {
         virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                        _("cannot get RSS for domain"));
     } else {
@@ -20763,25 +20830,25 @@ qemuConnectGetDomainCapabilities(virConnectPtr conn,
 }
 
 
+/* Data of the host sampled once for all domains of a bulk stats call */
+typedef struct _qemuDomainGetStatsHost qemuDomainGetStatsHost;
+typedef qemuDomainGetStatsHost *qemuDomainGetStatsHostPtr;
+struct _qemuDomainGetStatsHost {
+    virNetDevTapStatsSnapshotPtr netstats; /* NULL if not available */
+};
+
+
 static int
 qemuDomainGetStatsState(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                         virDomainObjPtr dom,
-                        virDomainStatsRecordPtr record,
-                        int *maxparams,
-                        unsigned int privflags ATTRIBUTE_UNUSED)
-{
-    if (virTypedParamsAddInt(&record->params,
-                             &record->nparams,
-                             maxparams,
-                             "state.state",
-                             dom->state.state) < 0)
+                        virTypedParamListPtr params,
+                        unsigned int privflags ATTRIBUTE_UNUSED,
+                        qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
+{
+    if (virTypedParamListAddInt(params, dom->state.state, "state.state") < 0)
         return -1;
 
-    if (virTypedParamsAddInt(&record->params,
-                             &record->nparams,
-                             maxparams,
-                             "state.reason",
-                             dom->state.reason) < 0)
+    if (virTypedParamListAddInt(params, dom->state.reason, "state.reason") < 0)
         return -1;
 
     return 0;
@@ -20793,6 +20860,9 @@ typedef enum {
                                             accessed */
     QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
                                             block stats */
+    QEMU_DOMAIN_STATS_HOST_ONLY = 1 << 2, /* sample guest state from the
+                                             host kernel instead of the
+                                             monitor */
 } qemuDomainStatsFlags;
 
 
@@ -20922,10 +20992,8 @@ qemuDomainGetResctrlMonData(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsCpuCache(virQEMUDriverPtr driver,
                            virDomainObjPtr dom,
-                           virDomainStatsRecordPtr record,
-                           int *maxparams)
+                           virTypedParamListPtr params)
 {
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
     virQEMUResctrlMonDataPtr *resdata = NULL;
     size_t nresdata = 0;
     size_t i = 0;
@@ -20939,49 +21007,32 @@ qemuDomainGetStatsCpuCache(virQEMUDriverPtr driver,
                                     VIR_RESCTRL_MONITOR_TYPE_CACHE) < 0)
         goto cleanup;
 
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-             "cpu.cache.monitor.count");
-    if (virTypedParamsAddUInt(&record->params, &record->nparams,
-                              maxparams, param_name, nresdata) < 0)
+    if (virTypedParamListAddUInt(params, nresdata,
+                                 "cpu.cache.monitor.count") < 0)
         goto cleanup;
 
     for (i = 0; i < nresdata; i++) {
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "cpu.cache.monitor.%zu.name", i);
-        if (virTypedParamsAddString(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    resdata[i]->name) < 0)
+        if (virTypedParamListAddString(params, resdata[i]->name,
+                                       "cpu.cache.monitor.%zu.name", i) < 0)
             goto cleanup;
 
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "cpu.cache.monitor.%zu.vcpus", i);
-        if (virTypedParamsAddString(&record->params, &record->nparams,
-                                    maxparams, param_name,
-                                    resdata[i]->vcpus) < 0)
+        if (virTypedParamListAddString(params, resdata[i]->vcpus,
+                                       "cpu.cache.monitor.%zu.vcpus", i) < 0)
             goto cleanup;
 
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "cpu.cache.monitor.%zu.bank.count", i);
-        if (virTypedParamsAddUInt(&record->params, &record->nparams,
-                                  maxparams, param_name,
-                                  resdata[i]->nstats) < 0)
+        if (virTypedParamListAddUInt(params, resdata[i]->nstats,
+                                     "cpu.cache.monitor.%zu.bank.count", i) < 0)
             goto cleanup;
 
         for (j = 0; j < resdata[i]->nstats; j++) {
-            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                     "cpu.cache.monitor.%zu.bank.%zu.id", i, j);
-            if (virTypedParamsAddUInt(&record->params, &record->nparams,
-                                      maxparams, param_name,
-                                      resdata[i]->stats[j]->id) < 0)
+            if (virTypedParamListAddUInt(params, resdata[i]->stats[j]->id,
+                                         "cpu.cache.monitor.%zu.bank.%zu.id",
+                                         i, j) < 0)
                 goto cleanup;
 
-            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                     "cpu.cache.monitor.%zu.bank.%zu.bytes", i, j);
-            if (virTypedParamsAddUInt(&record->params, &record->nparams,
-                                      maxparams, param_name,
-                                      resdata[i]->stats[j]->vals[0]) < 0)
+            if (virTypedParamListAddUInt(params, resdata[i]->stats[j]->vals[0],
+                                         "cpu.cache.monitor.%zu.bank.%zu.bytes",
+                                         i, j) < 0)
                 goto cleanup;
         }
     }
@@ -20997,8 +21048,7 @@ qemuDomainGetStatsCpuCache(virQEMUDriverPtr driver,
 
 static int
 qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
-                            virDomainStatsRecordPtr record,
-                            int *maxparams)
+                            virTypedParamListPtr params)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
     unsigned long long cpu_time = 0;
@@ -21010,25 +21060,13 @@ qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
         return 0;
 
     err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.time",
-                                        cpu_time) < 0)
+    if (!err && virTypedParamListAddULLong(params, cpu_time, "cpu.time") < 0)
         return -1;
 
     err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.user",
-                                        user_time) < 0)
+    if (!err && virTypedParamListAddULLong(params, user_time, "cpu.user") < 0)
         return -1;
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.system",
-                                        sys_time) < 0)
+    if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
         return -1;
 
     return 0;
@@ -21038,14 +21076,14 @@ qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
 static int
 qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
                       virDomainObjPtr dom,
-                      virDomainStatsRecordPtr record,
-                      int *maxparams,
-                      unsigned int privflags ATTRIBUTE_UNUSED)
+                      virTypedParamListPtr params,
+                      unsigned int privflags ATTRIBUTE_UNUSED,
+                      qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
 {
-    if (qemuDomainGetStatsCpuCgroup(dom, record, maxparams) < 0)
+    if (qemuDomainGetStatsCpuCgroup(dom, params) < 0)
         return -1;
 
-    if (qemuDomainGetStatsCpuCache(driver, dom, record, maxparams) < 0)
+    if (qemuDomainGetStatsCpuCache(driver, dom, params) < 0)
         return -1;
 
     return 0;
@@ -21055,9 +21093,9 @@ qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
-                          virDomainStatsRecordPtr record,
-                          int *maxparams,
-                          unsigned int privflags)
+                          virTypedParamListPtr params,
+                          unsigned int privflags,
+                          qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
 {
     virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
     int nr_stats;
@@ -21070,22 +21108,28 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
         cur_balloon = dom->def->mem.cur_balloon;
     }
 
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                "balloon.current",
-                                cur_balloon) < 0)
+    if (virTypedParamListAddULLong(params, cur_balloon, "balloon.current") < 0)
         return -1;
 
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                "balloon.maximum",
-                                virDomainDefGetMemoryTotal(dom->def)) < 0)
+    if (virTypedParamListAddULLong(params, virDomainDefGetMemoryTotal(dom->def),
+                                   "balloon.maximum") < 0)
         return -1;
 
-    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    if (!HAVE_JOB(privflags)) {
+        long rss;
+
+        /* RSS comes from the host kernel and needs no monitor access */
+        if (qemuGetProcessInfo(NULL, NULL, &rss, NULL, dom->pid, 0) < 0)
+            return 0;
+
+        if (virTypedParamListAddULLong(params, rss, "balloon.rss") < 0)
+            return -1;
+
         return 0;
+    }
 
     nr_stats = qemuDomainMemoryStatsInternal(driver, dom, stats,
                                              VIR_DOMAIN_MEMORY_STAT_NR);
@@ -21094,11 +21138,8 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
 
 #define STORE_MEM_RECORD(TAG, NAME) \
     if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ ##TAG) \
-        if (virTypedParamsAddULLong(&record->params, \
-                                    &record->nparams, \
-                                    maxparams, \
-                                    "balloon." NAME, \
-                                    stats[i].val) < 0) \
+        if (virTypedParamListAddULLong(params, stats[i].val, \
+                                       "balloon." NAME) < 0) \
             return -1;
 
     for (i = 0; i < nr_stats; i++) {
@@ -21125,36 +21166,36 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
                        virDomainObjPtr dom,
-                       virDomainStatsRecordPtr record,
-                       int *maxparams,
-                       unsigned int privflags)
+                       virTypedParamListPtr params,
+                       unsigned int privflags,
+                       qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
 {
     virDomainVcpuDefPtr vcpu;
     qemuDomainVcpuPrivatePtr vcpupriv;
     size_t i;
     int ret = -1;
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
     virVcpuInfoPtr cpuinfo = NULL;
     unsigned long long *cpuwait = NULL;
+    bool *cpuhalted = NULL;
+    bool hostHalted = (privflags & QEMU_DOMAIN_STATS_HOST_ONLY) &&
+                      virDomainObjGetState(dom, NULL) == VIR_DOMAIN_RUNNING;
 
-    if (virTypedParamsAddUInt(&record->params,
-                              &record->nparams,
-                              maxparams,
-                              "vcpu.current",
-                              virDomainDefGetVcpus(dom->def)) < 0)
+    if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
+                                 "vcpu.current") < 0)
         return -1;
 
-    if (virTypedParamsAddUInt(&record->params,
-                              &record->nparams,
-                              maxparams,
-                              "vcpu.maximum",
-                              virDomainDefGetVcpusMax(dom->def)) < 0)
+    if (virTypedParamListAddUInt(params, virDomainDefGetVcpusMax(dom->def),
+                                 "vcpu.maximum") < 0)
         return -1;
 
     if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
         VIR_ALLOC_N(cpuwait, virDomainDefGetVcpus(dom->def)) < 0)
         goto cleanup;
 
+    if (hostHalted &&
+        VIR_ALLOC_N(cpuhalted, virDomainDefGetVcpus(dom->def)) < 0)
+        goto cleanup;
+
     if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
         qemuDomainRefreshVcpuHalted(driver, dom, QEMU_ASYNC_JOB_NONE) < 0) {
             /* it's ok to be silent and go ahead, because halted vcpu info
@@ -21162,7 +21203,7 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
             virResetLastError();
     }
 
-    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait,
+    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait, cpuhalted,
                                  virDomainDefGetVcpus(dom->def),
                                  NULL, 0) < 0) {
         virResetLastError();
@@ -21171,36 +21212,29 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
     }
 
     for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.state", cpuinfo[i].number);
-        if (virTypedParamsAddInt(&record->params,
-                                 &record->nparams,
-                                 maxparams,
-                                 param_name,
-                                 cpuinfo[i].state) < 0)
+        if (virTypedParamListAddInt(params, cpuinfo[i].state,
+                                    "vcpu.%u.state", cpuinfo[i].number) < 0)
             goto cleanup;
 
         /* stats below are available only if the VM is alive */
         if (!virDomainObjIsActive(dom))
             continue;
 
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.time", cpuinfo[i].number);
-        if (virTypedParamsAddULLong(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    cpuinfo[i].cpuTime) < 0)
+        if (virTypedParamListAddULLong(params, cpuinfo[i].cpuTime,
+                                       "vcpu.%u.time", cpuinfo[i].number) < 0)
             goto cleanup;
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.wait", cpuinfo[i].number);
-        if (virTypedParamsAddULLong(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    cpuwait[i]) < 0)
+        if (virTypedParamListAddULLong(params, cpuwait[i],
+                                       "vcpu.%u.wait", cpuinfo[i].number) < 0)
             goto cleanup;
 
+        if (cpuhalted) {
+            if (virTypedParamListAddBoolean(params, cpuhalted[i],
+                                            "vcpu.%u.halted",
+                                            cpuinfo[i].number) < 0)
+                goto cleanup;
+            continue;
+        }
+
         /* state below is extracted from the individual vcpu structs */
         if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
             continue;
@@ -21208,13 +21242,10 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
         vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
 
         if (vcpupriv->halted != VIR_TRISTATE_BOOL_ABSENT) {
-            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                     "vcpu.%u.halted", cpuinfo[i].number);
-            if (virTypedParamsAddBoolean(&record->params,
-                                         &record->nparams,
-                                         maxparams,
-                                         param_name,
-                                         vcpupriv->halted == VIR_TRISTATE_BOOL_YES) < 0)
+            if (virTypedParamListAddBoolean(params,
+                                            vcpupriv->halted == VIR_TRISTATE_BOOL_YES,
+                                            "vcpu.%u.halted",
+                                            cpuinfo[i].number) < 0)
                 goto cleanup;
         }
     }
@@ -21224,53 +21255,36 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
  cleanup:
     VIR_FREE(cpuinfo);
     VIR_FREE(cpuwait);
+    VIR_FREE(cpuhalted);
     return ret;
 }
 
-#define QEMU_ADD_COUNT_PARAM(record, maxparams, type, count) \
+#define QEMU_ADD_COUNT_PARAM(params, type, count) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
-    if (virTypedParamsAddUInt(&(record)->params, \
-                              &(record)->nparams, \
-                              maxparams, \
-                              param_name, \
-                              count) < 0) \
+    if (virTypedParamListAddUInt(params, count, "%s.count", type) < 0) \
         goto cleanup; \
 } while (0)
 
-#define QEMU_ADD_NAME_PARAM(record, maxparams, type, subtype, num, name) \
+#define QEMU_ADD_NAME_PARAM(params, type, subtype, num, name) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "%s.%zu.%s", type, num, subtype); \
-    if (virTypedParamsAddString(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                name) < 0) \
+    if (virTypedParamListAddString(params, name, \
+                                   "%s.%zu.%s", type, num, subtype) < 0) \
         goto cleanup; \
 } while (0)
 
-#define QEMU_ADD_NET_PARAM(record, maxparams, num, name, value) \
+#define QEMU_ADD_NET_PARAM(params, num, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "net.%zu.%s", num, name); \
-    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
-                                              &(record)->nparams, \
-                                              maxparams, \
-                                              param_name, \
-                                              value) < 0) \
+    if (value >= 0 && \
+        virTypedParamListAddULLong(params, value, "net.%zu.%s", num, name) < 0) \
         return -1; \
 } while (0)
 
 static int
 qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                             virDomainObjPtr dom,
-                            virDomainStatsRecordPtr record,
-                            int *maxparams,
-                            unsigned int privflags ATTRIBUTE_UNUSED)
+                            virTypedParamListPtr params,
+                            unsigned int privflags ATTRIBUTE_UNUSED,
+                            qemuDomainGetStatsHostPtr host)
 {
     size_t i;
     struct _virDomainInterfaceStats tmp;
@@ -21279,7 +21293,7 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
     if (!virDomainObjIsActive(dom))
         return 0;
 
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "net", dom->def->nnets);
+    QEMU_ADD_COUNT_PARAM(params, "net", dom->def->nnets);
 
     /* Check the path is one of the domain's network interfaces. */
     for (i = 0; i < dom->def->nnets; i++) {
@@ -21293,14 +21307,19 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 
         actualType = virDomainNetGetActualType(net);
 
-        QEMU_ADD_NAME_PARAM(record, maxparams,
-                            "net", "name", i, net->ifname);
+        QEMU_ADD_NAME_PARAM(params, "net", "name", i, net->ifname);
 
         if (actualType == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
             if (virNetDevOpenvswitchInterfaceStats(net->ifname, &tmp) < 0) {
                 virResetLastError();
                 continue;
             }
+        } else if (host && host->netstats) {
+            if (virNetDevTapStatsSnapshotGet(host->netstats, net->ifname, &tmp,
+                                             !virDomainNetTypeSharesHostView(net)) < 0) {
+                virResetLastError();
+                continue;
+            }
         } else {
             if (virNetDevTapInterfaceStats(net->ifname, &tmp,
                                            !virDomainNetTypeSharesHostView(net)) < 0) {
@@ -21309,22 +21328,14 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
             }
         }
 
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.bytes", tmp.rx_bytes);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.pkts", tmp.rx_packets);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.errs", tmp.rx_errs);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.drop", tmp.rx_drop);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.bytes", tmp.tx_bytes);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.pkts", tmp.tx_packets);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.errs", tmp.tx_errs);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.drop", tmp.tx_drop);
+        QEMU_ADD_NET_PARAM(params, i, "rx.bytes", tmp.rx_bytes);
+        QEMU_ADD_NET_PARAM(params, i, "rx.pkts", tmp.rx_packets);
+        QEMU_ADD_NET_PARAM(params, i, "rx.errs", tmp.rx_errs);
+        QEMU_ADD_NET_PARAM(params, i, "rx.drop", tmp.rx_drop);
+        QEMU_ADD_NET_PARAM(params, i, "tx.bytes", tmp.tx_bytes);
+        QEMU_ADD_NET_PARAM(params, i, "tx.pkts", tmp.tx_packets);
+        QEMU_ADD_NET_PARAM(params, i, "tx.errs", tmp.tx_errs);
+        QEMU_ADD_NET_PARAM(params, i, "tx.drop", tmp.tx_drop);
     }
 
     ret = 0;
@@ -21334,43 +21345,26 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 
 #undef QEMU_ADD_NET_PARAM
 
-#define QEMU_ADD_BLOCK_PARAM_UI(record, maxparams, num, name, value) \
+#define QEMU_ADD_BLOCK_PARAM_UI(params, num, name, value) \
     do { \
-        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-                 "block.%zu.%s", num, name); \
-        if (virTypedParamsAddUInt(&(record)->params, \
-                                  &(record)->nparams, \
-                                  maxparams, \
-                                  param_name, \
-                                  value) < 0) \
+        if (virTypedParamListAddUInt(params, value, \
+                                     "block.%zu.%s", num, name) < 0) \
             goto cleanup; \
     } while (0)
 
 /* expects a LL, but typed parameter must be ULL */
-#define QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, num, name, value) \
+#define QEMU_ADD_BLOCK_PARAM_LL(params, num, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
-    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
-                                              &(record)->nparams, \
-                                              maxparams, \
-                                              param_name, \
-                                              value) < 0) \
+    if (value >= 0 && \
+        virTypedParamListAddULLong(params, value, \
+                                   "block.%zu.%s", num, name) < 0) \
         goto cleanup; \
 } while (0)
 
-#define QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, num, name, value) \
+#define QEMU_ADD_BLOCK_PARAM_ULL(params, num, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
-    if (virTypedParamsAddULLong(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                value) < 0) \
+    if (virTypedParamListAddULLong(params, value, \
+                                   "block.%zu.%s", num, name) < 0) \
         goto cleanup; \
 } while (0)
 
@@ -21379,8 +21373,7 @@ static int
 qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
                                    virQEMUDriverConfigPtr cfg,
                                    virDomainObjPtr dom,
-                                   virDomainStatsRecordPtr record,
-                                   int *maxparams,
+                                   virTypedParamListPtr params,
                                    virStorageSourcePtr src,
                                    size_t block_idx)
 {
@@ -21395,13 +21388,13 @@ qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
     }
 
     if (src->allocation)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "allocation", src->allocation);
     if (src->capacity)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "capacity", src->capacity);
     if (src->physical)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "physical", src->physical);
     ret = 0;
  cleanup:
@@ -21449,8 +21442,7 @@ static int
 qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
                            virQEMUDriverConfigPtr cfg,
                            virDomainObjPtr dom,
-                           virDomainStatsRecordPtr record,
-                           int *maxparams,
+                           virTypedParamListPtr params,
                            const char *entryname,
                            virStorageSourcePtr src,
                            size_t block_idx,
@@ -21462,8 +21454,8 @@ qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
     /* the VM is offline so we have to go and load the stast from the disk by
      * ourselves */
     if (!virDomainObjIsActive(dom)) {
-        ret = qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, record,
-                                                 maxparams, src, block_idx);
+        ret = qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, params,
+                                                 src, block_idx);
         goto cleanup;
     }
 
@@ -21475,18 +21467,18 @@ qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
-    QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                              "allocation", entry->wr_highest_offset);
 
     if (entry->capacity)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "capacity", entry->capacity);
     if (entry->physical) {
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "physical", entry->physical);
     } else {
         if (qemuDomainStorageUpdatePhysical(driver, cfg, dom, src) == 0)
-            QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+            QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                      "physical", src->physical);
     }
 
@@ -21500,8 +21492,7 @@ static int
 qemuDomainGetStatsBlockExportBackendStorage(const char *entryname,
                                             virHashTablePtr stats,
                                             size_t recordnr,
-                                            virDomainStatsRecordPtr records,
-                                            int *nrecords)
+                                            virTypedParamListPtr params)
 {
     qemuBlockStats *entry;
     int ret = -1;
@@ -21512,7 +21503,7 @@ qemuDomainGetStatsBlockExportBackendStorage(const char *entryname,
     }
 
     if (entry->write_threshold)
-        QEMU_ADD_BLOCK_PARAM_ULL(records, nrecords, recordnr, "threshold",
+        QEMU_ADD_BLOCK_PARAM_ULL(params, recordnr, "threshold",
                                  entry->write_threshold);
 
     ret = 0;
@@ -21525,8 +21516,7 @@ static int
 qemuDomainGetStatsBlockExportFrontend(const char *frontendname,
                                       virHashTablePtr stats,
                                       size_t recordnr,
-                                      virDomainStatsRecordPtr records,
-                                      int *nrecords)
+                                      virTypedParamListPtr params)
 {
     qemuBlockStats *entry;
     int ret = -1;
@@ -21539,14 +21529,14 @@ qemuDomainGetStatsBlockExportFrontend(const char *frontendname,
         goto cleanup;
     }
 
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.reqs", entry->rd_req);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.bytes", entry->rd_bytes);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.times", entry->rd_total_times);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.reqs", entry->wr_req);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.bytes", entry->wr_bytes);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.times", entry->wr_total_times);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "fl.reqs", entry->flush_req);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "fl.times", entry->flush_total_times);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "rd.reqs", entry->rd_req);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "rd.bytes", entry->rd_bytes);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "rd.times", entry->rd_total_times);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "wr.reqs", entry->wr_req);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "wr.bytes", entry->wr_bytes);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "wr.times", entry->wr_total_times);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "fl.reqs", entry->flush_req);
+    QEMU_ADD_BLOCK_PARAM_LL(params, recordnr, "fl.times", entry->flush_total_times);
 
     ret = 0;
  cleanup:
@@ -21558,17 +21548,16 @@ static int
 qemuDomainGetStatsBlockExportHeader(virDomainDiskDefPtr disk,
                                     virStorageSourcePtr src,
                                     size_t recordnr,
-                                    virDomainStatsRecordPtr records,
-                                    int *nrecords)
+                                    virTypedParamListPtr params)
 {
     int ret = -1;
 
-    QEMU_ADD_NAME_PARAM(records, nrecords, "block", "name", recordnr, disk->dst);
+    QEMU_ADD_NAME_PARAM(params, "block", "name", recordnr, disk->dst);
 
     if (virStorageSourceIsLocalStorage(src) && src->path)
-        QEMU_ADD_NAME_PARAM(records, nrecords, "block", "path", recordnr, src->path);
+        QEMU_ADD_NAME_PARAM(params, "block", "path", recordnr, src->path);
     if (src->id)
-        QEMU_ADD_BLOCK_PARAM_UI(records, nrecords, recordnr, "backingIndex",
+        QEMU_ADD_BLOCK_PARAM_UI(params, recordnr, "backingIndex",
                                 src->id);
 
     ret = 0;
@@ -21581,8 +21570,7 @@ static int
 qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
                                   virHashTablePtr stats,
                                   virHashTablePtr nodestats,
-                                  virDomainStatsRecordPtr records,
-                                  int *nrecords,
+                                  virTypedParamListPtr params,
                                   size_t *recordnr,
                                   bool visitBacking,
                                   virQEMUDriverPtr driver,
@@ -21609,7 +21597,7 @@ qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
                  "skip getting stats", disk->dst);
 
         return qemuDomainGetStatsBlockExportHeader(disk, disk->src, *recordnr,
-                                                   records, nrecords);
+                                                   params);
     }
 
     for (n = disk->src; virStorageSourceIsBacking(n); n = n->backingStore) {
@@ -21631,24 +21619,24 @@ qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
         }
 
         if (qemuDomainGetStatsBlockExportHeader(disk, n, *recordnr,
-                                                records, nrecords) < 0)
+                                                params) < 0)
             goto cleanup;
 
         /* The following stats make sense only for the frontend device */
         if (n == disk->src) {
             if (qemuDomainGetStatsBlockExportFrontend(frontendalias, stats, *recordnr,
-                                                      records, nrecords) < 0)
+                                                      params) < 0)
                 goto cleanup;
         }
 
-        if (qemuDomainGetStatsOneBlock(driver, cfg, dom, records, nrecords,
+        if (qemuDomainGetStatsOneBlock(driver, cfg, dom, params,
                                        backendalias, n, *recordnr,
                                        stats) < 0)
             goto cleanup;
 
         if (qemuDomainGetStatsBlockExportBackendStorage(backendstoragealias,
                                                         stats, *recordnr,
-                                                        records, nrecords) < 0)
+                                                        params) < 0)
             goto cleanup;
 
         VIR_FREE(alias);
@@ -21669,9 +21657,9 @@ qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
 static int
 qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
                         virDomainObjPtr dom,
-                        virDomainStatsRecordPtr record,
-                        int *maxparams,
-                        unsigned int privflags)
+                        virTypedParamListPtr params,
+                        unsigned int privflags,
+                        qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
 {
     size_t i;
     int ret = -1;
@@ -21719,18 +21707,18 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
     /* When listing backing chains, it's easier to fix up the count
      * after the iteration than it is to iterate twice; but we still
      * want count listed first.  */
-    count_index = record->nparams;
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "block", 0);
+    count_index = params->npar;
+    QEMU_ADD_COUNT_PARAM(params, "block", 0);
 
     for (i = 0; i < dom->def->ndisks; i++) {
         if (qemuDomainGetStatsBlockExportDisk(dom->def->disks[i], stats, nodestats,
-                                              record, maxparams, &visited,
+                                              params, &visited,
                                               visitBacking, driver, cfg, dom,
                                               blockdev) < 0)
             goto cleanup;
     }
 
-    record->params[count_index].value.ui = visited;
+    params->par[count_index].value.ui = visited;
     ret = 0;
 
  cleanup:
@@ -21747,38 +21735,26 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
 
 #undef QEMU_ADD_NAME_PARAM
 
-#define QEMU_ADD_IOTHREAD_PARAM_UI(record, maxparams, id, name, value) \
+#define QEMU_ADD_IOTHREAD_PARAM_UI(params, id, name, value) \
     do { \
-        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-                 "iothread.%u.%s", id, name); \
-        if (virTypedParamsAddUInt(&(record)->params, \
-                                  &(record)->nparams, \
-                                  maxparams, \
-                                  param_name, \
-                                  value) < 0) \
+        if (virTypedParamListAddUInt(params, value, \
+                                     "iothread.%u.%s", id, name) < 0) \
             goto cleanup; \
     } while (0)
 
-#define QEMU_ADD_IOTHREAD_PARAM_ULL(record, maxparams, id, name, value) \
+#define QEMU_ADD_IOTHREAD_PARAM_ULL(params, id, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "iothread.%u.%s", id, name); \
-    if (virTypedParamsAddULLong(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                value) < 0) \
+    if (virTypedParamListAddULLong(params, value, \
+                                   "iothread.%u.%s", id, name) < 0) \
         goto cleanup; \
 } while (0)
 
 static int
 qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
                            virDomainObjPtr dom,
-                           virDomainStatsRecordPtr record,
-                           int *maxparams,
-                           unsigned int privflags ATTRIBUTE_UNUSED)
+                           virTypedParamListPtr params,
+                           unsigned int privflags ATTRIBUTE_UNUSED,
+                           qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
     size_t i;
@@ -21798,19 +21774,19 @@ qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
     if (niothreads == 0)
         return 0;
 
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "iothread", niothreads);
+    QEMU_ADD_COUNT_PARAM(params, "iothread", niothreads);
 
     for (i = 0; i < niothreads; i++) {
         if (iothreads[i]->poll_valid) {
-            QEMU_ADD_IOTHREAD_PARAM_ULL(record, maxparams,
+            QEMU_ADD_IOTHREAD_PARAM_ULL(params,
                                         iothreads[i]->iothread_id,
                                         "poll-max-ns",
                                         iothreads[i]->poll_max_ns);
-            QEMU_ADD_IOTHREAD_PARAM_UI(record, maxparams,
+            QEMU_ADD_IOTHREAD_PARAM_UI(params,
                                        iothreads[i]->iothread_id,
                                        "poll-grow",
                                        iothreads[i]->poll_grow);
-            QEMU_ADD_IOTHREAD_PARAM_UI(record, maxparams,
+            QEMU_ADD_IOTHREAD_PARAM_UI(params,
                                        iothreads[i]->iothread_id,
                                        "poll-shrink",
                                        iothreads[i]->poll_shrink);
@@ -21836,23 +21812,15 @@ qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
                                virPerfEventType type,
-                               virDomainStatsRecordPtr record,
-                               int *maxparams)
+                               virTypedParamListPtr params)
 {
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
     uint64_t value = 0;
 
     if (virPerfReadEvent(perf, type, &value) < 0)
         return -1;
 
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "perf.%s",
-             virPerfEventTypeToString(type));
-
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                param_name,
-                                value) < 0)
+    if (virTypedParamListAddULLong(params, value, "perf.%s",
+                                   virPerfEventTypeToString(type)) < 0)
         return -1;
 
     return 0;
@@ -21861,9 +21829,9 @@ qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
 static int
 qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                        virDomainObjPtr dom,
-                       virDomainStatsRecordPtr record,
-                       int *maxparams,
-                       unsigned int privflags ATTRIBUTE_UNUSED)
+                       virTypedParamListPtr params,
+                       unsigned int privflags ATTRIBUTE_UNUSED,
+                       qemuDomainGetStatsHostPtr host ATTRIBUTE_UNUSED)
 {
     size_t i;
     qemuDomainObjPrivatePtr priv = dom->privateData;
@@ -21873,8 +21841,7 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
         if (!virPerfEventIsEnabled(priv->perf, i))
              continue;
 
-        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i,
-                                           record, maxparams) < 0)
+        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i, params) < 0)
             goto cleanup;
     }
 
@@ -21887,9 +21854,9 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 typedef int
 (*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
-                          virDomainStatsRecordPtr record,
-                          int *maxparams,
-                          unsigned int flags);
+                          virTypedParamListPtr list,
+                          unsigned int flags,
+                          qemuDomainGetStatsHostPtr host);
 
 struct qemuDomainGetStatsWorker {
     qemuDomainGetStatsFunc func;
@@ -21957,39 +21924,36 @@ qemuDomainGetStats(virConnectPtr conn,
                    virDomainObjPtr dom,
                    unsigned int stats,
                    virDomainStatsRecordPtr *record,
-                   unsigned int flags)
+                   unsigned int flags,
+                   qemuDomainGetStatsHostPtr host)
 {
-    int maxparams = 0;
+    VIR_AUTOPTR(virTypedParamList) params = NULL;
     virDomainStatsRecordPtr tmp;
     size_t i;
-    int ret = -1;
 
-    if (VIR_ALLOC(tmp) < 0)
-        goto cleanup;
+    if (VIR_ALLOC(params) < 0)
+        return -1;
 
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
         if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, tmp,
-                                                  &maxparams, flags) < 0)
-                goto cleanup;
+            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
+                                                  flags, host) < 0)
+                return -1;
         }
     }
 
-    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
-                                  dom->def->uuid, dom->def->id)))
-        goto cleanup;
-
-    *record = tmp;
-    tmp = NULL;
-    ret = 0;
+    if (VIR_ALLOC(tmp) < 0)
+        return -1;
 
- cleanup:
-    if (tmp) {
-        virTypedParamsFree(tmp->params, tmp->nparams);
+    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
+                                  dom->def->uuid, dom->def->id))) {
         VIR_FREE(tmp);
+        return -1;
     }
 
-    return ret;
+    tmp->nparams = virTypedParamListStealParams(params, &tmp->params);
+    *record = tmp;
+    return 0;
 }
 
 
@@ -22007,6 +21971,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virDomainObjPtr vm;
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
+    qemuDomainGetStatsHost host = { 0 };
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
@@ -22022,7 +21987,8 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
-                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_HOST_ONLY, -1);
 
     if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
         return -1;
@@ -22045,9 +22011,23 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
         goto cleanup;
 
-    if (qemuDomainGetStatsNeedMonitor(stats))
+    /* In host only mode every domain is sampled in a single sweep
+     * without waiting for jobs or monitor replies. */
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_HOST_ONLY)
+        privflags |= QEMU_DOMAIN_STATS_HOST_ONLY;
+    else if (qemuDomainGetStatsNeedMonitor(stats))
         privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
+    /* One dump of the host's interfaces serves all domains instead of
+     * reading /proc/net/dev for every interface. Without it, every
+     * interface is looked up on its own. */
+    if (stats & VIR_DOMAIN_STATS_INTERFACE &&
+        !(host.netstats = virNetDevTapStatsSnapshotNew())) {
+        VIR_DEBUG("Failed to fetch interface stats of the host: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     for (i = 0; i < nvms; i++) {
         virDomainStatsRecordPtr tmp = NULL;
         domflags = 0;
@@ -22070,7 +22050,8 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
         if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
             domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
+        domflags |= privflags & QEMU_DOMAIN_STATS_HOST_ONLY;
+        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags, &host) < 0) {
             if (HAVE_JOB(domflags) && vm)
                 qemuDomainObjEndJob(driver, vm);
 
@@ -22094,6 +22075,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
  cleanup:
     virErrorPreserveLast(&orig_err);
+    virNetDevTapStatsSnapshotFree(host.netstats);
     virDomainStatsRecordListFree(tmpstats);
     virObjectListFreeCount(vms, nvms);
     virErrorRestore(&orig_err);
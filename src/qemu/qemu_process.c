@@ -7969,11 +7969,124 @@ qemuProcessRefreshBlockjobs(virQEMUDriverPtr driver,
 }
 
 
+typedef enum {
+    QEMU_PROCESS_RECONNECT_PHASE_JOB,
+    QEMU_PROCESS_RECONNECT_PHASE_WAIT,
+    QEMU_PROCESS_RECONNECT_PHASE_MONITOR,
+    QEMU_PROCESS_RECONNECT_PHASE_REFRESH,
+    QEMU_PROCESS_RECONNECT_PHASE_SAVE,
+
+    QEMU_PROCESS_RECONNECT_PHASE_LAST
+} qemuProcessReconnectPhase;
+
+VIR_ENUM_DECL(qemuProcessReconnectPhase);
+VIR_ENUM_IMPL(qemuProcessReconnectPhase,
+              QEMU_PROCESS_RECONNECT_PHASE_LAST,
+              "job",
+              "wait",
+              "monitor",
+              "refresh",
+              "save",
+);
+
+/* Shared by the reconnect threads of all domains */
+typedef struct _qemuProcessReconnectState qemuProcessReconnectState;
+typedef qemuProcessReconnectState *qemuProcessReconnectStatePtr;
+struct _qemuProcessReconnectState {
+    virMutex lock;
+    virCond cond;
+    size_t refs;
+
+    size_t nactive;
+    size_t maxactive; /* 0 means unlimited */
+
+    size_t njobs;
+    size_t ndone;
+    size_t nfailed;
+
+    unsigned long long start;
+    /* cumulative time spent in each phase in milliseconds */
+    unsigned long long phases[QEMU_PROCESS_RECONNECT_PHASE_LAST];
+};
+
 struct qemuProcessReconnectData {
     virQEMUDriverPtr driver;
     virDomainObjPtr obj;
     virIdentityPtr identity;
+    qemuProcessReconnectStatePtr state;
 };
+
+
+/* Adds time elapsed since *@last to @phases[@phase] and moves *@last */
+static void
+qemuProcessReconnectPhaseDone(unsigned long long *phases,
+                              qemuProcessReconnectPhase phase,
+                              unsigned long long *last)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    phases[phase] += now - *last;
+    *last = now;
+}
+
+
+/* Waits until fewer than maxactive domains are being reconnected */
+static void
+qemuProcessReconnectAcquire(qemuProcessReconnectStatePtr state)
+{
+    virMutexLock(&state->lock);
+    while (state->maxactive && state->nactive >= state->maxactive)
+        ignore_value(virCondWait(&state->cond, &state->lock));
+    state->nactive++;
+    virMutexUnlock(&state->lock);
+}
+
+
+static void
+qemuProcessReconnectRelease(qemuProcessReconnectStatePtr state)
+{
+    virMutexLock(&state->lock);
+    state->nactive--;
+    virCondSignal(&state->cond);
+    virMutexUnlock(&state->lock);
+}
+
+
+static void
+qemuProcessReconnectStateUnref(qemuProcessReconnectStatePtr state)
+{
+    unsigned long long now;
+    bool last;
+    size_t i;
+
+    virMutexLock(&state->lock);
+    last = --state->refs == 0;
+    virMutexUnlock(&state->lock);
+
+    if (!last)
+        return;
+
+    if (state->njobs > 0) {
+        if (virTimeMillisNowRaw(&now) < 0)
+            now = state->start;
+
+        VIR_INFO("Reconnect to %zu domains finished in %llu ms",
+                 state->njobs, now - state->start);
+        for (i = 0; i < QEMU_PROCESS_RECONNECT_PHASE_LAST; i++)
+            VIR_INFO("Reconnect phase '%s' took %llu ms in total",
+                     qemuProcessReconnectPhaseTypeToString(i),
+                     state->phases[i]);
+    }
+
+    virCondDestroy(&state->cond);
+    virMutexDestroy(&state->lock);
+    VIR_FREE(state);
+}
+
+
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
@@ -7992,12 +8105,13 @@ struct qemuProcessReconnectData {
  * We can't do normal MonitorEnter & MonitorExit because these two lock the
  * monitor lock, which does not exists in this early phase.
  */
-static void
-qemuProcessReconnect(void *opaque)
+static int
+qemuProcessReconnect(struct qemuProcessReconnectData *data,
+                     unsigned long long *phases)
 {
-    struct qemuProcessReconnectData *data = opaque;
     virQEMUDriverPtr driver = data->driver;
     virDomainObjPtr obj = data->obj;
+    qemuProcessReconnectStatePtr reconnect = data->state;
     qemuDomainObjPrivatePtr priv;
     qemuDomainJobObj oldjob;
     int state;
@@ -8006,9 +8120,14 @@ qemuProcessReconnect(void *opaque)
     size_t i;
     unsigned int stopFlags = 0;
     bool jobStarted = false;
+    bool active = false;
     virCapsPtr caps = NULL;
     bool retry = true;
     bool tryMonReconn = false;
+    unsigned long long last = 0;
+    int ret = -1;
+
+    ignore_value(virTimeMillisNowRaw(&last));
 
     virIdentitySetCurrent(data->identity);
     virObjectUnref(data->identity);
@@ -8028,6 +8147,19 @@ qemuProcessReconnect(void *opaque)
         goto error;
     jobStarted = true;
 
+    qemuProcessReconnectPhaseDone(phases, QEMU_PROCESS_RECONNECT_PHASE_JOB, &last);
+
+    /* Only a limited number of domains is reconnected at the same time.
+     * The others wait for their turn here, unlocked so that listing
+     * domains is not blocked, but with the job held so that no API can
+     * use them before their monitor is connected. */
+    virObjectUnlock(obj);
+    qemuProcessReconnectAcquire(reconnect);
+    virObjectLock(obj);
+    active = true;
+
+    qemuProcessReconnectPhaseDone(phases, QEMU_PROCESS_RECONNECT_PHASE_WAIT, &last);
+
     /* XXX If we ever gonna change pid file pattern, come up with
      * some intelligence here to deal with old paths. */
     if (!(priv->pidfile = virPidFileBuildPath(cfg->stateDir, obj->def->name)))
@@ -8057,6 +8189,8 @@ qemuProcessReconnect(void *opaque)
     if (qemuConnectMonitor(driver, obj, QEMU_ASYNC_JOB_NONE, retry, NULL) < 0)
         goto error;
 
+    qemuProcessReconnectPhaseDone(phases, QEMU_PROCESS_RECONNECT_PHASE_MONITOR, &last);
+
     priv->machineName = qemuDomainGetMachineName(obj);
     if (!priv->machineName)
         goto error;
@@ -8130,6 +8264,7 @@ qemuProcessReconnect(void *opaque)
         VIR_DEBUG("Finishing shutdown sequence for domain %s",
                   obj->def->name);
         qemuProcessShutdownOrReboot(driver, obj);
+        ret = 0;
         goto cleanup;
     }
 
@@ -8215,10 +8350,14 @@ qemuProcessReconnect(void *opaque)
         }
     }
 
+    qemuProcessReconnectPhaseDone(phases, QEMU_PROCESS_RECONNECT_PHASE_REFRESH, &last);
+
     /* update domain state XML with possibly updated state in virDomainObj */
     if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
         goto error;
 
+    qemuProcessReconnectPhaseDone(phases, QEMU_PROCESS_RECONNECT_PHASE_SAVE, &last);
+
     /* Run an hook to allow admins to do some magic */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
         char *xml = qemuDomainDefFormatXML(driver, priv->qemuCaps, obj->def, 0);
@@ -8239,7 +8378,11 @@ qemuProcessReconnect(void *opaque)
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
 
+    ret = 0;
+
  cleanup:
+    if (active)
+        qemuProcessReconnectRelease(reconnect);
     if (jobStarted) {
         if (!virDomainObjIsActive(obj))
             qemuDomainRemoveInactive(driver, obj);
@@ -8253,7 +8396,7 @@ qemuProcessReconnect(void *opaque)
     virObjectUnref(caps);
     virNWFilterUnlockFilterUpdates();
     virIdentitySetCurrent(NULL);
-    return;
+    return ret;
 
  error:
     if (virDomainObjIsActive(obj)) {
@@ -8283,6 +8426,35 @@ qemuProcessReconnect(void *opaque)
     goto cleanup;
 }
 
+static void
+qemuProcessReconnectThread(void *opaque)
+{
+    struct qemuProcessReconnectData *data = opaque;
+    qemuProcessReconnectStatePtr state = data->state;
+    unsigned long long phases[QEMU_PROCESS_RECONNECT_PHASE_LAST] = { 0 };
+    size_t i;
+    int rc;
+
+    rc = qemuProcessReconnect(data, phases);
+
+    virMutexLock(&state->lock);
+    for (i = 0; i < QEMU_PROCESS_RECONNECT_PHASE_LAST; i++)
+        state->phases[i] += phases[i];
+    if (rc < 0)
+        state->nfailed++;
+    state->ndone++;
+
+    /* Report progress roughly after every tenth of the domains */
+    if (state->ndone == state->njobs ||
+        state->ndone % MAX(state->njobs / 10, 1) == 0)
+        VIR_INFO("Reconnected %zu of %zu domains (%zu failed)",
+                 state->ndone, state->njobs, state->nfailed);
+    virMutexUnlock(&state->lock);
+
+    qemuProcessReconnectStateUnref(state);
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
@@ -8290,6 +8462,7 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     virThread thread;
     struct qemuProcessReconnectData *src = opaque;
     struct qemuProcessReconnectData *data;
+    qemuProcessReconnectStatePtr state = src->state;
 
     /* If the VM was inactive, we don't need to reconnect */
     if (!obj->pid)
@@ -8309,7 +8482,12 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     virObjectLock(obj);
     virObjectRef(obj);
 
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
+    virMutexLock(&state->lock);
+    state->refs++;
+    state->njobs++;
+    virMutexUnlock(&state->lock);
+
+    if (virThreadCreate(&thread, false, qemuProcessReconnectThread, data) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Could not create thread. QEMU initialization "
                          "might be incomplete"));
@@ -8326,6 +8504,11 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
         virNWFilterUnlockFilterUpdates();
         virObjectUnref(data->identity);
         VIR_FREE(data);
+
+        virMutexLock(&state->lock);
+        state->refs--;
+        state->njobs--;
+        virMutexUnlock(&state->lock);
         return -1;
     }
 
@@ -8336,13 +8519,41 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. Every domain gets its own thread, but at most
+ * reconnect_workers from qemu.conf are reconnected at the same time.
  */
 void
 qemuProcessReconnectAll(virQEMUDriverPtr driver)
 {
+    VIR_AUTOUNREF(virQEMUDriverConfigPtr) cfg = virQEMUDriverGetConfig(driver);
     struct qemuProcessReconnectData data = {.driver = driver};
+    qemuProcessReconnectStatePtr state;
+
+    if (VIR_ALLOC(state) < 0)
+        return;
+
+    if (virMutexInit(&state->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        VIR_FREE(state);
+        return;
+    }
+
+    if (virCondInit(&state->cond) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init condition"));
+        virMutexDestroy(&state->lock);
+        VIR_FREE(state);
+        return;
+    }
+
+    /* this reference is dropped once all threads are spawned */
+    state->refs = 1;
+    state->maxactive = cfg->reconnectWorkers;
+    ignore_value(virTimeMillisNowRaw(&state->start));
+
+    data.state = state;
     virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+
+    qemuProcessReconnectStateUnref(state);
 }
 
 
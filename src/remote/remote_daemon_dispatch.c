@@ -5134,6 +5134,7 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
     case VIR_DRV_FEATURE_FD_PASSING:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_TYPED_PARAMS:
         supported = 1;
         break;
     case VIR_DRV_FEATURE_MIGRATION_V1:
@@ -6956,43 +6957,39 @@ remoteDispatchNetworkGetDHCPLeases(virNetServerPtr server ATTRIBUTE_UNUSED,
 }
 
 
+/* Collects the stats records for both the plain and the compact flavour
+ * of the bulk stats RPC call. */
 static int
-remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
-                                       virNetServerClientPtr client,
-                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
-                                       virNetMessageErrorPtr rerr,
-                                       remote_connect_get_all_domain_stats_args *args,
-                                       remote_connect_get_all_domain_stats_ret *ret)
+remoteDispatchConnectGetAllDomainStatsCollect(virConnectPtr conn,
+                                              remote_nonnull_domain *doms_val,
+                                              unsigned int doms_len,
+                                              unsigned int stats,
+                                              unsigned int flags,
+                                              virDomainStatsRecordPtr **retStats)
 {
-    int rv = -1;
+    int nrecords = -1;
     size_t i;
-    virDomainStatsRecordPtr *retStats = NULL;
-    int nrecords = 0;
     virDomainPtr *doms = NULL;
-    virConnectPtr conn = remoteGetHypervisorConn(client);
 
-    if (!conn)
-        goto cleanup;
-
-    if (args->doms.doms_len) {
-        if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+    if (doms_len) {
+        if (VIR_ALLOC_N(doms, doms_len + 1) < 0)
             goto cleanup;
 
-        for (i = 0; i < args->doms.doms_len; i++) {
-            if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+        for (i = 0; i < doms_len; i++) {
+            if (!(doms[i] = get_nonnull_domain(conn, doms_val[i])))
                 goto cleanup;
         }
 
         if ((nrecords = virDomainListGetStats(doms,
-                                              args->stats,
-                                              &retStats,
-                                              args->flags)) < 0)
+                                              stats,
+                                              retStats,
+                                              flags)) < 0)
             goto cleanup;
     } else {
         if ((nrecords = virConnectGetAllDomainStats(conn,
-                                                    args->stats,
-                                                    &retStats,
-                                                    args->flags)) < 0)
+                                                    stats,
+                                                    retStats,
+                                                    flags)) < 0)
             goto cleanup;
     }
 
@@ -7001,9 +6998,42 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
                        _("Number of domain stats records is %d, "
                          "which exceeds max limit: %d"),
                        nrecords, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
-        goto cleanup;
+        virDomainStatsRecordListFree(*retStats);
+        *retStats = NULL;
+        nrecords = -1;
     }
 
+ cleanup:
+    virObjectListFree(doms);
+    return nrecords;
+}
+
+
+static int
+remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                       virNetServerClientPtr client,
+                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                       virNetMessageErrorPtr rerr,
+                                       remote_connect_get_all_domain_stats_args *args,
+                                       remote_connect_get_all_domain_stats_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if ((nrecords = remoteDispatchConnectGetAllDomainStatsCollect(conn,
+                                                                  args->doms.doms_val,
+                                                                  args->doms.doms_len,
+                                                                  args->stats,
+                                                                  args->flags,
+                                                                  &retStats)) < 0)
+        goto cleanup;
+
     if (nrecords) {
         if (VIR_ALLOC_N(ret->retStats.retStats_val, nrecords) < 0)
             goto cleanup;
@@ -7035,7 +7065,80 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
         virNetMessageSaveError(rerr);
 
     virDomainStatsRecordListFree(retStats);
-    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectGetAllDomainStatsCompact(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                              virNetServerClientPtr client,
+                                              virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                              virNetMessageErrorPtr rerr,
+                                              remote_connect_get_all_domain_stats_compact_args *args,
+                                              remote_connect_get_all_domain_stats_compact_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    virTypedParamsKeyTablePtr table = NULL;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if ((nrecords = remoteDispatchConnectGetAllDomainStatsCollect(conn,
+                                                                  args->doms.doms_val,
+                                                                  args->doms.doms_len,
+                                                                  args->stats,
+                                                                  args->flags,
+                                                                  &retStats)) < 0)
+        goto cleanup;
+
+    if (!(table = virTypedParamsKeyTableNew()))
+        goto cleanup;
+
+    if (nrecords) {
+        if (VIR_ALLOC_N(ret->retStats.retStats_val, nrecords) < 0)
+            goto cleanup;
+
+        ret->retStats.retStats_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            remote_domain_stats_record_compact *dst = ret->retStats.retStats_val + i;
+
+            if (make_nonnull_domain(&dst->dom, retStats[i]->dom) < 0)
+                goto cleanup;
+
+            if (virTypedParamsSerializeCompact(retStats[i]->params,
+                                               retStats[i]->nparams,
+                                               table,
+                                               (virTypedParameterRemoteCompactPtr *) &dst->params.params_val,
+                                               &dst->params.params_len,
+                                               VIR_TYPED_PARAM_STRING_OKAY) < 0)
+                goto cleanup;
+        }
+    }
+
+    if (table->nkeys > REMOTE_TYPED_PARAM_KEYS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of distinct stats names is %zu, "
+                         "which exceeds max limit: %d"),
+                       table->nkeys, REMOTE_TYPED_PARAM_KEYS_MAX);
+        goto cleanup;
+    }
+
+    virTypedParamsKeyTableSteal(table, &ret->keys.keys_val, &ret->keys.keys_len);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsKeyTableFree(table);
+    virDomainStatsRecordListFree(retStats);
 
     return rv;
 }
@@ -242,6 +242,12 @@ const REMOTE_NETWORK_DHCP_LEASES_MAX = 65536;
 /* Upper limit on count of parameters returned via bulk stats API */
 const REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX = 262144;
 
+/*
+ * Upper limit on number of distinct parameter names in a message using
+ * the compact typed parameter encoding.
+ */
+const REMOTE_TYPED_PARAM_KEYS_MAX = 262144;
+
 /* Upper limit of message size for tunable event. */
 const REMOTE_DOMAIN_EVENT_TUNABLE_MAX = 2048;
 
@@ -425,6 +431,14 @@ struct remote_typed_param {
     remote_typed_param_value value;
 };
 
+/* Compact wire encoding of virTypedParameter. Instead of the name the
+ * parameter carries an index into a table of names sent once per message.
+ */
+struct remote_typed_param_compact {
+    unsigned int key;
+    remote_typed_param_value value;
+};
+
 struct remote_node_get_cpu_stats {
     remote_nonnull_string field;
     unsigned hyper value;
@@ -3353,6 +3367,22 @@ struct remote_connect_get_all_domain_stats_ret {
     remote_domain_stats_record retStats<REMOTE_DOMAIN_LIST_MAX>;
 };
 
+struct remote_domain_stats_record_compact {
+    remote_nonnull_domain dom;
+    remote_typed_param_compact params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_compact_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_domain_stats_compact_ret {
+    remote_nonnull_string keys<REMOTE_TYPED_PARAM_KEYS_MAX>;
+    remote_domain_stats_record_compact retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
 struct remote_domain_fsinfo {
     remote_nonnull_string mountpoint;
     remote_nonnull_string name;
@@ -6584,5 +6614,12 @@ enum remote_procedure {
      * @generate: both
      * @acl: domain:checkpoint
      */
-    REMOTE_PROC_DOMAIN_CHECKPOINT_DELETE = 417
+    REMOTE_PROC_DOMAIN_CHECKPOINT_DELETE = 417,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT = 418
 };
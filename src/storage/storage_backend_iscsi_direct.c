@@ -20,6 +20,8 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+#include <poll.h>
 #include <iscsi/iscsi.h>
 #include <iscsi/scsi-lowlevel.h>
 
@@ -29,6 +31,7 @@
 #include "storage_util.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virfdstream.h"
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
@@ -39,9 +42,16 @@
 
 #define ISCSI_DEFAULT_TARGET_PORT 3260
 #define VIR_ISCSI_TEST_UNIT_TIMEOUT 30 * 1000
-#define BLOCK_PER_PACKET 128
 #define VOL_NAME_PREFIX "unit:0:0:"
 
+/* Commands kept in flight for volume I/O. The target's command window
+ * may limit it further. */
+#define VIR_ISCSI_DIRECT_MAX_TASKS 32
+/* Bytes transferred by a single READ or WRITE and zeroed by a single
+ * WRITE SAME, unless the target sets lower limits */
+#define VIR_ISCSI_DIRECT_XFER_SIZE (1024 * 1024)
+#define VIR_ISCSI_DIRECT_WS_SIZE (256 * 1024 * 1024)
+
 VIR_LOG_INIT("storage.storage_backend_iscsi_direct");
 
 static struct iscsi_context *
@@ -616,50 +626,511 @@ virStorageBackendISCSIDirectGetLun(virStorageVolDefPtr vol,
     return 0;
 }
 
+/*
+ * Limits of a LUN relevant for volume I/O, from READ CAPACITY(16) and
+ * the Block Limits and Logical Block Provisioning VPD pages. Limits
+ * the target doesn't report are zero.
+ */
+typedef struct _virISCSIDirectLimits virISCSIDirectLimits;
+typedef virISCSIDirectLimits *virISCSIDirectLimitsPtr;
+struct _virISCSIDirectLimits {
+    uint32_t block_size;
+    uint64_t nblocks;
+    uint32_t max_xfer_len;      /* blocks per READ/WRITE */
+    uint64_t max_ws_len;        /* blocks per WRITE SAME */
+    uint32_t max_unmap;         /* blocks per UNMAP */
+    bool unmap;                 /* UNMAP is supported */
+};
+
+static void *
+virISCSIDirectInquiryVPD(struct iscsi_context *iscsi,
+                         int lun,
+                         int page_code,
+                         struct scsi_task **task)
+{
+    void *data;
+
+    /* VPD pages are optional, so failures are not errors */
+    if (!(*task = iscsi_inquiry_sync(iscsi, lun, 1, page_code, 255)))
+        return NULL;
+
+    if ((*task)->status != SCSI_STATUS_GOOD ||
+        !(data = scsi_datain_unmarshall(*task))) {
+        VIR_DEBUG("VPD page 0x%x of LUN %d is not available: %s",
+                  page_code, lun, iscsi_get_error(iscsi));
+        scsi_free_scsi_task(*task);
+        *task = NULL;
+        return NULL;
+    }
+
+    return data;
+}
+
 static int
-virStorageBackendISCSIDirectVolWipeZero(virStorageVolDefPtr vol,
-                                        struct iscsi_context *iscsi)
+virISCSIDirectGetLimits(struct iscsi_context *iscsi,
+                        int lun,
+                        virISCSIDirectLimitsPtr limits)
 {
-    uint64_t lba = 0;
-    uint32_t block_size;
-    uint64_t nb_block;
     struct scsi_task *task = NULL;
-    int lun = 0;
-    int ret = -1;
-    VIR_AUTOFREE(unsigned char *) data = NULL;
+    struct scsi_inquiry_block_limits *bl;
+    struct scsi_inquiry_logical_block_provisioning *lbp;
+    uint64_t last_lba = 0;
 
-    if (virStorageBackendISCSIDirectGetLun(vol, &lun) < 0)
-        return ret;
-    if (virISCSIDirectTestUnitReady(iscsi, lun) < 0)
-        return ret;
-    if (virISCSIDirectGetVolumeCapacity(iscsi, lun, &block_size, &nb_block))
-        return ret;
-    if (VIR_ALLOC_N(data, block_size * BLOCK_PER_PACKET))
-        return ret;
+    memset(limits, 0, sizeof(*limits));
+
+    if (virISCSIDirectGetVolumeCapacity(iscsi, lun, &limits->block_size,
+                                        &last_lba) < 0)
+        return -1;
+
+    if (!limits->block_size) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("LUN %d is not a block device"), lun);
+        return -1;
+    }
 
-    while (lba < nb_block) {
-        const uint64_t to_write = MIN(nb_block - lba + 1, BLOCK_PER_PACKET);
+    /* READ CAPACITY returns the address of the last block */
+    limits->nblocks = last_lba + 1;
 
-        task = iscsi_write16_sync(iscsi, lun, lba, data,
-                                  block_size * to_write,
-                                  block_size, 0, 0, 0, 0, 0);
+    if ((bl = virISCSIDirectInquiryVPD(iscsi, lun,
+                                       SCSI_INQUIRY_PAGECODE_BLOCK_LIMITS,
+                                       &task))) {
+        limits->max_xfer_len = bl->max_xfer_len;
+        limits->max_ws_len = bl->max_ws_len;
+        limits->max_unmap = bl->max_unmap;
+        scsi_free_scsi_task(task);
+    }
 
-        if (!task ||
-            task->status != SCSI_STATUS_GOOD) {
+    if ((lbp = virISCSIDirectInquiryVPD(iscsi, lun,
+                                        SCSI_INQUIRY_PAGECODE_LOGICAL_BLOCK_PROVISIONING,
+                                        &task))) {
+        limits->unmap = lbp->lbpu && limits->max_unmap;
+        scsi_free_scsi_task(task);
+    }
+
+    VIR_DEBUG("LUN %d: block_size=%u nblocks=%llu max_xfer_len=%u "
+              "max_ws_len=%llu max_unmap=%u unmap=%d",
+              lun, limits->block_size, (unsigned long long)limits->nblocks,
+              limits->max_xfer_len, (unsigned long long)limits->max_ws_len,
+              limits->max_unmap, limits->unmap);
+
+    return 0;
+}
+
+
+/*
+ * Pipelined SCSI commands on a LUN, keeping up to VIR_ISCSI_DIRECT_MAX_TASKS
+ * of them in flight. Commands are completed in the order they were
+ * submitted. The object owns the iscsi connection, so that it is only
+ * torn down once no command refers to the buffers anymore.
+ */
+typedef enum {
+    VIR_ISCSI_DIRECT_IO_READ,
+    VIR_ISCSI_DIRECT_IO_WRITE,
+    VIR_ISCSI_DIRECT_IO_WRITE_SAME,
+    VIR_ISCSI_DIRECT_IO_UNMAP,
+} virISCSIDirectIOOp;
+
+typedef struct _virISCSIDirectIOReq virISCSIDirectIOReq;
+typedef virISCSIDirectIOReq *virISCSIDirectIOReqPtr;
+struct _virISCSIDirectIOReq {
+    virISCSIDirectIOOp op;
+    struct scsi_task *task;
+    bool done;
+    int status;
+    uint64_t lba;
+    uint32_t nblocks;
+    unsigned char *buf;     /* @buflen bytes, allocated on first use */
+    size_t consumed;        /* bytes of a completed read handed out */
+};
+
+typedef struct _virISCSIDirectIO virISCSIDirectIO;
+typedef virISCSIDirectIO *virISCSIDirectIOPtr;
+struct _virISCSIDirectIO {
+    struct iscsi_context *iscsi;
+    int lun;
+    uint32_t block_size;
+    size_t buflen;
+
+    virISCSIDirectIOReqPtr reqs;
+    size_t nreqs;
+    size_t head;            /* oldest request */
+    size_t inflight;
+
+    unsigned char *zeroes;  /* shared by zeroing requests */
+    size_t zeroeslen;
+};
+
+/* On success, @iscsi is owned by the returned object. */
+static virISCSIDirectIOPtr
+virISCSIDirectIONew(struct iscsi_context *iscsi,
+                    int lun,
+                    uint32_t block_size,
+                    size_t buflen)
+{
+    virISCSIDirectIOPtr io;
+
+    if (VIR_ALLOC(io) < 0 ||
+        VIR_ALLOC_N(io->reqs, VIR_ISCSI_DIRECT_MAX_TASKS) < 0) {
+        VIR_FREE(io);
+        return NULL;
+    }
+
+    io->iscsi = iscsi;
+    io->lun = lun;
+    io->block_size = block_size;
+    io->buflen = buflen;
+    io->nreqs = VIR_ISCSI_DIRECT_MAX_TASKS;
+
+    return io;
+}
+
+static void
+virISCSIDirectIOCallback(struct iscsi_context *iscsi ATTRIBUTE_UNUSED,
+                         int status,
+                         void *command_data ATTRIBUTE_UNUSED,
+                         void *opaque)
+{
+    virISCSIDirectIOReqPtr req = opaque;
+
+    req->done = true;
+    req->status = status;
+}
+
+/* Run the libiscsi event loop until @req is completed */
+static int
+virISCSIDirectIOService(virISCSIDirectIOPtr io,
+                        virISCSIDirectIOReqPtr req)
+{
+    while (!req->done) {
+        struct pollfd pfd = {
+            .fd = iscsi_get_fd(io->iscsi),
+            .events = iscsi_which_events(io->iscsi),
+        };
+
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("failed to poll iscsi connection"));
+            return -1;
+        }
+
+        if (iscsi_service(io->iscsi, pfd.revents) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("failed to write to LUN %d: %s"),
-                           lun, iscsi_get_error(iscsi));
-            scsi_free_scsi_task(task);
+                           _("iscsi connection failed: %s"),
+                           iscsi_get_error(io->iscsi));
             return -1;
         }
+    }
 
-        scsi_free_scsi_task(task);
-        lba += to_write;
+    return 0;
+}
+
+/* Wait for the oldest request to finish. Returns 0 on success or if
+ * there is none, -1 with an error reported if it failed. */
+static int
+virISCSIDirectIOWaitHead(virISCSIDirectIOPtr io)
+{
+    virISCSIDirectIOReqPtr req = &io->reqs[io->head];
+
+    if (!io->inflight || !req->task)
+        return 0;
+
+    if (virISCSIDirectIOService(io, req) < 0)
+        return -1;
+
+    if (req->status != SCSI_STATUS_GOOD) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to access %u blocks of LUN %d at "
+                         "LBA %llu: %s"),
+                       req->nblocks, io->lun,
+                       (unsigned long long)req->lba,
+                       iscsi_get_error(io->iscsi));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+virISCSIDirectIOPopHead(virISCSIDirectIOPtr io)
+{
+    virISCSIDirectIOReqPtr req = &io->reqs[io->head];
+
+    scsi_free_scsi_task(req->task);
+    req->task = NULL;
+    req->consumed = 0;
+    io->head = (io->head + 1) % io->nreqs;
+    io->inflight--;
+}
+
+/* Returns the request to be submitted next, waiting for the oldest
+ * one to finish if all of them are in flight. */
+static virISCSIDirectIOReqPtr
+virISCSIDirectIONext(virISCSIDirectIOPtr io)
+{
+    virISCSIDirectIOReqPtr req;
+
+    if (io->inflight == io->nreqs) {
+        if (virISCSIDirectIOWaitHead(io) < 0)
+            return NULL;
+        virISCSIDirectIOPopHead(io);
+    }
+
+    req = &io->reqs[(io->head + io->inflight) % io->nreqs];
+
+    if (io->buflen && !req->buf &&
+        VIR_ALLOC_N(req->buf, io->buflen) < 0)
+        return NULL;
+
+    return req;
+}
+
+/* Submit @req returned by virISCSIDirectIONext. Writes use @data if
+ * set, which must be kept intact until the request is finished, and
+ * the request's own buffer otherwise. WRITE SAME writes the single
+ * block of @data to @nblocks blocks. */
+static int
+virISCSIDirectIOSubmit(virISCSIDirectIOPtr io,
+                       virISCSIDirectIOReqPtr req,
+                       virISCSIDirectIOOp op,
+                       uint64_t lba,
+                       uint32_t nblocks,
+                       unsigned char *data)
+{
+    struct unmap_list list = { .lba = lba, .num = nblocks };
+
+    req->op = op;
+    req->lba = lba;
+    req->nblocks = nblocks;
+    req->done = false;
+
+    if (!data)
+        data = req->buf;
+
+    switch (op) {
+    case VIR_ISCSI_DIRECT_IO_READ:
+        req->task = iscsi_read16_task(io->iscsi, io->lun, lba,
+                                      nblocks * io->block_size,
+                                      io->block_size, 0, 0, 0, 0, 0,
+                                      virISCSIDirectIOCallback, req);
+        break;
+    case VIR_ISCSI_DIRECT_IO_WRITE:
+        req->task = iscsi_write16_task(io->iscsi, io->lun, lba, data,
+                                       nblocks * io->block_size,
+                                       io->block_size, 0, 0, 0, 0, 0,
+                                       virISCSIDirectIOCallback, req);
+        break;
+    case VIR_ISCSI_DIRECT_IO_WRITE_SAME:
+        req->task = iscsi_writesame16_task(io->iscsi, io->lun, lba, data,
+                                           io->block_size, nblocks,
+                                           0, 0, 0, 0,
+                                           virISCSIDirectIOCallback, req);
+        break;
+    case VIR_ISCSI_DIRECT_IO_UNMAP:
+        req->task = iscsi_unmap_task(io->iscsi, io->lun, 0, 0, &list, 1,
+                                     virISCSIDirectIOCallback, req);
+        break;
+    }
+
+    if (!req->task) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to submit command to LUN %d: %s"),
+                       io->lun, iscsi_get_error(io->iscsi));
+        return -1;
     }
 
+    io->inflight++;
     return 0;
 }
 
+/* Wait for all requests in flight. Returns -1 if any of them failed. */
+static int
+virISCSIDirectIODrain(virISCSIDirectIOPtr io)
+{
+    int ret = 0;
+
+    while (io->inflight) {
+        if (virISCSIDirectIOWaitHead(io) < 0) {
+            ret = -1;
+            /* The connection is broken, don't wait for the others */
+            if (!io->reqs[io->head].done)
+                break;
+        }
+        virISCSIDirectIOPopHead(io);
+    }
+
+    return ret;
+}
+
+/* Returns a zeroed buffer of @len bytes kept until @io is freed */
+static unsigned char *
+virISCSIDirectIOZeroes(virISCSIDirectIOPtr io,
+                       size_t len)
+{
+    if (io->zeroeslen < len) {
+        if (io->inflight) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("zero buffer can't grow while in use"));
+            return NULL;
+        }
+
+        VIR_FREE(io->zeroes);
+        io->zeroeslen = 0;
+        if (VIR_ALLOC_N(io->zeroes, len) < 0)
+            return NULL;
+        io->zeroeslen = len;
+    }
+
+    return io->zeroes;
+}
+
+static void
+virISCSIDirectIOFree(virISCSIDirectIOPtr io)
+{
+    virErrorPtr orig_err;
+    size_t i;
+
+    if (!io)
+        return;
+
+    virErrorPreserveLast(&orig_err);
+    ignore_value(virISCSIDirectIODrain(io));
+    virISCSIDirectDisconnect(io->iscsi);
+    /* This cancels commands left after a connection failure */
+    iscsi_destroy_context(io->iscsi);
+    virErrorRestore(&orig_err);
+
+    for (i = 0; i < io->nreqs; i++) {
+        scsi_free_scsi_task(io->reqs[i].task);
+        VIR_FREE(io->reqs[i].buf);
+    }
+    VIR_FREE(io->reqs);
+    VIR_FREE(io->zeroes);
+    VIR_FREE(io);
+}
+
+/* Blocks transferred by a single READ or WRITE */
+static uint32_t
+virISCSIDirectXferLen(virISCSIDirectLimitsPtr limits)
+{
+    uint32_t xfer_len = VIR_ISCSI_DIRECT_XFER_SIZE / limits->block_size;
+
+    if (limits->max_xfer_len)
+        xfer_len = MIN(xfer_len, limits->max_xfer_len);
+
+    return MAX(xfer_len, 1);
+}
+
+/* Zero the first block of the LUN with a WRITE SAME to find out whether
+ * the target supports the command. Returns 1 if it does, 0 if not and
+ * -1 on error. */
+static int
+virISCSIDirectWriteSameSupported(virISCSIDirectIOPtr io)
+{
+    struct scsi_task *task;
+    unsigned char *data;
+    int ret = -1;
+
+    if (!(data = virISCSIDirectIOZeroes(io, io->block_size)))
+        return -1;
+
+    if (!(task = iscsi_writesame16_sync(io->iscsi, io->lun, 0, data,
+                                        io->block_size, 1, 0, 0, 0, 0))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to write to LUN %d: %s"),
+                       io->lun, iscsi_get_error(io->iscsi));
+        return -1;
+    }
+
+    if (task->status == SCSI_STATUS_GOOD) {
+        ret = 1;
+    } else if (task->status == SCSI_STATUS_CHECK_CONDITION &&
+               task->sense.key == SCSI_SENSE_ILLEGAL_REQUEST) {
+        VIR_DEBUG("LUN %d doesn't support WRITE SAME", io->lun);
+        ret = 0;
+    } else {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to write to LUN %d: %s"),
+                       io->lun, iscsi_get_error(io->iscsi));
+    }
+
+    scsi_free_scsi_task(task);
+    return ret;
+}
+
+static int
+virStorageBackendISCSIDirectVolWipeZero(virISCSIDirectIOPtr io,
+                                        virISCSIDirectLimitsPtr limits)
+{
+    virISCSIDirectIOOp op = VIR_ISCSI_DIRECT_IO_WRITE;
+    uint32_t len = virISCSIDirectXferLen(limits);
+    virISCSIDirectIOReqPtr req;
+    unsigned char *data;
+    uint64_t lba = 0;
+    int rc;
+
+    /* Let the target zero the blocks itself if it can */
+    if ((rc = virISCSIDirectWriteSameSupported(io)) < 0)
+        return -1;
+
+    if (rc) {
+        op = VIR_ISCSI_DIRECT_IO_WRITE_SAME;
+        len = VIR_ISCSI_DIRECT_WS_SIZE / limits->block_size;
+        if (limits->max_ws_len)
+            len = MIN(len, limits->max_ws_len);
+        len = MAX(len, 1);
+    }
+
+    if (!(data = virISCSIDirectIOZeroes(io, op == VIR_ISCSI_DIRECT_IO_WRITE ?
+                                        len * limits->block_size :
+                                        limits->block_size)))
+        return -1;
+
+    VIR_DEBUG("Zeroing %llu blocks of LUN %d using %s of %u blocks",
+              (unsigned long long)limits->nblocks, io->lun,
+              op == VIR_ISCSI_DIRECT_IO_WRITE ? "WRITE" : "WRITE SAME", len);
+
+    while (lba < limits->nblocks) {
+        uint32_t count = MIN(limits->nblocks - lba, len);
+
+        if (!(req = virISCSIDirectIONext(io)) ||
+            virISCSIDirectIOSubmit(io, req, op, lba, count, data) < 0)
+            return -1;
+
+        lba += count;
+    }
+
+    return virISCSIDirectIODrain(io);
+}
+
+static int
+virStorageBackendISCSIDirectVolWipeUnmap(virISCSIDirectIOPtr io,
+                                         virISCSIDirectLimitsPtr limits)
+{
+    virISCSIDirectIOReqPtr req;
+    uint64_t lba = 0;
+
+    if (!limits->unmap) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("LUN %d doesn't support UNMAP"), io->lun);
+        return -1;
+    }
+
+    while (lba < limits->nblocks) {
+        uint32_t count = MIN(limits->nblocks - lba, limits->max_unmap);
+
+        if (!(req = virISCSIDirectIONext(io)) ||
+            virISCSIDirectIOSubmit(io, req, VIR_ISCSI_DIRECT_IO_UNMAP,
+                                   lba, count, NULL) < 0)
+            return -1;
+
+        lba += count;
+    }
+
+    return virISCSIDirectIODrain(io);
+}
+
 static int
 virStorageBackenISCSIDirectWipeVol(virStoragePoolObjPtr pool,
                                    virStorageVolDefPtr vol,
@@ -667,10 +1138,16 @@ virStorageBackenISCSIDirectWipeVol(virStoragePoolObjPtr pool,
                                    unsigned int flags)
 {
     struct iscsi_context *iscsi = NULL;
+    virISCSIDirectIOPtr io = NULL;
+    virISCSIDirectLimits limits;
+    int lun = 0;
     int ret = -1;
 
     virCheckFlags(0, -1);
 
+    if (virStorageBackendISCSIDirectGetLun(vol, &lun) < 0)
+        return -1;
+
     virObjectLock(pool);
     iscsi = virStorageBackendISCSIDirectSetConnection(pool, NULL);
     virObjectUnlock(pool);
@@ -678,12 +1155,23 @@ virStorageBackenISCSIDirectWipeVol(virStoragePoolObjPtr pool,
     if (!iscsi)
         return -1;
 
+    if (virISCSIDirectTestUnitReady(iscsi, lun) < 0 ||
+        virISCSIDirectGetLimits(iscsi, lun, &limits) < 0)
+        goto cleanup;
+
+    if (!(io = virISCSIDirectIONew(iscsi, lun, limits.block_size, 0)))
+        goto cleanup;
+    iscsi = NULL;
+
     switch ((virStorageVolWipeAlgorithm) algorithm) {
     case VIR_STORAGE_VOL_WIPE_ALG_ZERO:
-        if (virStorageBackendISCSIDirectVolWipeZero(vol, iscsi) < 0)
+        if (virStorageBackendISCSIDirectVolWipeZero(io, &limits) < 0)
             goto cleanup;
         break;
     case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
+        if (virStorageBackendISCSIDirectVolWipeUnmap(io, &limits) < 0)
+            goto cleanup;
+        break;
     case VIR_STORAGE_VOL_WIPE_ALG_NNSA:
     case VIR_STORAGE_VOL_WIPE_ALG_DOD:
     case VIR_STORAGE_VOL_WIPE_ALG_BSI:
@@ -700,11 +1188,291 @@ virStorageBackenISCSIDirectWipeVol(virStoragePoolObjPtr pool,
 
     ret = 0;
  cleanup:
-    virISCSIDirectDisconnect(iscsi);
-    iscsi_destroy_context(iscsi);
+    virISCSIDirectIOFree(io);
+    if (iscsi) {
+        virISCSIDirectDisconnect(iscsi);
+        iscsi_destroy_context(iscsi);
+    }
+    return ret;
+}
+
+
+/* Volume upload and download using pipelined READ/WRITE commands */
+typedef struct _virISCSIDirectStream virISCSIDirectStream;
+typedef virISCSIDirectStream *virISCSIDirectStreamPtr;
+struct _virISCSIDirectStream {
+    virISCSIDirectIOPtr io;
+    uint32_t xfer_len;
+
+    uint64_t lba;       /* next block to submit */
+    uint64_t end;
+
+    /* upload: request being filled and its fill level in bytes */
+    virISCSIDirectIOReqPtr req;
+    size_t fill;
+};
+
+static void
+virISCSIDirectStreamFree(void *opaque)
+{
+    virISCSIDirectStreamPtr data = opaque;
+
+    if (!data)
+        return;
+
+    virISCSIDirectIOFree(data->io);
+    VIR_FREE(data);
+}
+
+static ssize_t
+virISCSIDirectStreamRead(char *buf,
+                         size_t len,
+                         void *opaque)
+{
+    virISCSIDirectStreamPtr data = opaque;
+    virISCSIDirectIOPtr io = data->io;
+    virISCSIDirectIOReqPtr req;
+    size_t size;
+    size_t n;
+
+    /* Keep the read ahead window full */
+    while (io->inflight < io->nreqs && data->lba < data->end) {
+        uint32_t count = MIN(data->end - data->lba, data->xfer_len);
+
+        if (!(req = virISCSIDirectIONext(io)) ||
+            virISCSIDirectIOSubmit(io, req, VIR_ISCSI_DIRECT_IO_READ,
+                                   data->lba, count, NULL) < 0)
+            return -1;
+
+        data->lba += count;
+    }
+
+    if (!io->inflight)
+        return 0;
+
+    if (virISCSIDirectIOWaitHead(io) < 0)
+        return -1;
+
+    req = &io->reqs[io->head];
+    size = (size_t)req->nblocks * io->block_size;
+
+    if (req->task->datain.size < size) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("short read from LUN %d at LBA %llu"),
+                       io->lun, (unsigned long long)req->lba);
+        return -1;
+    }
+
+    n = MIN(len, size - req->consumed);
+    memcpy(buf, req->task->datain.data + req->consumed, n);
+    req->consumed += n;
+
+    if (req->consumed == size)
+        virISCSIDirectIOPopHead(io);
+
+    return n;
+}
+
+static int
+virISCSIDirectStreamSubmitWrite(virISCSIDirectStreamPtr data)
+{
+    virISCSIDirectIOReqPtr req = data->req;
+    uint32_t count = data->fill / data->io->block_size;
+
+    data->req = NULL;
+
+    if (virISCSIDirectIOSubmit(data->io, req, VIR_ISCSI_DIRECT_IO_WRITE,
+                               data->lba, count, NULL) < 0)
+        return -1;
+
+    data->lba += count;
+    return 0;
+}
+
+static ssize_t
+virISCSIDirectStreamWrite(const char *buf,
+                          size_t len,
+                          void *opaque)
+{
+    virISCSIDirectStreamPtr data = opaque;
+    virISCSIDirectIOPtr io = data->io;
+    size_t done = 0;
+    size_t reqlen;
+    size_t n;
+
+    while (done < len) {
+        if (!data->req) {
+            if (data->lba == data->end) {
+                virReportError(VIR_ERR_OPERATION_INVALID,
+                               _("cannot write beyond the end of LUN %d"),
+                               io->lun);
+                return -1;
+            }
+
+            if (!(data->req = virISCSIDirectIONext(io)))
+                return -1;
+            data->fill = 0;
+        }
+
+        reqlen = MIN(data->end - data->lba, data->xfer_len) * io->block_size;
+        n = MIN(len - done, reqlen - data->fill);
+        memcpy(data->req->buf + data->fill, buf + done, n);
+        data->fill += n;
+        done += n;
+
+        if (data->fill == reqlen &&
+            virISCSIDirectStreamSubmitWrite(data) < 0)
+            return -1;
+    }
+
+    return len;
+}
+
+static int
+virISCSIDirectStreamFinish(void *opaque)
+{
+    virISCSIDirectStreamPtr data = opaque;
+    virISCSIDirectIOPtr io = data->io;
+    struct scsi_task *task;
+    int ret = -1;
+
+    if (data->req) {
+        if (data->fill % io->block_size) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("uploaded data is not a multiple of the "
+                             "block size %u of LUN %d"),
+                           io->block_size, io->lun);
+            return -1;
+        }
+
+        if (virISCSIDirectStreamSubmitWrite(data) < 0)
+            return -1;
+    }
+
+    if (virISCSIDirectIODrain(io) < 0)
+        return -1;
+
+    if (!(task = iscsi_synchronizecache10_sync(io->iscsi, io->lun,
+                                               0, 0, 0, 0)) ||
+        task->status != SCSI_STATUS_GOOD) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to synchronize cache of LUN %d: %s"),
+                       io->lun, iscsi_get_error(io->iscsi));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    scsi_free_scsi_task(task);
     return ret;
 }
 
+static virFDStreamIOCallbacks virISCSIDirectStreamIO = {
+    .read = virISCSIDirectStreamRead,
+    .write = virISCSIDirectStreamWrite,
+    .finish = virISCSIDirectStreamFinish,
+    .free = virISCSIDirectStreamFree,
+};
+
+static int
+virStorageBackendISCSIDirectVolStreamOpen(virStoragePoolObjPtr pool,
+                                          virStorageVolDefPtr vol,
+                                          virStreamPtr stream,
+                                          unsigned long long offset,
+                                          unsigned long long len,
+                                          int oflags)
+{
+    struct iscsi_context *iscsi = NULL;
+    virISCSIDirectStreamPtr data = NULL;
+    virISCSIDirectLimits limits;
+    int lun = 0;
+
+    if (virStorageBackendISCSIDirectGetLun(vol, &lun) < 0)
+        return -1;
+
+    virObjectLock(pool);
+    iscsi = virStorageBackendISCSIDirectSetConnection(pool, NULL);
+    virObjectUnlock(pool);
+
+    if (!iscsi)
+        return -1;
+
+    if (virISCSIDirectTestUnitReady(iscsi, lun) < 0 ||
+        virISCSIDirectGetLimits(iscsi, lun, &limits) < 0)
+        goto error;
+
+    if (offset % limits.block_size || len % limits.block_size) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("offset and length must be multiples of the "
+                         "block size %u of LUN %d"),
+                       limits.block_size, lun);
+        goto error;
+    }
+
+    if (offset / limits.block_size > limits.nblocks) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("offset %llu is beyond the end of LUN %d"),
+                       offset, lun);
+        goto error;
+    }
+
+    if (VIR_ALLOC(data) < 0)
+        goto error;
+
+    data->xfer_len = virISCSIDirectXferLen(&limits);
+    data->lba = offset / limits.block_size;
+    data->end = limits.nblocks;
+    if (len && len / limits.block_size < limits.nblocks - data->lba)
+        data->end = data->lba + len / limits.block_size;
+
+    if (!(data->io = virISCSIDirectIONew(iscsi, lun, limits.block_size,
+                                         (size_t)data->xfer_len *
+                                         limits.block_size)))
+        goto error;
+    iscsi = NULL;
+
+    return virFDStreamOpenIOCallbacks(stream, &virISCSIDirectStreamIO, data,
+                                      (data->end - data->lba) *
+                                      limits.block_size,
+                                      oflags);
+
+ error:
+    virISCSIDirectStreamFree(data);
+    if (iscsi) {
+        virISCSIDirectDisconnect(iscsi);
+        iscsi_destroy_context(iscsi);
+    }
+    return -1;
+}
+
+static int
+virStorageBackendISCSIDirectVolUpload(virStoragePoolObjPtr pool,
+                                      virStorageVolDefPtr vol,
+                                      virStreamPtr stream,
+                                      unsigned long long offset,
+                                      unsigned long long len,
+                                      unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    return virStorageBackendISCSIDirectVolStreamOpen(pool, vol, stream,
+                                                     offset, len, O_WRONLY);
+}
+
+static int
+virStorageBackendISCSIDirectVolDownload(virStoragePoolObjPtr pool,
+                                        virStorageVolDefPtr vol,
+                                        virStreamPtr stream,
+                                        unsigned long long offset,
+                                        unsigned long long len,
+                                        unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    return virStorageBackendISCSIDirectVolStreamOpen(pool, vol, stream,
+                                                     offset, len, O_RDONLY);
+}
+
 
 virStorageBackend virStorageBackendISCSIDirect = {
     .type = VIR_STORAGE_POOL_ISCSI_DIRECT,
@@ -712,6 +1480,8 @@ virStorageBackend virStorageBackendISCSIDirect = {
     .checkPool = virStorageBackendISCSIDirectCheckPool,
     .findPoolSources = virStorageBackendISCSIDirectFindPoolSources,
     .refreshPool = virStorageBackendISCSIDirectRefreshPool,
+    .uploadVol = virStorageBackendISCSIDirectVolUpload,
+    .downloadVol = virStorageBackendISCSIDirectVolDownload,
     .wipeVol = virStorageBackenISCSIDirectWipeVol,
 };
 
@@ -21,6 +21,7 @@
 
 #include <config.h>
 
+#include <fcntl.h>
 #include <inttypes.h>
 #include "datatypes.h"
 #include "virerror.h"
@@ -36,6 +37,7 @@
 #include "rbd/librbd.h"
 #include "secret_util.h"
 #include "storage_util.h"
+#include "virfdstream.h"
 #include <libxml/xpathInternals.h>
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
@@ -548,14 +550,14 @@ volStorageBackendRBDRefreshVolInfo(virStorageVolDefPtr vol,
     uint64_t flags;
 
     if ((r = rbd_open_read_only(ptr->ioctx, vol->name, &image, NULL)) < 0) {
-        ret = -r;
+        ret = r;
         virReportSystemError(-r, _("failed to open the RBD image '%s'"),
                              vol->name);
         goto cleanup;
     }
 
     if ((r = rbd_stat(image, &info, sizeof(info))) < 0) {
-        ret = -r;
+        ret = r;
         virReportSystemError(-r, _("failed to stat the RBD image '%s'"),
                              vol->name);
         goto cleanup;
@@ -701,6 +703,22 @@ virStorageBackendRBDGetVolNames(virStorageBackendRBDStatePtr ptr)
 #endif /* ! HAVE_RBD_LIST2 */
 
 
+struct virStorageBackendRBDRefreshPoolData {
+    virStoragePoolObjPtr pool;
+    virStorageBackendRBDStatePtr ptr;
+};
+
+
+static int
+virStorageBackendRBDRefreshPoolProbe(virStorageVolDefPtr vol,
+                                     void *opaque)
+{
+    struct virStorageBackendRBDRefreshPoolData *data = opaque;
+
+    return volStorageBackendRBDRefreshVolInfo(vol, data->pool, data->ptr);
+}
+
+
 static int
 virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
 {
@@ -711,6 +729,9 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     struct rados_cluster_stat_t clusterstat;
     struct rados_pool_stat_t poolstat;
     char **names = NULL;
+    virStorageBackendVolProbePtr probes = NULL;
+    size_t nprobes = 0;
+    struct virStorageBackendRBDRefreshPoolData data;
     size_t i;
 
     if (!(ptr = virStorageBackendRBDNewState(pool)))
@@ -740,15 +761,27 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
         goto cleanup;
 
     for (i = 0; names[i] != NULL; i++) {
-        VIR_AUTOPTR(virStorageVolDef) vol = NULL;
+        virStorageBackendVolProbe probe = { NULL };
 
-        if (VIR_ALLOC(vol) < 0)
+        if (VIR_ALLOC(probe.vol) < 0)
             goto cleanup;
 
-        VIR_STEAL_PTR(vol->name, names[i]);
+        VIR_STEAL_PTR(probe.vol->name, names[i]);
+
+        if (VIR_APPEND_ELEMENT(probes, nprobes, probe) < 0) {
+            virStorageVolDefFree(probe.vol);
+            goto cleanup;
+        }
+    }
 
-        r = volStorageBackendRBDRefreshVolInfo(vol, pool, ptr);
+    /* Opening and querying each image takes several round trips to the
+     * cluster, query them in parallel. */
+    data.pool = pool;
+    data.ptr = ptr;
+    virStorageBackendProbeVols(probes, nprobes,
+                               virStorageBackendRBDRefreshPoolProbe, &data);
 
+    for (i = 0; i < nprobes; i++) {
         /* It could be that a volume has been deleted through a different route
          * then libvirt and that will cause a -ENOENT to be returned.
          *
@@ -758,16 +791,17 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
          *
          * Do not error out and simply ignore the volume
          */
-        if (r < 0) {
-            if (r == -ENOENT || r == -ETIMEDOUT)
+        if (probes[i].rc < 0) {
+            if (probes[i].rc == -ENOENT || probes[i].rc == -ETIMEDOUT)
                 continue;
 
+            virErrorRestore(&probes[i].error);
             goto cleanup;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
+        if (virStoragePoolObjAddVol(pool, probes[i].vol) < 0)
             goto cleanup;
-        vol = NULL;
+        probes[i].vol = NULL;
     }
 
     VIR_DEBUG("Found %zu images in RBD pool %s",
@@ -776,6 +810,7 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     ret = 0;
 
  cleanup:
+    virStorageBackendVolProbesFree(probes, nprobes);
     virStringListFree(names);
     virStorageBackendRBDFreeState(&ptr);
     return ret;
@@ -1373,71 +1408,336 @@ virStorageBackendRBDResizeVol(virStoragePoolObjPtr pool,
     return ret;
 }
 
+/*
+ * Asynchronous I/O on an RBD image keeping up to @nreqs requests in
+ * flight, so that transfers are not bound by the latency of the
+ * individual objects. Requests are completed in the order they were
+ * submitted.
+ */
+typedef enum {
+    VIR_STORAGE_BACKEND_RBD_AIO_READ,
+    VIR_STORAGE_BACKEND_RBD_AIO_WRITE,
+    VIR_STORAGE_BACKEND_RBD_AIO_DISCARD,
+} virStorageBackendRBDAIOOp;
+
+typedef struct _virStorageBackendRBDAIOReq virStorageBackendRBDAIOReq;
+typedef virStorageBackendRBDAIOReq *virStorageBackendRBDAIOReqPtr;
+struct _virStorageBackendRBDAIOReq {
+    virStorageBackendRBDAIOOp op;
+    rbd_completion_t comp;
+    uint64_t offset;
+    size_t len;
+    char *buf;          /* @buflen bytes, allocated on first use */
+    size_t consumed;    /* bytes of a completed read handed out */
+};
+
+typedef struct _virStorageBackendRBDAIO virStorageBackendRBDAIO;
+typedef virStorageBackendRBDAIO *virStorageBackendRBDAIOPtr;
+struct _virStorageBackendRBDAIO {
+    rbd_image_t image;
+    const char *imgname;
+    size_t buflen;
+
+    virStorageBackendRBDAIOReqPtr reqs;
+    size_t nreqs;
+    size_t head;        /* oldest request */
+    size_t inflight;
+};
+
+/* The window is given by rbd_concurrent_management_ops, which the rbd
+ * tool itself uses to limit in flight requests of imports and exports
+ * and which can be tuned by the pool's config_opts. This is used if it
+ * can't be read. */
+#define VIR_STORAGE_BACKEND_RBD_AIO_WINDOW 10
+#define VIR_STORAGE_BACKEND_RBD_AIO_WINDOW_MAX 256
+
+/* Upper limits of the buffer of a single streaming request and of all
+ * buffers of a stream */
+#define VIR_STORAGE_BACKEND_RBD_AIO_BUFLEN_MAX (8 * 1024 * 1024)
+#define VIR_STORAGE_BACKEND_RBD_AIO_MEM_MAX (128 * 1024 * 1024)
+
+static size_t
+virStorageBackendRBDAIOWindow(virStorageBackendRBDStatePtr ptr)
+{
+    char value[32];
+    unsigned int window;
+
+    if (rados_conf_get(ptr->cluster, "rbd_concurrent_management_ops",
+                       value, sizeof(value)) < 0 ||
+        virStrToLong_ui(value, NULL, 10, &window) < 0 ||
+        window == 0)
+        return VIR_STORAGE_BACKEND_RBD_AIO_WINDOW;
+
+    return MIN(window, VIR_STORAGE_BACKEND_RBD_AIO_WINDOW_MAX);
+}
+
+
+static virStorageBackendRBDAIOPtr
+virStorageBackendRBDAIONew(rbd_image_t image,
+                           const char *imgname,
+                           size_t window,
+                           size_t buflen)
+{
+    virStorageBackendRBDAIOPtr aio;
+
+    if (VIR_ALLOC(aio) < 0 ||
+        VIR_ALLOC_N(aio->reqs, window) < 0) {
+        VIR_FREE(aio);
+        return NULL;
+    }
+
+    aio->image = image;
+    aio->imgname = imgname;
+    aio->nreqs = window;
+    aio->buflen = buflen;
+
+    return aio;
+}
+
+
+/* Wait for the oldest request to finish. Returns 0 on success or
+ * if there is none, -1 with an error reported if it failed. */
+static int
+virStorageBackendRBDAIOWaitHead(virStorageBackendRBDAIOPtr aio)
+{
+    virStorageBackendRBDAIOReqPtr req = &aio->reqs[aio->head];
+    ssize_t r;
+
+    if (!aio->inflight || !req->comp)
+        return 0;
+
+    rbd_aio_wait_for_complete(req->comp);
+    r = rbd_aio_get_return_value(req->comp);
+    rbd_aio_release(req->comp);
+    req->comp = NULL;
+
+    if (r >= 0)
+        return 0;
+
+    switch (req->op) {
+    case VIR_STORAGE_BACKEND_RBD_AIO_READ:
+        virReportSystemError(-r, _("reading %zu bytes failed on "
+                                   "RBD image %s at offset %llu"),
+                             req->len, aio->imgname,
+                             (unsigned long long)req->offset);
+        break;
+    case VIR_STORAGE_BACKEND_RBD_AIO_WRITE:
+        virReportSystemError(-r, _("writing %zu bytes failed on "
+                                   "RBD image %s at offset %llu"),
+                             req->len, aio->imgname,
+                             (unsigned long long)req->offset);
+        break;
+    case VIR_STORAGE_BACKEND_RBD_AIO_DISCARD:
+        virReportSystemError(-r, _("discarding %zu bytes failed on "
+                                   "RBD image %s at offset %llu"),
+                             req->len, aio->imgname,
+                             (unsigned long long)req->offset);
+        break;
+    }
+
+    return -1;
+}
+
+
+static void
+virStorageBackendRBDAIOPopHead(virStorageBackendRBDAIOPtr aio)
+{
+    aio->reqs[aio->head].consumed = 0;
+    aio->head = (aio->head + 1) % aio->nreqs;
+    aio->inflight--;
+}
+
+
+/* Returns the request to be submitted next, waiting for the oldest
+ * one to finish if all of them are in flight. */
+static virStorageBackendRBDAIOReqPtr
+virStorageBackendRBDAIONext(virStorageBackendRBDAIOPtr aio)
+{
+    virStorageBackendRBDAIOReqPtr req;
+
+    if (aio->inflight == aio->nreqs) {
+        if (virStorageBackendRBDAIOWaitHead(aio) < 0)
+            return NULL;
+        virStorageBackendRBDAIOPopHead(aio);
+    }
+
+    req = &aio->reqs[(aio->head + aio->inflight) % aio->nreqs];
+
+    if (aio->buflen && !req->buf &&
+        VIR_ALLOC_N(req->buf, aio->buflen) < 0)
+        return NULL;
+
+    return req;
+}
+
+
+/* Submit @req returned by virStorageBackendRBDAIONext. Writes use
+ * @buf if set, which must be kept intact until the request is
+ * finished, and the request's own buffer otherwise. */
+static int
+virStorageBackendRBDAIOSubmit(virStorageBackendRBDAIOPtr aio,
+                              virStorageBackendRBDAIOReqPtr req,
+                              virStorageBackendRBDAIOOp op,
+                              uint64_t offset,
+                              size_t len,
+                              const char *buf)
+{
+    int r;
+
+    req->op = op;
+    req->offset = offset;
+    req->len = len;
+
+    if ((r = rbd_aio_create_completion(NULL, NULL, &req->comp)) < 0) {
+        virReportSystemError(-r, _("failed to create AIO completion for "
+                                   "RBD image %s"), aio->imgname);
+        return -1;
+    }
+
+    switch (op) {
+    case VIR_STORAGE_BACKEND_RBD_AIO_READ:
+        r = rbd_aio_read(aio->image, offset, len, req->buf, req->comp);
+        break;
+    case VIR_STORAGE_BACKEND_RBD_AIO_WRITE:
+        r = rbd_aio_write(aio->image, offset, len,
+                          buf ? buf : req->buf, req->comp);
+        break;
+    case VIR_STORAGE_BACKEND_RBD_AIO_DISCARD:
+        r = rbd_aio_discard(aio->image, offset, len, req->comp);
+        break;
+    }
+
+    if (r < 0) {
+        virReportSystemError(-r, _("failed to submit I/O of %zu bytes to "
+                                   "RBD image %s at offset %llu"),
+                             len, aio->imgname, (unsigned long long)offset);
+        rbd_aio_release(req->comp);
+        req->comp = NULL;
+        return -1;
+    }
+
+    aio->inflight++;
+    return 0;
+}
+
+
+/* Wait for all requests in flight. Returns -1 if any of them failed. */
+static int
+virStorageBackendRBDAIODrain(virStorageBackendRBDAIOPtr aio)
+{
+    int ret = 0;
+
+    while (aio->inflight) {
+        if (virStorageBackendRBDAIOWaitHead(aio) < 0)
+            ret = -1;
+        virStorageBackendRBDAIOPopHead(aio);
+    }
+
+    return ret;
+}
+
+
+static void
+virStorageBackendRBDAIOFree(virStorageBackendRBDAIOPtr aio)
+{
+    virErrorPtr orig_err;
+    size_t i;
+
+    if (!aio)
+        return;
+
+    /* Buffers must not be freed while librbd may still use them */
+    virErrorPreserveLast(&orig_err);
+    ignore_value(virStorageBackendRBDAIODrain(aio));
+    virErrorRestore(&orig_err);
+
+    for (i = 0; i < aio->nreqs; i++)
+        VIR_FREE(aio->reqs[i].buf);
+    VIR_FREE(aio->reqs);
+    VIR_FREE(aio);
+}
+
+
 static int
 virStorageBackendRBDVolWipeZero(rbd_image_t image,
                                 char *imgname,
                                 rbd_image_info_t *info,
-                                uint64_t stripe_count)
+                                uint64_t stripe_count,
+                                size_t window)
 {
-    int r = -1;
+    int ret = -1;
     unsigned long long offset = 0;
     unsigned long long length;
+    virStorageBackendRBDAIOPtr aio = NULL;
+    virStorageBackendRBDAIOReqPtr req;
     VIR_AUTOFREE(char *) writebuf = NULL;
 
     if (VIR_ALLOC_N(writebuf, info->obj_size * stripe_count) < 0)
         return -1;
 
+    if (!(aio = virStorageBackendRBDAIONew(image, imgname, window, 0)))
+        return -1;
+
     while (offset < info->size) {
         length = MIN((info->size - offset), (info->obj_size * stripe_count));
 
-        if ((r = rbd_write(image, offset, length, writebuf)) < 0) {
-            virReportSystemError(-r, _("writing %llu bytes failed on "
-                                       "RBD image %s at offset %llu"),
-                                       length, imgname, offset);
-            return -1;
-        }
+        /* All requests share the same zeroed buffer */
+        if (!(req = virStorageBackendRBDAIONext(aio)) ||
+            virStorageBackendRBDAIOSubmit(aio, req,
+                                          VIR_STORAGE_BACKEND_RBD_AIO_WRITE,
+                                          offset, length, writebuf) < 0)
+            goto cleanup;
 
-        VIR_DEBUG("Wrote %llu bytes to RBD image %s at offset %llu",
+        VIR_DEBUG("Writing %llu bytes to RBD image %s at offset %llu",
                   length, imgname, offset);
 
         offset += length;
     }
 
-    return 0;
+    ret = virStorageBackendRBDAIODrain(aio);
+
+ cleanup:
+    virStorageBackendRBDAIOFree(aio);
+    return ret;
 }
 
 static int
 virStorageBackendRBDVolWipeDiscard(rbd_image_t image,
                                    char *imgname,
                                    rbd_image_info_t *info,
-                                   uint64_t stripe_count)
+                                   uint64_t stripe_count,
+                                   size_t window)
 {
-    int r = -1;
     int ret = -1;
     unsigned long long offset = 0;
     unsigned long long length;
+    virStorageBackendRBDAIOPtr aio = NULL;
+    virStorageBackendRBDAIOReqPtr req;
 
     VIR_DEBUG("Wiping RBD %s volume using discard)", imgname);
 
+    if (!(aio = virStorageBackendRBDAIONew(image, imgname, window, 0)))
+        return -1;
+
     while (offset < info->size) {
         length = MIN((info->size - offset), (info->obj_size * stripe_count));
 
-        if ((r = rbd_discard(image, offset, length)) < 0) {
-            virReportSystemError(-r, _("discarding %llu bytes failed on "
-                                       "RBD image %s at offset %llu"),
-                                     length, imgname, offset);
+        if (!(req = virStorageBackendRBDAIONext(aio)) ||
+            virStorageBackendRBDAIOSubmit(aio, req,
+                                          VIR_STORAGE_BACKEND_RBD_AIO_DISCARD,
+                                          offset, length, NULL) < 0)
             goto cleanup;
-        }
 
-        VIR_DEBUG("Discarded %llu bytes of RBD image %s at offset %llu",
+        VIR_DEBUG("Discarding %llu bytes of RBD image %s at offset %llu",
                   length, imgname, offset);
 
         offset += length;
     }
 
-    ret = 0;
+    ret = virStorageBackendRBDAIODrain(aio);
 
  cleanup:
+    virStorageBackendRBDAIOFree(aio);
     return ret;
 }
 
@@ -1452,6 +1752,7 @@ virStorageBackendRBDVolWipe(virStoragePoolObjPtr pool,
     rbd_image_t image = NULL;
     rbd_image_info_t info;
     uint64_t stripe_count;
+    size_t window;
     int r = -1;
     int ret = -1;
 
@@ -1484,17 +1785,20 @@ virStorageBackendRBDVolWipe(virStoragePoolObjPtr pool,
         goto cleanup;
     }
 
-    VIR_DEBUG("Need to wipe %"PRIu64" bytes from RBD image %s/%s",
-              info.size, def->source.name, vol->name);
+    window = virStorageBackendRBDAIOWindow(ptr);
+
+    VIR_DEBUG("Need to wipe %"PRIu64" bytes from RBD image %s/%s "
+              "with %zu requests in flight",
+              info.size, def->source.name, vol->name, window);
 
     switch ((virStorageVolWipeAlgorithm) algorithm) {
     case VIR_STORAGE_VOL_WIPE_ALG_ZERO:
         r = virStorageBackendRBDVolWipeZero(image, vol->name,
-                                            &info, stripe_count);
+                                            &info, stripe_count, window);
             break;
     case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
         r = virStorageBackendRBDVolWipeDiscard(image, vol->name,
-                                               &info, stripe_count);
+                                               &info, stripe_count, window);
         break;
     case VIR_STORAGE_VOL_WIPE_ALG_NNSA:
     case VIR_STORAGE_VOL_WIPE_ALG_DOD:
@@ -1510,11 +1814,9 @@ virStorageBackendRBDVolWipe(virStoragePoolObjPtr pool,
         goto cleanup;
     }
 
-    if (r < 0) {
-        virReportSystemError(-r, _("failed to wipe RBD image %s"),
-                             vol->name);
+    /* the error was reported already */
+    if (r < 0)
         goto cleanup;
-    }
 
     ret = 0;
 
@@ -1528,6 +1830,279 @@ virStorageBackendRBDVolWipe(virStoragePoolObjPtr pool,
 }
 
 
+/* Volume upload and download through librbd AIO */
+typedef struct _virStorageBackendRBDStream virStorageBackendRBDStream;
+typedef virStorageBackendRBDStream *virStorageBackendRBDStreamPtr;
+struct _virStorageBackendRBDStream {
+    virStorageBackendRBDStatePtr ptr;
+    rbd_image_t image;
+    char *imgname;
+    virStorageBackendRBDAIOPtr aio;
+
+    uint64_t offset;    /* next byte to submit */
+    uint64_t end;
+
+    /* upload: request being filled, its length and fill level */
+    virStorageBackendRBDAIOReqPtr req;
+    size_t reqlen;
+    size_t fill;
+};
+
+
+static void
+virStorageBackendRBDStreamFree(void *opaque)
+{
+    virStorageBackendRBDStreamPtr data = opaque;
+
+    if (!data)
+        return;
+
+    virStorageBackendRBDAIOFree(data->aio);
+    if (data->image)
+        rbd_close(data->image);
+    virStorageBackendRBDFreeState(&data->ptr);
+    VIR_FREE(data->imgname);
+    VIR_FREE(data);
+}
+
+
+static ssize_t
+virStorageBackendRBDStreamRead(char *buf,
+                               size_t len,
+                               void *opaque)
+{
+    virStorageBackendRBDStreamPtr data = opaque;
+    virStorageBackendRBDAIOPtr aio = data->aio;
+    virStorageBackendRBDAIOReqPtr req;
+    size_t n;
+
+    /* Keep the read ahead window full */
+    while (aio->inflight < aio->nreqs && data->offset < data->end) {
+        n = MIN(aio->buflen - data->offset % aio->buflen,
+                data->end - data->offset);
+
+        if (!(req = virStorageBackendRBDAIONext(aio)) ||
+            virStorageBackendRBDAIOSubmit(aio, req,
+                                          VIR_STORAGE_BACKEND_RBD_AIO_READ,
+                                          data->offset, n, NULL) < 0)
+            return -1;
+
+        data->offset += n;
+    }
+
+    if (!aio->inflight)
+        return 0;
+
+    if (virStorageBackendRBDAIOWaitHead(aio) < 0)
+        return -1;
+
+    req = &aio->reqs[aio->head];
+    n = MIN(len, req->len - req->consumed);
+    memcpy(buf, req->buf + req->consumed, n);
+    req->consumed += n;
+
+    if (req->consumed == req->len)
+        virStorageBackendRBDAIOPopHead(aio);
+
+    return n;
+}
+
+
+static int
+virStorageBackendRBDStreamSubmitWrite(virStorageBackendRBDStreamPtr data)
+{
+    virStorageBackendRBDAIOReqPtr req = data->req;
+
+    data->req = NULL;
+
+    if (virStorageBackendRBDAIOSubmit(data->aio, req,
+                                      VIR_STORAGE_BACKEND_RBD_AIO_WRITE,
+                                      data->offset, data->fill, NULL) < 0)
+        return -1;
+
+    data->offset += data->fill;
+    return 0;
+}
+
+
+static ssize_t
+virStorageBackendRBDStreamWrite(const char *buf,
+                                size_t len,
+                                void *opaque)
+{
+    virStorageBackendRBDStreamPtr data = opaque;
+    virStorageBackendRBDAIOPtr aio = data->aio;
+    size_t done = 0;
+    size_t n;
+
+    while (done < len) {
+        if (!data->req) {
+            if (data->offset == data->end) {
+                virReportError(VIR_ERR_OPERATION_INVALID,
+                               _("cannot write beyond the end of "
+                                 "RBD image %s"), data->imgname);
+                return -1;
+            }
+
+            if (!(data->req = virStorageBackendRBDAIONext(aio)))
+                return -1;
+
+            /* Let requests other than the first one start at an object
+             * boundary, so that each of them hits a single object */
+            data->reqlen = MIN(aio->buflen - data->offset % aio->buflen,
+                               data->end - data->offset);
+            data->fill = 0;
+        }
+
+        n = MIN(len - done, data->reqlen - data->fill);
+        memcpy(data->req->buf + data->fill, buf + done, n);
+        data->fill += n;
+        done += n;
+
+        if (data->fill == data->reqlen &&
+            virStorageBackendRBDStreamSubmitWrite(data) < 0)
+            return -1;
+    }
+
+    return len;
+}
+
+
+static int
+virStorageBackendRBDStreamFinish(void *opaque)
+{
+    virStorageBackendRBDStreamPtr data = opaque;
+    int r;
+
+    if (data->req &&
+        virStorageBackendRBDStreamSubmitWrite(data) < 0)
+        return -1;
+
+    if (virStorageBackendRBDAIODrain(data->aio) < 0)
+        return -1;
+
+    if ((r = rbd_flush(data->image)) < 0) {
+        virReportSystemError(-r, _("failed to flush RBD image %s"),
+                             data->imgname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static virFDStreamIOCallbacks virStorageBackendRBDStreamIO = {
+    .read = virStorageBackendRBDStreamRead,
+    .write = virStorageBackendRBDStreamWrite,
+    .finish = virStorageBackendRBDStreamFinish,
+    .free = virStorageBackendRBDStreamFree,
+};
+
+
+static int
+virStorageBackendRBDVolStreamOpen(virStoragePoolObjPtr pool,
+                                  virStorageVolDefPtr vol,
+                                  virStreamPtr stream,
+                                  unsigned long long offset,
+                                  unsigned long long len,
+                                  int oflags)
+{
+    virStorageBackendRBDStreamPtr data = NULL;
+    rbd_image_info_t info;
+    size_t buflen;
+    size_t window;
+    int r;
+
+    if (VIR_ALLOC(data) < 0 ||
+        VIR_STRDUP(data->imgname, vol->name) < 0)
+        goto error;
+
+    virObjectLock(pool);
+    data->ptr = virStorageBackendRBDNewState(pool);
+    virObjectUnlock(pool);
+
+    if (!data->ptr)
+        goto error;
+
+    if ((r = rbd_open(data->ptr->ioctx, vol->name, &data->image, NULL)) < 0) {
+        data->image = NULL;
+        virReportSystemError(-r, _("failed to open the RBD image %s"),
+                             vol->name);
+        goto error;
+    }
+
+    if ((r = rbd_stat(data->image, &info, sizeof(info))) < 0) {
+        virReportSystemError(-r, _("failed to stat the RBD image %s"),
+                             vol->name);
+        goto error;
+    }
+
+    if (offset > info.size) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("offset %llu is beyond the end of RBD image %s"),
+                       offset, vol->name);
+        goto error;
+    }
+
+    data->offset = offset;
+    data->end = info.size;
+    if (len && len < info.size - offset)
+        data->end = offset + len;
+
+    /* One object per request, but don't let a huge object size of the
+     * image make the window take too much memory */
+    buflen = MIN(info.obj_size, VIR_STORAGE_BACKEND_RBD_AIO_BUFLEN_MAX);
+    window = MIN(virStorageBackendRBDAIOWindow(data->ptr),
+                 MAX(1, VIR_STORAGE_BACKEND_RBD_AIO_MEM_MAX / buflen));
+
+    if (!(data->aio = virStorageBackendRBDAIONew(data->image, data->imgname,
+                                                 window, buflen)))
+        goto error;
+
+    VIR_DEBUG("Streaming RBD image %s from offset %llu to %llu "
+              "with %zu requests in flight",
+              vol->name, offset, (unsigned long long)data->end,
+              data->aio->nreqs);
+
+    return virFDStreamOpenIOCallbacks(stream, &virStorageBackendRBDStreamIO,
+                                      data, data->end - offset, oflags);
+
+ error:
+    virStorageBackendRBDStreamFree(data);
+    return -1;
+}
+
+
+static int
+virStorageBackendRBDVolUpload(virStoragePoolObjPtr pool,
+                              virStorageVolDefPtr vol,
+                              virStreamPtr stream,
+                              unsigned long long offset,
+                              unsigned long long len,
+                              unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    return virStorageBackendRBDVolStreamOpen(pool, vol, stream,
+                                             offset, len, O_WRONLY);
+}
+
+
+static int
+virStorageBackendRBDVolDownload(virStoragePoolObjPtr pool,
+                                virStorageVolDefPtr vol,
+                                virStreamPtr stream,
+                                unsigned long long offset,
+                                unsigned long long len,
+                                unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    return virStorageBackendRBDVolStreamOpen(pool, vol, stream,
+                                             offset, len, O_RDONLY);
+}
+
+
 virStorageBackend virStorageBackendRBD = {
     .type = VIR_STORAGE_POOL_RBD,
 
@@ -1538,6 +2113,8 @@ virStorageBackend virStorageBackendRBD = {
     .refreshVol = virStorageBackendRBDRefreshVol,
     .deleteVol = virStorageBackendRBDDeleteVol,
     .resizeVol = virStorageBackendRBDResizeVol,
+    .uploadVol = virStorageBackendRBDVolUpload,
+    .downloadVol = virStorageBackendRBDVolDownload,
     .wipeVol = virStorageBackendRBDVolWipe
 };
 
@@ -81,9 +81,11 @@ storagePoolRefreshFailCleanup(virStorageBackendPtr backend,
                               virStoragePoolObjPtr obj,
                               const char *stateFile)
 {
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
     virErrorPtr orig_err = virSaveLastError();
 
     virStoragePoolObjClearVols(obj);
+    virStorageBackendProbeCacheDropPool(def->target.path);
 
     if (stateFile)
         unlink(stateFile);
@@ -123,6 +125,9 @@ static void
 virStoragePoolUpdateInactive(virStoragePoolObjPtr *objptr)
 {
     virStoragePoolObjPtr obj = *objptr;
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+
+    virStorageBackendProbeCacheDropPool(def->target.path);
 
     if (!virStoragePoolObjGetConfigFile(obj)) {
         virStoragePoolObjRemove(driver->pools, obj);
@@ -913,6 +918,7 @@ storagePoolUndefine(virStoragePoolPtr pool)
                                             0);
 
     VIR_INFO("Undefining storage pool '%s'", def->name);
+    virStorageBackendProbeCacheDropPool(def->target.path);
     virStoragePoolObjRemove(driver->pools, obj);
     virObjectUnref(obj);
     obj = NULL;
@@ -1547,9 +1553,13 @@ storageVolLookupByKey(virConnectPtr conn,
         .key = key, .voldef = NULL };
     virStorageVolPtr vol = NULL;
 
-    if ((obj = virStoragePoolObjListSearch(driver->pools,
-                                           storageVolLookupByKeyCallback,
-                                           &data)) && data.voldef) {
+    /* The index misses volumes whose entry couldn't be added, search
+     * through all pools then, like for paths below. */
+    if ((obj = virStoragePoolObjListFindVolByKey(driver->pools,
+                                                 key, &data.voldef)) ||
+        ((obj = virStoragePoolObjListSearch(driver->pools,
+                                            storageVolLookupByKeyCallback,
+                                            &data)) && data.voldef)) {
         def = virStoragePoolObjGetDef(obj);
         if (virStorageVolLookupByKeyEnsureACL(conn, def, data.voldef) == 0) {
             vol = virGetStorageVol(conn, def->name,
@@ -1630,9 +1640,15 @@ storageVolLookupByPath(virConnectPtr conn,
     if (!(data.cleanpath = virFileSanitizePath(path)))
         return NULL;
 
-    if ((obj = virStoragePoolObjListSearch(driver->pools,
-                                           storageVolLookupByPathCallback,
-                                           &data)) && data.voldef) {
+    /* Most lookups use the volume's target path as is, only search
+     * through all pools translating @path to each pool's stable path
+     * if that is not the case. */
+    if ((obj = virStoragePoolObjListFindVolByPath(driver->pools,
+                                                  data.cleanpath,
+                                                  &data.voldef)) ||
+        ((obj = virStoragePoolObjListSearch(driver->pools,
+                                            storageVolLookupByPathCallback,
+                                            &data)) && data.voldef)) {
         def = virStoragePoolObjGetDef(obj);
 
         if (virStorageVolLookupByPathEnsureACL(conn, def, data.voldef) == 0) {
@@ -77,6 +77,7 @@
 #include "virstring.h"
 #include "virxml.h"
 #include "virfdstream.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -100,6 +101,10 @@ virStorageBackendNamespaceInit(int poolType,
 
 #define READ_BLOCK_SIZE_DEFAULT  (1024 * 1024)
 #define WRITE_BLOCK_SIZE_DEFAULT (4 * 1024)
+#define COPY_RANGE_SIZE_MAX      (1024ULL * 1024 * 1024)
+#define WIPE_BLOCK_SIZE_DEFAULT  (1024 * 1024)
+#define WIPE_WORKERS_MAX         4
+#define PROBE_WORKERS_MAX        8
 
 /*
  * Perform the O(1) btrfs clone operation, if possible.
@@ -122,6 +127,169 @@ reflinkCloneFile(int dest_fd ATTRIBUTE_UNUSED,
 #endif
 
 
+/*
+ * Check whether @buf of @len bytes contains only zeroes. Once the first
+ * few bytes are known to be zero, comparing the buffer with itself
+ * shifted by that amount lets memcmp() use its vectorized implementation
+ * without the need for a separate zero-filled buffer.
+ */
+static bool
+storageBackendBufferIsZero(const char *buf,
+                           size_t len)
+{
+    size_t head = MIN(len, 16);
+    size_t i;
+
+    for (i = 0; i < head; i++) {
+        if (buf[i])
+            return false;
+    }
+
+    return len == head || memcmp(buf, buf + head, len - head) == 0;
+}
+
+
+/*
+ * Copy up to @len bytes from the current position of @inputfd to the
+ * current position of @fd through @buf. Blocks of @wbytes consisting of
+ * zeroes are skipped if @want_sparse is set. The amount of bytes
+ * consumed from @inputfd, which is less than @len only if EOF was
+ * reached, is stored in @copied.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+static int
+storageBackendCopyRange(virStorageVolDefPtr vol,
+                        virStorageVolDefPtr inputvol,
+                        int inputfd,
+                        int fd,
+                        char *buf,
+                        size_t bufsize,
+                        int wbytes,
+                        unsigned long long len,
+                        bool want_sparse,
+                        unsigned long long *copied)
+{
+    size_t rbytes = bufsize;
+    int amtread = -1;
+    int interval;
+    int ret;
+
+    *copied = 0;
+
+    while (amtread != 0) {
+        int amtleft;
+
+        if (len - *copied < rbytes)
+            rbytes = len - *copied;
+
+        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
+            ret = -errno;
+            virReportSystemError(errno,
+                                 _("failed reading from file '%s'"),
+                                 inputvol->target.path);
+            return ret;
+        }
+        *copied += amtread;
+
+        /* Loop over amt read in wbytes increments, looking for sparse
+         * blocks */
+        amtleft = amtread;
+        while (amtleft > 0) {
+            int offset = amtread - amtleft;
+            interval = ((wbytes > amtleft) ? amtleft : wbytes);
+
+            if (want_sparse && storageBackendBufferIsZero(buf + offset, interval)) {
+                if (lseek(fd, interval, SEEK_CUR) < 0) {
+                    ret = -errno;
+                    virReportSystemError(errno,
+                                         _("cannot extend file '%s'"),
+                                         vol->target.path);
+                    return ret;
+                }
+            } else if (safewrite(fd, buf + offset, interval) < 0) {
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("failed writing to file '%s'"),
+                                     vol->target.path);
+                return ret;
+            }
+
+            amtleft -= interval;
+        }
+    }
+
+    return 0;
+}
+
+
+#if HAVE_COPY_FILE_RANGE
+/*
+ * Copy up to @len bytes between the current positions of @inputfd and
+ * @fd inside the kernel, which avoids bouncing the data through
+ * userspace and lets filesystems share the extents instead of copying
+ * them. The amount of bytes copied is stored in @copied.
+ *
+ * Returns 0 on success, 1 if the file systems do not support such copy
+ * before anything was copied, -errno on error.
+ */
+static int
+storageBackendCopyRangeKernel(virStorageVolDefPtr vol,
+                              virStorageVolDefPtr inputvol,
+                              int inputfd,
+                              int fd,
+                              unsigned long long len,
+                              unsigned long long *copied)
+{
+    ssize_t rc;
+    int ret;
+
+    *copied = 0;
+
+    while (*copied < len) {
+        if ((rc = copy_file_range(inputfd, NULL, fd, NULL,
+                                  MIN(len - *copied, COPY_RANGE_SIZE_MAX),
+                                  0)) < 0) {
+            if (*copied == 0 &&
+                (errno == ENOSYS || errno == EXDEV ||
+                 errno == EINVAL || errno == EOPNOTSUPP)) {
+                char ebuf[1024];
+                VIR_DEBUG("copy_file_range from '%s' to '%s' is not "
+                          "supported: %s", inputvol->target.path,
+                          vol->target.path,
+                          virStrerror(errno, ebuf, sizeof(ebuf)));
+                return 1;
+            }
+
+            ret = -errno;
+            virReportSystemError(errno,
+                                 _("failed copying from '%s' to '%s'"),
+                                 inputvol->target.path, vol->target.path);
+            return ret;
+        }
+
+        /* EOF */
+        if (rc == 0)
+            break;
+
+        *copied += rc;
+    }
+
+    return 0;
+}
+#endif /* HAVE_COPY_FILE_RANGE */
+
+
+/*
+ * Copy the contents of @inputvol into @fd. At most *@total bytes are
+ * copied and *@total is decreased by the amount processed.
+ *
+ * If @want_sparse is set, holes in @inputvol are found with SEEK_DATA
+ * and SEEK_HOLE and skipped, data extents are copied by the kernel
+ * where possible and blocks of zeroes are not written to @fd.
+ *
+ * Returns 0 on success, -errno on error.
+ */
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
@@ -130,13 +298,14 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           bool want_sparse,
                           bool reflink_copy)
 {
-    int amtread = -1;
     int ret = 0;
     size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
     int wbytes = 0;
-    int interval;
     struct stat st;
-    VIR_AUTOFREE(char *) zerobuf = NULL;
+    bool useExtents = want_sparse;
+#if HAVE_COPY_FILE_RANGE
+    bool useKernelCopy = want_sparse;
+#endif
     VIR_AUTOFREE(char *) buf = NULL;
     VIR_AUTOCLOSE inputfd = -1;
 
@@ -157,9 +326,6 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     if (wbytes < WRITE_BLOCK_SIZE_DEFAULT)
         wbytes = WRITE_BLOCK_SIZE_DEFAULT;
 
-    if (VIR_ALLOC_N(zerobuf, wbytes) < 0)
-        return -errno;
-
     if (VIR_ALLOC_N(buf, rbytes) < 0)
         return -errno;
 
@@ -176,45 +342,66 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         }
     }
 
-    while (amtread != 0) {
-        int amtleft;
-
-        if (*total < rbytes)
-            rbytes = *total;
-
-        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
-            ret = -errno;
-            virReportSystemError(errno,
-                                 _("failed reading from file '%s'"),
-                                 inputvol->target.path);
-            return ret;
+    while (*total > 0) {
+        unsigned long long len = *total;
+        unsigned long long copied = 0;
+        int inData = 1;
+        long long extent;
+
+        if (useExtents) {
+            if (virFileInData(inputfd, &inData, &extent) < 0) {
+                VIR_DEBUG("Unable to find extents of '%s', copying all data",
+                          inputvol->target.path);
+                virResetLastError();
+                useExtents = false;
+            } else if (!inData && extent == 0) {
+                /* EOF */
+                break;
+            } else {
+                len = MIN(len, extent);
+            }
         }
-        *total -= amtread;
 
-        /* Loop over amt read in 512 byte increments, looking for sparse
-         * blocks */
-        amtleft = amtread;
-        do {
-            interval = ((wbytes > amtleft) ? amtleft : wbytes);
-            int offset = amtread - amtleft;
-
-            if (want_sparse && memcmp(buf+offset, zerobuf, interval) == 0) {
-                if (lseek(fd, interval, SEEK_CUR) < 0) {
-                    ret = -errno;
-                    virReportSystemError(errno,
-                                         _("cannot extend file '%s'"),
-                                         vol->target.path);
-                    return ret;
-                }
-            } else if (safewrite(fd, buf+offset, interval) < 0) {
+        if (!inData) {
+            /* Holes are kept as holes in the target */
+            if (lseek(inputfd, len, SEEK_CUR) < 0 ||
+                lseek(fd, len, SEEK_CUR) < 0) {
                 ret = -errno;
                 virReportSystemError(errno,
-                                     _("failed writing to file '%s'"),
-                                     vol->target.path);
+                                     _("cannot skip hole when copying '%s' to '%s'"),
+                                     inputvol->target.path, vol->target.path);
                 return ret;
+            }
+            *total -= len;
+            continue;
+        }
 
+#if HAVE_COPY_FILE_RANGE
+        if (useKernelCopy) {
+            if ((ret = storageBackendCopyRangeKernel(vol, inputvol, inputfd, fd,
+                                                     len, &copied)) < 0)
+                return ret;
+
+            if (ret == 1) {
+                useKernelCopy = false;
+                ret = 0;
+            } else {
+                *total -= copied;
+                if (copied < len)
+                    break;
+                continue;
             }
-        } while ((amtleft -= interval) > 0);
+        }
+#endif /* HAVE_COPY_FILE_RANGE */
+
+        if ((ret = storageBackendCopyRange(vol, inputvol, inputfd, fd,
+                                           buf, rbytes, wbytes, len,
+                                           want_sparse, &copied)) < 0)
+            return ret;
+
+        *total -= copied;
+        if (copied < len)
+            break;
     }
 
     if (fdatasync(fd) < 0) {
@@ -2520,22 +2707,150 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/*
+ * Try to have the kernel zero @len bytes at @offset of @fd without
+ * transferring any data: BLKZEROOUT for block devices (which the
+ * device may satisfy with WRITE ZEROES / WRITE SAME) and
+ * FALLOC_FL_ZERO_RANGE for regular files.
+ *
+ * Returns 0 if the range was zeroed, 1 if zeroing could not be
+ * offloaded and the caller has to write the zeroes itself, -1 on
+ * error with error reported.
+ */
+static int
+storageBackendWipeOffload(const char *path,
+                          int fd,
+                          const struct stat *st,
+                          off_t offset,
+                          unsigned long long len)
+{
+#if defined(__linux__) && defined(BLKZEROOUT)
+    if (S_ISBLK(st->st_mode)) {
+        uint64_t range[2] = { offset, len };
+
+        if (ioctl(fd, BLKZEROOUT, range) == 0)
+            return 0;
+
+        /* Unaligned ranges are rejected with EINVAL */
+        if (errno != ENOTTY && errno != EOPNOTSUPP && errno != EINVAL) {
+            virReportSystemError(errno,
+                                 _("Failed to zero %llu bytes of volume "
+                                   "with path '%s'"),
+                                 len, path);
+            return -1;
+        }
+
+        VIR_DEBUG("BLKZEROOUT not usable on '%s': errno=%d", path, errno);
+        return 1;
+    }
+#endif
+
+/* Avoid issues with older kernel's <linux/fs.h> namespace pollution. */
+#if HAVE_FALLOCATE - 0 && defined(FALLOC_FL_ZERO_RANGE)
+    if (S_ISREG(st->st_mode)) {
+        if (fallocate(fd, FALLOC_FL_ZERO_RANGE, offset, len) == 0)
+            return 0;
+
+        if (errno != ENOSYS && errno != EOPNOTSUPP) {
+            virReportSystemError(errno,
+                                 _("Failed to zero %llu bytes of volume "
+                                   "with path '%s'"),
+                                 len, path);
+            return -1;
+        }
+
+        VIR_DEBUG("FALLOC_FL_ZERO_RANGE not usable on '%s': errno=%d",
+                  path, errno);
+        return 1;
+    }
+#endif
+
+    return 1;
+}
+
+
+typedef struct _storageBackendWipeData storageBackendWipeData;
+typedef storageBackendWipeData *storageBackendWipeDataPtr;
+struct _storageBackendWipeData {
+    virMutex lock;
+
+    int fd;
+    const char *buf;
+    size_t buflen;
+
+    off_t next;     /* offset of the next chunk to be written */
+    off_t end;
+
+    int err;        /* errno of the first failed write */
+    size_t errlen;  /* length of the chunk that failed */
+};
+
+
+/*
+ * Write zeroes to chunks of the wipe range until there is none left or
+ * any writer failed. Several of these run in parallel so that more than
+ * one request is outstanding on the device.
+ */
+static void
+storageBackendWipeWorker(void *opaque)
+{
+    storageBackendWipeDataPtr data = opaque;
+
+    for (;;) {
+        off_t offset;
+        size_t len;
+        size_t done = 0;
+
+        virMutexLock(&data->lock);
+        if (data->err || data->next >= data->end) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        offset = data->next;
+        len = MIN(data->buflen, data->end - offset);
+        data->next += len;
+        virMutexUnlock(&data->lock);
+
+        while (done < len) {
+            ssize_t r = pwrite(data->fd, data->buf, len - done, offset + done);
+
+            if (r < 0 && errno == EINTR)
+                continue;
+
+            if (r <= 0) {
+                virMutexLock(&data->lock);
+                if (!data->err) {
+                    data->err = r < 0 ? errno : ENOSPC;
+                    data->errlen = len;
+                }
+                virMutexUnlock(&data->lock);
+                return;
+            }
+
+            done += r;
+        }
+    }
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
+                        const struct stat *st,
                         unsigned long long wipe_len,
                         size_t writebuf_length,
                         bool zero_end)
 {
-    int written = 0;
-    unsigned long long remaining = 0;
+    storageBackendWipeData data;
+    virThread workers[WIPE_WORKERS_MAX];
+    size_t nworkers;
+    size_t nstarted = 0;
+    size_t i;
     off_t size;
-    size_t write_size = 0;
+    int rc;
+    char ebuf[1024];
     VIR_AUTOFREE(char *) writebuf = NULL;
 
-    if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
-        return -1;
-
     if (!zero_end) {
         if ((size = lseek(fd, 0, SEEK_SET)) < 0) {
             virReportSystemError(errno,
@@ -2556,23 +2871,61 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
-    remaining = wipe_len;
-    while (remaining > 0) {
+    if ((rc = storageBackendWipeOffload(path, fd, st, size, wipe_len)) < 0)
+        return -1;
 
-        write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
-        written = safewrite(fd, writebuf, write_size);
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %zu bytes to "
-                                   "storage volume with path '%s'"),
-                                 write_size, path);
+    if (rc == 0) {
+        VIR_DEBUG("Zeroing of volume with path '%s' offloaded", path);
+        goto sync;
+    }
 
-            return -1;
+    if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
+        return -1;
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    data.fd = fd;
+    data.buf = writebuf;
+    data.buflen = writebuf_length;
+    data.next = size;
+    data.end = size + wipe_len;
+
+    nworkers = MIN(WIPE_WORKERS_MAX, VIR_DIV_UP(wipe_len, writebuf_length));
+
+    /* The calling thread does its share of the work too */
+    for (i = 1; i < nworkers; i++) {
+        if (virThreadCreate(&workers[nstarted], true,
+                            storageBackendWipeWorker, &data) < 0) {
+            VIR_WARN("Failed to start wipe worker thread: %s",
+                     virStrerror(errno, ebuf, sizeof(ebuf)));
+            break;
         }
+        nstarted++;
+    }
+
+    VIR_DEBUG("Wiping volume with path '%s' using %zu writers",
+              path, nstarted + 1);
+
+    storageBackendWipeWorker(&data);
 
-        remaining -= written;
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&workers[i]);
+
+    virMutexDestroy(&data.lock);
+
+    if (data.err) {
+        virReportSystemError(data.err,
+                             _("Failed to write %zu bytes to "
+                               "storage volume with path '%s'"),
+                             data.errlen, path);
+        return -1;
     }
 
+ sync:
     if (fdatasync(fd) < 0) {
         virReportSystemError(errno,
                              _("cannot sync data to volume with path '%s'"),
@@ -2663,7 +3016,8 @@ storageBackendVolWipeLocalFile(const char *path,
     if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE))
         return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
 
-    return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
+    return storageBackendWipeLocal(path, fd, &st, allocation,
+                                   MAX(st.st_blksize, WIPE_BLOCK_SIZE_DEFAULT),
                                    zero_end);
 }
 
@@ -3352,6 +3706,246 @@ virStorageBackendDeviceIsEmpty(const char *devpath,
 }
 
 
+/*
+ * Image metadata probed from files of local pools, keyed by path.
+ * An entry is only used while its virFileStamp matches, which lets a
+ * refresh of a pool with many unchanged volumes skip reading and
+ * parsing their headers.
+ */
+typedef struct _virStorageBackendProbeCacheEntry virStorageBackendProbeCacheEntry;
+typedef virStorageBackendProbeCacheEntry *virStorageBackendProbeCacheEntryPtr;
+struct _virStorageBackendProbeCacheEntry {
+    virFileStamp stamp;
+
+    unsigned long long generation; /* last refresh the entry was used in */
+
+    virStorageSourcePtr meta;
+    int backingStoreFormat;
+};
+
+#define VIR_STORAGE_BACKEND_PROBE_CACHE_MAX 1024
+
+static virMutex probeCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr probeCache;
+static unsigned long long probeCacheGeneration;
+
+
+static void
+virStorageBackendProbeCacheEntryFree(void *payload,
+                                     const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageBackendProbeCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    virObjectUnref(entry->meta);
+    VIR_FREE(entry);
+}
+
+
+/*
+ * Look up cached metadata of @path described by @sb.
+ *
+ * Returns 1 and fills @meta with a copy of the cached metadata and
+ * @backingStoreFormat on a hit, 0 on a miss, -1 on error.
+ */
+int
+virStorageBackendProbeCacheGet(const char *path,
+                               const struct stat *sb,
+                               virStorageSourcePtr *meta,
+                               int *backingStoreFormat)
+{
+    virStorageBackendProbeCacheEntryPtr entry;
+    int ret = 0;
+
+    virMutexLock(&probeCacheLock);
+
+    if (!probeCache ||
+        !(entry = virHashLookup(probeCache, path)))
+        goto cleanup;
+
+    if (!virFileStampMatch(&entry->stamp, sb)) {
+        ignore_value(virHashRemoveEntry(probeCache, path));
+        goto cleanup;
+    }
+
+    if (!(*meta = virStorageSourceCopy(entry->meta, false))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    *backingStoreFormat = entry->backingStoreFormat;
+    entry->generation = probeCacheGeneration;
+    ret = 1;
+
+ cleanup:
+    virMutexUnlock(&probeCacheLock);
+    return ret;
+}
+
+
+static int
+storageBackendProbeCacheEvictIter(const void *payload,
+                                  const void *name ATTRIBUTE_UNUSED,
+                                  const void *opaque ATTRIBUTE_UNUSED)
+{
+    const virStorageBackendProbeCacheEntry *entry = payload;
+
+    return entry->generation < probeCacheGeneration;
+}
+
+
+/*
+ * Remember @meta probed from @path described by @sb, unless the file
+ * changed too recently for virFileStampSet.
+ *
+ * Once the cache is full, entries not used by the latest refresh are
+ * dropped. If that doesn't make room, @meta is not cached.
+ *
+ * Returns 0 on success (including when nothing was cached), -1 on error.
+ */
+int
+virStorageBackendProbeCacheSet(const char *path,
+                               const struct stat *sb,
+                               const virStorageSource *meta,
+                               int backingStoreFormat)
+{
+    virStorageBackendProbeCacheEntryPtr entry = NULL;
+    int ret = -1;
+
+    if (VIR_ALLOC(entry) < 0)
+        return -1;
+
+    if (!virFileStampSet(&entry->stamp, sb)) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    entry->backingStoreFormat = backingStoreFormat;
+
+    if (!(entry->meta = virStorageSourceCopy(meta, false)))
+        goto cleanup;
+
+    virMutexLock(&probeCacheLock);
+
+    if (!probeCache &&
+        !(probeCache = virHashCreate(64, virStorageBackendProbeCacheEntryFree))) {
+        virMutexUnlock(&probeCacheLock);
+        goto cleanup;
+    }
+
+    if (virHashSize(probeCache) >= VIR_STORAGE_BACKEND_PROBE_CACHE_MAX &&
+        !virHashLookup(probeCache, path)) {
+        ignore_value(virHashRemoveSet(probeCache,
+                                      storageBackendProbeCacheEvictIter,
+                                      NULL));
+
+        if (virHashSize(probeCache) >= VIR_STORAGE_BACKEND_PROBE_CACHE_MAX) {
+            virMutexUnlock(&probeCacheLock);
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
+    entry->generation = probeCacheGeneration;
+    if (virHashUpdateEntry(probeCache, path, entry) < 0) {
+        virMutexUnlock(&probeCacheLock);
+        goto cleanup;
+    }
+    entry = NULL;
+
+    virMutexUnlock(&probeCacheLock);
+    ret = 0;
+
+ cleanup:
+    virStorageBackendProbeCacheEntryFree(entry, NULL);
+    return ret;
+}
+
+
+/*
+ * Start a refresh of a pool, returns the generation to be passed to
+ * storageBackendProbeCachePrune() once the refresh is done.
+ */
+static unsigned long long
+storageBackendProbeCacheBegin(void)
+{
+    unsigned long long ret;
+
+    virMutexLock(&probeCacheLock);
+    ret = ++probeCacheGeneration;
+    virMutexUnlock(&probeCacheLock);
+
+    return ret;
+}
+
+
+struct storageBackendProbeCachePruneData {
+    const char *dir;
+    size_t dirlen;
+    unsigned long long generation;
+};
+
+
+static int
+storageBackendProbeCachePruneIter(const void *payload,
+                                  const void *name,
+                                  const void *opaque)
+{
+    const virStorageBackendProbeCacheEntry *entry = payload;
+    const struct storageBackendProbeCachePruneData *data = opaque;
+    const char *path = name;
+
+    /* Only direct children of @dir belong to the pool */
+    if (STRNEQLEN(path, data->dir, data->dirlen) ||
+        path[data->dirlen] != '/' ||
+        strchr(path + data->dirlen + 1, '/'))
+        return 0;
+
+    return entry->generation < data->generation;
+}
+
+
+/*
+ * Drop entries for files in @dir which were not seen by the refresh
+ * started as @generation, i.e. files which are gone from the pool.
+ */
+static void
+storageBackendProbeCachePrune(const char *dir,
+                              unsigned long long generation)
+{
+    struct storageBackendProbeCachePruneData data = {
+        .dir = dir, .dirlen = strlen(dir), .generation = generation,
+    };
+
+    virMutexLock(&probeCacheLock);
+    if (probeCache)
+        ignore_value(virHashRemoveSet(probeCache,
+                                      storageBackendProbeCachePruneIter,
+                                      &data));
+    virMutexUnlock(&probeCacheLock);
+}
+
+
+/**
+ * virStorageBackendProbeCacheDropPool:
+ * @dir: target path of a pool
+ *
+ * Drop cached metadata of all files in @dir, to be called once the
+ * pool is stopped or undefined.
+ */
+void
+virStorageBackendProbeCacheDropPool(const char *dir)
+{
+    if (!dir)
+        return;
+
+    /* every entry is older than that */
+    storageBackendProbeCachePrune(dir, ULLONG_MAX);
+}
+
+
 static int
 storageBackendProbeTarget(virStorageSourcePtr target,
                           virStorageEncryptionPtr *encryption)
@@ -3384,12 +3978,22 @@ storageBackendProbeTarget(virStorageSourcePtr target,
         }
     }
 
-    if (!(meta = virStorageFileGetMetadataFromFD(target->path,
-                                                 fd,
-                                                 VIR_STORAGE_FILE_AUTO,
-                                                 &backingStoreFormat)))
+    if ((rc = virStorageBackendProbeCacheGet(target->path, &sb,
+                                             &meta, &backingStoreFormat)) < 0)
         return -1;
 
+    if (rc == 0) {
+        if (!(meta = virStorageFileGetMetadataFromFD(target->path,
+                                                     fd,
+                                                     VIR_STORAGE_FILE_AUTO,
+                                                     &backingStoreFormat)))
+            return -1;
+
+        if (virStorageBackendProbeCacheSet(target->path, &sb,
+                                           meta, backingStoreFormat) < 0)
+            return -1;
+    }
+
     if (meta->backingStoreRaw) {
         if (!(target->backingStore = virStorageSourceNewFromBacking(meta)))
             return -1;
@@ -3513,6 +4117,130 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol)
 }
 
 
+typedef struct _virStorageBackendProbeVolsData virStorageBackendProbeVolsData;
+typedef virStorageBackendProbeVolsData *virStorageBackendProbeVolsDataPtr;
+struct _virStorageBackendProbeVolsData {
+    virMutex lock;
+    virStorageBackendVolProbePtr probes;
+    size_t nprobes;
+    size_t next;
+
+    virStorageBackendProbeVolFunc func;
+    void *opaque;
+};
+
+
+static void
+virStorageBackendProbeVolsWorker(void *opaque)
+{
+    virStorageBackendProbeVolsDataPtr data = opaque;
+
+    for (;;) {
+        virStorageBackendVolProbePtr probe;
+
+        virMutexLock(&data->lock);
+        if (data->next == data->nprobes) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        probe = &data->probes[data->next++];
+        virMutexUnlock(&data->lock);
+
+        if ((probe->rc = data->func(probe->vol, data->opaque)) < 0)
+            virErrorPreserveLast(&probe->error);
+    }
+}
+
+
+/**
+ * virStorageBackendProbeVols:
+ * @probes: volumes to probe
+ * @nprobes: number of items in @probes
+ * @func: function probing a single volume
+ * @opaque: data passed to @func
+ *
+ * Call @func on the volume of each item of @probes, using up to
+ * PROBE_WORKERS_MAX threads so that the time spent waiting for I/O or
+ * network round trips of different volumes overlaps. The return value
+ * of @func is stored in the item's @rc and, if it is negative, the error
+ * it reported in the item's @error. It is up to the caller to decide
+ * which failures are fatal, and to add the volumes to the pool in the
+ * order of @probes afterwards.
+ */
+void
+virStorageBackendProbeVols(virStorageBackendVolProbePtr probes,
+                           size_t nprobes,
+                           virStorageBackendProbeVolFunc func,
+                           void *opaque)
+{
+    virStorageBackendProbeVolsData data = {
+        .probes = probes, .nprobes = nprobes, .func = func, .opaque = opaque,
+    };
+    virThread workers[PROBE_WORKERS_MAX];
+    size_t nworkers = MIN(PROBE_WORKERS_MAX, nprobes);
+    size_t nstarted = 0;
+    size_t i;
+
+    if (virMutexInit(&data.lock) < 0) {
+        VIR_WARN("Failed to initialize mutex, probing volumes serially");
+        nworkers = 0;
+    }
+
+    /* The calling thread does its share of the work too */
+    for (i = 1; i < nworkers; i++) {
+        if (virThreadCreate(&workers[nstarted], true,
+                            virStorageBackendProbeVolsWorker, &data) < 0) {
+            VIR_WARN("Failed to start volume probe worker thread");
+            break;
+        }
+        nstarted++;
+    }
+
+    VIR_DEBUG("Probing %zu volumes using %zu threads", nprobes, nstarted + 1);
+
+    if (nworkers == 0) {
+        for (i = 0; i < nprobes; i++) {
+            if ((probes[i].rc = func(probes[i].vol, opaque)) < 0)
+                virErrorPreserveLast(&probes[i].error);
+        }
+        return;
+    }
+
+    virStorageBackendProbeVolsWorker(&data);
+
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&workers[i]);
+
+    virMutexDestroy(&data.lock);
+}
+
+
+void
+virStorageBackendVolProbesFree(virStorageBackendVolProbePtr probes,
+                               size_t nprobes)
+{
+    size_t i;
+
+    if (!probes)
+        return;
+
+    for (i = 0; i < nprobes; i++) {
+        virStorageVolDefFree(probes[i].vol);
+        virFreeError(probes[i].error);
+    }
+
+    VIR_FREE(probes);
+}
+
+
+static int
+virStorageBackendRefreshLocalProbe(virStorageVolDefPtr vol,
+                                   void *opaque ATTRIBUTE_UNUSED)
+{
+    return virStorageBackendRefreshVolTargetUpdate(vol);
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
@@ -3527,15 +4255,21 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     struct stat statbuf;
     int direrr;
     int ret = -1;
+    unsigned long long generation;
+    virStorageBackendVolProbePtr probes = NULL;
+    size_t nprobes = 0;
+    size_t i;
     VIR_AUTOPTR(virStorageVolDef) vol = NULL;
     VIR_AUTOCLOSE fd = -1;
     VIR_AUTOUNREF(virStorageSourcePtr) target = NULL;
 
+    generation = storageBackendProbeCacheBegin();
+
     if (virDirOpen(&dir, def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
+        virStorageBackendVolProbe probe = { NULL };
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
@@ -3557,24 +4291,36 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
         if (VIR_STRDUP(vol->key, vol->target.path) < 0)
             goto cleanup;
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
+        VIR_STEAL_PTR(probe.vol, vol);
+        if (VIR_APPEND_ELEMENT(probes, nprobes, probe) < 0) {
+            virStorageVolDefFree(probe.vol);
+            goto cleanup;
+        }
+    }
+    if (direrr < 0)
+        goto cleanup;
+    VIR_DIR_CLOSE(dir);
+
+    virStorageBackendProbeVols(probes, nprobes,
+                               virStorageBackendRefreshLocalProbe, NULL);
+
+    for (i = 0; i < nprobes; i++) {
+        if (probes[i].rc < 0) {
+            if (probes[i].rc == -2) {
                 /* Silently ignore non-regular files,
                  * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
                 continue;
             }
+            virErrorRestore(&probes[i].error);
             goto cleanup;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
+        if (virStoragePoolObjAddVol(pool, probes[i].vol) < 0)
             goto cleanup;
-        vol = NULL;
+        probes[i].vol = NULL;
     }
-    if (direrr < 0)
-        goto cleanup;
-    VIR_DIR_CLOSE(dir);
+
+    storageBackendProbeCachePrune(def->target.path, generation);
 
     if (!(target = virStorageSourceNew()))
         goto cleanup;
@@ -3620,6 +4366,7 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     ret = 0;
  cleanup:
     VIR_DIR_CLOSE(dir);
+    virStorageBackendVolProbesFree(probes, nprobes);
     return ret;
 }
 
@@ -105,6 +105,34 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol);
 
 int virStorageBackendRefreshLocal(virStoragePoolObjPtr pool);
 
+int virStorageBackendProbeCacheGet(const char *path,
+                                   const struct stat *sb,
+                                   virStorageSourcePtr *meta,
+                                   int *backingStoreFormat);
+int virStorageBackendProbeCacheSet(const char *path,
+                                   const struct stat *sb,
+                                   const virStorageSource *meta,
+                                   int backingStoreFormat);
+void virStorageBackendProbeCacheDropPool(const char *dir);
+
+typedef int (*virStorageBackendProbeVolFunc)(virStorageVolDefPtr vol,
+                                             void *opaque);
+
+typedef struct _virStorageBackendVolProbe virStorageBackendVolProbe;
+typedef virStorageBackendVolProbe *virStorageBackendVolProbePtr;
+struct _virStorageBackendVolProbe {
+    virStorageVolDefPtr vol;
+    int rc;             /* return value of the probe function */
+    virErrorPtr error;  /* error reported by a failed probe */
+};
+
+void virStorageBackendProbeVols(virStorageBackendVolProbePtr probes,
+                                size_t nprobes,
+                                virStorageBackendProbeVolFunc func,
+                                void *opaque);
+void virStorageBackendVolProbesFree(virStorageBackendVolProbePtr probes,
+                                    size_t nprobes);
+
 int virStorageUtilGlusterExtractPoolSources(const char *host,
                                             const char *xml,
                                             virStoragePoolSourceListPtr list,
@@ -31,6 +31,7 @@
 #include <signal.h>
 
 #include "internal.h"
+#include "c-ctype.h"
 #include "datatypes.h"
 #include "virbitmap.h"
 #include "virdnsmasq.h"
@@ -40,6 +41,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
@@ -48,11 +50,34 @@ VIR_LOG_INIT("util.dnsmasq");
 
 #define DNSMASQ_HOSTSFILE_SUFFIX "hostsfile"
 #define DNSMASQ_ADDNHOSTSFILE_SUFFIX "addnhosts"
+#define DNSMASQ_HOSTSDIR_SUFFIX "hostsdir"
+#define DNSMASQ_ADDNHOSTSDIR_SUFFIX "addnhostsdir"
+
+/* upper limit for reading back a file of a single host */
+#define DNSMASQ_HOSTSDIR_FILE_MAX (1024 * 1024)
+
+static char *
+dnsmasqFileNameNew(const char *name,
+                   const char *config_dir,
+                   const char *suffix)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+
+    virBufferAsprintf(&buf, "%s", config_dir);
+    virBufferEscapeString(&buf, "/%s", name);
+    virBufferAsprintf(&buf, ".%s", suffix);
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
 
 static void
 dhcphostFree(dnsmasqDhcpHost *host)
 {
     VIR_FREE(host->host);
+    VIR_FREE(host->ip);
 }
 
 static void
@@ -81,6 +106,7 @@ addnhostsFree(dnsmasqAddnHostsfile *addnhostsfile)
     }
 
     VIR_FREE(addnhostsfile->path);
+    VIR_FREE(addnhostsfile->dir);
 
     VIR_FREE(addnhostsfile);
 }
@@ -142,7 +168,6 @@ addnhostsNew(const char *name,
              const char *config_dir)
 {
     dnsmasqAddnHostsfile *addnhostsfile;
-    virBuffer buf = VIR_BUFFER_INITIALIZER;
 
     if (VIR_ALLOC(addnhostsfile) < 0)
         return NULL;
@@ -150,20 +175,15 @@ addnhostsNew(const char *name,
     addnhostsfile->hosts = NULL;
     addnhostsfile->nhosts = 0;
 
-    virBufferAsprintf(&buf, "%s", config_dir);
-    virBufferEscapeString(&buf, "/%s", name);
-    virBufferAsprintf(&buf, ".%s", DNSMASQ_ADDNHOSTSFILE_SUFFIX);
-
-    if (virBufferCheckError(&buf) < 0)
-                goto error;
-
-    if (!(addnhostsfile->path = virBufferContentAndReset(&buf)))
+    if (!(addnhostsfile->path = dnsmasqFileNameNew(name, config_dir,
+                                                   DNSMASQ_ADDNHOSTSFILE_SUFFIX)) ||
+        !(addnhostsfile->dir = dnsmasqFileNameNew(name, config_dir,
+                                                  DNSMASQ_ADDNHOSTSDIR_SUFFIX)))
         goto error;
 
     return addnhostsfile;
 
  error:
-    virBufferFreeAndReset(&buf);
     addnhostsFree(addnhostsfile);
     return NULL;
 }
@@ -290,6 +310,7 @@ hostsfileFree(dnsmasqHostsfile *hostsfile)
     }
 
     VIR_FREE(hostsfile->path);
+    VIR_FREE(hostsfile->dir);
 
     VIR_FREE(hostsfile);
 }
@@ -340,7 +361,7 @@ hostsfileAdd(dnsmasqHostsfile *hostsfile,
                         mac, ipstr) < 0)
             goto error;
     }
-    VIR_FREE(ipstr);
+    VIR_STEAL_PTR(hostsfile->hosts[hostsfile->nhosts].ip, ipstr);
 
     hostsfile->nhosts++;
 
@@ -356,7 +377,6 @@ hostsfileNew(const char *name,
              const char *config_dir)
 {
     dnsmasqHostsfile *hostsfile;
-    virBuffer buf = VIR_BUFFER_INITIALIZER;
 
     if (VIR_ALLOC(hostsfile) < 0)
         return NULL;
@@ -364,19 +384,15 @@ hostsfileNew(const char *name,
     hostsfile->hosts = NULL;
     hostsfile->nhosts = 0;
 
-    virBufferAsprintf(&buf, "%s", config_dir);
-    virBufferEscapeString(&buf, "/%s", name);
-    virBufferAsprintf(&buf, ".%s", DNSMASQ_HOSTSFILE_SUFFIX);
-
-    if (virBufferCheckError(&buf) < 0)
-                goto error;
-
-    if (!(hostsfile->path = virBufferContentAndReset(&buf)))
+    if (!(hostsfile->path = dnsmasqFileNameNew(name, config_dir,
+                                               DNSMASQ_HOSTSFILE_SUFFIX)) ||
+        !(hostsfile->dir = dnsmasqFileNameNew(name, config_dir,
+                                              DNSMASQ_HOSTSDIR_SUFFIX)))
         goto error;
+
     return hostsfile;
 
  error:
-    virBufferFreeAndReset(&buf);
     hostsfileFree(hostsfile);
     return NULL;
 }
@@ -451,6 +467,273 @@ hostsfileSave(dnsmasqHostsfile *hostsfile)
     return 0;
 }
 
+/*
+ * The hostsdir variants of the hostsfile and addnhosts files keep each
+ * host in a file of its own, named after its IP address. dnsmasq
+ * watches these directories and reads new or changed files on its own,
+ * but it only forgets about removed or changed hosts when it is told
+ * to reload.
+ */
+typedef struct {
+    const char *dir;
+    virHashTablePtr entries;
+    virHashTablePtr prev;
+    bool reload;
+} dnsmasqHostsDirData;
+
+/* Append @line to the contents of the file @name */
+static int
+hostsdirAppend(virHashTablePtr entries,
+               const char *name,
+               const char *line)
+{
+    const char *old = virHashLookup(entries, name);
+    char *content = NULL;
+
+    if (old) {
+        if (virAsprintf(&content, "%s%s", old, line) < 0)
+            return -1;
+    } else {
+        if (VIR_STRDUP(content, line) < 0)
+            return -1;
+    }
+
+    if (virHashUpdateEntry(entries, name, content) < 0) {
+        VIR_FREE(content);
+        return -1;
+    }
+
+    return 0;
+}
+
+static virHashTablePtr
+hostsfileEntries(const dnsmasqHostsfile *hostsfile)
+{
+    VIR_AUTOPTR(virHashTable) entries = NULL;
+    size_t i;
+
+    if (!(entries = virHashCreate(hostsfile->nhosts, virHashValueFree)))
+        return NULL;
+
+    for (i = 0; i < hostsfile->nhosts; i++) {
+        VIR_AUTOFREE(char *) line = NULL;
+
+        if (!hostsfile->hosts[i].host)
+            continue;
+
+        if (virAsprintf(&line, "%s\n", hostsfile->hosts[i].host) < 0 ||
+            hostsdirAppend(entries, hostsfile->hosts[i].ip, line) < 0)
+            return NULL;
+    }
+
+    VIR_RETURN_PTR(entries);
+}
+
+static virHashTablePtr
+addnhostsEntries(const dnsmasqAddnHostsfile *addnhostsfile)
+{
+    VIR_AUTOPTR(virHashTable) entries = NULL;
+    size_t i, j;
+
+    if (!(entries = virHashCreate(addnhostsfile->nhosts, virHashValueFree)))
+        return NULL;
+
+    for (i = 0; i < addnhostsfile->nhosts; i++) {
+        const dnsmasqAddnHost *host = &addnhostsfile->hosts[i];
+        virBuffer buf = VIR_BUFFER_INITIALIZER;
+        VIR_AUTOFREE(char *) line = NULL;
+
+        /* the same format as addnhostsWrite uses */
+        virBufferAsprintf(&buf, "%s\t", host->ip);
+        for (j = 0; j < host->nhostnames; j++)
+            virBufferAsprintf(&buf, "%s\t", host->hostnames[j]);
+        virBufferAddLit(&buf, "\n");
+
+        if (virBufferCheckError(&buf) < 0)
+            return NULL;
+
+        line = virBufferContentAndReset(&buf);
+        if (hostsdirAppend(entries, host->ip, line) < 0)
+            return NULL;
+    }
+
+    VIR_RETURN_PTR(entries);
+}
+
+static int
+hostsdirWrite(const char *dir,
+              const char *name,
+              const char *content)
+{
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOFREE(char *) tmp = NULL;
+
+    /* dnsmasq skips files starting with a dot, so it never reads a
+     * partially written file */
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0 ||
+        virAsprintf(&tmp, "%s/.%s.new", dir, name) < 0)
+        return -1;
+
+    if (virFileWriteStr(tmp, content, 0644) < 0) {
+        virReportSystemError(errno, _("cannot write config file '%s'"), tmp);
+        unlink(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, path) < 0) {
+        virReportSystemError(errno, _("cannot rename config file '%s' to '%s'"),
+                             tmp, path);
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+hostsdirRemove(const char *dir,
+               const char *name)
+{
+    VIR_AUTOFREE(char *) path = NULL;
+
+    if (virAsprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        virReportSystemError(errno, _("cannot remove config file '%s'"),
+                             path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Remove the file of a host which is gone since @data->prev */
+static int
+hostsdirRemoveIter(void *payload ATTRIBUTE_UNUSED,
+                   const void *name,
+                   void *opaque)
+{
+    dnsmasqHostsDirData *data = opaque;
+
+    if (virHashLookup(data->entries, name))
+        return 0;
+
+    data->reload = true;
+    return hostsdirRemove(data->dir, name);
+}
+
+/* Remove the files of all hosts which are not in @data->entries */
+static int
+hostsdirPrune(dnsmasqHostsDirData *data)
+{
+    DIR *dirp = NULL;
+    struct dirent *ent;
+    int direrr;
+    int ret = -1;
+
+    if (virDirOpen(&dirp, data->dir) < 0)
+        return -1;
+
+    while ((direrr = virDirRead(dirp, &ent, data->dir)) > 0) {
+        /* leftovers of an interrupted write are not known to dnsmasq */
+        if (ent->d_name[0] != '.') {
+            if (virHashLookup(data->entries, ent->d_name))
+                continue;
+            data->reload = true;
+        }
+
+        if (hostsdirRemove(data->dir, ent->d_name) < 0)
+            goto cleanup;
+    }
+
+    if (direrr < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dirp);
+    return ret;
+}
+
+/* Write the file of a host unless it is unchanged */
+static int
+hostsdirWriteIter(void *payload,
+                  const void *name,
+                  void *opaque)
+{
+    dnsmasqHostsDirData *data = opaque;
+    const char *content = payload;
+
+    if (data->prev) {
+        const char *prevContent = virHashLookup(data->prev, name);
+
+        if (prevContent) {
+            if (STREQ(prevContent, content))
+                return 0;
+            data->reload = true;
+        }
+    } else {
+        VIR_AUTOFREE(char *) path = NULL;
+        VIR_AUTOFREE(char *) old = NULL;
+
+        if (virAsprintf(&path, "%s/%s", data->dir, (const char *)name) < 0)
+            return -1;
+
+        if (virFileExists(path)) {
+            if (virFileReadAll(path, DNSMASQ_HOSTSDIR_FILE_MAX, &old) < 0)
+                return -1;
+            if (STREQ(old, content))
+                return 0;
+            data->reload = true;
+        }
+    }
+
+#ifndef __linux__
+    /* dnsmasq watches the directories only on Linux */
+    data->reload = true;
+#endif
+
+    return hostsdirWrite(data->dir, name, content);
+}
+
+static int
+hostsdirSave(const char *dir,
+             virHashTablePtr entries,
+             virHashTablePtr prev,
+             bool *reload)
+{
+    dnsmasqHostsDirData data = {
+        .dir = dir,
+        .entries = entries,
+        .prev = prev,
+        .reload = false,
+    };
+
+    if (virFileMakePath(dir) < 0) {
+        virReportSystemError(errno, _("cannot create config directory '%s'"),
+                             dir);
+        return -1;
+    }
+
+    if (prev) {
+        if (virHashForEach(prev, hostsdirRemoveIter, &data) < 0)
+            return -1;
+    } else {
+        if (hostsdirPrune(&data) < 0)
+            return -1;
+    }
+
+    if (virHashForEach(entries, hostsdirWriteIter, &data) < 0)
+        return -1;
+
+    if (data.reload)
+        *reload = true;
+
+    return 0;
+}
+
 /**
  * dnsmasqContextNew:
  *
@@ -569,6 +852,53 @@ dnsmasqSave(const dnsmasqContext *ctx)
 }
 
 
+/**
+ * dnsmasqSaveHostsDirs:
+ * @ctx: pointer to the dnsmasq context for each network
+ * @prev: pointer to the context saved last time or NULL
+ * @reload: set to true if dnsmasq needs to reload its configuration
+ *
+ * Saves the hosts of a context to disk with one file per host, which
+ * dnsmasq picks up by itself. Only the files of hosts which differ
+ * from @prev are written or removed; without @prev, the files already
+ * on disk are compared instead. If a host known to dnsmasq is changed
+ * or removed, @reload is set to true.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+dnsmasqSaveHostsDirs(const dnsmasqContext *ctx,
+                     const dnsmasqContext *prev,
+                     bool *reload)
+{
+    VIR_AUTOPTR(virHashTable) hosts = NULL;
+    VIR_AUTOPTR(virHashTable) prevHosts = NULL;
+    VIR_AUTOPTR(virHashTable) addnhosts = NULL;
+    VIR_AUTOPTR(virHashTable) prevAddnhosts = NULL;
+    bool dummy;
+
+    if (!reload)
+        reload = &dummy;
+    *reload = false;
+
+    if (!(hosts = hostsfileEntries(ctx->hostsfile)) ||
+        !(addnhosts = addnhostsEntries(ctx->addnhostsfile)))
+        return -1;
+
+    if (prev &&
+        (!(prevHosts = hostsfileEntries(prev->hostsfile)) ||
+         !(prevAddnhosts = addnhostsEntries(prev->addnhostsfile))))
+        return -1;
+
+    if (hostsdirSave(ctx->hostsfile->dir, hosts, prevHosts, reload) < 0 ||
+        hostsdirSave(ctx->addnhostsfile->dir, addnhosts, prevAddnhosts,
+                     reload) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /**
  * dnsmasqDelete:
  * @ctx: pointer to the dnsmasq context for each network
@@ -580,10 +910,16 @@ dnsmasqDelete(const dnsmasqContext *ctx)
 {
     int ret = 0;
 
-    if (ctx->hostsfile)
+    if (ctx->hostsfile) {
         ret = genericFileDelete(ctx->hostsfile->path);
-    if (ctx->addnhostsfile)
+        if (virFileDeleteTree(ctx->hostsfile->dir) < 0)
+            ret = -1;
+    }
+    if (ctx->addnhostsfile) {
         ret = genericFileDelete(ctx->addnhostsfile->path);
+        if (virFileDeleteTree(ctx->addnhostsfile->dir) < 0)
+            ret = -1;
+    }
 
     return ret;
 }
@@ -655,6 +991,25 @@ dnsmasqCapsSet(dnsmasqCapsPtr caps,
 
 #define DNSMASQ_VERSION_STR "Dnsmasq version "
 
+/* Check whether the --help output in @buf lists @option on its own,
+ * rather than as a part of a longer option such as --dhcp-hostsdir
+ * for --hostsdir */
+static bool
+dnsmasqCapsHasOption(const char *buf, const char *option)
+{
+    size_t len = strlen(option);
+    const char *tmp = buf;
+
+    while ((tmp = strstr(tmp, option))) {
+        if ((tmp == buf || !(c_isalnum(tmp[-1]) || tmp[-1] == '-')) &&
+            !(c_isalnum(tmp[len]) || tmp[len] == '-'))
+            return true;
+        tmp += len;
+    }
+
+    return false;
+}
+
 static int
 dnsmasqCapsSetFromBuffer(dnsmasqCapsPtr caps, const char *buf)
 {
@@ -683,13 +1038,19 @@ dnsmasqCapsSetFromBuffer(dnsmasqCapsPtr caps, const char *buf)
     if (strstr(buf, "--ra-param"))
         dnsmasqCapsSet(caps, DNSMASQ_CAPS_RA_PARAM);
 
+    if (dnsmasqCapsHasOption(buf, "--dhcp-hostsdir") &&
+        dnsmasqCapsHasOption(buf, "--hostsdir"))
+        dnsmasqCapsSet(caps, DNSMASQ_CAPS_HOSTSDIR);
+
     VIR_INFO("dnsmasq version is %d.%d, --bind-dynamic is %spresent, "
-             "SO_BINDTODEVICE is %sin use, --ra-param is %spresent",
+             "SO_BINDTODEVICE is %sin use, --ra-param is %spresent, "
+             "--dhcp-hostsdir is %spresent",
              (int)caps->version / 1000000,
              (int)(caps->version % 1000000) / 1000,
              dnsmasqCapsGet(caps, DNSMASQ_CAPS_BIND_DYNAMIC) ? "" : "NOT ",
              dnsmasqCapsGet(caps, DNSMASQ_CAPS_BINDTODEVICE) ? "" : "NOT ",
-             dnsmasqCapsGet(caps, DNSMASQ_CAPS_RA_PARAM) ? "" : "NOT ");
+             dnsmasqCapsGet(caps, DNSMASQ_CAPS_RA_PARAM) ? "" : "NOT ",
+             dnsmasqCapsGet(caps, DNSMASQ_CAPS_HOSTSDIR) ? "" : "NOT ");
     return 0;
 
  fail:
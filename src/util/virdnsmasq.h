@@ -34,6 +34,7 @@ typedef struct
      */
     char *host;
 
+    char *ip;  /* Names the file of the host in the hostsdir. */
 } dnsmasqDhcpHost;
 
 typedef struct
@@ -42,6 +43,7 @@ typedef struct
     dnsmasqDhcpHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's dhcp-hostsdir. */
 } dnsmasqHostsfile;
 
 typedef struct
@@ -58,6 +60,7 @@ typedef struct
     dnsmasqAddnHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's hostsdir. */
 } dnsmasqAddnHostsfile;
 
 typedef struct
@@ -71,6 +74,7 @@ typedef enum {
    DNSMASQ_CAPS_BIND_DYNAMIC = 0, /* support for --bind-dynamic */
    DNSMASQ_CAPS_BINDTODEVICE = 1, /* uses SO_BINDTODEVICE for --bind-interfaces */
    DNSMASQ_CAPS_RA_PARAM = 2,     /* support for --ra-param */
+   DNSMASQ_CAPS_HOSTSDIR = 3,     /* support for --dhcp-hostsdir and --hostsdir */
 
    DNSMASQ_CAPS_LAST,             /* this must always be the last item */
 } dnsmasqCapsFlags;
@@ -92,6 +96,9 @@ int              dnsmasqAddHost(dnsmasqContext *ctx,
                                 virSocketAddr *ip,
                                 const char *name);
 int              dnsmasqSave(const dnsmasqContext *ctx);
+int              dnsmasqSaveHostsDirs(const dnsmasqContext *ctx,
+                                      const dnsmasqContext *prev,
+                                      bool *reload);
 int              dnsmasqDelete(const dnsmasqContext *ctx);
 int              dnsmasqReload(pid_t pid);
 
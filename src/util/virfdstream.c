@@ -400,6 +400,10 @@ struct _virFDStreamThreadData {
     char *fdinname;
     int fdout;
     char *fdoutname;
+
+    /* Used instead of fdin/fdout on the non-pipe side, if set */
+    const virFDStreamIOCallbacks *io;
+    void *ioOpaque;
 };
 
 
@@ -409,6 +413,8 @@ virFDStreamThreadDataFree(virFDStreamThreadDataPtr data)
     if (!data)
         return;
 
+    if (data->io && data->io->free)
+        data->io->free(data->ioOpaque);
     virObjectUnref(data->st);
     VIR_FREE(data->fdinname);
     VIR_FREE(data->fdoutname);
@@ -416,8 +422,33 @@ virFDStreamThreadDataFree(virFDStreamThreadDataPtr data)
 }
 
 
+/* At most this much data is requested to be read ahead at the start
+ * of a data section of a sparse file, where kernel's own readahead
+ * starts from scratch after the preceding hole was skipped. */
+#define VIR_FDSTREAM_READAHEAD_MAX (4 * 1024 * 1024)
+
+static void
+virFDStreamReadAhead(int fd,
+                     long long length)
+{
+#if HAVE_POSIX_FADVISE
+    off_t cur;
+
+    if ((cur = lseek(fd, 0, SEEK_CUR)) == (off_t) -1)
+        return;
+
+    /* Just a hint, errors are not interesting */
+    ignore_value(posix_fadvise(fd, cur,
+                               MIN(length, VIR_FDSTREAM_READAHEAD_MAX),
+                               POSIX_FADV_WILLNEED));
+#endif /* HAVE_POSIX_FADVISE */
+}
+
+
 static ssize_t
 virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
+                        const virFDStreamIOCallbacks *io,
+                        void *ioOpaque,
                         bool sparse,
                         const int fdin,
                         const int fdout,
@@ -442,8 +473,10 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
             sectionLen > length - total)
             sectionLen = length - total;
 
-        if (inData)
+        if (inData) {
             *dataLen = sectionLen;
+            virFDStreamReadAhead(fdin, sectionLen);
+        }
     }
 
     if (length &&
@@ -475,7 +508,10 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
         if (VIR_ALLOC_N(buf, buflen) < 0)
             goto error;
 
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
+        if (io) {
+            if ((got = io->read(buf, buflen, ioOpaque)) < 0)
+                goto error;
+        } else if ((got = saferead(fdin, buf, buflen)) < 0) {
             virReportSystemError(errno,
                                  _("Unable to read %s"),
                                  fdinname);
@@ -504,6 +540,8 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
 
 static ssize_t
 virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
+                         const virFDStreamIOCallbacks *io,
+                         void *ioOpaque,
                          bool sparse,
                          const int fdin,
                          const int fdout,
@@ -517,14 +555,22 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 
     switch (msg->type) {
     case VIR_FDSTREAM_MSG_TYPE_DATA:
-        got = safewrite(fdout,
-                        msg->stream.data.buf + msg->stream.data.offset,
-                        msg->stream.data.len - msg->stream.data.offset);
-        if (got < 0) {
-            virReportSystemError(errno,
-                                 _("Unable to write %s"),
-                                 fdoutname);
-            return -1;
+        if (io) {
+            got = io->write(msg->stream.data.buf + msg->stream.data.offset,
+                            msg->stream.data.len - msg->stream.data.offset,
+                            ioOpaque);
+            if (got < 0)
+                return -1;
+        } else {
+            got = safewrite(fdout,
+                            msg->stream.data.buf + msg->stream.data.offset,
+                            msg->stream.data.len - msg->stream.data.offset);
+            if (got < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to write %s"),
+                                     fdoutname);
+                return -1;
+            }
         }
 
         msg->stream.data.offset += got;
@@ -579,12 +625,20 @@ virFDStreamThread(void *opaque)
     char *fdinname = data->fdinname;
     int fdout = data->fdout;
     char *fdoutname = data->fdoutname;
+    const virFDStreamIOCallbacks *io = data->io;
+    void *ioOpaque = data->ioOpaque;
     virFDStreamDataPtr fdst = st->privateData;
     bool doRead = fdst->threadDoRead;
     size_t buflen = 256 * 1024;
     size_t total = 0;
     size_t dataLen = 0;
 
+#if HAVE_POSIX_FADVISE
+    /* Let the kernel use a larger readahead window for the file */
+    if (doRead && !io)
+        ignore_value(posix_fadvise(fdin, 0, 0, POSIX_FADV_SEQUENTIAL));
+#endif /* HAVE_POSIX_FADVISE */
+
     virObjectRef(fdst);
     virObjectLock(fdst);
 
@@ -611,13 +665,13 @@ virFDStreamThread(void *opaque)
         }
 
         if (doRead)
-            got = virFDStreamThreadDoRead(fdst, sparse,
+            got = virFDStreamThreadDoRead(fdst, io, ioOpaque, sparse,
                                           fdin, fdout,
                                           fdinname, fdoutname,
                                           length, total,
                                           &dataLen, buflen);
         else
-            got = virFDStreamThreadDoWrite(fdst, sparse,
+            got = virFDStreamThreadDoWrite(fdst, io, ioOpaque, sparse,
                                            fdin, fdout,
                                            fdinname, fdoutname);
 
@@ -630,6 +684,11 @@ virFDStreamThread(void *opaque)
         total += got;
     }
 
+    /* All data was transferred, let the other side flush it. */
+    if (io && io->finish &&
+        io->finish(ioOpaque) < 0)
+        goto error;
+
  cleanup:
     fdst->threadQuit = true;
     virObjectUnlock(fdst);
@@ -665,6 +724,7 @@ virFDStreamJoinWorker(virFDStreamDataPtr fdst,
 
     if (fdst->threadErr && !streamAbort) {
         /* errors are expected on streamAbort */
+        virSetError(fdst->threadErr);
         goto cleanup;
     }
 
@@ -682,7 +742,7 @@ virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
     virFDStreamDataPtr fdst;
     virStreamEventCallback cb;
     void *opaque;
-    int ret;
+    int ret = 0;
 
     VIR_DEBUG("st=%p", st);
 
@@ -722,9 +782,11 @@ virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
         ret = -1;
 
     /* mutex locked */
-    if ((ret = VIR_CLOSE(fdst->fd)) < 0)
+    if (VIR_CLOSE(fdst->fd) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to close"));
+        ret = -1;
+    }
 
     st->privateData = NULL;
 
@@ -1429,6 +1491,90 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                        oflags, 0, true, sparse);
 }
 
+
+/**
+ * virFDStreamOpenIOCallbacks:
+ * @st: stream to open
+ * @io: callbacks transferring the data
+ * @opaque: data passed to the callbacks
+ * @length: maximum number of bytes to transfer, 0 for unlimited
+ * @oflags: O_RDONLY to read data using @io, O_WRONLY to write it
+ *
+ * Open @st for data produced or consumed by @io rather than by a file
+ * descriptor, e.g. for storage accessed through a library. The
+ * callbacks are invoked from a worker thread, so they may block. Any
+ * error reported by @io->finish fails closing of @st.
+ *
+ * Ownership of @opaque is passed to the stream, it is freed using
+ * @io->free even if this function fails.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFDStreamOpenIOCallbacks(virStreamPtr st,
+                           const virFDStreamIOCallbacks *io,
+                           void *opaque,
+                           unsigned long long length,
+                           int oflags)
+{
+    int pipefds[2] = { -1, -1 };
+    virFDStreamThreadDataPtr threadData = NULL;
+    int fd;
+
+    VIR_DEBUG("st=%p io=%p opaque=%p length=%llu oflags=0x%x",
+              st, io, opaque, length, oflags);
+
+    if ((oflags & O_ACCMODE) == O_RDWR) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot request read and write flags together"));
+        goto error;
+    }
+
+    if (pipe(pipefds) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create pipe"));
+        goto error;
+    }
+
+    if (VIR_ALLOC(threadData) < 0)
+        goto error;
+
+    threadData->st = virObjectRef(st);
+    threadData->length = length;
+    threadData->io = io;
+    threadData->ioOpaque = opaque;
+    opaque = NULL;
+
+    if ((oflags & O_ACCMODE) == O_RDONLY) {
+        threadData->fdin = -1;
+        threadData->fdout = pipefds[1];
+        if (VIR_STRDUP(threadData->fdoutname, "pipe") < 0)
+            goto error;
+        fd = pipefds[0];
+        threadData->doRead = true;
+    } else {
+        threadData->fdin = pipefds[0];
+        threadData->fdout = -1;
+        if (VIR_STRDUP(threadData->fdinname, "pipe") < 0)
+            goto error;
+        fd = pipefds[1];
+        threadData->doRead = false;
+    }
+
+    if (virFDStreamOpenInternal(st, fd, threadData, length) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    VIR_FORCE_CLOSE(pipefds[0]);
+    VIR_FORCE_CLOSE(pipefds[1]);
+    if (opaque && io->free)
+        io->free(opaque);
+    virFDStreamThreadDataFree(threadData);
+    return -1;
+}
+
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
                                   virFDStreamInternalCloseCb cb,
                                   void *opaque,
@@ -60,6 +60,30 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                bool sparse,
                                int oflags);
 
+/* Callbacks of streams opened by virFDStreamOpenIOCallbacks. @read and
+ * @write return the number of bytes transferred (0 on EOF for @read),
+ * -1 with an error reported. */
+typedef ssize_t (*virFDStreamIOReadCb)(char *buf, size_t len, void *opaque);
+typedef ssize_t (*virFDStreamIOWriteCb)(const char *buf, size_t len,
+                                        void *opaque);
+typedef int (*virFDStreamIOFinishCb)(void *opaque);
+typedef void (*virFDStreamIOFreeCb)(void *opaque);
+
+typedef struct _virFDStreamIOCallbacks virFDStreamIOCallbacks;
+struct _virFDStreamIOCallbacks {
+    virFDStreamIOReadCb read;
+    virFDStreamIOWriteCb write;
+    /* called once all data was transferred, optional */
+    virFDStreamIOFinishCb finish;
+    virFDStreamIOFreeCb free;
+};
+
+int virFDStreamOpenIOCallbacks(virStreamPtr st,
+                               const virFDStreamIOCallbacks *io,
+                               void *opaque,
+                               unsigned long long length,
+                               int oflags);
+
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
                                   virFDStreamInternalCloseCb cb,
                                   void *opaque,
@@ -82,6 +82,7 @@
 
 #include "c-ctype.h"
 #include "areadlink.h"
+#include "stat-time.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -1837,6 +1838,58 @@ virFileIsRegular(const char *path)
 }
 
 
+/**
+ * virFileStampSet:
+ * @stamp: where to store the file's identity
+ * @sb: result of stat() of the file
+ *
+ * Remember the identity, size and timestamps of a file, so that data
+ * derived from its contents can be reused until virFileStampMatch
+ * tells the file has changed.
+ *
+ * Returns false if the file was changed within the last second. More
+ * changes within the same timestamp tick would go unnoticed, so such
+ * files should not be cached.
+ */
+bool
+virFileStampSet(virFileStampPtr stamp,
+                const struct stat *sb)
+{
+    stamp->dev = sb->st_dev;
+    stamp->ino = sb->st_ino;
+    stamp->size = sb->st_size;
+    stamp->mtime = get_stat_mtime(sb);
+    stamp->ctime = get_stat_ctime(sb);
+
+    return stamp->ctime.tv_sec < time(NULL) - 1;
+}
+
+
+/**
+ * virFileStampMatch:
+ * @stamp: identity stored by virFileStampSet
+ * @sb: result of stat() of the file
+ *
+ * Returns true if the file described by @sb is the same and unchanged
+ * since @stamp was set.
+ */
+bool
+virFileStampMatch(const virFileStamp *stamp,
+                  const struct stat *sb)
+{
+    struct timespec mtime = get_stat_mtime(sb);
+    struct timespec ctime = get_stat_ctime(sb);
+
+    return stamp->dev == sb->st_dev &&
+        stamp->ino == sb->st_ino &&
+        stamp->size == sb->st_size &&
+        stamp->mtime.tv_sec == mtime.tv_sec &&
+        stamp->mtime.tv_nsec == mtime.tv_nsec &&
+        stamp->ctime.tv_sec == ctime.tv_sec &&
+        stamp->ctime.tv_nsec == ctime.tv_nsec;
+}
+
+
 /**
  * virFileExists: Check for presence of file
  * @path: Path of file to check
@@ -25,6 +25,7 @@
 #pragma once
 
 #include <dirent.h>
+#include <sys/stat.h>
 
 #include "internal.h"
 #include "virbitmap.h"
@@ -199,9 +200,25 @@ void virFileActivateDirOverride(const char *argv0)
 off_t virFileLength(const char *path, int fd) ATTRIBUTE_NONNULL(1);
 bool virFileIsDir (const char *file) ATTRIBUTE_NONNULL(1);
 bool virFileExists(const char *file) ATTRIBUTE_NONNULL(1) ATTRIBUTE_NOINLINE;
-bool virFileIsExecutable(const char *file) ATTRIBUTE_NONNULL(1);
+bool virFileIsExecutable(const char *file)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NOINLINE;
 bool virFileIsRegular(const char *file) ATTRIBUTE_NONNULL(1);
 
+typedef struct _virFileStamp virFileStamp;
+typedef virFileStamp *virFileStampPtr;
+struct _virFileStamp {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+};
+
+bool virFileStampSet(virFileStampPtr stamp, const struct stat *sb)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+bool virFileStampMatch(const virFileStamp *stamp, const struct stat *sb)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 enum {
     VIR_FILE_SHFS_NFS = (1 << 0),
     VIR_FILE_SHFS_GFS2 = (1 << 1),
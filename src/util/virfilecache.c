@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -125,11 +126,15 @@ virFileCacheGetFileName(virFileCachePtr cache,
 }
 
 
+/* @locked tells whether the caller holds the lock of @cache. The
+ * isValid handler is always called with the lock held. */
 static int
 virFileCacheLoad(virFileCachePtr cache,
                  const char *name,
+                 bool locked,
                  void **data)
 {
+    bool valid;
     VIR_AUTOFREE(char *) file = NULL;
     int ret = -1;
     void *loadData = NULL;
@@ -159,7 +164,13 @@ virFileCacheLoad(virFileCachePtr cache,
         goto cleanup;
     }
 
-    if (!cache->handlers.isValid(loadData, cache->priv)) {
+    if (!locked)
+        virObjectLock(cache);
+    valid = cache->handlers.isValid(loadData, cache->priv);
+    if (!locked)
+        virObjectUnlock(cache);
+
+    if (!valid) {
         VIR_DEBUG("Outdated cached capabilities '%s' for '%s'", file, name);
         unlink(file);
         ret = 0;
@@ -196,12 +207,13 @@ virFileCacheSave(virFileCachePtr cache,
 
 static void *
 virFileCacheNewData(virFileCachePtr cache,
-                    const char *name)
+                    const char *name,
+                    bool locked)
 {
     void *data = NULL;
     int rv;
 
-    if ((rv = virFileCacheLoad(cache, name, &data)) < 0)
+    if ((rv = virFileCacheLoad(cache, name, locked, &data)) < 0)
         return NULL;
 
     if (rv == 0) {
@@ -276,7 +288,7 @@ virFileCacheValidate(virFileCachePtr cache,
 
     if (!*data && name) {
         VIR_DEBUG("Creating data for '%s'", name);
-        *data = virFileCacheNewData(cache, name);
+        *data = virFileCacheNewData(cache, name, true);
         if (*data) {
             VIR_DEBUG("Caching data '%p' for '%s'", *data, name);
             if (virHashAddEntry(cache->table, name, *data) < 0) {
@@ -418,3 +430,149 @@ virFileCacheInsertData(virFileCachePtr cache,
 
     return ret;
 }
+
+
+typedef struct _virFileCachePrefetchData virFileCachePrefetchData;
+typedef virFileCachePrefetchData *virFileCachePrefetchDataPtr;
+struct _virFileCachePrefetchData {
+    virFileCachePtr cache;
+    virMutex lock;
+    char **names;
+    void **data;
+    size_t nnames;
+    size_t next;
+};
+
+
+static void
+virFileCachePrefetchWorker(void *opaque)
+{
+    virFileCachePrefetchDataPtr prefetch = opaque;
+    size_t i;
+
+    while (true) {
+        virMutexLock(&prefetch->lock);
+        i = prefetch->next++;
+        virMutexUnlock(&prefetch->lock);
+
+        if (i >= prefetch->nnames)
+            break;
+
+        VIR_DEBUG("Prefetching data for '%s'", prefetch->names[i]);
+        if (!(prefetch->data[i] = virFileCacheNewData(prefetch->cache,
+                                                      prefetch->names[i],
+                                                      false))) {
+            VIR_WARN("Failed to prefetch data for '%s': %s",
+                     prefetch->names[i], virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+}
+
+
+/**
+ * virFileCachePrefetch:
+ * @cache: existing cache object
+ * @names: NULL terminated list of names to create data for
+ * @nworkers: maximum number of threads to use
+ *
+ * Loads or creates data for all @names which are not in @cache yet,
+ * using up to @nworkers threads in parallel. This is meant to speed up
+ * filling a cache whose newData() handler is slow, for example because
+ * it has to run an external process. The newData(), loadFile() and
+ * saveFile() handlers must be safe to call from multiple threads at
+ * once; isValid() is still called with @cache locked.
+ *
+ * Failing to create data for some name is not an error, a later
+ * virFileCacheLookup() will retry and report it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char **names,
+                     size_t nworkers)
+{
+    virFileCachePrefetchData prefetch = { .cache = cache };
+    virThreadPtr workers = NULL;
+    size_t nworkersStarted = 0;
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&prefetch.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    virObjectLock(cache);
+    for (i = 0; names && names[i]; i++) {
+        if (virHashLookup(cache->table, names[i]) ||
+            virStringListHasString((const char **)prefetch.names, names[i]))
+            continue;
+
+        if (virStringListAdd(&prefetch.names, names[i]) < 0) {
+            virObjectUnlock(cache);
+            goto cleanup;
+        }
+        prefetch.nnames++;
+    }
+    virObjectUnlock(cache);
+
+    if (prefetch.nnames == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(prefetch.data, prefetch.nnames) < 0)
+        goto cleanup;
+
+    nworkers = MAX(1, MIN(nworkers, prefetch.nnames));
+    if (VIR_ALLOC_N(workers, nworkers - 1) < 0)
+        goto cleanup;
+
+    /* The calling thread works too, so one thread less is needed */
+    for (i = 0; i < nworkers - 1; i++) {
+        if (virThreadCreate(&workers[i], true,
+                            virFileCachePrefetchWorker, &prefetch) < 0) {
+            VIR_WARN("Failed to start cache prefetch worker");
+            break;
+        }
+        nworkersStarted++;
+    }
+
+    virFileCachePrefetchWorker(&prefetch);
+
+    for (i = 0; i < nworkersStarted; i++)
+        virThreadJoin(&workers[i]);
+
+    virObjectLock(cache);
+    for (i = 0; i < prefetch.nnames; i++) {
+        if (!prefetch.data[i])
+            continue;
+
+        /* Someone may have looked the data up meanwhile */
+        if (virHashLookup(cache->table, prefetch.names[i]))
+            continue;
+
+        VIR_DEBUG("Caching data '%p' for '%s'",
+                  prefetch.data[i], prefetch.names[i]);
+        if (virHashAddEntry(cache->table, prefetch.names[i],
+                            prefetch.data[i]) < 0) {
+            virObjectUnlock(cache);
+            goto cleanup;
+        }
+        prefetch.data[i] = NULL;
+    }
+    virObjectUnlock(cache);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; prefetch.data && i < prefetch.nnames; i++)
+        virObjectUnref(prefetch.data[i]);
+    VIR_FREE(prefetch.data);
+    VIR_FREE(workers);
+    virStringListFree(prefetch.names);
+    virMutexDestroy(&prefetch.lock);
+    return ret;
+}
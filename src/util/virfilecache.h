@@ -132,3 +132,8 @@ int
 virFileCacheInsertData(virFileCachePtr cache,
                        const char *name,
                        void *data);
+
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char **names,
+                     size_t nworkers);
@@ -22,6 +22,8 @@
 
 #include <stdarg.h>
 
+#include "c-ctype.h"
+
 #define LIBVIRT_VIRFIREWALLPRIV_H_ALLOW
 #include "virfirewallpriv.h"
 #include "virfirewalld.h"
@@ -47,6 +49,16 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               EBTABLES_PATH,
               IPTABLES_PATH,
               IP6TABLES_PATH,
+              NFT_PATH,
+);
+
+VIR_ENUM_DECL(virFirewallLayerRestoreCommand);
+VIR_ENUM_IMPL(virFirewallLayerRestoreCommand,
+              VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_RESTORE_PATH,
+              IPTABLES_RESTORE_PATH,
+              IP6TABLES_RESTORE_PATH,
+              NFT_PATH,
 );
 
 struct _virFirewallRule {
@@ -75,6 +87,28 @@ struct _virFirewallGroup {
 };
 
 
+/* Rules of one table of one layer applied with a single
+ * invocation of the matching *-restore tool */
+typedef struct _virFirewallBatchEntry virFirewallBatchEntry;
+typedef virFirewallBatchEntry *virFirewallBatchEntryPtr;
+struct _virFirewallBatchEntry {
+    virFirewallRulePtr rule;
+    char *line;
+    bool ignoreErrors;
+    bool skip;
+};
+
+typedef struct _virFirewallBatch virFirewallBatch;
+typedef virFirewallBatch *virFirewallBatchPtr;
+struct _virFirewallBatch {
+    virFirewallLayer layer;
+    char *table;
+
+    size_t nentries;
+    virFirewallBatchEntryPtr entries;
+};
+
+
 struct _virFirewall {
     int err;
 
@@ -85,6 +119,9 @@ struct _virFirewall {
 
 static virFirewallBackend currentBackend = VIR_FIREWALL_BACKEND_AUTOMATIC;
 static virMutex ruleLock = VIR_MUTEX_INITIALIZER;
+/* ebtables-restore has no way to take the ebtables lock itself, so
+ * every ebtables process run directly is serialized with this lock */
+static virMutex ebtablesRestoreLock = VIR_MUTEX_INITIALIZER;
 
 static int
 virFirewallValidateBackend(virFirewallBackend backend);
@@ -102,12 +139,32 @@ static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+static bool iptablesUseRestore;
+static bool ip6tablesUseRestore;
+static bool ebtablesUseRestore;
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
     lockOverride = avoid;
 }
 
+/**
+ * virFirewallSetRestoreOverride:
+ * @use: true to batch rules through the *-restore tools
+ *
+ * Force use of iptables-restore / ip6tables-restore / ebtables-restore
+ * by the direct backend regardless of what was found by the probes,
+ * which are skipped entirely with virFirewallSetLockOverride.
+ */
+void
+virFirewallSetRestoreOverride(bool use)
+{
+    iptablesUseRestore = use;
+    ip6tablesUseRestore = use;
+    ebtablesUseRestore = use;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -144,9 +201,59 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+static void
+virFirewallCheckUpdateRestore(bool *restoreflag,
+                              const char *const*args)
+{
+    int status; /* Ignore failed commands without logging them */
+    VIR_AUTOPTR(virCommand) cmd = NULL;
+
+    if (!virFileIsExecutable(args[0])) {
+        VIR_INFO("%s not available", args[0]);
+        return;
+    }
+
+    /* An empty transaction is enough to see whether the tool
+     * accepts the options and input format used for batching */
+    cmd = virCommandNewArgs(args);
+    virCommandSetInputBuffer(cmd, "*filter\nCOMMIT\n");
+    if (virCommandRun(cmd, &status) < 0 || status) {
+        VIR_INFO("batching not supported by %s", args[0]);
+    } else {
+        VIR_INFO("using batching with %s", args[0]);
+        *restoreflag = true;
+    }
+}
+
+static void
+virFirewallCheckUpdateRestoring(void)
+{
+    const char *iptablesArgs[] = {
+        IPTABLES_RESTORE_PATH, "--noflush",
+        iptablesUseLock ? "-w" : NULL, NULL,
+    };
+    const char *ip6tablesArgs[] = {
+        IP6TABLES_RESTORE_PATH, "--noflush",
+        ip6tablesUseLock ? "-w" : NULL, NULL,
+    };
+    const char *ebtablesArgs[] = {
+        EBTABLES_RESTORE_PATH, "--noflush", NULL,
+    };
+    if (lockOverride)
+        return;
+    virFirewallCheckUpdateRestore(&iptablesUseRestore,
+                                  iptablesArgs);
+    virFirewallCheckUpdateRestore(&ip6tablesUseRestore,
+                                  ip6tablesArgs);
+    virFirewallCheckUpdateRestore(&ebtablesUseRestore,
+                                  ebtablesArgs);
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
+    bool automatic = backend == VIR_FIREWALL_BACKEND_AUTOMATIC;
+
     VIR_DEBUG("Validating backend %d", backend);
     if (backend == VIR_FIREWALL_BACKEND_AUTOMATIC ||
         backend == VIR_FIREWALL_BACKEND_FIREWALLD) {
@@ -180,19 +287,40 @@ virFirewallValidateBackend(virFirewallBackend backend)
 
         for (i = 0; i < ARRAY_CARDINALITY(commands); i++) {
             if (!virFileIsExecutable(commands[i])) {
+                if (automatic && virFileIsExecutable(NFT_PATH)) {
+                    VIR_DEBUG("%s not available, using nftables backend",
+                              commands[i]);
+                    backend = VIR_FIREWALL_BACKEND_NFTABLES;
+                    break;
+                }
                 virReportSystemError(errno,
                                      _("direct firewall backend requested, but %s is not available"),
                                      commands[i]);
                 return -1;
             }
         }
-        VIR_DEBUG("found iptables/ip6tables/ebtables, using direct backend");
+        if (backend == VIR_FIREWALL_BACKEND_DIRECT)
+            VIR_DEBUG("found iptables/ip6tables/ebtables, using direct backend");
+    }
+
+    if (backend == VIR_FIREWALL_BACKEND_NFTABLES &&
+        !virFileIsExecutable(NFT_PATH)) {
+        virReportSystemError(errno,
+                             _("nftables firewall backend requested, but %s is not available"),
+                             NFT_PATH);
+        return -1;
     }
 
     currentBackend = backend;
 
+    if (backend == VIR_FIREWALL_BACKEND_NFTABLES)
+        return 0;
+
     virFirewallCheckUpdateLocking();
 
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT)
+        virFirewallCheckUpdateRestoring();
+
     return 0;
 }
 
@@ -207,6 +335,22 @@ virFirewallSetBackend(virFirewallBackend backend)
     return virFirewallValidateBackend(backend);
 }
 
+/**
+ * virFirewallUseNftables:
+ *
+ * Returns true if the nftables backend is in use, in which case
+ * callers must only add rules to VIR_FIREWALL_LAYER_NFTABLES
+ */
+bool
+virFirewallUseNftables(void)
+{
+    if (virFirewallInitialize() < 0)
+        return false;
+
+    return currentBackend == VIR_FIREWALL_BACKEND_NFTABLES;
+}
+
+
 static virFirewallGroupPtr
 virFirewallGroupNew(void)
 {
@@ -369,6 +513,7 @@ virFirewallAddRuleFullV(virFirewallPtr firewall,
         if (ip6tablesUseLock)
             ADD_ARG(rule, "-w");
         break;
+    case VIR_FIREWALL_LAYER_NFTABLES:
     case VIR_FIREWALL_LAYER_LAST:
         break;
     }
@@ -576,6 +721,65 @@ size_t virFirewallRuleGetArgCount(virFirewallRulePtr rule)
 }
 
 
+/**
+ * virFirewallRuleGetArg:
+ * @rule: the rule to look at
+ * @idx: index of the argument
+ *
+ * Returns the argument @idx of @rule, which includes the locking
+ * option automatically added for the layer, or NULL if out of range.
+ */
+const char *
+virFirewallRuleGetArg(virFirewallRulePtr rule,
+                      size_t idx)
+{
+    if (!rule || idx >= rule->argsLen)
+        return NULL;
+    return rule->args[idx];
+}
+
+
+virFirewallLayer
+virFirewallRuleGetLayer(virFirewallRulePtr rule)
+{
+    return rule->layer;
+}
+
+
+/**
+ * virFirewallGetRuleCount:
+ * @firewall: the firewall ruleset
+ *
+ * Returns the number of rules added to the current transaction,
+ * not counting its rollback rules.
+ */
+size_t
+virFirewallGetRuleCount(virFirewallPtr firewall)
+{
+    if (!firewall || firewall->err || firewall->ngroups == 0)
+        return 0;
+    return firewall->groups[firewall->currentGroup]->naction;
+}
+
+
+/**
+ * virFirewallGetRule:
+ * @firewall: the firewall ruleset
+ * @idx: index of the rule
+ *
+ * Returns the rule @idx of the current transaction, or NULL if
+ * out of range.
+ */
+virFirewallRulePtr
+virFirewallGetRule(virFirewallPtr firewall,
+                   size_t idx)
+{
+    if (idx >= virFirewallGetRuleCount(firewall))
+        return NULL;
+    return firewall->groups[firewall->currentGroup]->action[idx];
+}
+
+
 /**
  * virFirewallStartTransaction:
  * @firewall: the firewall ruleset
@@ -669,6 +873,7 @@ virFirewallApplyRuleDirect(virFirewallRulePtr rule,
     VIR_AUTOPTR(virCommand) cmd = NULL;
     int status;
     VIR_AUTOFREE(char *) error = NULL;
+    int rc;
 
     if (!bin) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -685,7 +890,15 @@ virFirewallApplyRuleDirect(virFirewallRulePtr rule,
     virCommandSetOutputBuffer(cmd, output);
     virCommandSetErrorBuffer(cmd, &error);
 
-    if (virCommandRun(cmd, &status) < 0)
+    /* firewalls with ebtables rules don't necessarily hold ruleLock
+     * when ebtables-restore is used, see virFirewallRuleNeedsLock */
+    if (rule->layer == VIR_FIREWALL_LAYER_ETHERNET)
+        virMutexLock(&ebtablesRestoreLock);
+    rc = virCommandRun(cmd, &status);
+    if (rule->layer == VIR_FIREWALL_LAYER_ETHERNET)
+        virMutexUnlock(&ebtablesRestoreLock);
+
+    if (rc < 0)
         return -1;
 
     if (status != 0) {
@@ -733,7 +946,23 @@ virFirewallApplyRule(virFirewallPtr firewall,
             return -1;
         break;
     case VIR_FIREWALL_BACKEND_FIREWALLD:
-        if (virFirewallApplyRuleFirewallD(rule, ignoreErrors, &output) < 0)
+        /* firewalld can only pass through iptables and ebtables rules */
+        if (rule->layer == VIR_FIREWALL_LAYER_NFTABLES) {
+            if (virFirewallApplyRuleDirect(rule, ignoreErrors, &output) < 0)
+                return -1;
+        } else {
+            if (virFirewallApplyRuleFirewallD(rule, ignoreErrors, &output) < 0)
+                return -1;
+        }
+        break;
+    case VIR_FIREWALL_BACKEND_NFTABLES:
+        if (rule->layer != VIR_FIREWALL_LAYER_NFTABLES) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                           _("Unable to apply %s rules with the nftables firewall backend"),
+                           virFirewallLayerCommandTypeToString(rule->layer));
+            return -1;
+        }
+        if (virFirewallApplyRuleDirect(rule, ignoreErrors, &output) < 0)
             return -1;
         break;
 
@@ -767,25 +996,451 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return 0;
 }
 
+static bool
+virFirewallLayerUseRestore(virFirewallLayer layer)
+{
+    switch (layer) {
+    case VIR_FIREWALL_LAYER_ETHERNET:
+        return ebtablesUseRestore;
+    case VIR_FIREWALL_LAYER_IPV4:
+        return iptablesUseRestore;
+    case VIR_FIREWALL_LAYER_IPV6:
+        return ip6tablesUseRestore;
+    case VIR_FIREWALL_LAYER_NFTABLES:
+        return true;
+    case VIR_FIREWALL_LAYER_LAST:
+        break;
+    }
+    return false;
+}
+
+
+static bool
+virFirewallRestoreArgIsSafe(const char *arg)
+{
+    /* The restore tools split lines on whitespace and give special
+     * meaning to quotes, so anything needing quoting is left for
+     * a direct invocation */
+    return *arg && !strpbrk(arg, " \t\n\"'\\");
+}
+
+
+static bool
+virFirewallRestoreCommandIsSupported(const char *arg)
+{
+    const char *commands[] = {
+        "-A", "--append",
+        "-I", "--insert",
+        "-D", "--delete",
+        "-R", "--replace",
+        "-N", "--new-chain",
+        "-X", "--delete-chain",
+        "-F", "--flush",
+        "-E", "--rename-chain",
+        "-P", "--policy",
+    };
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(commands); i++) {
+        if (STREQ(arg, commands[i]))
+            return true;
+    }
+    return false;
+}
+
+
+/*
+ * Format @rule as a line of input for the *-restore tools, stripping
+ * the lock option and storing the table name in @table.
+ *
+ * Returns 1 on success, 0 if the rule can't be batched, -1 on error
+ */
+static int
+virFirewallRuleToRestoreLine(virFirewallRulePtr rule,
+                             const char **table,
+                             char **line)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    bool haveCommand = false;
+    size_t i;
+
+    /* nft input uses the same syntax as its command line, and
+     * a transaction may span any number of tables */
+    if (rule->layer == VIR_FIREWALL_LAYER_NFTABLES) {
+        *table = "";
+        for (i = 0; i < rule->argsLen; i++) {
+            if (strchr(rule->args[i], '\n'))
+                goto unsupported;
+            if (i > 0)
+                virBufferAddLit(&buf, " ");
+            virBufferAdd(&buf, rule->args[i], -1);
+        }
+        if (rule->argsLen == 0)
+            goto unsupported;
+        goto done;
+    }
+
+    *table = NULL;
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (i == 0 &&
+            (STREQ(arg, "-w") || STREQ(arg, "--concurrent")))
+            continue;
+
+        if (STREQ(arg, "-t") || STREQ(arg, "--table")) {
+            if (*table || i + 1 == rule->argsLen)
+                goto unsupported;
+            *table = rule->args[++i];
+            if (!virFirewallRestoreArgIsSafe(*table))
+                goto unsupported;
+            continue;
+        }
+
+        if (!virFirewallRestoreArgIsSafe(arg))
+            goto unsupported;
+
+        if (!haveCommand) {
+            if (!virFirewallRestoreCommandIsSupported(arg))
+                goto unsupported;
+            haveCommand = true;
+        } else {
+            virBufferAddLit(&buf, " ");
+        }
+        virBufferAdd(&buf, arg, -1);
+    }
+
+    if (!haveCommand)
+        goto unsupported;
+
+    if (!*table)
+        *table = "filter";
+
+ done:
+    virBufferAddLit(&buf, "\n");
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
+
+    *line = virBufferContentAndReset(&buf);
+    return 1;
+
+ unsupported:
+    virBufferFreeAndReset(&buf);
+    return 0;
+}
+
+
+static void
+virFirewallBatchClear(virFirewallBatchPtr batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->nentries; i++)
+        VIR_FREE(batch->entries[i].line);
+    VIR_FREE(batch->entries);
+    batch->nentries = 0;
+    VIR_FREE(batch->table);
+}
+
+
+/*
+ * Queue @rule on the batch for its layer and table if it can be
+ * applied through the *-restore tools.
+ *
+ * Returns 1 if the rule was queued, 0 if it has to be applied
+ * on its own, -1 on error
+ */
+static int
+virFirewallBatchAdd(virFirewallBatchPtr *batches,
+                    size_t *nbatches,
+                    virFirewallRulePtr rule,
+                    bool ignoreErrors)
+{
+    virFirewallBatchEntry entry = { 0 };
+    const char *table;
+    size_t i;
+    int rc;
+
+    if (rule->queryCB ||
+        !virFirewallLayerUseRestore(rule->layer))
+        return 0;
+
+    if (rule->layer != VIR_FIREWALL_LAYER_NFTABLES &&
+        currentBackend != VIR_FIREWALL_BACKEND_DIRECT)
+        return 0;
+
+    if ((rc = virFirewallRuleToRestoreLine(rule, &table, &entry.line)) <= 0)
+        return rc;
+
+    entry.rule = rule;
+    entry.ignoreErrors = ignoreErrors || rule->ignoreErrors;
+
+    for (i = 0; i < *nbatches; i++) {
+        if ((*batches)[i].layer == rule->layer &&
+            STREQ((*batches)[i].table, table))
+            break;
+    }
+
+    if (i == *nbatches) {
+        virFirewallBatch batch = { 0 };
+
+        batch.layer = rule->layer;
+        if (VIR_STRDUP(batch.table, table) < 0 ||
+            VIR_APPEND_ELEMENT(*batches, *nbatches, batch) < 0) {
+            VIR_FREE(batch.table);
+            VIR_FREE(entry.line);
+            return -1;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT((*batches)[i].entries,
+                           (*batches)[i].nentries, entry) < 0) {
+        VIR_FREE(entry.line);
+        return -1;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Find the input line reported as failed by the *-restore tools,
+ * "iptables-restore: line 3 failed" or "Error occurred at line: 3",
+ * or by nft, "/dev/stdin:3:1-20: Error: ..."
+ */
+static int
+virFirewallBatchGetFailedLine(virFirewallLayer layer,
+                              const char *error,
+                              unsigned int *line)
+{
+    const char *needle = "line";
+    const char *tmp = error;
+    int ret = -1;
+
+    if (layer == VIR_FIREWALL_LAYER_NFTABLES)
+        needle = "stdin";
+
+    while (tmp && (tmp = strstr(tmp, needle))) {
+        char *end;
+
+        tmp += strlen(needle);
+        if (*tmp == ':')
+            tmp++;
+        virSkipSpaces(&tmp);
+
+        if (c_isdigit(*tmp) &&
+            virStrToLong_ui(tmp, &end, 10, line) == 0) {
+            ret = 0;
+            tmp = end;
+        }
+    }
+
+    return ret;
+}
+
+
+static int
+virFirewallBatchApplyDirect(virFirewallBatchPtr batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->nentries; i++) {
+        VIR_AUTOFREE(char *) output = NULL;
+
+        if (batch->entries[i].skip)
+            continue;
+
+        if (virFirewallApplyRuleDirect(batch->entries[i].rule,
+                                       batch->entries[i].ignoreErrors,
+                                       &output) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Apply all rules of @batch in a single transaction. The *-restore
+ * tools commit a table atomically, and so does nft with all of its
+ * input, so when a rule whose errors are to be ignored fails, nothing
+ * was changed and the remaining rules can be applied without it.
+ * They are applied one by one then, rather than feeding the whole
+ * batch to the tool again for every further rule that fails, e.g.
+ * when tearing down rules which are partly gone already.
+ */
+static int
+virFirewallBatchApply(virFirewallBatchPtr batch)
+{
+    const char *bin = virFirewallLayerRestoreCommandTypeToString(batch->layer);
+    bool nft = batch->layer == VIR_FIREWALL_LAYER_NFTABLES;
+    /* restore input starts with the table name, nft with the first rule */
+    unsigned int first = nft ? 1 : 2;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    VIR_AUTOPTR(virCommand) cmd = NULL;
+    VIR_AUTOFREE(char *) input = NULL;
+    VIR_AUTOFREE(char *) error = NULL;
+    virFirewallBatchEntryPtr entry;
+    unsigned int line;
+    int status;
+    int rc;
+    size_t i;
+
+    if (!bin) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown firewall layer %d"),
+                       batch->layer);
+        return -1;
+    }
+
+    if (batch->nentries == 0)
+        return 0;
+
+    if (!nft)
+        virBufferAsprintf(&buf, "*%s\n", batch->table);
+    for (i = 0; i < batch->nentries; i++)
+        virBufferAdd(&buf, batch->entries[i].line, -1);
+    if (!nft)
+        virBufferAddLit(&buf, "COMMIT\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
+    input = virBufferContentAndReset(&buf);
+
+    VIR_INFO("Applying %zu rules to table '%s' with %s",
+             batch->nentries, batch->table, bin);
+
+    if (nft) {
+        cmd = virCommandNewArgList(bin, "-f", "-", NULL);
+    } else {
+        cmd = virCommandNewArgList(bin, "--noflush", NULL);
+        if ((batch->layer == VIR_FIREWALL_LAYER_IPV4 && iptablesUseLock) ||
+            (batch->layer == VIR_FIREWALL_LAYER_IPV6 && ip6tablesUseLock))
+            virCommandAddArg(cmd, "-w");
+    }
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (batch->layer == VIR_FIREWALL_LAYER_ETHERNET)
+        virMutexLock(&ebtablesRestoreLock);
+    rc = virCommandRun(cmd, &status);
+    if (batch->layer == VIR_FIREWALL_LAYER_ETHERNET)
+        virMutexUnlock(&ebtablesRestoreLock);
+
+    if (rc < 0)
+        return -1;
+
+    if (status == 0)
+        return 0;
+
+    if (virFirewallBatchGetFailedLine(batch->layer, error, &line) < 0 ||
+        line < first || line - first >= batch->nentries) {
+        VIR_DEBUG("Unable to find failed rule in '%s', "
+                  "applying rules one by one", NULLSTR(error));
+        return virFirewallBatchApplyDirect(batch);
+    }
+
+    entry = &batch->entries[line - first];
+    if (!entry->ignoreErrors) {
+        VIR_AUTOFREE(char *) str = virFirewallRuleToString(entry->rule);
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules %s: %s"),
+                       NULLSTR(str), NULLSTR(error));
+        return -1;
+    }
+
+    VIR_DEBUG("Ignoring error applying rule at line %u, "
+              "applying remaining rules one by one", line);
+    entry->skip = true;
+    return virFirewallBatchApplyDirect(batch);
+}
+
+
+/*
+ * Apply all queued batches, in the order they were created.
+ * With @keepGoing set, a failed batch doesn't prevent
+ * the remaining ones from being applied.
+ */
+static int
+virFirewallBatchApplyAll(virFirewallBatchPtr *batches,
+                         size_t *nbatches,
+                         bool keepGoing)
+{
+    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < *nbatches; i++) {
+        if ((ret == 0 || keepGoing) &&
+            virFirewallBatchApply(&(*batches)[i]) < 0)
+            ret = -1;
+        virFirewallBatchClear(&(*batches)[i]);
+    }
+    VIR_FREE(*batches);
+    *nbatches = 0;
+
+    return ret;
+}
+
+
+/*
+ * Apply the action or rollback rules of @group. Consecutive rules
+ * which don't need their output examined are batched per table when
+ * the direct backend can use the *-restore tools, so that each table
+ * is changed by a single process rather than one per rule.
+ */
+static int
+virFirewallApplyRules(virFirewallPtr firewall,
+                      virFirewallGroupPtr group,
+                      bool rollback,
+                      bool ignoreErrors)
+{
+    virFirewallBatchPtr batches = NULL;
+    size_t nbatches = 0;
+    size_t i;
+    int rc;
+
+    /* Query callbacks may append rules to the group while
+     * it is being applied, so re-read the array each time */
+    for (i = 0; i < (rollback ? group->nrollback : group->naction); i++) {
+        virFirewallRulePtr rule = rollback ? group->rollback[i] : group->action[i];
+
+        if ((rc = virFirewallBatchAdd(&batches, &nbatches,
+                                      rule, ignoreErrors)) < 0)
+            goto error;
+        if (rc > 0)
+            continue;
+
+        if (virFirewallBatchApplyAll(&batches, &nbatches, rollback) < 0 &&
+            !rollback)
+            goto error;
+
+        if (virFirewallApplyRule(firewall, rule, ignoreErrors) < 0 &&
+            !rollback)
+            goto error;
+    }
+
+    return virFirewallBatchApplyAll(&batches, &nbatches, rollback);
+
+ error:
+    for (i = 0; i < nbatches; i++)
+        virFirewallBatchClear(&batches[i]);
+    VIR_FREE(batches);
+    return -1;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
-    size_t i;
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=0x%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
-    for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
-    }
-    return 0;
+    return virFirewallApplyRules(firewall, group, false, ignoreErrors);
 }
 
 
@@ -794,16 +1449,67 @@ virFirewallRollbackGroup(virFirewallPtr firewall,
                          size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
-    size_t i;
 
     VIR_INFO("Starting rollback for group %p", group);
     firewall->currentGroup = idx;
     group->addingRollback = true;
-    for (i = 0; i < group->nrollback; i++) {
-        ignore_value(virFirewallApplyRule(firewall,
-                                          group->rollback[i],
-                                          true));
+    ignore_value(virFirewallApplyRules(firewall, group, true, true));
+}
+
+
+static bool
+virFirewallRuleNeedsLock(virFirewallRulePtr rule)
+{
+    if (rule->layer == VIR_FIREWALL_LAYER_NFTABLES)
+        return false;
+
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT)
+        return true;
+
+    /* This also covers rules added later by query callbacks of @rule,
+     * which are in the same layer: ebtables runs are serialized with
+     * ebtablesRestoreLock and iptables waits for the xtables lock */
+    switch (rule->layer) {
+    case VIR_FIREWALL_LAYER_ETHERNET:
+        return !(ebtablesUseRestore && ebtablesUseLock);
+    case VIR_FIREWALL_LAYER_IPV4:
+        return !(iptablesUseRestore && iptablesUseLock);
+    case VIR_FIREWALL_LAYER_IPV6:
+        return !(ip6tablesUseRestore && ip6tablesUseLock);
+    case VIR_FIREWALL_LAYER_NFTABLES:
+    case VIR_FIREWALL_LAYER_LAST:
+        break;
     }
+    return true;
+}
+
+
+/*
+ * Batches of rules fed to nft or to the *-restore tools are applied
+ * atomically while the tool holds the system-wide xtables / ebtables
+ * lock, so firewalls consisting only of such rules can be applied in
+ * parallel. Everything else, e.g. rules passed through firewalld one
+ * by one, is serialized within the process.
+ */
+static bool
+virFirewallNeedsRuleLock(virFirewallPtr firewall)
+{
+    size_t i, j;
+
+    for (i = 0; i < firewall->ngroups; i++) {
+        virFirewallGroupPtr group = firewall->groups[i];
+
+        for (j = 0; j < group->naction; j++) {
+            if (virFirewallRuleNeedsLock(group->action[j]))
+                return true;
+        }
+        for (j = 0; j < group->nrollback; j++) {
+            if (virFirewallRuleNeedsLock(group->rollback[j]))
+                return true;
+        }
+    }
+
+    return false;
 }
 
 
@@ -811,28 +1517,30 @@ int
 virFirewallApply(virFirewallPtr firewall)
 {
     size_t i, j;
+    bool locked = false;
     int ret = -1;
 
-    virMutexLock(&ruleLock);
-
     if (currentBackend == VIR_FIREWALL_BACKEND_AUTOMATIC) {
         /* a specific backend should have been set when the firewall
          * object was created. If not, it means none was found.
          */
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Failed to initialize a valid firewall backend"));
-        goto cleanup;
+        return -1;
     }
     if (!firewall || firewall->err == ENOMEM) {
         virReportOOMError();
-        goto cleanup;
+        return -1;
     }
     if (firewall->err) {
         virReportSystemError(firewall->err, "%s",
                              _("Unable to create rule"));
-        goto cleanup;
+        return -1;
     }
 
+    if ((locked = virFirewallNeedsRuleLock(firewall)))
+        virMutexLock(&ruleLock);
+
     VIR_DEBUG("Applying groups for %p", firewall);
     for (i = 0; i < firewall->ngroups; i++) {
         if (virFirewallApplyGroup(firewall, i) < 0) {
@@ -867,6 +1575,7 @@ virFirewallApply(virFirewallPtr firewall)
 
     ret = 0;
  cleanup:
-    virMutexUnlock(&ruleLock);
+    if (locked)
+        virMutexUnlock(&ruleLock);
     return ret;
 }
@@ -33,6 +33,9 @@ typedef enum {
     VIR_FIREWALL_LAYER_ETHERNET,
     VIR_FIREWALL_LAYER_IPV4,
     VIR_FIREWALL_LAYER_IPV6,
+    /* Arguments are tokens of a nft command; all such rules of a
+     * transaction are applied atomically by a single nft process */
+    VIR_FIREWALL_LAYER_NFTABLES,
 
     VIR_FIREWALL_LAYER_LAST,
 } virFirewallLayer;
@@ -92,6 +95,16 @@ void virFirewallRuleAddArgList(virFirewallPtr firewall,
 
 size_t virFirewallRuleGetArgCount(virFirewallRulePtr rule);
 
+const char *virFirewallRuleGetArg(virFirewallRulePtr rule,
+                                  size_t idx);
+
+virFirewallLayer virFirewallRuleGetLayer(virFirewallRulePtr rule);
+
+size_t virFirewallGetRuleCount(virFirewallPtr firewall);
+
+virFirewallRulePtr virFirewallGetRule(virFirewallPtr firewall,
+                                      size_t idx);
+
 typedef enum {
     /* Ignore all errors when applying rules, so no
      * rollback block will be required */
@@ -114,4 +127,6 @@ int virFirewallApply(virFirewallPtr firewall);
 
 void virFirewallSetLockOverride(bool avoid);
 
+bool virFirewallUseNftables(void);
+
 VIR_DEFINE_AUTOPTR_FUNC(virFirewall, virFirewallFree);
@@ -46,6 +46,7 @@ VIR_ENUM_IMPL(virFirewallLayerFirewallD,
               "eb",
               "ipv4",
               "ipv6",
+              "",
               );
 
 
@@ -283,7 +284,7 @@ virFirewallDApplyRule(virFirewallLayer layer,
 
     memset(&error, 0, sizeof(error));
 
-    if (!ipv) {
+    if (!ipv || !*ipv) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unknown firewall layer %d"),
                        layer);
@@ -30,8 +30,11 @@ typedef enum {
     VIR_FIREWALL_BACKEND_AUTOMATIC,
     VIR_FIREWALL_BACKEND_DIRECT,
     VIR_FIREWALL_BACKEND_FIREWALLD,
+    VIR_FIREWALL_BACKEND_NFTABLES,
 
     VIR_FIREWALL_BACKEND_LAST,
 } virFirewallBackend;
 
 int virFirewallSetBackend(virFirewallBackend backend);
+
+void virFirewallSetRestoreOverride(bool use);
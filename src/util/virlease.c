@@ -31,6 +31,7 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virutil.h"
+#include "virjson.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
@@ -42,21 +43,22 @@
 #define VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX (32 * 1024 * 1024)
 
 
-int
-virLeaseReadCustomLeaseFile(virJSONValuePtr leases_array_new,
-                            const char *custom_lease_file,
-                            const char *ip_to_delete,
-                            char **server_duid)
+/* Read the leases of the JSON file, which held the leases before
+ * the lease database was introduced */
+static int
+virLeaseReadCustomLeaseFile(const char *custom_lease_file,
+                            virLeaseDBEntryPtr *leases,
+                            size_t *nleases)
 {
     VIR_AUTOFREE(char *) lease_entries = NULL;
     VIR_AUTOPTR(virJSONValue) leases_array = NULL;
-    long long expirytime;
     int custom_lease_file_len = 0;
     virJSONValuePtr lease_tmp = NULL;
-    const char *ip_tmp = NULL;
-    const char *server_duid_tmp = NULL;
     size_t i;
 
+    if (!virFileExists(custom_lease_file))
+        return 0;
+
     /* Read entire contents */
     if ((custom_lease_file_len = virFileReadAll(custom_lease_file,
                                                 VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
@@ -81,67 +83,135 @@ virLeaseReadCustomLeaseFile(virJSONValuePtr leases_array_new,
         return -1;
     }
 
-    i = 0;
-    while (i < virJSONValueArraySize(leases_array)) {
-        if (!(lease_tmp = virJSONValueArrayGet(leases_array, i))) {
+    for (i = 0; i < virJSONValueArraySize(leases_array); i++) {
+        virLeaseDBEntry lease = { 0 };
+
+        if (!(lease_tmp = virJSONValueArrayGet(leases_array, i)) ||
+            virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time",
+                                            &lease.expirytime) < 0 ||
+            !virJSONValueObjectGetString(lease_tmp, "ip-address")) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("failed to parse json"));
             return -1;
         }
 
-        if (!(ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address")) ||
-            (virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time", &expirytime) < 0)) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("failed to parse json"));
+        if (VIR_STRDUP(lease.ip,
+                       virJSONValueObjectGetString(lease_tmp, "ip-address")) < 0 ||
+            VIR_STRDUP(lease.mac,
+                       virJSONValueObjectGetString(lease_tmp, "mac-address")) < 0 ||
+            VIR_STRDUP(lease.hostname,
+                       virJSONValueObjectGetString(lease_tmp, "hostname")) < 0 ||
+            VIR_STRDUP(lease.clientid,
+                       virJSONValueObjectGetString(lease_tmp, "client-id")) < 0 ||
+            VIR_STRDUP(lease.iaid,
+                       virJSONValueObjectGetString(lease_tmp, "iaid")) < 0 ||
+            VIR_STRDUP(lease.serverDuid,
+                       virJSONValueObjectGetString(lease_tmp, "server-duid")) < 0 ||
+            VIR_APPEND_ELEMENT(*leases, *nleases, lease) < 0) {
+            virLeaseDBEntryClear(&lease);
             return -1;
         }
+    }
+
+    return 0;
+}
+
+
+/**
+ * virLeaseReadLeases:
+ * @lease_db_file: path of the lease database
+ * @custom_lease_file: path of the JSON file read if there's no database yet
+ * @ip_to_delete: IP address whose lease is left out, or NULL
+ * @server_duid: DUID of the DHCPv6 server, filled in from the leases if unset
+ * @leases: filled with the leases
+ * @nleases: number of @leases
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virLeaseReadLeases(const char *lease_db_file,
+                   const char *custom_lease_file,
+                   const char *ip_to_delete,
+                   char **server_duid,
+                   virLeaseDBEntryPtr *leases,
+                   size_t *nleases)
+{
+    virLeaseDBEntryPtr tmp = NULL;
+    size_t ntmp = 0;
+    size_t i;
+    int ret = -1;
+
+    *leases = NULL;
+    *nleases = 0;
+
+    if (virFileExists(lease_db_file)) {
+        VIR_AUTOPTR(virLeaseDB) db = NULL;
+
+        if (!(db = virLeaseDBOpen(lease_db_file)) ||
+            VIR_ALLOC_N(tmp, virLeaseDBGetCount(db)) < 0)
+            goto cleanup;
+
+        for (ntmp = 0; ntmp < virLeaseDBGetCount(db); ntmp++) {
+            if (virLeaseDBGetEntry(db, ntmp, &tmp[ntmp]) < 0)
+                goto cleanup;
+        }
+    } else if (custom_lease_file &&
+               virLeaseReadCustomLeaseFile(custom_lease_file, &tmp, &ntmp) < 0) {
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(*leases, ntmp) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ntmp; i++) {
+        virLeaseDBEntryPtr lease = &tmp[i];
 
         /* Check whether lease has to be included or not */
-        if (ip_to_delete && STREQ(ip_tmp, ip_to_delete)) {
-            i++;
+        if (!lease->ip ||
+            (ip_to_delete && STREQ(lease->ip, ip_to_delete)))
             continue;
-        }
 
-        if (server_duid && strchr(ip_tmp, ':')) {
+        if (server_duid && strchr(lease->ip, ':')) {
             /* This is an ipv6 lease */
-            if ((server_duid_tmp
-                 = virJSONValueObjectGetString(lease_tmp, "server-duid"))) {
-                if (!*server_duid && VIR_STRDUP(*server_duid, server_duid_tmp) < 0) {
+            if (lease->serverDuid) {
+                if (!*server_duid && VIR_STRDUP(*server_duid, lease->serverDuid) < 0) {
                     /* Control reaches here when the 'action' is not for an
                      * ipv6 lease or, for some weird reason the env var
                      * DNSMASQ_SERVER_DUID wasn't set*/
-                    return -1;
+                    goto cleanup;
                 }
             } else {
                 /* Inject server-duid into those ipv6 leases which
                  * didn't have it previously, for example, those
                  * created by leaseshelper from libvirt 1.2.6 */
-                if (virJSONValueObjectAppendString(lease_tmp, "server-duid", *server_duid) < 0)
-                    return -1;
+                if (VIR_STRDUP(lease->serverDuid, *server_duid) < 0)
+                    goto cleanup;
             }
         }
 
         /* Move old lease to new array */
-        if (virJSONValueArrayAppend(leases_array_new, lease_tmp) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("failed to create json"));
-            return -1;
-        }
-
-        ignore_value(virJSONValueArraySteal(leases_array, i));
+        (*leases)[(*nleases)++] = *lease;
+        memset(lease, 0, sizeof(*lease));
     }
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    virLeaseDBEntryListFree(tmp, ntmp);
+    if (ret < 0) {
+        virLeaseDBEntryListFree(*leases, *nleases);
+        *leases = NULL;
+        *nleases = 0;
+    }
+    return ret;
 }
 
 
 int
-virLeasePrintLeases(virJSONValuePtr leases_array_new,
+virLeasePrintLeases(const virLeaseDBEntry *leases,
+                    size_t nleases,
                     const char *server_duid)
 {
-    virJSONValuePtr lease_tmp = NULL;
-    const char *ip_tmp = NULL;
-    long long expirytime = 0;
     size_t i;
 
     /* Man page of dnsmasq says: the script (helper program, in our case)
@@ -153,48 +223,44 @@ virLeasePrintLeases(virJSONValuePtr leases_array_new,
      * $expirytime $iaid $ip $hostname $clientduid # For all ipv6 leases */
 
     /* Traversing the ipv4 leases */
-    for (i = 0; i < virJSONValueArraySize(leases_array_new); i++) {
-        lease_tmp = virJSONValueArrayGet(leases_array_new, i);
-        if (!(ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address"))) {
+    for (i = 0; i < nleases; i++) {
+        if (!leases[i].ip) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("failed to parse json"));
+                           _("found lease without ip-address"));
             return -1;
         }
-        if (!strchr(ip_tmp, ':')) {
-            if (virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time",
-                                                &expirytime) < 0)
+        if (!strchr(leases[i].ip, ':')) {
+            if (!leases[i].expirytime)
                 continue;
 
             printf("%lld %s %s %s %s\n",
-                   expirytime,
-                   virJSONValueObjectGetString(lease_tmp, "mac-address"),
-                   virJSONValueObjectGetString(lease_tmp, "ip-address"),
-                   NULLSTR_STAR(virJSONValueObjectGetString(lease_tmp, "hostname")),
-                   NULLSTR_STAR(virJSONValueObjectGetString(lease_tmp, "client-id")));
+                   leases[i].expirytime,
+                   NULLSTR(leases[i].mac),
+                   leases[i].ip,
+                   NULLSTR_STAR(leases[i].hostname),
+                   NULLSTR_STAR(leases[i].clientid));
         }
     }
 
     /* Traversing the ipv6 leases */
     if (server_duid) {
         printf("duid %s\n", server_duid);
-        for (i = 0; i < virJSONValueArraySize(leases_array_new); i++) {
-            lease_tmp = virJSONValueArrayGet(leases_array_new, i);
-            if (!(ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address"))) {
+        for (i = 0; i < nleases; i++) {
+            if (!leases[i].ip) {
                 virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("failed to parse json"));
+                               _("found lease without ip-address"));
                 return -1;
             }
-            if (strchr(ip_tmp, ':')) {
-                if (virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time",
-                                                    &expirytime) < 0)
+            if (strchr(leases[i].ip, ':')) {
+                if (!leases[i].expirytime)
                     continue;
 
                 printf("%lld %s %s %s %s\n",
-                       expirytime,
-                       virJSONValueObjectGetString(lease_tmp, "iaid"),
-                       virJSONValueObjectGetString(lease_tmp, "ip-address"),
-                       NULLSTR_STAR(virJSONValueObjectGetString(lease_tmp, "hostname")),
-                       NULLSTR_STAR(virJSONValueObjectGetString(lease_tmp, "client-id")));
+                       leases[i].expirytime,
+                       NULLSTR(leases[i].iaid),
+                       leases[i].ip,
+                       NULLSTR_STAR(leases[i].hostname),
+                       NULLSTR_STAR(leases[i].clientid));
             }
         }
     }
@@ -204,7 +270,7 @@ virLeasePrintLeases(virJSONValuePtr leases_array_new,
 
 
 int
-virLeaseNew(virJSONValuePtr *lease_ret,
+virLeaseNew(virLeaseDBEntryPtr *lease_ret,
             const char *mac,
             const char *clientid,
             const char *ip,
@@ -212,7 +278,7 @@ virLeaseNew(virJSONValuePtr *lease_ret,
             const char *iaid,
             const char *server_duid)
 {
-    VIR_AUTOPTR(virJSONValue) lease_new = NULL;
+    VIR_AUTOPTR(virLeaseDBEntry) lease_new = NULL;
     const char *exptime_tmp = getenv("DNSMASQ_LEASE_EXPIRES");
     long long expirytime = 0;
     VIR_AUTOFREE(char *) exptime = NULL;
@@ -243,28 +309,18 @@ virLeaseNew(virJSONValuePtr *lease_ret,
     }
 
     /* Create new lease */
-    if (!(lease_new = virJSONValueNewObject())) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("failed to create json"));
+    if (VIR_ALLOC(lease_new) < 0)
         return -1;
-    }
 
-    if (iaid && virJSONValueObjectAppendString(lease_new, "iaid", iaid) < 0)
-        return -1;
-    if (ip && virJSONValueObjectAppendString(lease_new, "ip-address", ip) < 0)
-        return -1;
-    if (mac && virJSONValueObjectAppendString(lease_new, "mac-address", mac) < 0)
-        return -1;
-    if (hostname && virJSONValueObjectAppendString(lease_new, "hostname", hostname) < 0)
-        return -1;
-    if (clientid && virJSONValueObjectAppendString(lease_new, "client-id", clientid) < 0)
-        return -1;
-    if (server_duid && virJSONValueObjectAppendString(lease_new, "server-duid", server_duid) < 0)
-        return -1;
-    if (expirytime && virJSONValueObjectAppendNumberLong(lease_new, "expiry-time", expirytime) < 0)
+    lease_new->expirytime = expirytime;
+    if (VIR_STRDUP(lease_new->iaid, iaid) < 0 ||
+        VIR_STRDUP(lease_new->ip, ip) < 0 ||
+        VIR_STRDUP(lease_new->mac, mac) < 0 ||
+        VIR_STRDUP(lease_new->hostname, hostname) < 0 ||
+        VIR_STRDUP(lease_new->clientid, clientid) < 0 ||
+        VIR_STRDUP(lease_new->serverDuid, server_duid) < 0)
         return -1;
 
-    *lease_ret = lease_new;
-    lease_new = NULL;
+    VIR_STEAL_PTR(*lease_ret, lease_new);
     return 0;
 }
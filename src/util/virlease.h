@@ -22,18 +22,21 @@
 
 #pragma once
 
-#include "virjson.h"
+#include "virleasedb.h"
 
-int virLeaseReadCustomLeaseFile(virJSONValuePtr leases_array_new,
-                                const char *custom_lease_file,
-                                const char *ip_to_delete,
-                                char **server_duid);
+int virLeaseReadLeases(const char *lease_db_file,
+                       const char *custom_lease_file,
+                       const char *ip_to_delete,
+                       char **server_duid,
+                       virLeaseDBEntryPtr *leases,
+                       size_t *nleases);
 
-int virLeasePrintLeases(virJSONValuePtr leases_array_new,
+int virLeasePrintLeases(const virLeaseDBEntry *leases,
+                        size_t nleases,
                         const char *server_duid);
 
 
-int virLeaseNew(virJSONValuePtr *lease_ret,
+int virLeaseNew(virLeaseDBEntryPtr *lease_ret,
                 const char *mac,
                 const char *clientid,
                 const char *ip,
@@ -0,0 +1,413 @@
+/*
+ * virleasedb.c: hash indexed database of DHCP leases
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+#include "virleasedb.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virleasedbfile.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NETWORK
+
+/* the number of buckets never drops below this, so that the entries
+ * following them stay aligned */
+#define VIR_LEASE_DB_BUCKETS_MIN 16
+
+struct _virLeaseDB {
+    void *data;
+    size_t len;
+    bool mapped;
+
+    /* NULL if the database is empty */
+    const virLeaseDBFileHeader *hdr;
+};
+
+
+void
+virLeaseDBEntryClear(virLeaseDBEntryPtr entry)
+{
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->ip);
+    VIR_FREE(entry->mac);
+    VIR_FREE(entry->hostname);
+    VIR_FREE(entry->clientid);
+    VIR_FREE(entry->iaid);
+    VIR_FREE(entry->serverDuid);
+    entry->expirytime = 0;
+}
+
+
+void
+virLeaseDBEntryFree(virLeaseDBEntryPtr entry)
+{
+    virLeaseDBEntryClear(entry);
+    VIR_FREE(entry);
+}
+
+
+void
+virLeaseDBEntryListFree(virLeaseDBEntryPtr entries,
+                        size_t nentries)
+{
+    size_t i;
+
+    for (i = 0; i < nentries; i++)
+        virLeaseDBEntryClear(&entries[i]);
+    VIR_FREE(entries);
+}
+
+
+/**
+ * virLeaseDBOpen:
+ * @path: path of the database
+ *
+ * Map the lease database at @path. A missing or empty file is an
+ * empty database.
+ *
+ * Returns the database or NULL on failure.
+ */
+virLeaseDBPtr
+virLeaseDBOpen(const char *path)
+{
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+    struct stat sb;
+    int fd = -1;
+    virLeaseDBPtr ret = NULL;
+
+    if (VIR_ALLOC(db) < 0)
+        return NULL;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        if (errno == ENOENT)
+            VIR_RETURN_PTR(db);
+
+        virReportSystemError(errno, _("cannot open lease database '%s'"),
+                             path);
+        return NULL;
+    }
+
+    if (fstat(fd, &sb) < 0) {
+        virReportSystemError(errno, _("cannot stat lease database '%s'"),
+                             path);
+        goto cleanup;
+    }
+
+    if (sb.st_size == 0) {
+        VIR_STEAL_PTR(ret, db);
+        goto cleanup;
+    }
+
+    db->len = sb.st_size;
+
+#ifdef HAVE_MMAP
+    if ((db->data = mmap(NULL, db->len, PROT_READ, MAP_SHARED,
+                         fd, 0)) == MAP_FAILED) {
+        db->data = NULL;
+        virReportSystemError(errno, _("cannot map lease database '%s'"),
+                             path);
+        goto cleanup;
+    }
+    db->mapped = true;
+#else /* !HAVE_MMAP */
+    if (VIR_ALLOC_N(db->data, db->len) < 0)
+        goto cleanup;
+
+    if (saferead(fd, db->data, db->len) != (ssize_t)db->len) {
+        virReportSystemError(errno, _("cannot read lease database '%s'"),
+                             path);
+        goto cleanup;
+    }
+#endif /* !HAVE_MMAP */
+
+    if (!(db->hdr = virLeaseDBFileCheck(db->data, db->len))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid lease database '%s'"), path);
+        goto cleanup;
+    }
+
+    VIR_STEAL_PTR(ret, db);
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
+void
+virLeaseDBFree(virLeaseDBPtr db)
+{
+    if (!db)
+        return;
+
+#ifdef HAVE_MMAP
+    if (db->mapped)
+        munmap(db->data, db->len);
+    else
+#endif /* HAVE_MMAP */
+        VIR_FREE(db->data);
+    VIR_FREE(db);
+}
+
+
+size_t
+virLeaseDBGetCount(virLeaseDBPtr db)
+{
+    return db->hdr ? db->hdr->nentries : 0;
+}
+
+
+/**
+ * virLeaseDBGetEntry:
+ * @db: lease database
+ * @idx: index of the lease, lower than virLeaseDBGetCount()
+ * @entry: filled with a copy of the lease
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virLeaseDBGetEntry(virLeaseDBPtr db,
+                   size_t idx,
+                   virLeaseDBEntryPtr entry)
+{
+    const virLeaseDBFileEntry *fentry;
+
+    memset(entry, 0, sizeof(*entry));
+
+    if (idx >= virLeaseDBGetCount(db)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("no lease %zu in lease database"), idx);
+        return -1;
+    }
+
+    fentry = virLeaseDBFileEntryGet(db->hdr, idx + 1);
+
+    entry->expirytime = fentry->expirytime;
+    if (VIR_STRDUP(entry->ip, virLeaseDBFileString(db->hdr, fentry->ip)) < 0 ||
+        VIR_STRDUP(entry->mac, virLeaseDBFileString(db->hdr, fentry->mac)) < 0 ||
+        VIR_STRDUP(entry->hostname,
+                   virLeaseDBFileString(db->hdr, fentry->hostname)) < 0 ||
+        VIR_STRDUP(entry->clientid,
+                   virLeaseDBFileString(db->hdr, fentry->clientid)) < 0 ||
+        VIR_STRDUP(entry->iaid, virLeaseDBFileString(db->hdr, fentry->iaid)) < 0 ||
+        VIR_STRDUP(entry->serverDuid,
+                   virLeaseDBFileString(db->hdr, fentry->serverDuid)) < 0) {
+        virLeaseDBEntryClear(entry);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virLeaseDBFindMAC:
+ * @db: lease database
+ * @mac: MAC address to look for
+ * @prev: index of the previous lease found, or -1 to start
+ *
+ * Look the next lease of @mac up in the index.
+ *
+ * Returns the index of the lease or -1 if there is no other one.
+ */
+ssize_t
+virLeaseDBFindMAC(virLeaseDBPtr db,
+                  const char *mac,
+                  ssize_t prev)
+{
+    const virLeaseDBFileEntry *fentry;
+    const char *fmac;
+    uint32_t n;
+    size_t i;
+
+    if (!db->hdr)
+        return -1;
+
+    if (prev < 0) {
+        n = virLeaseDBFileFirst(db->hdr, VIR_LEASE_DB_INDEX_MAC, mac);
+    } else {
+        if (!(fentry = virLeaseDBFileEntryGet(db->hdr, prev + 1)))
+            return -1;
+        n = fentry->next[VIR_LEASE_DB_INDEX_MAC];
+    }
+
+    /* bounded, in case the chain of a damaged database loops */
+    for (i = 0; i < db->hdr->nentries; i++) {
+        if (!(fentry = virLeaseDBFileEntryGet(db->hdr, n)))
+            break;
+
+        if ((fmac = virLeaseDBFileString(db->hdr, fentry->mac)) &&
+            STRCASEEQ(fmac, mac))
+            return n - 1;
+
+        n = fentry->next[VIR_LEASE_DB_INDEX_MAC];
+    }
+
+    return -1;
+}
+
+
+static uint32_t
+virLeaseDBSaveString(char *strings,
+                     size_t *offset,
+                     const char *str)
+{
+    uint32_t ret = *offset;
+
+    if (!str)
+        return 0;
+
+    strcpy(strings + *offset, str);
+    *offset += strlen(str) + 1;
+
+    return ret;
+}
+
+
+static int
+virLeaseDBSaveHelper(int fd,
+                     const void *opaque)
+{
+    const virLeaseDBFileHeader *hdr = opaque;
+    size_t len = virLeaseDBFileSize(hdr->nbuckets, hdr->nentries,
+                                    hdr->strsize);
+
+    if (safewrite(fd, hdr, len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virLeaseDBSave:
+ * @path: path of the database
+ * @entries: the leases
+ * @nentries: number of @entries
+ *
+ * Write a database of @entries and atomically replace @path with it.
+ * Readers which have the old database mapped keep using it.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virLeaseDBSave(const char *path,
+               const virLeaseDBEntry *entries,
+               size_t nentries)
+{
+    VIR_AUTOFREE(void *) data = NULL;
+    virLeaseDBFileHeader *hdr;
+    uint32_t *buckets;
+    virLeaseDBFileEntry *fentries;
+    char *strings;
+    size_t nbuckets = VIR_LEASE_DB_BUCKETS_MIN;
+    size_t strsize = 1;
+    size_t offset = 1;
+    size_t i;
+
+    for (i = 0; i < nentries; i++) {
+        const char *strs[] = {
+            entries[i].ip, entries[i].mac, entries[i].hostname,
+            entries[i].clientid, entries[i].iaid, entries[i].serverDuid,
+        };
+        size_t j;
+
+        for (j = 0; j < ARRAY_CARDINALITY(strs); j++) {
+            if (strs[j])
+                strsize += strlen(strs[j]) + 1;
+        }
+    }
+
+    while (nbuckets < nentries)
+        nbuckets <<= 1;
+
+    if (nbuckets > UINT32_MAX || strsize > UINT32_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("too many leases for lease database '%s'"), path);
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(data, virLeaseDBFileSize(nbuckets, nentries, strsize)) < 0)
+        return -1;
+
+    hdr = data;
+    memcpy(hdr->magic, VIR_LEASE_DB_FILE_MAGIC, sizeof(hdr->magic));
+    hdr->version = VIR_LEASE_DB_FILE_VERSION;
+    hdr->nbuckets = nbuckets;
+    hdr->nentries = nentries;
+    hdr->strsize = strsize;
+
+    buckets = (uint32_t *)(hdr + 1);
+    fentries = (void *)(buckets + VIR_LEASE_DB_INDEX_LAST * nbuckets);
+    strings = (char *)(fentries + nentries);
+
+    /* filling the chains from the back keeps the leases of a key in
+     * their order */
+    for (i = nentries; i-- > 0;) {
+        const virLeaseDBEntry *entry = &entries[i];
+        virLeaseDBFileEntry *fentry = &fentries[i];
+        const char *keys[VIR_LEASE_DB_INDEX_LAST] = {
+            [VIR_LEASE_DB_INDEX_MAC] = entry->mac,
+            [VIR_LEASE_DB_INDEX_HOSTNAME] = entry->hostname,
+        };
+        size_t j;
+
+        for (j = 0; j < VIR_LEASE_DB_INDEX_LAST; j++) {
+            uint32_t *bucket;
+
+            if (!keys[j])
+                continue;
+
+            bucket = &buckets[j * nbuckets +
+                              (virLeaseDBFileHash(keys[j]) & (nbuckets - 1))];
+            fentry->next[j] = *bucket;
+            *bucket = i + 1;
+        }
+    }
+
+    for (i = 0; i < nentries; i++) {
+        const virLeaseDBEntry *entry = &entries[i];
+        virLeaseDBFileEntry *fentry = &fentries[i];
+
+        fentry->expirytime = entry->expirytime;
+        fentry->ip = virLeaseDBSaveString(strings, &offset, entry->ip);
+        fentry->mac = virLeaseDBSaveString(strings, &offset, entry->mac);
+        fentry->hostname = virLeaseDBSaveString(strings, &offset,
+                                                entry->hostname);
+        fentry->clientid = virLeaseDBSaveString(strings, &offset,
+                                                entry->clientid);
+        fentry->iaid = virLeaseDBSaveString(strings, &offset, entry->iaid);
+        fentry->serverDuid = virLeaseDBSaveString(strings, &offset,
+                                                  entry->serverDuid);
+    }
+
+    return virFileRewrite(path, 0644, virLeaseDBSaveHelper, hdr);
+}
@@ -0,0 +1,62 @@
+/*
+ * virleasedb.h: hash indexed database of DHCP leases
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virautoclean.h"
+
+typedef struct _virLeaseDBEntry virLeaseDBEntry;
+typedef virLeaseDBEntry *virLeaseDBEntryPtr;
+struct _virLeaseDBEntry {
+    long long expirytime;
+    char *ip;
+    char *mac;
+    char *hostname;
+    char *clientid;
+    char *iaid;
+    char *serverDuid;
+};
+
+typedef struct _virLeaseDB virLeaseDB;
+typedef virLeaseDB *virLeaseDBPtr;
+
+void virLeaseDBEntryClear(virLeaseDBEntryPtr entry);
+void virLeaseDBEntryFree(virLeaseDBEntryPtr entry);
+void virLeaseDBEntryListFree(virLeaseDBEntryPtr entries,
+                             size_t nentries);
+
+virLeaseDBPtr virLeaseDBOpen(const char *path);
+void virLeaseDBFree(virLeaseDBPtr db);
+
+size_t virLeaseDBGetCount(virLeaseDBPtr db);
+int virLeaseDBGetEntry(virLeaseDBPtr db,
+                       size_t idx,
+                       virLeaseDBEntryPtr entry);
+ssize_t virLeaseDBFindMAC(virLeaseDBPtr db,
+                          const char *mac,
+                          ssize_t prev);
+
+int virLeaseDBSave(const char *path,
+                   const virLeaseDBEntry *entries,
+                   size_t nentries);
+
+VIR_DEFINE_AUTOPTR_FUNC(virLeaseDBEntry, virLeaseDBEntryFree);
+VIR_DEFINE_AUTOPTR_FUNC(virLeaseDB, virLeaseDBFree);
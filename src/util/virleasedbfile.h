@@ -0,0 +1,187 @@
+/*
+ * virleasedbfile.h: on-disk format of the lease database
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * This file is shared with the NSS module, which must not link with
+ * anything but the C library, so it must not include any libvirt
+ * headers.
+ *
+ * A database is never modified once written. Updates write a new one
+ * which is renamed over the old one, so readers can map the file and
+ * look leases up without any locking.
+ *
+ * The file consists of, in this order and without padding:
+ *
+ *   virLeaseDBFileHeader header;
+ *   uint32_t buckets[VIR_LEASE_DB_INDEX_LAST][header.nbuckets];
+ *   virLeaseDBFileEntry entries[header.nentries];
+ *   char strings[header.strsize];
+ *
+ * Every index has a hash table of header.nbuckets buckets, each
+ * holding the number of the first entry in the bucket, chained by
+ * entry.next. Entry numbers start at 1, 0 ends a chain. Strings are
+ * referenced by their offset in the string table, the empty string
+ * at offset 0 stands for an unset one.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define VIR_LEASE_DB_FILE_MAGIC "LVLEASE"
+#define VIR_LEASE_DB_FILE_VERSION 1
+
+typedef enum {
+    VIR_LEASE_DB_INDEX_MAC,
+    VIR_LEASE_DB_INDEX_HOSTNAME,
+
+    VIR_LEASE_DB_INDEX_LAST
+} virLeaseDBIndex;
+
+typedef struct _virLeaseDBFileHeader virLeaseDBFileHeader;
+struct _virLeaseDBFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nbuckets; /* a power of two */
+    uint32_t nentries;
+    uint32_t strsize;
+};
+
+typedef struct _virLeaseDBFileEntry virLeaseDBFileEntry;
+struct _virLeaseDBFileEntry {
+    int64_t expirytime;
+    uint32_t next[VIR_LEASE_DB_INDEX_LAST];
+    uint32_t ip;
+    uint32_t mac;
+    uint32_t hostname;
+    uint32_t clientid;
+    uint32_t iaid;
+    uint32_t serverDuid;
+};
+
+
+/* FNV-1a of @str ignoring ASCII case, so that MAC addresses can be
+ * looked up regardless of their case */
+static inline uint32_t
+virLeaseDBFileHash(const char *str)
+{
+    uint32_t hash = 2166136261U;
+
+    for (; *str; str++) {
+        unsigned char c = *str;
+
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        hash = (hash ^ c) * 16777619U;
+    }
+
+    return hash;
+}
+
+
+static inline size_t
+virLeaseDBFileSize(uint32_t nbuckets,
+                   uint32_t nentries,
+                   uint32_t strsize)
+{
+    return sizeof(virLeaseDBFileHeader) +
+        VIR_LEASE_DB_INDEX_LAST * (size_t)nbuckets * sizeof(uint32_t) +
+        (size_t)nentries * sizeof(virLeaseDBFileEntry) +
+        strsize;
+}
+
+
+/* Returns the header of the database of @len bytes at @data or NULL
+ * if it is not a valid database */
+static inline const virLeaseDBFileHeader *
+virLeaseDBFileCheck(const void *data,
+                    size_t len)
+{
+    const virLeaseDBFileHeader *hdr = data;
+    const char *strings;
+
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr->magic, VIR_LEASE_DB_FILE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != VIR_LEASE_DB_FILE_VERSION ||
+        hdr->nbuckets == 0 ||
+        (hdr->nbuckets & (hdr->nbuckets - 1)) ||
+        hdr->strsize == 0 ||
+        hdr->nbuckets > len || hdr->nentries > len || hdr->strsize > len ||
+        virLeaseDBFileSize(hdr->nbuckets, hdr->nentries, hdr->strsize) != len)
+        return NULL;
+
+    /* make sure that every string is terminated */
+    strings = (const char *)data + len - hdr->strsize;
+    if (strings[0] != '\0' || strings[hdr->strsize - 1] != '\0')
+        return NULL;
+
+    return hdr;
+}
+
+
+static inline const uint32_t *
+virLeaseDBFileBuckets(const virLeaseDBFileHeader *hdr,
+                      virLeaseDBIndex index)
+{
+    return (const uint32_t *)(hdr + 1) + (size_t)index * hdr->nbuckets;
+}
+
+
+/* Returns entry number @n (starting at 1) or NULL if it doesn't exist */
+static inline const virLeaseDBFileEntry *
+virLeaseDBFileEntryGet(const virLeaseDBFileHeader *hdr,
+                       uint32_t n)
+{
+    const virLeaseDBFileEntry *entries;
+
+    if (n == 0 || n > hdr->nentries)
+        return NULL;
+
+    entries = (const virLeaseDBFileEntry *)(const void *)
+        virLeaseDBFileBuckets(hdr, VIR_LEASE_DB_INDEX_LAST);
+    return &entries[n - 1];
+}
+
+
+/* Returns the string at @offset or NULL if it is unset or invalid */
+static inline const char *
+virLeaseDBFileString(const virLeaseDBFileHeader *hdr,
+                     uint32_t offset)
+{
+    if (offset == 0 || offset >= hdr->strsize)
+        return NULL;
+
+    return (const char *)hdr +
+        virLeaseDBFileSize(hdr->nbuckets, hdr->nentries, 0) + offset;
+}
+
+
+/* Returns the number of the first entry in the bucket of @key in
+ * @index, or 0 if there is none */
+static inline uint32_t
+virLeaseDBFileFirst(const virLeaseDBFileHeader *hdr,
+                    virLeaseDBIndex index,
+                    const char *key)
+{
+    return virLeaseDBFileBuckets(hdr, index)[virLeaseDBFileHash(key) &
+                                             (hdr->nbuckets - 1)];
+}
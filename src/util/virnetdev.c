@@ -956,6 +956,378 @@ virNetDevGetMaster(const char *ifname ATTRIBUTE_UNUSED,
 #endif /* defined(__linux__) && defined(HAVE_LIBNL) */
 
 
+typedef enum {
+    VIR_NETDEV_LINK_OP_MAC,
+    VIR_NETDEV_LINK_OP_MTU,
+    VIR_NETDEV_LINK_OP_MASTER,
+    VIR_NETDEV_LINK_OP_ONLINE,
+} virNetDevLinkOp;
+
+typedef struct _virNetDevLinkBatchRequest virNetDevLinkBatchRequest;
+struct _virNetDevLinkBatchRequest {
+    virNetDevLinkOp op;
+    char *ifname;
+    char *arg; /* MAC address or master, for error messages */
+};
+
+struct _virNetDevLinkBatch {
+    virNetlinkBatchPtr nlbatch;
+    virNetDevLinkBatchRequest *reqs;
+    size_t nreqs;
+};
+
+
+void
+virNetDevLinkBatchFree(virNetDevLinkBatchPtr batch)
+{
+    size_t i;
+
+    if (!batch)
+        return;
+
+    for (i = 0; i < batch->nreqs; i++) {
+        VIR_FREE(batch->reqs[i].ifname);
+        VIR_FREE(batch->reqs[i].arg);
+    }
+    VIR_FREE(batch->reqs);
+    virNetlinkBatchFree(batch->nlbatch);
+    VIR_FREE(batch);
+}
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/**
+ * virNetDevLinkBatchNew:
+ *
+ * Create a batch of changes to network interfaces. The changes are
+ * all sent to the kernel in a single message by virNetDevLinkBatchRun,
+ * instead of taking one socket and at least one system call each.
+ *
+ * Returns the new batch or NULL on error.
+ */
+virNetDevLinkBatchPtr
+virNetDevLinkBatchNew(void)
+{
+    VIR_AUTOPTR(virNetDevLinkBatch) batch = NULL;
+
+    if (VIR_ALLOC(batch) < 0 ||
+        !(batch->nlbatch = virNetlinkBatchNew(NETLINK_ROUTE)))
+        return NULL;
+
+    VIR_RETURN_PTR(batch);
+}
+
+
+static struct nl_msg *
+virNetDevLinkBatchNewMsg(const char *ifname,
+                         unsigned int flags,
+                         unsigned int change)
+{
+    struct nl_msg *nl_msg;
+    struct ifinfomsg ifinfo = {
+        .ifi_family = AF_UNSPEC,
+        .ifi_flags = flags,
+        .ifi_change = change,
+    };
+
+    /* the kernel looks the interface up by its name as the index is 0 */
+    if (!(nl_msg = nlmsg_alloc_simple(RTM_SETLINK, NLM_F_REQUEST))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0 ||
+        nla_put(nl_msg, IFLA_IFNAME, strlen(ifname) + 1, ifname) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        nlmsg_free(nl_msg);
+        return NULL;
+    }
+
+    return nl_msg;
+}
+
+
+static int
+virNetDevLinkBatchAddMsg(virNetDevLinkBatchPtr batch,
+                         struct nl_msg *nl_msg,
+                         virNetDevLinkOp op,
+                         const char *ifname,
+                         const char *arg)
+{
+    virNetDevLinkBatchRequest req = { .op = op };
+
+    if (VIR_STRDUP(req.ifname, ifname) < 0 ||
+        VIR_STRDUP(req.arg, arg) < 0 ||
+        VIR_APPEND_ELEMENT(batch->reqs, batch->nreqs, req) < 0) {
+        VIR_FREE(req.ifname);
+        VIR_FREE(req.arg);
+        nlmsg_free(nl_msg);
+        return -1;
+    }
+
+    return virNetlinkBatchAdd(batch->nlbatch, nl_msg, 0);
+}
+
+
+/**
+ * virNetDevLinkBatchSetMAC:
+ * @batch: the batch of changes
+ * @ifname: interface name to set MAC for
+ * @macaddr: MAC address
+ *
+ * Add setting the @macaddr of @ifname to @batch.
+ *
+ * Returns 0 in case of success or -1 on failure
+ */
+int
+virNetDevLinkBatchSetMAC(virNetDevLinkBatchPtr batch,
+                         const char *ifname,
+                         const virMacAddr *macaddr)
+{
+    char macstr[VIR_MAC_STRING_BUFLEN];
+    struct nl_msg *nl_msg;
+
+    if (!(nl_msg = virNetDevLinkBatchNewMsg(ifname, 0, 0)))
+        return -1;
+
+    if (nla_put(nl_msg, IFLA_ADDRESS, VIR_MAC_BUFLEN, macaddr->addr) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        nlmsg_free(nl_msg);
+        return -1;
+    }
+
+    return virNetDevLinkBatchAddMsg(batch, nl_msg, VIR_NETDEV_LINK_OP_MAC,
+                                    ifname, virMacAddrFormat(macaddr, macstr));
+}
+
+
+/**
+ * virNetDevLinkBatchSetMTU:
+ * @batch: the batch of changes
+ * @ifname: interface name to set MTU for
+ * @mtu: MTU value
+ *
+ * Add setting the @mtu of @ifname to @batch.
+ *
+ * Returns 0 in case of success or -1 on failure
+ */
+int
+virNetDevLinkBatchSetMTU(virNetDevLinkBatchPtr batch,
+                         const char *ifname,
+                         int mtu)
+{
+    struct nl_msg *nl_msg;
+
+    if (!(nl_msg = virNetDevLinkBatchNewMsg(ifname, 0, 0)))
+        return -1;
+
+    if (nla_put_u32(nl_msg, IFLA_MTU, mtu) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        nlmsg_free(nl_msg);
+        return -1;
+    }
+
+    return virNetDevLinkBatchAddMsg(batch, nl_msg, VIR_NETDEV_LINK_OP_MTU,
+                                    ifname, NULL);
+}
+
+
+/**
+ * virNetDevLinkBatchSetMaster:
+ * @batch: the batch of changes
+ * @ifname: the network interface name
+ * @master: the bridge or bond to attach @ifname to
+ *
+ * Add attaching @ifname to @master to @batch. @master must exist at
+ * the time it is added.
+ *
+ * Returns 0 in case of success or -1 on failure
+ */
+int
+virNetDevLinkBatchSetMaster(virNetDevLinkBatchPtr batch,
+                            const char *ifname,
+                            const char *master)
+{
+    struct nl_msg *nl_msg;
+    int ifindex;
+
+    if (virNetDevGetIndex(master, &ifindex) < 0 ||
+        !(nl_msg = virNetDevLinkBatchNewMsg(ifname, 0, 0)))
+        return -1;
+
+    if (nla_put_u32(nl_msg, IFLA_MASTER, ifindex) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        nlmsg_free(nl_msg);
+        return -1;
+    }
+
+    return virNetDevLinkBatchAddMsg(batch, nl_msg, VIR_NETDEV_LINK_OP_MASTER,
+                                    ifname, master);
+}
+
+
+/**
+ * virNetDevLinkBatchSetOnline:
+ * @batch: the batch of changes
+ * @ifname: the interface name
+ * @online: true for up, false for down
+ *
+ * Add activating (up, true) or deactivating (down, false) @ifname to
+ * @batch.
+ *
+ * Returns 0 in case of success or -1 on failure
+ */
+int
+virNetDevLinkBatchSetOnline(virNetDevLinkBatchPtr batch,
+                            const char *ifname,
+                            bool online)
+{
+    struct nl_msg *nl_msg;
+
+    if (!(nl_msg = virNetDevLinkBatchNewMsg(ifname, online ? IFF_UP : 0,
+                                            IFF_UP)))
+        return -1;
+
+    return virNetDevLinkBatchAddMsg(batch, nl_msg, VIR_NETDEV_LINK_OP_ONLINE,
+                                    ifname, NULL);
+}
+
+
+/**
+ * virNetDevLinkBatchRun:
+ * @batch: the batch of changes
+ *
+ * Apply all changes of @batch in the order they were added. The
+ * kernel attempts every change, even when an earlier one failed, and
+ * the first failed change is reported.
+ *
+ * Returns 0 in case of success or -1 on failure
+ */
+int
+virNetDevLinkBatchRun(virNetDevLinkBatchPtr batch)
+{
+    virNetDevLinkBatchRequest *req = NULL;
+    int error = 0;
+    size_t i;
+
+    if (virNetlinkBatchRun(batch->nlbatch, &error) == 0)
+        return 0;
+
+    if (error == 0)
+        return -1;
+
+    for (i = 0; i < batch->nreqs; i++) {
+        if ((error = virNetlinkBatchGetError(batch->nlbatch, i)) < 0) {
+            req = &batch->reqs[i];
+            break;
+        }
+    }
+
+    if (!req) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed netlink response message"));
+        return -1;
+    }
+
+    switch (req->op) {
+    case VIR_NETDEV_LINK_OP_MAC:
+        virReportSystemError(-error,
+                             _("Cannot set interface MAC to %s on '%s'"),
+                             req->arg, req->ifname);
+        break;
+    case VIR_NETDEV_LINK_OP_MTU:
+        virReportSystemError(-error,
+                             _("Cannot set interface MTU on '%s'"),
+                             req->ifname);
+        break;
+    case VIR_NETDEV_LINK_OP_MASTER:
+        virReportSystemError(-error,
+                             _("Unable to add bridge %s port %s"),
+                             req->arg, req->ifname);
+        break;
+    case VIR_NETDEV_LINK_OP_ONLINE:
+        virReportSystemError(-error,
+                             _("Cannot set interface flags on '%s'"),
+                             req->ifname);
+        break;
+    }
+
+    return -1;
+}
+
+
+#else /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
+virNetDevLinkBatchPtr
+virNetDevLinkBatchNew(void)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Unable to change links in a batch on this platform"));
+    return NULL;
+}
+
+
+int
+virNetDevLinkBatchSetMAC(virNetDevLinkBatchPtr batch ATTRIBUTE_UNUSED,
+                         const char *ifname ATTRIBUTE_UNUSED,
+                         const virMacAddr *macaddr ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Unable to change links in a batch on this platform"));
+    return -1;
+}
+
+
+int
+virNetDevLinkBatchSetMTU(virNetDevLinkBatchPtr batch ATTRIBUTE_UNUSED,
+                         const char *ifname ATTRIBUTE_UNUSED,
+                         int mtu ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Unable to change links in a batch on this platform"));
+    return -1;
+}
+
+
+int
+virNetDevLinkBatchSetMaster(virNetDevLinkBatchPtr batch ATTRIBUTE_UNUSED,
+                            const char *ifname ATTRIBUTE_UNUSED,
+                            const char *master ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Unable to change links in a batch on this platform"));
+    return -1;
+}
+
+
+int
+virNetDevLinkBatchSetOnline(virNetDevLinkBatchPtr batch ATTRIBUTE_UNUSED,
+                            const char *ifname ATTRIBUTE_UNUSED,
+                            bool online ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Unable to change links in a batch on this platform"));
+    return -1;
+}
+
+
+int
+virNetDevLinkBatchRun(virNetDevLinkBatchPtr batch ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Unable to change links in a batch on this platform"));
+    return -1;
+}
+
+
+#endif /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
 #if defined(SIOCGIFVLAN) && defined(HAVE_STRUCT_IFREQ) && HAVE_DECL_GET_VLAN_VID_CMD
 int virNetDevGetVLanID(const char *ifname, int *vlanid)
 {
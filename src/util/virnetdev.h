@@ -198,7 +198,8 @@ int virNetDevSetName(const char *ifname, const char *newifname)
 char *virNetDevGetName(int ifindex)
     ATTRIBUTE_RETURN_CHECK;
 int virNetDevGetIndex(const char *ifname, int *ifindex)
-    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK
+    ATTRIBUTE_NOINLINE;
 
 int virNetDevGetVLanID(const char *ifname, int *vlanid)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
@@ -206,6 +207,32 @@ int virNetDevGetVLanID(const char *ifname, int *vlanid)
 int virNetDevGetMaster(const char *ifname, char **master)
    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
 
+typedef struct _virNetDevLinkBatch virNetDevLinkBatch;
+typedef virNetDevLinkBatch *virNetDevLinkBatchPtr;
+
+virNetDevLinkBatchPtr virNetDevLinkBatchNew(void);
+void virNetDevLinkBatchFree(virNetDevLinkBatchPtr batch);
+int virNetDevLinkBatchSetMAC(virNetDevLinkBatchPtr batch,
+                             const char *ifname,
+                             const virMacAddr *macaddr)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_RETURN_CHECK;
+int virNetDevLinkBatchSetMTU(virNetDevLinkBatchPtr batch,
+                             const char *ifname,
+                             int mtu)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+int virNetDevLinkBatchSetMaster(virNetDevLinkBatchPtr batch,
+                                const char *ifname,
+                                const char *master)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_RETURN_CHECK;
+int virNetDevLinkBatchSetOnline(virNetDevLinkBatchPtr batch,
+                                const char *ifname,
+                                bool online)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+int virNetDevLinkBatchRun(virNetDevLinkBatchPtr batch)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
 int virNetDevValidateConfig(const char *ifname,
                             const virMacAddr *macaddr, int ifindex)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
@@ -312,3 +339,4 @@ int virNetDevRunEthernetScript(const char *ifname, const char *script)
     ATTRIBUTE_NOINLINE;
 
 VIR_DEFINE_AUTOPTR_FUNC(virNetDevRxFilter, virNetDevRxFilterFree);
+VIR_DEFINE_AUTOPTR_FUNC(virNetDevLinkBatch, virNetDevLinkBatchFree);
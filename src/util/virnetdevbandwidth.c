@@ -20,7 +20,8 @@
 #include <unistd.h>
 
 #include "virnetdevbandwidth.h"
-#include "vircommand.h"
+#include "virnetdev.h"
+#include "virnetlink.h"
 #include "viralloc.h"
 #include "virerror.h"
 #include "virstring.h"
@@ -39,9 +40,145 @@ virNetDevBandwidthFree(virNetDevBandwidthPtr def)
     VIR_FREE(def);
 }
 
+/*
+ * virNetDevBandwidthCopy:
+ * @dest: destination
+ * @src:  source (may be NULL)
+ *
+ * Returns -1 on OOM error (which gets reported),
+ * 0 otherwise.
+ */
+int
+virNetDevBandwidthCopy(virNetDevBandwidthPtr *dest,
+                       const virNetDevBandwidth *src)
+{
+    int ret = -1;
+
+    *dest = NULL;
+    if (!src) {
+        /* nothing to be copied */
+        return 0;
+    }
+
+    if (VIR_ALLOC(*dest) < 0)
+        goto cleanup;
+
+    if (src->in) {
+        if (VIR_ALLOC((*dest)->in) < 0)
+            goto cleanup;
+        memcpy((*dest)->in, src->in, sizeof(*src->in));
+    }
+
+    if (src->out) {
+        if (VIR_ALLOC((*dest)->out) < 0) {
+            VIR_FREE((*dest)->in);
+            goto cleanup;
+        }
+        memcpy((*dest)->out, src->out, sizeof(*src->out));
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0) {
+        virNetDevBandwidthFree(*dest);
+        *dest = NULL;
+    }
+    return ret;
+}
+
+bool
+virNetDevBandwidthEqual(virNetDevBandwidthPtr a,
+                        virNetDevBandwidthPtr b)
+{
+    if (!a && !b)
+        return true;
+
+    if (!a || !b)
+        return false;
+
+    /* in */
+    if (a->in) {
+        if (!b->in)
+            return false;
+
+        if (a->in->average != b->in->average ||
+            a->in->peak != b->in->peak ||
+            a->in->floor != b->in->floor ||
+            a->in->burst != b->in->burst)
+            return false;
+    } else if (b->in) {
+        return false;
+    }
+
+    /*out*/
+    if (a->out) {
+        if (!b->out)
+            return false;
+
+        if (a->out->average != b->out->average ||
+            a->out->peak != b->out->peak ||
+            a->out->floor != b->out->floor ||
+            a->out->burst != b->out->burst)
+            return false;
+    } else if (b->out) {
+        return false;
+    }
+
+    return true;
+}
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+
+# include <linux/if_ether.h>
+# include <linux/pkt_cls.h>
+# include <linux/pkt_sched.h>
+# include <linux/rtnetlink.h>
+
+/* The packet scheduler of the kernel measures time in ticks of 64ns */
+# define VIR_NETDEV_BANDWIDTH_TICKS_PER_SEC (1000000000ULL / 64)
+
+/* The defaults of tc for computing the buffers of HTB classes */
+# define VIR_NETDEV_BANDWIDTH_HZ 1000
+# define VIR_NETDEV_BANDWIDTH_HTB_MTU 1600
+
+/* The MTU of the policer on ingress, i.e. 64kb */
+# define VIR_NETDEV_BANDWIDTH_POLICE_MTU 65536
+# define VIR_NETDEV_BANDWIDTH_POLICE_CELL_LOG 9
+
+/* u32 filters must have 800:: prefix. Don't ask. */
+# define VIR_NETDEV_BANDWIDTH_U32_HANDLE(id) (0x80000000U | (id))
+
+/* Rates are given in kilobytes per second and sizes in kibibytes */
+# define VIR_NETDEV_BANDWIDTH_RATE(kbps) ((kbps) * 1000ULL)
+# define VIR_NETDEV_BANDWIDTH_SIZE(kb) ((kb) * 1024ULL)
+
+/* The time needed to send @size bytes at @rate bytes per second,
+ * in ticks of the packet scheduler */
+static unsigned int
+virNetDevBandwidthXmitTime(unsigned long long rate,
+                           unsigned long long size)
+{
+    if (!rate)
+        return 0;
+
+    if (size > ULLONG_MAX / VIR_NETDEV_BANDWIDTH_TICKS_PER_SEC ||
+        size * VIR_NETDEV_BANDWIDTH_TICKS_PER_SEC / rate > UINT_MAX)
+        return UINT_MAX;
+
+    return size * VIR_NETDEV_BANDWIDTH_TICKS_PER_SEC / rate;
+}
+
 static void
-virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
-                                       const virNetDevBandwidthRate *rate)
+virNetDevBandwidthSetRateSpec(struct tc_ratespec *spec,
+                              unsigned long long rate)
+{
+    spec->rate = MIN(rate, UINT_MAX);
+    spec->linklayer = TC_LINKLAYER_ETHERNET;
+}
+
+static unsigned long long
+virNetDevBandwidthOptimalQuantum(const virNetDevBandwidthRate *rate)
 {
     const unsigned long long mtu = 1500;
     unsigned long long r2q;
@@ -58,16 +195,302 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
     if (!r2q)
         r2q = 1;
 
-    virCommandAddArg(cmd, "quantum");
-    virCommandAddArgFormat(cmd, "%llu", r2q);
+    return r2q;
+}
+
+
+/**
+ * virNetDevBandwidthNewMsg:
+ * @type: RTM_* type of the message
+ * @flags: NLM_F_* flags of the message
+ * @ifindex: index of the interface to operate on
+ * @parent: handle of the parent qdisc or class
+ * @handle: handle of the object itself
+ * @info: priority and protocol of a filter
+ * @kind: type of the object (may be NULL)
+ *
+ * Returns a new traffic control message or NULL on error.
+ */
+static struct nl_msg *
+virNetDevBandwidthNewMsg(int type,
+                         int flags,
+                         int ifindex,
+                         uint32_t parent,
+                         uint32_t handle,
+                         uint32_t info,
+                         const char *kind)
+{
+    struct nl_msg *nl_msg;
+    struct tcmsg tcm = {
+        .tcm_family = AF_UNSPEC,
+        .tcm_ifindex = ifindex,
+        .tcm_parent = parent,
+        .tcm_handle = handle,
+        .tcm_info = info,
+    };
+
+    if (!(nl_msg = nlmsg_alloc_simple(type, flags))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &tcm, sizeof(tcm), NLMSG_ALIGNTO) < 0)
+        goto buffer_too_small;
+
+    if (kind && nla_put_string(nl_msg, TCA_KIND, kind) < 0)
+        goto buffer_too_small;
+
+    return nl_msg;
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return NULL;
+}
+
+
+static int
+virNetDevBandwidthAddMsg(virNetlinkBatchPtr batch,
+                         int type,
+                         int flags,
+                         int ifindex,
+                         uint32_t parent,
+                         uint32_t handle,
+                         uint32_t info,
+                         const char *kind,
+                         unsigned int batchFlags)
+{
+    struct nl_msg *nl_msg;
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(type, flags, ifindex,
+                                            parent, handle, info, kind)))
+        return -1;
+
+    return virNetlinkBatchAdd(batch, nl_msg, batchFlags);
+}
+
+
+static int
+virNetDevBandwidthAddHTBQdisc(virNetlinkBatchPtr batch,
+                              int ifindex,
+                              unsigned int defcls)
+{
+    struct nl_msg *nl_msg;
+    struct tc_htb_glob glob = {
+        .version = 3,
+        .rate2quantum = 10,
+        .defcls = defcls,
+    };
+    struct nlattr *options;
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(RTM_NEWQDISC,
+                                            NLM_F_CREATE | NLM_F_EXCL,
+                                            ifindex, TC_H_ROOT,
+                                            TC_H_MAKE(1 << 16, 0), 0, "htb")))
+        return -1;
+
+    NETLINK_MSG_NEST_START(nl_msg, options, TCA_OPTIONS);
+    NETLINK_MSG_PUT(nl_msg, TCA_HTB_INIT, sizeof(glob), &glob);
+    NETLINK_MSG_NEST_END(nl_msg, options);
+
+    return virNetlinkBatchAdd(batch, nl_msg, 0);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return -1;
+}
+
+
+/**
+ * virNetDevBandwidthAddHTBClass:
+ * @batch: batch to add the message to
+ * @ifindex: index of the interface to operate on
+ * @create: whether to create the class rather than change it
+ * @parent: handle of the parent qdisc or class
+ * @classid: handle of the class
+ * @rate: guaranteed rate in bytes per second
+ * @ceil: maximum rate in bytes per second (0 for @rate)
+ * @burst: size of the burst in bytes (0 for the default)
+ * @quantum: quantum of the class
+ */
+static int
+virNetDevBandwidthAddHTBClass(virNetlinkBatchPtr batch,
+                              int ifindex,
+                              bool create,
+                              uint32_t parent,
+                              uint32_t classid,
+                              unsigned long long rate,
+                              unsigned long long ceil,
+                              unsigned long long burst,
+                              unsigned long long quantum)
+{
+    struct nl_msg *nl_msg;
+    struct tc_htb_opt opt = { 0 };
+    struct nlattr *options;
+
+    if (!ceil)
+        ceil = rate;
+    if (!burst)
+        burst = rate / VIR_NETDEV_BANDWIDTH_HZ + VIR_NETDEV_BANDWIDTH_HTB_MTU;
+
+    virNetDevBandwidthSetRateSpec(&opt.rate, rate);
+    virNetDevBandwidthSetRateSpec(&opt.ceil, ceil);
+    opt.buffer = virNetDevBandwidthXmitTime(rate, burst);
+    opt.cbuffer = virNetDevBandwidthXmitTime(ceil,
+                                             ceil / VIR_NETDEV_BANDWIDTH_HZ +
+                                             VIR_NETDEV_BANDWIDTH_HTB_MTU);
+    opt.quantum = MIN(quantum, UINT_MAX);
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(RTM_NEWTCLASS,
+                                            create ? NLM_F_CREATE | NLM_F_EXCL : 0,
+                                            ifindex, parent, classid,
+                                            0, "htb")))
+        return -1;
+
+    NETLINK_MSG_NEST_START(nl_msg, options, TCA_OPTIONS);
+    NETLINK_MSG_PUT(nl_msg, TCA_HTB_PARMS, sizeof(opt), &opt);
+    if (rate > UINT_MAX &&
+        nla_put_u64(nl_msg, TCA_HTB_RATE64, rate) < 0)
+        goto buffer_too_small;
+    if (ceil > UINT_MAX &&
+        nla_put_u64(nl_msg, TCA_HTB_CEIL64, ceil) < 0)
+        goto buffer_too_small;
+    NETLINK_MSG_NEST_END(nl_msg, options);
+
+    return virNetlinkBatchAdd(batch, nl_msg, 0);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return -1;
+}
+
+
+static int
+virNetDevBandwidthAddSFQQdisc(virNetlinkBatchPtr batch,
+                              int ifindex,
+                              uint32_t parent,
+                              uint32_t handle)
+{
+    struct nl_msg *nl_msg;
+    struct tc_sfq_qopt opt = { .perturb_period = 10 };
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(RTM_NEWQDISC,
+                                            NLM_F_CREATE | NLM_F_EXCL,
+                                            ifindex, parent, handle,
+                                            0, "sfq")))
+        return -1;
+
+    NETLINK_MSG_PUT(nl_msg, TCA_OPTIONS, sizeof(opt), &opt);
+
+    return virNetlinkBatchAdd(batch, nl_msg, 0);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return -1;
+}
+
+
+/* Place the traffic marked by the firewall into class 1 */
+static int
+virNetDevBandwidthAddFwFilter(virNetlinkBatchPtr batch,
+                              int ifindex)
+{
+    struct nl_msg *nl_msg;
+    struct nlattr *options;
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(RTM_NEWTFILTER,
+                                            NLM_F_CREATE | NLM_F_EXCL,
+                                            ifindex, TC_H_MAKE(1 << 16, 0), 1,
+                                            TC_H_MAKE(1 << 16, htons(ETH_P_ALL)),
+                                            "fw")))
+        return -1;
+
+    NETLINK_MSG_NEST_START(nl_msg, options, TCA_OPTIONS);
+    if (nla_put_u32(nl_msg, TCA_FW_CLASSID, 1) < 0)
+        goto buffer_too_small;
+    NETLINK_MSG_NEST_END(nl_msg, options);
+
+    return virNetlinkBatchAdd(batch, nl_msg, 0);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return -1;
 }
 
+
+/* Drop all ingress traffic exceeding @rate bytes per second with
+ * bursts of @burst bytes */
+static int
+virNetDevBandwidthAddPoliceFilter(virNetlinkBatchPtr batch,
+                                  int ifindex,
+                                  unsigned long long rate,
+                                  unsigned long long burst)
+{
+    struct nl_msg *nl_msg;
+    struct tc_police police = { .action = TC_ACT_SHOT };
+    uint32_t rtab[256];
+    struct {
+        struct tc_u32_sel sel;
+        struct tc_u32_key key;
+    } sel = { .sel = { .flags = TC_U32_TERMINAL, .nkeys = 1 } };
+    struct nlattr *options;
+    struct nlattr *policeopts;
+    size_t i;
+
+    virNetDevBandwidthSetRateSpec(&police.rate, rate);
+    police.rate.cell_log = VIR_NETDEV_BANDWIDTH_POLICE_CELL_LOG;
+    police.rate.cell_align = -1;
+    police.burst = virNetDevBandwidthXmitTime(rate, burst);
+    police.mtu = VIR_NETDEV_BANDWIDTH_POLICE_MTU;
+
+    for (i = 0; i < ARRAY_CARDINALITY(rtab); i++)
+        rtab[i] = virNetDevBandwidthXmitTime(rate, (i + 1) <<
+                                             VIR_NETDEV_BANDWIDTH_POLICE_CELL_LOG);
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(RTM_NEWTFILTER,
+                                            NLM_F_CREATE | NLM_F_EXCL,
+                                            ifindex, TC_H_MAKE(TC_H_INGRESS, 0),
+                                            0, htons(ETH_P_ALL), "u32")))
+        return -1;
+
+    NETLINK_MSG_NEST_START(nl_msg, options, TCA_OPTIONS);
+    NETLINK_MSG_NEST_START(nl_msg, policeopts, TCA_U32_POLICE);
+    NETLINK_MSG_PUT(nl_msg, TCA_POLICE_TBF, sizeof(police), &police);
+    NETLINK_MSG_PUT(nl_msg, TCA_POLICE_RATE, sizeof(rtab), rtab);
+    if (rate > UINT_MAX &&
+        nla_put_u64(nl_msg, TCA_POLICE_RATE64, rate) < 0)
+        goto buffer_too_small;
+    NETLINK_MSG_NEST_END(nl_msg, policeopts);
+    if (nla_put_u32(nl_msg, TCA_U32_CLASSID, 1) < 0)
+        goto buffer_too_small;
+    NETLINK_MSG_PUT(nl_msg, TCA_U32_SEL, sizeof(sel), &sel);
+    NETLINK_MSG_NEST_END(nl_msg, options);
+
+    return virNetlinkBatchAdd(batch, nl_msg, 0);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return -1;
+}
+
+
 /**
  * virNetDevBandwidthManipulateFilter:
- * @ifname: interface to operate on
+ * @batch: batch to add the messages to
+ * @ifindex: index of the interface to operate on
  * @ifmac_ptr: MAC of the interface to create filter over
  * @id: filter ID
- * @class_id: where to place traffic
  * @remove_old: whether to remove the filter
  * @create_new: whether to create the filter
  *
@@ -79,12 +502,12 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
  * bridge) and filter the traffic into QDiscs based on the
  * originating vNET device.
  *
- * Long story short, @ifname is the interface where the filter
+ * Long story short, @ifindex is the interface where the filter
  * should be created. The @ifmac_ptr is the MAC address for which
  * the filter should be created (usually different to the MAC
- * address of @ifname). Then, like everything - even filters have
- * an @id which should be unique (per @ifname). And @class_id
- * tells into which QDisc should filter place the traffic.
+ * address of @ifindex). Then, like everything - even filters have
+ * an @id which should be unique (per @ifindex). The filter places
+ * the traffic into the class 1:@id.
  *
  * This function can be used for both, removing stale filter
  * (@remove_old set to true) and creating new one (@create_new
@@ -93,75 +516,141 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
  * Returns: 0 on success,
  *         -1 otherwise (with error reported).
  */
-static int ATTRIBUTE_NONNULL(1)
-virNetDevBandwidthManipulateFilter(const char *ifname,
+static int
+virNetDevBandwidthManipulateFilter(virNetlinkBatchPtr batch,
+                                   int ifindex,
                                    const virMacAddr *ifmac_ptr,
                                    unsigned int id,
-                                   const char *class_id,
                                    bool remove_old,
                                    bool create_new)
 {
-    int ret = -1;
-    char *filter_id = NULL;
-    virCommandPtr cmd = NULL;
+    struct nl_msg *nl_msg;
     unsigned char ifmac[VIR_MAC_BUFLEN];
-    char *mac[2] = {NULL, NULL};
+    struct {
+        struct tc_u32_sel sel;
+        struct tc_u32_key keys[3];
+    } sel = { .sel = { .flags = TC_U32_TERMINAL, .nkeys = 3 } };
+    struct nlattr *options;
 
     if (!(remove_old || create_new)) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("filter creation API error"));
-        goto cleanup;
+        return -1;
     }
 
-    /* u32 filters must have 800:: prefix. Don't ask. */
-    if (virAsprintf(&filter_id, "800::%u", id) < 0)
-        goto cleanup;
+    /* Don't treat errors as fatal, but try to remove as much as
+     * possible */
+    if (remove_old &&
+        virNetDevBandwidthAddMsg(batch, RTM_DELTFILTER, 0, ifindex, 0,
+                                 VIR_NETDEV_BANDWIDTH_U32_HANDLE(id),
+                                 TC_H_MAKE(2 << 16, 0), "u32",
+                                 VIR_NETLINK_BATCH_IGNORE_ERROR) < 0)
+        return -1;
 
-    if (remove_old) {
-        int cmd_ret = 0;
+    if (!create_new)
+        return 0;
 
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "del", "dev", ifname,
-                             "prio", "2", "handle",  filter_id, "u32", NULL);
+    virMacAddrGetRaw(ifmac_ptr, ifmac);
+
+    /* Okay, this not nice. But since libvirt does not necessarily track
+     * interface IP address(es), and tc fw filter simply refuse to use
+     * ebtables marks, we need to use u32 selector to match MAC address.
+     * The offsets are relative to the IP header, so the keys match the
+     * ethertype and the source MAC address of the ethernet header.
+     * If libvirt will ever know something, remove this FIXME
+     */
+    sel.keys[0].off = -4;
+    sel.keys[0].val = htonl(ETH_P_IP);
+    sel.keys[0].mask = htonl(0xffff);
+
+    sel.keys[1].off = -12;
+    sel.keys[1].val = htonl((ifmac[2] << 24) | (ifmac[3] << 16) |
+                            (ifmac[4] << 8) | ifmac[5]);
+    sel.keys[1].mask = htonl(0xffffffff);
+
+    sel.keys[2].off = -16;
+    sel.keys[2].val = htonl((ifmac[0] << 8) | ifmac[1]);
+    sel.keys[2].mask = htonl(0xffff);
+
+    if (!(nl_msg = virNetDevBandwidthNewMsg(RTM_NEWTFILTER,
+                                            NLM_F_CREATE | NLM_F_EXCL,
+                                            ifindex, 0,
+                                            VIR_NETDEV_BANDWIDTH_U32_HANDLE(id),
+                                            TC_H_MAKE(2 << 16, htons(ETH_P_IP)),
+                                            "u32")))
+        return -1;
 
-        if (virCommandRun(cmd, &cmd_ret) < 0)
-            goto cleanup;
+    NETLINK_MSG_NEST_START(nl_msg, options, TCA_OPTIONS);
+    if (nla_put_u32(nl_msg, TCA_U32_CLASSID, TC_H_MAKE(1 << 16, id)) < 0)
+        goto buffer_too_small;
+    NETLINK_MSG_PUT(nl_msg, TCA_U32_SEL, sizeof(sel), &sel);
+    NETLINK_MSG_NEST_END(nl_msg, options);
 
-    }
+    return virNetlinkBatchAdd(batch, nl_msg, 0);
 
-    if (create_new) {
-        virMacAddrGetRaw(ifmac_ptr, ifmac);
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    nlmsg_free(nl_msg);
+    return -1;
+}
 
-        if (virAsprintf(&mac[0], "0x%02x%02x%02x%02x", ifmac[2],
-                        ifmac[3], ifmac[4], ifmac[5]) < 0 ||
-            virAsprintf(&mac[1], "0x%02x%02x", ifmac[0], ifmac[1]) < 0)
-            goto cleanup;
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        /* Okay, this not nice. But since libvirt does not necessarily track
-         * interface IP address(es), and tc fw filter simply refuse to use
-         * ebtables marks, we need to use u32 selector to match MAC address.
-         * If libvirt will ever know something, remove this FIXME
-         */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "protocol", "ip",
-                             "prio", "2", "handle", filter_id, "u32",
-                             "match", "u16", "0x0800", "0xffff", "at", "-2",
-                             "match", "u32", mac[0], "0xffffffff", "at", "-12",
-                             "match", "u16", mac[1], "0xffff", "at", "-14",
-                             "flowid", class_id, NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+/* Remove the root and ingress qdiscs, which may not exist */
+static int
+virNetDevBandwidthAddClear(virNetlinkBatchPtr batch,
+                           int ifindex)
+{
+    if (virNetDevBandwidthAddMsg(batch, RTM_DELQDISC, 0, ifindex,
+                                 TC_H_ROOT, 0, 0, NULL,
+                                 VIR_NETLINK_BATCH_IGNORE_ERROR) < 0 ||
+        virNetDevBandwidthAddMsg(batch, RTM_DELQDISC, 0, ifindex,
+                                 TC_H_INGRESS, TC_H_MAKE(TC_H_INGRESS, 0),
+                                 0, "ingress",
+                                 VIR_NETLINK_BATCH_IGNORE_ERROR) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virNetDevBandwidthBatchNew:
+ * @ifname: interface to operate on
+ * @ifindex: filled with the index of @ifname
+ *
+ * Start a batch of traffic control messages for @ifname, which
+ * are all sent to the kernel at once by virNetDevBandwidthBatchRun.
+ *
+ * Returns the new batch or NULL on error.
+ */
+static virNetlinkBatchPtr
+virNetDevBandwidthBatchNew(const char *ifname,
+                           int *ifindex)
+{
+    if (virNetDevGetIndex(ifname, ifindex) < 0)
+        return NULL;
+
+    return virNetlinkBatchNew(NETLINK_ROUTE);
+}
+
+
+static int
+virNetDevBandwidthBatchRun(virNetlinkBatchPtr batch,
+                           const char *ifname)
+{
+    int error = 0;
+
+    if (virNetlinkBatchRun(batch, &error) < 0) {
+        if (error != 0) {
+            virReportSystemError(-error,
+                                 _("unable to set up traffic control "
+                                   "on interface %s"), ifname);
+        }
+        return -1;
     }
 
-    ret = 0;
- cleanup:
-    VIR_FREE(mac[1]);
-    VIR_FREE(mac[0]);
-    VIR_FREE(filter_id);
-    virCommandFree(cmd);
-    return ret;
+    return 0;
 }
 
 
@@ -194,17 +683,13 @@ virNetDevBandwidthSet(const char *ifname,
                       bool hierarchical_class,
                       bool swapped)
 {
-    int ret = -1;
     virNetDevBandwidthRatePtr rx = NULL, tx = NULL; /* From domain POV */
-    virCommandPtr cmd = NULL;
-    char *average = NULL;
-    char *peak = NULL;
-    char *burst = NULL;
+    VIR_AUTOPTR(virNetlinkBatch) batch = NULL;
+    int ifindex;
 
     if (!bandwidth) {
         /* nothing to be enabled */
-        ret = 0;
-        goto cleanup;
+        return 0;
     }
 
     if (geteuid() != 0) {
@@ -229,24 +714,22 @@ virNetDevBandwidthSet(const char *ifname,
         tx = bandwidth->out;
     }
 
-    virNetDevBandwidthClear(ifname);
+    /* All the changes are sent to the kernel at once, starting with
+     * the removal of any previous setting */
+    if (!(batch = virNetDevBandwidthBatchNew(ifname, &ifindex)) ||
+        virNetDevBandwidthAddClear(batch, ifindex) < 0)
+        return -1;
 
     if (tx && tx->average) {
-        if (virAsprintf(&average, "%llukbps", tx->average) < 0)
-            goto cleanup;
-        if (tx->peak &&
-            (virAsprintf(&peak, "%llukbps", tx->peak) < 0))
-            goto cleanup;
-        if (tx->burst &&
-            (virAsprintf(&burst, "%llukb", tx->burst) < 0))
-            goto cleanup;
+        unsigned long long average = VIR_NETDEV_BANDWIDTH_RATE(tx->average);
+        unsigned long long peak = VIR_NETDEV_BANDWIDTH_RATE(tx->peak);
+        unsigned long long burst = VIR_NETDEV_BANDWIDTH_SIZE(tx->burst);
+        unsigned long long quantum = virNetDevBandwidthOptimalQuantum(tx);
+        uint32_t leaf = TC_H_MAKE(1 << 16, hierarchical_class ? 2 : 1);
 
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "root",
-                             "handle", "1:", "htb", "default",
-                             hierarchical_class ? "2" : "1", NULL);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        if (virNetDevBandwidthAddHTBQdisc(batch, ifindex,
+                                          TC_H_MIN(leaf)) < 0)
+            return -1;
 
         /* If we are creating a hierarchical class, all non guaranteed traffic
          * goes to the 1:2 class which will adjust 'rate' dynamically as NICs
@@ -311,91 +794,40 @@ virNetDevBandwidthSet(const char *ifname,
          * This description is rather long, but it is still a good idea to read
          * it before you dig into the code.
          */
-        if (hierarchical_class) {
-            virCommandFree(cmd);
-            cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                                 "1:", "classid", "1:1", "htb", "rate", average,
-                                 "ceil", peak ? peak : average, NULL);
-            virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-            if (virCommandRun(cmd, NULL) < 0)
-                goto cleanup;
-        }
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:1" : "1:", "classid",
-                             hierarchical_class ? "1:2" : "1:1", "htb",
-                             "rate", average, NULL);
-
-        if (peak)
-            virCommandAddArgList(cmd, "ceil", peak, NULL);
-        if (burst)
-            virCommandAddArgList(cmd, "burst", burst, NULL);
-
-        virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:2" : "1:1",
-                             "handle", "2:", "sfq", "perturb",
-                             "10", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "1:0", "protocol", "all", "prio", "1", "handle",
-                             "1", "fw", "flowid", "1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        VIR_FREE(average);
-        VIR_FREE(peak);
-        VIR_FREE(burst);
+        if (hierarchical_class &&
+            virNetDevBandwidthAddHTBClass(batch, ifindex, true,
+                                          TC_H_MAKE(1 << 16, 0),
+                                          TC_H_MAKE(1 << 16, 1),
+                                          average, peak, 0, quantum) < 0)
+            return -1;
+
+        if (virNetDevBandwidthAddHTBClass(batch, ifindex, true,
+                                          TC_H_MAKE(1 << 16,
+                                                    hierarchical_class ? 1 : 0),
+                                          leaf, average, peak, burst,
+                                          quantum) < 0 ||
+            virNetDevBandwidthAddSFQQdisc(batch, ifindex, leaf,
+                                          TC_H_MAKE(2 << 16, 0)) < 0 ||
+            virNetDevBandwidthAddFwFilter(batch, ifindex) < 0)
+            return -1;
     }
 
     if (rx) {
-        if (virAsprintf(&average, "%llukbps", rx->average) < 0)
-            goto cleanup;
-        if (virAsprintf(&burst, "%llukb", rx->burst ? rx->burst : rx->average) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname,
-                                 "ingress", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        /* Set filter to match all ingress traffic */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "ffff:", "protocol", "all", "u32", "match", "u32",
-                             "0", "0", "police", "rate", average,
-                             "burst", burst, "mtu", "64kb", "drop", "flowid",
-                             ":1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        unsigned long long average = VIR_NETDEV_BANDWIDTH_RATE(rx->average);
+        unsigned long long burst = VIR_NETDEV_BANDWIDTH_SIZE(rx->burst ?
+                                                             rx->burst :
+                                                             rx->average);
+
+        if (virNetDevBandwidthAddMsg(batch, RTM_NEWQDISC,
+                                     NLM_F_CREATE | NLM_F_EXCL, ifindex,
+                                     TC_H_INGRESS, TC_H_MAKE(TC_H_INGRESS, 0),
+                                     0, "ingress", 0) < 0 ||
+            virNetDevBandwidthAddPoliceFilter(batch, ifindex,
+                                              average, burst) < 0)
+            return -1;
     }
 
-    ret = 0;
-
- cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(average);
-    VIR_FREE(peak);
-    VIR_FREE(burst);
-    return ret;
+    return virNetDevBandwidthBatchRun(batch, ifname);
 }
 
 /**
@@ -404,125 +836,29 @@ virNetDevBandwidthSet(const char *ifname,
  *
  * This function tries to disable QoS on specified interface
  * by deleting root and ingress qdisc. However, this may fail
- * if we try to remove the default one.
+ * if we try to remove the default one. There is nothing to
+ * clear if the interface is gone already.
  *
  * Return 0 on success, -1 otherwise.
  */
 int
 virNetDevBandwidthClear(const char *ifname)
 {
-    int ret = 0;
-    int dummy; /* for ignoring the exit status */
-    virCommandPtr cmd = NULL;
+    VIR_AUTOPTR(virNetlinkBatch) batch = NULL;
+    int ifindex;
+    int rc;
 
     if (!ifname)
        return 0;
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", ifname, "root", NULL);
-
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc",  "del", "dev", ifname, "ingress", NULL);
-
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
-
-    return ret;
-}
-
-/*
- * virNetDevBandwidthCopy:
- * @dest: destination
- * @src:  source (may be NULL)
- *
- * Returns -1 on OOM error (which gets reported),
- * 0 otherwise.
- */
-int
-virNetDevBandwidthCopy(virNetDevBandwidthPtr *dest,
-                       const virNetDevBandwidth *src)
-{
-    int ret = -1;
-
-    *dest = NULL;
-    if (!src) {
-        /* nothing to be copied */
-        return 0;
-    }
-
-    if (VIR_ALLOC(*dest) < 0)
-        goto cleanup;
-
-    if (src->in) {
-        if (VIR_ALLOC((*dest)->in) < 0)
-            goto cleanup;
-        memcpy((*dest)->in, src->in, sizeof(*src->in));
-    }
-
-    if (src->out) {
-        if (VIR_ALLOC((*dest)->out) < 0) {
-            VIR_FREE((*dest)->in);
-            goto cleanup;
-        }
-        memcpy((*dest)->out, src->out, sizeof(*src->out));
-    }
-
-    ret = 0;
-
- cleanup:
-    if (ret < 0) {
-        virNetDevBandwidthFree(*dest);
-        *dest = NULL;
-    }
-    return ret;
-}
-
-bool
-virNetDevBandwidthEqual(virNetDevBandwidthPtr a,
-                        virNetDevBandwidthPtr b)
-{
-    if (!a && !b)
-        return true;
-
-    if (!a || !b)
-        return false;
-
-    /* in */
-    if (a->in) {
-        if (!b->in)
-            return false;
-
-        if (a->in->average != b->in->average ||
-            a->in->peak != b->in->peak ||
-            a->in->floor != b->in->floor ||
-            a->in->burst != b->in->burst)
-            return false;
-    } else if (b->in) {
-        return false;
-    }
-
-    /*out*/
-    if (a->out) {
-        if (!b->out)
-            return false;
+    if ((rc = virNetDevExists(ifname)) <= 0)
+        return rc;
 
-        if (a->out->average != b->out->average ||
-            a->out->peak != b->out->peak ||
-            a->out->floor != b->out->floor ||
-            a->out->burst != b->out->burst)
-            return false;
-    } else if (b->out) {
-        return false;
-    }
+    if (!(batch = virNetDevBandwidthBatchNew(ifname, &ifindex)) ||
+        virNetDevBandwidthAddClear(batch, ifindex) < 0)
+        return -1;
 
-    return true;
+    return virNetDevBandwidthBatchRun(batch, ifname);
 }
 
 /*
@@ -552,13 +888,11 @@ virNetDevBandwidthPlug(const char *brname,
                        virNetDevBandwidthPtr bandwidth,
                        unsigned int id)
 {
-    int ret = -1;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *qdisc_id = NULL;
-    char *floor = NULL;
-    char *ceil = NULL;
+    VIR_AUTOPTR(virNetlinkBatch) batch = NULL;
     char ifmacStr[VIR_MAC_STRING_BUFLEN];
+    unsigned long long floor;
+    unsigned long long ceil;
+    int ifindex;
 
     if (id <= 2) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("Invalid class ID %d"), id);
@@ -575,45 +909,25 @@ virNetDevBandwidthPlug(const char *brname,
         return -1;
     }
 
-    if (virAsprintf(&class_id, "1:%x", id) < 0 ||
-        virAsprintf(&qdisc_id, "%x:", id) < 0 ||
-        virAsprintf(&floor, "%llukbps", bandwidth->in->floor) < 0 ||
-        virAsprintf(&ceil, "%llukbps", net_bandwidth->in->peak ?
-                    net_bandwidth->in->peak :
-                    net_bandwidth->in->average) < 0)
-        goto cleanup;
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "add", "dev", brname, "parent", "1:1",
-                         "classid", class_id, "htb", "rate", floor,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
-
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "add", "dev", brname, "parent",
-                         class_id, "handle", qdisc_id, "sfq", "perturb",
-                         "10", NULL);
-
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    if (virNetDevBandwidthManipulateFilter(brname, ifmac_ptr, id,
-                                           class_id, false, true) < 0)
-        goto cleanup;
-
-    ret = 0;
+    floor = VIR_NETDEV_BANDWIDTH_RATE(bandwidth->in->floor);
+    ceil = VIR_NETDEV_BANDWIDTH_RATE(net_bandwidth->in->peak ?
+                                     net_bandwidth->in->peak :
+                                     net_bandwidth->in->average);
+
+    if (!(batch = virNetDevBandwidthBatchNew(brname, &ifindex)) ||
+        virNetDevBandwidthAddHTBClass(batch, ifindex, true,
+                                      TC_H_MAKE(1 << 16, 1),
+                                      TC_H_MAKE(1 << 16, id),
+                                      floor, ceil, 0,
+                                      virNetDevBandwidthOptimalQuantum(bandwidth->in)) < 0 ||
+        virNetDevBandwidthAddSFQQdisc(batch, ifindex,
+                                      TC_H_MAKE(1 << 16, id),
+                                      TC_H_MAKE(id << 16, 0)) < 0 ||
+        virNetDevBandwidthManipulateFilter(batch, ifindex, ifmac_ptr, id,
+                                           false, true) < 0)
+        return -1;
 
- cleanup:
-    VIR_FREE(ceil);
-    VIR_FREE(floor);
-    VIR_FREE(qdisc_id);
-    VIR_FREE(class_id);
-    virCommandFree(cmd);
-    return ret;
+    return virNetDevBandwidthBatchRun(batch, brname);
 }
 
 /*
@@ -621,7 +935,8 @@ virNetDevBandwidthPlug(const char *brname,
  * @brname: from which bridge are we unplugging
  * @id: unique identifier (MUST be greater than 2)
  *
- * Remove QoS settings from bridge.
+ * Remove QoS settings from bridge. There is nothing to remove
+ * if the bridge is gone already.
  *
  * Returns 0 on success, -1 otherwise.
  */
@@ -629,49 +944,32 @@ int
 virNetDevBandwidthUnplug(const char *brname,
                          unsigned int id)
 {
-    int ret = -1;
-    int cmd_ret = 0;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *qdisc_id = NULL;
+    VIR_AUTOPTR(virNetlinkBatch) batch = NULL;
+    int ifindex;
+    int rc;
 
     if (id <= 2) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("Invalid class ID %d"), id);
         return -1;
     }
 
-    if (virAsprintf(&class_id, "1:%x", id) < 0 ||
-        virAsprintf(&qdisc_id, "%x:", id) < 0)
-        goto cleanup;
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", brname,
-                         "handle", qdisc_id, NULL);
+    if ((rc = virNetDevExists(brname)) <= 0)
+        return rc;
 
     /* Don't threat tc errors as fatal, but
      * try to remove as much as possible */
-    if (virCommandRun(cmd, &cmd_ret) < 0)
-        goto cleanup;
-
-    if (virNetDevBandwidthManipulateFilter(brname, NULL, id,
-                                           NULL, true, false) < 0)
-        goto cleanup;
-
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "del", "dev", brname,
-                         "classid", class_id, NULL);
-
-    if (virCommandRun(cmd, &cmd_ret) < 0)
-        goto cleanup;
-
-    ret = 0;
+    if (!(batch = virNetDevBandwidthBatchNew(brname, &ifindex)) ||
+        virNetDevBandwidthAddMsg(batch, RTM_DELQDISC, 0, ifindex,
+                                 TC_H_MAKE(1 << 16, id), TC_H_MAKE(id << 16, 0),
+                                 0, NULL, VIR_NETLINK_BATCH_IGNORE_ERROR) < 0 ||
+        virNetDevBandwidthManipulateFilter(batch, ifindex, NULL, id,
+                                           true, false) < 0 ||
+        virNetDevBandwidthAddMsg(batch, RTM_DELTCLASS, 0, ifindex,
+                                 0, TC_H_MAKE(1 << 16, id), 0, NULL,
+                                 VIR_NETLINK_BATCH_IGNORE_ERROR) < 0)
+        return -1;
 
- cleanup:
-    VIR_FREE(qdisc_id);
-    VIR_FREE(class_id);
-    virCommandFree(cmd);
-    return ret;
+    return virNetDevBandwidthBatchRun(batch, brname);
 }
 
 /**
@@ -694,36 +992,21 @@ virNetDevBandwidthUpdateRate(const char *ifname,
                              virNetDevBandwidthPtr bandwidth,
                              unsigned long long new_rate)
 {
-    int ret = -1;
-    virCommandPtr cmd = NULL;
-    char *class_id = NULL;
-    char *rate = NULL;
-    char *ceil = NULL;
-
-    if (virAsprintf(&class_id, "1:%x", id) < 0 ||
-        virAsprintf(&rate, "%llukbps", new_rate) < 0 ||
-        virAsprintf(&ceil, "%llukbps", bandwidth->in->peak ?
-                    bandwidth->in->peak :
-                    bandwidth->in->average) < 0)
-        goto cleanup;
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "class", "change", "dev", ifname,
-                         "classid", class_id, "htb", "rate", rate,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
-
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    ret = 0;
+    VIR_AUTOPTR(virNetlinkBatch) batch = NULL;
+    int ifindex;
+
+    if (!(batch = virNetDevBandwidthBatchNew(ifname, &ifindex)) ||
+        virNetDevBandwidthAddHTBClass(batch, ifindex, false, 0,
+                                      TC_H_MAKE(1 << 16, id),
+                                      VIR_NETDEV_BANDWIDTH_RATE(new_rate),
+                                      VIR_NETDEV_BANDWIDTH_RATE(bandwidth->in->peak ?
+                                                                bandwidth->in->peak :
+                                                                bandwidth->in->average),
+                                      0,
+                                      virNetDevBandwidthOptimalQuantum(bandwidth->in)) < 0)
+        return -1;
 
- cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(class_id);
-    VIR_FREE(rate);
-    VIR_FREE(ceil);
-    return ret;
+    return virNetDevBandwidthBatchRun(batch, ifname);
 }
 
 /**
@@ -748,18 +1031,84 @@ virNetDevBandwidthUpdateFilter(const char *ifname,
                                const virMacAddr *ifmac_ptr,
                                unsigned int id)
 {
-    int ret = -1;
-    char *class_id = NULL;
+    VIR_AUTOPTR(virNetlinkBatch) batch = NULL;
+    int ifindex;
 
-    if (virAsprintf(&class_id, "1:%x", id) < 0)
-        goto cleanup;
+    if (!(batch = virNetDevBandwidthBatchNew(ifname, &ifindex)) ||
+        virNetDevBandwidthManipulateFilter(batch, ifindex, ifmac_ptr, id,
+                                           true, true) < 0)
+        return -1;
 
-    if (virNetDevBandwidthManipulateFilter(ifname, ifmac_ptr, id,
-                                           class_id, true, true) < 0)
-        goto cleanup;
+    return virNetDevBandwidthBatchRun(batch, ifname);
+}
 
-    ret = 0;
- cleanup:
-    VIR_FREE(class_id);
-    return ret;
+#else /* !(__linux__ && HAVE_LIBNL) */
+
+int
+virNetDevBandwidthSet(const char *ifname ATTRIBUTE_UNUSED,
+                      virNetDevBandwidthPtr bandwidth,
+                      bool hierarchical_class ATTRIBUTE_UNUSED,
+                      bool swapped ATTRIBUTE_UNUSED)
+{
+    if (!bandwidth)
+        return 0;
+
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to set bandwidth limits on this platform"));
+    return -1;
 }
+
+int
+virNetDevBandwidthClear(const char *ifname)
+{
+    if (!ifname)
+        return 0;
+
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to clear bandwidth limits on this platform"));
+    return -1;
+}
+
+int
+virNetDevBandwidthPlug(const char *brname ATTRIBUTE_UNUSED,
+                       virNetDevBandwidthPtr net_bandwidth ATTRIBUTE_UNUSED,
+                       const virMacAddr *ifmac_ptr ATTRIBUTE_UNUSED,
+                       virNetDevBandwidthPtr bandwidth ATTRIBUTE_UNUSED,
+                       unsigned int id ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to set bandwidth limits on this platform"));
+    return -1;
+}
+
+int
+virNetDevBandwidthUnplug(const char *brname ATTRIBUTE_UNUSED,
+                         unsigned int id ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to clear bandwidth limits on this platform"));
+    return -1;
+}
+
+int
+virNetDevBandwidthUpdateRate(const char *ifname ATTRIBUTE_UNUSED,
+                             unsigned int id ATTRIBUTE_UNUSED,
+                             virNetDevBandwidthPtr bandwidth ATTRIBUTE_UNUSED,
+                             unsigned long long new_rate ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to set bandwidth limits on this platform"));
+    return -1;
+}
+
+int
+virNetDevBandwidthUpdateFilter(const char *ifname ATTRIBUTE_UNUSED,
+                               const virMacAddr *ifmac_ptr ATTRIBUTE_UNUSED,
+                               unsigned int id ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Unable to set bandwidth limits on this platform"));
+    return -1;
+}
+
+#endif /* !(__linux__ && HAVE_LIBNL) */
@@ -20,12 +20,16 @@
 
 #include "virmacaddr.h"
 #include "virnetdevtap.h"
+#define LIBVIRT_VIRNETDEVTAPPRIV_H_ALLOW
+#include "virnetdevtappriv.h"
 #include "virnetdev.h"
 #include "virnetdevbridge.h"
 #include "virnetdevmidonet.h"
 #include "virnetdevopenvswitch.h"
+#include "virnetlink.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
@@ -553,6 +557,65 @@ virNetDevTapAttachBridge(const char *tapname,
 }
 
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/**
+ * virNetDevTapSetupBridgePort:
+ * @tapname: the tap interface name
+ * @brname: the bridge name
+ * @tapmac: MAC address for the tap device
+ * @mtu: requested MTU for port (or 0 for "default")
+ * @actualMTU: MTU actually set for port (after accounting for bridge's MTU)
+ * @online: whether to bring the tap device up
+ *
+ * Does the same as virNetDevSetMAC, virNetDevTapAttachBridge and
+ * virNetDevSetOnline for a tap device on a Linux host bridge, in the
+ * same order, but sends all of the changes to the kernel at once.
+ *
+ * Returns 0 in case of success or -1 on failure
+ */
+static int
+virNetDevTapSetupBridgePort(const char *tapname,
+                            const char *brname,
+                            const virMacAddr *tapmac,
+                            unsigned int mtu,
+                            unsigned int *actualMTU,
+                            bool online)
+{
+    VIR_AUTOPTR(virNetDevLinkBatch) batch = NULL;
+
+    /* see virNetDevTapAttachBridge for why the MTU is always set */
+    if (mtu == 0) {
+        int brMTU = virNetDevGetMTU(brname);
+
+        if (brMTU < 0)
+            return -1;
+
+        mtu = brMTU;
+    }
+
+    if (!(batch = virNetDevLinkBatchNew()) ||
+        virNetDevLinkBatchSetMAC(batch, tapname, tapmac) < 0 ||
+        virNetDevLinkBatchSetMTU(batch, tapname, mtu) < 0 ||
+        virNetDevLinkBatchSetMaster(batch, tapname, brname) < 0 ||
+        virNetDevLinkBatchSetOnline(batch, tapname, online) < 0 ||
+        virNetDevLinkBatchRun(batch) < 0)
+        return -1;
+
+    /* the kernel may not have applied @mtu as is */
+    if (actualMTU) {
+        int retMTU = virNetDevGetMTU(tapname);
+
+        if (retMTU < 0)
+            return -1;
+
+        *actualMTU = retMTU;
+    }
+
+    return 0;
+}
+#endif
+
+
 /**
  * virNetDevTapReattachBridge:
  * @tapname: the tap interface name (or name template)
@@ -695,6 +758,20 @@ int virNetDevTapCreateInBridgePort(const char *brname,
             tapmac.addr[0] = 0xFE;
     }
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+    if (!virtPortProfile) {
+        if (virNetDevTapSetupBridgePort(*ifname, brname, &tapmac, mtu,
+                                        actualMTU,
+                                        !!(flags & VIR_NETDEV_TAP_CREATE_IFUP)) < 0)
+            goto error;
+
+        if (virNetDevSetCoalesce(*ifname, coalesce, false) < 0)
+            goto error;
+
+        return 0;
+    }
+#endif
+
     if (virNetDevSetMAC(*ifname, &tapmac) < 0)
         goto error;
 
@@ -901,3 +978,211 @@ virNetDevTapInterfaceStats(const char *ifname ATTRIBUTE_UNUSED,
 }
 
 #endif /* __linux__ */
+
+
+struct _virNetDevTapStatsSnapshot {
+    virHashTablePtr stats; /* virDomainInterfaceStats by interface name */
+};
+
+
+void
+virNetDevTapStatsSnapshotFree(virNetDevTapStatsSnapshotPtr snapshot)
+{
+    if (!snapshot)
+        return;
+
+    virHashFree(snapshot->stats);
+    VIR_FREE(snapshot);
+}
+
+
+virNetDevTapStatsSnapshotPtr
+virNetDevTapStatsSnapshotNewEmpty(void)
+{
+    virNetDevTapStatsSnapshotPtr snapshot;
+
+    if (VIR_ALLOC(snapshot) < 0)
+        return NULL;
+
+    if (!(snapshot->stats = virHashCreate(32, virHashValueFree))) {
+        VIR_FREE(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+static struct nla_policy virNetDevTapStatsPolicy[IFLA_MAX + 1] = {
+    [IFLA_IFNAME] = { .type = NLA_STRING },
+};
+
+
+int
+virNetDevTapStatsSnapshotCallback(struct nlmsghdr *msg,
+                                  void *opaque)
+{
+    virNetDevTapStatsSnapshotPtr snapshot = opaque;
+    struct nlattr *tb[IFLA_MAX + 1];
+    VIR_AUTOFREE(virDomainInterfaceStatsPtr) stats = NULL;
+    const char *ifname;
+
+    if (msg->nlmsg_type != RTM_NEWLINK)
+        return 0;
+
+    if (nlmsg_parse(msg, sizeof(struct ifinfomsg), tb, IFLA_MAX,
+                    virNetDevTapStatsPolicy) < 0 ||
+        !tb[IFLA_IFNAME])
+        return 0;
+
+    ifname = nla_get_string(tb[IFLA_IFNAME]);
+
+    if (VIR_ALLOC(stats) < 0)
+        return -1;
+
+    /* the same sums as in /proc/net/dev */
+    if (tb[IFLA_STATS64] &&
+        nla_len(tb[IFLA_STATS64]) >= sizeof(struct rtnl_link_stats64)) {
+        struct rtnl_link_stats64 link;
+
+        memcpy(&link, nla_data(tb[IFLA_STATS64]), sizeof(link));
+        stats->rx_bytes = link.rx_bytes;
+        stats->rx_packets = link.rx_packets;
+        stats->rx_errs = link.rx_errors;
+        stats->rx_drop = link.rx_dropped + link.rx_missed_errors;
+        stats->tx_bytes = link.tx_bytes;
+        stats->tx_packets = link.tx_packets;
+        stats->tx_errs = link.tx_errors;
+        stats->tx_drop = link.tx_dropped;
+    } else if (tb[IFLA_STATS] &&
+               nla_len(tb[IFLA_STATS]) >= sizeof(struct rtnl_link_stats)) {
+        struct rtnl_link_stats link;
+
+        memcpy(&link, nla_data(tb[IFLA_STATS]), sizeof(link));
+        stats->rx_bytes = link.rx_bytes;
+        stats->rx_packets = link.rx_packets;
+        stats->rx_errs = link.rx_errors;
+        stats->rx_drop = link.rx_dropped + link.rx_missed_errors;
+        stats->tx_bytes = link.tx_bytes;
+        stats->tx_packets = link.tx_packets;
+        stats->tx_errs = link.tx_errors;
+        stats->tx_drop = link.tx_dropped;
+    } else {
+        return 0;
+    }
+
+    if (virHashUpdateEntry(snapshot->stats, ifname, stats) < 0)
+        return -1;
+    stats = NULL;
+
+    return 0;
+}
+
+
+/**
+ * virNetDevTapStatsSnapshotNew:
+ *
+ * Fetch the RX/TX statistics of all interfaces of the host with a
+ * single netlink dump, so that the statistics of many interfaces can
+ * be looked up with virNetDevTapStatsSnapshotGet without reading
+ * /proc/net/dev once per interface.
+ *
+ * Returns the snapshot or NULL on error.
+ */
+virNetDevTapStatsSnapshotPtr
+virNetDevTapStatsSnapshotNew(void)
+{
+    VIR_AUTOPTR(virNetDevTapStatsSnapshot) snapshot = NULL;
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+    struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+
+    if (!(snapshot = virNetDevTapStatsSnapshotNewEmpty()))
+        return NULL;
+
+    if (!(nl_msg = nlmsg_alloc_simple(RTM_GETLINK,
+                                      NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return NULL;
+    }
+
+    if (virNetlinkDumpCommand(nl_msg, virNetDevTapStatsSnapshotCallback,
+                              0, 0, NETLINK_ROUTE, 0, snapshot) < 0)
+        return NULL;
+
+    VIR_RETURN_PTR(snapshot);
+}
+#else
+int
+virNetDevTapStatsSnapshotCallback(struct nlmsghdr *msg ATTRIBUTE_UNUSED,
+                                  void *opaque ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                   _("interface stats snapshots not implemented on this platform"));
+    return -1;
+}
+
+
+virNetDevTapStatsSnapshotPtr
+virNetDevTapStatsSnapshotNew(void)
+{
+    virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                   _("interface stats snapshots not implemented on this platform"));
+    return NULL;
+}
+#endif
+
+
+/**
+ * virNetDevTapStatsSnapshotGet:
+ * @snapshot: statistics of the host's interfaces
+ * @ifname: interface
+ * @stats: where to store statistics
+ * @swapped: whether to swap RX/TX fields
+ *
+ * Look the RX/TX statistics of @ifname up in @snapshot, like
+ * virNetDevTapInterfaceStats fetches them.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+int
+virNetDevTapStatsSnapshotGet(virNetDevTapStatsSnapshotPtr snapshot,
+                             const char *ifname,
+                             virDomainInterfaceStatsPtr stats,
+                             bool swapped)
+{
+    virDomainInterfaceStatsPtr found;
+
+    if (!ifname) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Interface name not provided"));
+        return -1;
+    }
+
+    if (!(found = virHashLookup(snapshot->stats, ifname))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Interface '%s' not found"), ifname);
+        return -1;
+    }
+
+    if (swapped) {
+        stats->rx_bytes = found->tx_bytes;
+        stats->rx_packets = found->tx_packets;
+        stats->rx_errs = found->tx_errs;
+        stats->rx_drop = found->tx_drop;
+        stats->tx_bytes = found->rx_bytes;
+        stats->tx_packets = found->rx_packets;
+        stats->tx_errs = found->rx_errs;
+        stats->tx_drop = found->rx_drop;
+    } else {
+        *stats = *found;
+    }
+
+    return 0;
+}
@@ -102,3 +102,17 @@ int virNetDevTapInterfaceStats(const char *ifname,
                                virDomainInterfaceStatsPtr stats,
                                bool swapped)
     ATTRIBUTE_RETURN_CHECK;
+
+typedef struct _virNetDevTapStatsSnapshot virNetDevTapStatsSnapshot;
+typedef virNetDevTapStatsSnapshot *virNetDevTapStatsSnapshotPtr;
+
+virNetDevTapStatsSnapshotPtr virNetDevTapStatsSnapshotNew(void);
+void virNetDevTapStatsSnapshotFree(virNetDevTapStatsSnapshotPtr snapshot);
+int virNetDevTapStatsSnapshotGet(virNetDevTapStatsSnapshotPtr snapshot,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats,
+                                 bool swapped)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3) ATTRIBUTE_RETURN_CHECK;
+
+VIR_DEFINE_AUTOPTR_FUNC(virNetDevTapStatsSnapshot,
+                        virNetDevTapStatsSnapshotFree);
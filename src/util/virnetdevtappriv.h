@@ -0,0 +1,34 @@
+/*
+ * virnetdevtappriv.h: Functions for testing virNetDevTap APIs
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBVIRT_VIRNETDEVTAPPRIV_H_ALLOW
+# error "virnetdevtappriv.h may only be included by virnetdevtap.c or test suites"
+#endif /* LIBVIRT_VIRNETDEVTAPPRIV_H_ALLOW */
+
+#pragma once
+
+#include "virnetdevtap.h"
+#include "virnetlink.h"
+
+virNetDevTapStatsSnapshotPtr virNetDevTapStatsSnapshotNewEmpty(void);
+
+int virNetDevTapStatsSnapshotCallback(struct nlmsghdr *msg,
+                                      void *opaque);
@@ -28,6 +28,8 @@
 #include <sys/socket.h>
 
 #include "virnetlink.h"
+#define LIBVIRT_VIRNETLINKPRIV_H_ALLOW
+#include "virnetlinkpriv.h"
 #include "virnetdev.h"
 #include "virlog.h"
 #include "virthread.h"
@@ -89,6 +91,32 @@ enum virNetlinkDeleteMode {
 /* Unique ID for the next netlink watch to be registered */
 static int nextWatch = 1;
 
+typedef struct _virNetlinkBatchRequest virNetlinkBatchRequest;
+struct _virNetlinkBatchRequest {
+    struct nl_msg *msg;
+    unsigned int flags; /* virNetlinkBatchFlags */
+    bool acked;
+    int error; /* netlink error code of the acknowledgement */
+};
+
+struct _virNetlinkBatch {
+    unsigned int protocol;
+    virNetlinkBatchRequest *reqs;
+    size_t nreqs;
+};
+
+static virNetlinkBatchDryRunCallback batchDryRunCallback;
+static void *batchDryRunOpaque;
+
+/* Sockets for requests to the kernel, kept per thread between requests */
+typedef struct _virNetlinkHandleCache virNetlinkHandleCache;
+struct _virNetlinkHandleCache {
+    pid_t pid; /* of the process the sockets were created in */
+    virNetlinkHandle *handles[MAX_LINKS];
+};
+
+static virThreadLocal virNetlinkHandleCacheKey;
+
 /* Allocate extra slots for virEventPollHandle/virEventPollTimeout
  records in this multiple */
 # define NETLINK_EVENT_ALLOC_EXTENT 10
@@ -203,6 +231,129 @@ virNetlinkCreateSocket(int protocol)
     goto cleanup;
 }
 
+static void
+virNetlinkHandleCacheClear(virNetlinkHandleCache *cache)
+{
+    size_t i;
+
+    for (i = 0; i < MAX_LINKS; i++) {
+        if (cache->handles[i]) {
+            virNetlinkFree(cache->handles[i]);
+            cache->handles[i] = NULL;
+        }
+    }
+}
+
+
+static void
+virNetlinkHandleCacheFree(void *opaque)
+{
+    virNetlinkHandleCache *cache = opaque;
+
+    virNetlinkHandleCacheClear(cache);
+    VIR_FREE(cache);
+}
+
+
+static int
+virNetlinkHandleCacheOnceInit(void)
+{
+    if (virThreadLocalInit(&virNetlinkHandleCacheKey,
+                           virNetlinkHandleCacheFree) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize netlink socket cache"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetlinkHandleCache);
+
+
+/**
+ * virNetlinkAcquireSocket:
+ * @protocol: which protocol to connect to (e.g. NETLINK_ROUTE)
+ *
+ * Get a netlink socket for sending requests to the kernel. The socket
+ * released last by the calling thread is reused if there is one, so
+ * that not every request has to create and bind a new socket.
+ *
+ * Returns a handle to the netlink socket, or NULL if there was a failure.
+ */
+static virNetlinkHandle *
+virNetlinkAcquireSocket(unsigned int protocol)
+{
+    virNetlinkHandleCache *cache;
+    virNetlinkHandle *nlhandle = NULL;
+
+    if (virNetlinkHandleCacheInitialize() < 0)
+        return NULL;
+
+    /* a child process must not share the sockets of its parent */
+    if ((cache = virThreadLocalGet(&virNetlinkHandleCacheKey)) &&
+        cache->pid == getpid())
+        VIR_STEAL_PTR(nlhandle, cache->handles[protocol]);
+
+    if (!nlhandle)
+        nlhandle = virNetlinkCreateSocket(protocol);
+
+    return nlhandle;
+}
+
+
+/**
+ * virNetlinkReleaseSocket:
+ * @protocol: the protocol @nlhandle is connected to
+ * @nlhandle: socket returned by virNetlinkAcquireSocket
+ *
+ * Keep the socket for the next request of the calling thread, or
+ * free it if it can't be kept. Messages still queued on the socket,
+ * like the acknowledgement of a request whose reply was already
+ * received, are dropped so that they can't be mistaken for replies to
+ * the next request. @nlhandle is cleared in any case.
+ */
+static void
+virNetlinkReleaseSocket(unsigned int protocol,
+                        virNetlinkHandle **nlhandle)
+{
+    virNetlinkHandleCache *cache;
+    int fd = nl_socket_get_fd(*nlhandle);
+
+    while (recv(fd, NULL, 0, MSG_DONTWAIT | MSG_TRUNC) >= 0 ||
+           errno == EINTR)
+        ;
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        goto error;
+
+    if (!(cache = virThreadLocalGet(&virNetlinkHandleCacheKey))) {
+        if (VIR_ALLOC_QUIET(cache) < 0)
+            goto error;
+
+        if (virThreadLocalSet(&virNetlinkHandleCacheKey, cache) < 0) {
+            VIR_FREE(cache);
+            goto error;
+        }
+    }
+
+    if (cache->pid != getpid()) {
+        virNetlinkHandleCacheClear(cache);
+        cache->pid = getpid();
+    }
+
+    if (cache->handles[protocol])
+        goto error;
+
+    VIR_STEAL_PTR(cache->handles[protocol], *nlhandle);
+    return;
+
+ error:
+    virNetlinkFree(*nlhandle);
+    *nlhandle = NULL;
+}
+
+
 static virNetlinkHandle *
 virNetlinkSendRequest(struct nl_msg *nl_msg, uint32_t src_pid,
                       struct sockaddr_nl nladdr,
@@ -221,7 +372,12 @@ virNetlinkSendRequest(struct nl_msg *nl_msg, uint32_t src_pid,
         goto error;
     }
 
-    if (!(nlhandle = virNetlinkCreateSocket(protocol)))
+    /* a socket with group memberships is not reused */
+    if (groups)
+        nlhandle = virNetlinkCreateSocket(protocol);
+    else
+        nlhandle = virNetlinkAcquireSocket(protocol);
+    if (!nlhandle)
         goto error;
 
     fd = nl_socket_get_fd(nlhandle);
@@ -317,6 +473,9 @@ int virNetlinkCommand(struct nl_msg *nl_msg,
         return -1;
     }
 
+    if (groups == 0)
+        virNetlinkReleaseSocket(protocol, &nlhandle);
+
     VIR_STEAL_PTR(*resp, temp_resp);
     *respbuflen = len;
     return 0;
@@ -362,9 +521,289 @@ virNetlinkDumpCommand(struct nl_msg *nl_msg,
         }
     }
 
+    if (groups == 0)
+        virNetlinkReleaseSocket(protocol, &nlhandle);
+
+    return 0;
+}
+
+/**
+ * virNetlinkBatchNew:
+ * @protocol: netlink protocol of the requests
+ *
+ * Create a batch of netlink requests, which are sent to the kernel
+ * in one message by virNetlinkBatchRun.
+ *
+ * Returns the new batch or NULL on error.
+ */
+virNetlinkBatchPtr
+virNetlinkBatchNew(unsigned int protocol)
+{
+    virNetlinkBatchPtr batch;
+
+    if (protocol >= MAX_LINKS) {
+        virReportSystemError(EINVAL,
+                             _("invalid protocol argument: %d"), protocol);
+        return NULL;
+    }
+
+    if (VIR_ALLOC(batch) < 0)
+        return NULL;
+
+    batch->protocol = protocol;
+
+    return batch;
+}
+
+
+void
+virNetlinkBatchFree(virNetlinkBatchPtr batch)
+{
+    size_t i;
+
+    if (!batch)
+        return;
+
+    for (i = 0; i < batch->nreqs; i++)
+        nlmsg_free(batch->reqs[i].msg);
+    VIR_FREE(batch->reqs);
+    VIR_FREE(batch);
+}
+
+
+/**
+ * virNetlinkBatchAdd:
+ * @batch: the batch of requests
+ * @msg: the request to add
+ * @flags: bitwise-OR of virNetlinkBatchFlags
+ *
+ * Append @msg to the requests of @batch, which takes ownership of
+ * @msg even on failure. The requests are processed in the order they
+ * were added.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetlinkBatchAdd(virNetlinkBatchPtr batch,
+                   struct nl_msg *msg,
+                   unsigned int flags)
+{
+    virNetlinkBatchRequest req = { .msg = msg, .flags = flags };
+
+    if (VIR_APPEND_ELEMENT(batch->reqs, batch->nreqs, req) < 0) {
+        nlmsg_free(msg);
+        return -1;
+    }
+
     return 0;
 }
 
+
+static int
+virNetlinkBatchAck(virNetlinkBatchPtr batch,
+                   struct nlmsghdr *resp,
+                   int *error)
+{
+    struct nlmsgerr *err;
+    virNetlinkBatchRequest *req;
+
+    if (resp->nlmsg_type != NLMSG_ERROR)
+        return 0;
+
+    err = (struct nlmsgerr *)NLMSG_DATA(resp);
+    if (resp->nlmsg_len < NLMSG_LENGTH(sizeof(*err))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed netlink response message"));
+        return -1;
+    }
+
+    /* the sequence numbers of the requests start at 1 */
+    if (resp->nlmsg_seq == 0 || resp->nlmsg_seq > batch->nreqs)
+        return 0;
+
+    req = &batch->reqs[resp->nlmsg_seq - 1];
+    if (req->acked)
+        return 0;
+
+    req->acked = true;
+    req->error = err->error;
+
+    if (err->error < 0 && *error == 0 &&
+        !(req->flags & VIR_NETLINK_BATCH_IGNORE_ERROR))
+        *error = err->error;
+
+    return 1;
+}
+
+
+/**
+ * virNetlinkBatchRun:
+ * @batch: the batch of requests
+ * @error: netlink error code of the first request that failed
+ *
+ * Send all requests of @batch to the kernel in a single message and
+ * collect the acknowledgements of all of them. The kernel processes
+ * every request, even when an earlier one failed.
+ *
+ * Returns 0 on success, -1 on error. Additionally, if the @error is
+ * non-zero, then a request not added with
+ * VIR_NETLINK_BATCH_IGNORE_ERROR failed, but no error message is
+ * generated leaving it up to the caller to handle the condition.
+ */
+int
+virNetlinkBatchRun(virNetlinkBatchPtr batch,
+                   int *error)
+{
+    struct sockaddr_nl nladdr = {
+            .nl_family = AF_NETLINK,
+            .nl_pid    = 0,
+            .nl_groups = 0,
+    };
+    VIR_AUTOPTR(virNetlinkHandle) nlhandle = NULL;
+    VIR_AUTOFREE(char *) buf = NULL;
+    size_t buflen = 0;
+    size_t pending = batch->nreqs;
+    size_t off = 0;
+    size_t i;
+    int fd;
+
+    *error = 0;
+
+    for (i = 0; i < batch->nreqs; i++) {
+        struct nlmsghdr *nlmsg = nlmsg_hdr(batch->reqs[i].msg);
+
+        nlmsg->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+        nlmsg->nlmsg_seq = i + 1;
+        nlmsg->nlmsg_pid = 0;
+        batch->reqs[i].acked = false;
+        batch->reqs[i].error = 0;
+        buflen += NLMSG_ALIGN(nlmsg->nlmsg_len);
+    }
+
+    if (batchDryRunCallback) {
+        for (i = 0; i < batch->nreqs; i++) {
+            int err = 0;
+
+            batchDryRunCallback(nlmsg_hdr(batch->reqs[i].msg),
+                                &err, batchDryRunOpaque);
+            batch->reqs[i].error = err;
+
+            if (err < 0 && *error == 0 &&
+                !(batch->reqs[i].flags & VIR_NETLINK_BATCH_IGNORE_ERROR))
+                *error = err;
+        }
+        return *error ? -1 : 0;
+    }
+
+    if (pending == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(buf, buflen) < 0)
+        return -1;
+
+    for (i = 0; i < batch->nreqs; i++) {
+        struct nlmsghdr *nlmsg = nlmsg_hdr(batch->reqs[i].msg);
+
+        memcpy(buf + off, nlmsg, nlmsg->nlmsg_len);
+        off += NLMSG_ALIGN(nlmsg->nlmsg_len);
+    }
+
+    if (!(nlhandle = virNetlinkAcquireSocket(batch->protocol)))
+        return -1;
+
+    fd = nl_socket_get_fd(nlhandle);
+
+    if (sendto(fd, buf, buflen, 0,
+               (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+        virReportSystemError(errno,
+                             "%s", _("cannot send to netlink socket"));
+        return -1;
+    }
+
+    while (pending > 0) {
+        VIR_AUTOFREE(struct nlmsghdr *) resp = NULL;
+        struct nlmsghdr *msg;
+        struct pollfd fds[1] = { { .fd = fd, .events = POLLIN } };
+        int len;
+        int n;
+
+        n = poll(fds, ARRAY_CARDINALITY(fds), NETLINK_ACK_TIMEOUT_S);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("error in poll call"));
+            return -1;
+        }
+        if (n == 0) {
+            virReportSystemError(ETIMEDOUT, "%s",
+                                 _("no valid netlink response was received"));
+            return -1;
+        }
+
+        len = nl_recv(nlhandle, &nladdr, (unsigned char **)&resp, NULL);
+        if (len <= 0) {
+            virReportSystemError(errno, "%s", _("nl_recv failed"));
+            return -1;
+        }
+
+        VIR_WARNINGS_NO_CAST_ALIGN
+        for (msg = resp; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+            VIR_WARNINGS_RESET
+            int rc;
+
+            if ((rc = virNetlinkBatchAck(batch, msg, error)) < 0)
+                return -1;
+            pending -= rc;
+        }
+    }
+
+    virNetlinkReleaseSocket(batch->protocol, &nlhandle);
+
+    return *error ? -1 : 0;
+}
+
+
+/**
+ * virNetlinkBatchGetError:
+ * @batch: the batch of requests
+ * @idx: index of the request, in the order the requests were added
+ *
+ * Get the result of a single request of a batch that was run, which
+ * is useful to report which of the requests failed.
+ *
+ * Returns the netlink error code the request was acknowledged with,
+ * or 0 if it succeeded.
+ */
+int
+virNetlinkBatchGetError(virNetlinkBatchPtr batch,
+                        size_t idx)
+{
+    if (idx >= batch->nreqs)
+        return 0;
+
+    return batch->reqs[idx].error;
+}
+
+
+/**
+ * virNetlinkBatchSetDryRun:
+ * @cb: callback to run instead of sending a request
+ * @opaque: data passed to @cb
+ *
+ * Make virNetlinkBatchRun pass every request to @cb instead of sending
+ * it to the kernel. The callback may set the netlink error code of the
+ * request. Pass NULL for @cb to cancel this effect.
+ */
+void
+virNetlinkBatchSetDryRun(virNetlinkBatchDryRunCallback cb,
+                         void *opaque)
+{
+    batchDryRunCallback = cb;
+    batchDryRunOpaque = opaque;
+}
+
+
 /**
  * virNetlinkDumpLink:
  *
@@ -1250,6 +1689,55 @@ int virNetlinkCommand(struct nl_msg *nl_msg ATTRIBUTE_UNUSED,
     return -1;
 }
 
+virNetlinkBatchPtr
+virNetlinkBatchNew(unsigned int protocol ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return NULL;
+}
+
+
+void
+virNetlinkBatchFree(virNetlinkBatchPtr batch ATTRIBUTE_UNUSED)
+{
+}
+
+
+int
+virNetlinkBatchAdd(virNetlinkBatchPtr batch ATTRIBUTE_UNUSED,
+                   struct nl_msg *msg ATTRIBUTE_UNUSED,
+                   unsigned int flags ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+
+int
+virNetlinkBatchRun(virNetlinkBatchPtr batch ATTRIBUTE_UNUSED,
+                   int *error)
+{
+    *error = 0;
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+
+int
+virNetlinkBatchGetError(virNetlinkBatchPtr batch ATTRIBUTE_UNUSED,
+                        size_t idx ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+
+void
+virNetlinkBatchSetDryRun(virNetlinkBatchDryRunCallback cb ATTRIBUTE_UNUSED,
+                         void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
 int
 virNetlinkDumpCommand(struct nl_msg *nl_msg ATTRIBUTE_UNUSED,
                       virNetlinkDumpCallback callback ATTRIBUTE_UNUSED,
@@ -106,6 +106,29 @@ int virNetlinkDelLink(const char *ifname, virNetlinkDelLinkFallback fallback);
 
 int virNetlinkGetErrorCode(struct nlmsghdr *resp, unsigned int recvbuflen);
 
+typedef enum {
+    /* a failure of the request does not fail the batch */
+    VIR_NETLINK_BATCH_IGNORE_ERROR = (1 << 0),
+} virNetlinkBatchFlags;
+
+typedef struct _virNetlinkBatch virNetlinkBatch;
+typedef virNetlinkBatch *virNetlinkBatchPtr;
+
+virNetlinkBatchPtr virNetlinkBatchNew(unsigned int protocol);
+void virNetlinkBatchFree(virNetlinkBatchPtr batch);
+int virNetlinkBatchAdd(virNetlinkBatchPtr batch,
+                       struct nl_msg *msg,
+                       unsigned int flags)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+int virNetlinkBatchRun(virNetlinkBatchPtr batch,
+                       int *error)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+int virNetlinkBatchGetError(virNetlinkBatchPtr batch,
+                            size_t idx)
+    ATTRIBUTE_NONNULL(1);
+
+VIR_DEFINE_AUTOPTR_FUNC(virNetlinkBatch, virNetlinkBatchFree);
+
 int virNetlinkDumpLink(const char *ifname, int ifindex,
                        void **nlData, struct nlattr **tb,
                        uint32_t src_pid, uint32_t dst_pid)
@@ -0,0 +1,35 @@
+/*
+ * virnetlinkpriv.h: Functions for testing virNetlink APIs
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBVIRT_VIRNETLINKPRIV_H_ALLOW
+# error "virnetlinkpriv.h may only be included by virnetlink.c or test suites"
+#endif /* LIBVIRT_VIRNETLINKPRIV_H_ALLOW */
+
+#pragma once
+
+#include "virnetlink.h"
+
+typedef void (*virNetlinkBatchDryRunCallback)(struct nlmsghdr *msg,
+                                              int *error,
+                                              void *opaque);
+
+void virNetlinkBatchSetDryRun(virNetlinkBatchDryRunCallback cb,
+                              void *opaque);
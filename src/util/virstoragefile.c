@@ -42,6 +42,7 @@
 #include "virjson.h"
 #include "virstorageencryption.h"
 #include "virsecret.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -4849,6 +4850,173 @@ virStorageFileReportBrokenChain(int errcode,
 }
 
 
+/*
+ * Headers of local image files read while detecting backing chains,
+ * keyed by the uid and gid they were read as and the file's unique
+ * identifier. An entry is only used while its virFileStamp matches, so
+ * that starting domains or pivoting block jobs doesn't have to read the
+ * headers of all the unchanged images in long backing chains again.
+ */
+typedef struct _virStorageFileHeaderCacheEntry virStorageFileHeaderCacheEntry;
+typedef virStorageFileHeaderCacheEntry *virStorageFileHeaderCacheEntryPtr;
+struct _virStorageFileHeaderCacheEntry {
+    virFileStamp stamp;
+
+    char *buf;
+    size_t len;
+};
+
+#define VIR_STORAGE_FILE_HEADER_CACHE_MAX 1024
+
+static virMutex headerCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr headerCache;
+
+
+static void
+virStorageFileHeaderCacheEntryFree(void *payload,
+                                   const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageFileHeaderCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->buf);
+    VIR_FREE(entry);
+}
+
+
+/*
+ * Look up the header cached under @name of the file described by @st
+ * and copy it into @buf.
+ *
+ * Returns the length of the header on a hit, -1 on a miss or error.
+ */
+static ssize_t
+virStorageFileHeaderCacheGet(const char *name,
+                             const struct stat *st,
+                             char **buf)
+{
+    virStorageFileHeaderCacheEntryPtr entry;
+    ssize_t ret = -1;
+
+    virMutexLock(&headerCacheLock);
+
+    if (!headerCache ||
+        !(entry = virHashLookup(headerCache, name)))
+        goto cleanup;
+
+    if (!virFileStampMatch(&entry->stamp, st)) {
+        ignore_value(virHashRemoveEntry(headerCache, name));
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N_QUIET(*buf, entry->len + 1) < 0)
+        goto cleanup;
+
+    memcpy(*buf, entry->buf, entry->len);
+    ret = entry->len;
+
+ cleanup:
+    virMutexUnlock(&headerCacheLock);
+    return ret;
+}
+
+
+/*
+ * Remember @len bytes of header in @buf under @name for the file
+ * described by @st, unless it changed too recently for virFileStampSet.
+ * Failures are not fatal, the header is simply read again next time.
+ */
+static void
+virStorageFileHeaderCacheSet(const char *name,
+                             const struct stat *st,
+                             const char *buf,
+                             size_t len)
+{
+    virStorageFileHeaderCacheEntryPtr entry = NULL;
+
+    if (VIR_ALLOC_QUIET(entry) < 0)
+        return;
+
+    if (!virFileStampSet(&entry->stamp, st) ||
+        VIR_ALLOC_N_QUIET(entry->buf, len) < 0)
+        goto cleanup;
+
+    memcpy(entry->buf, buf, len);
+    entry->len = len;
+
+    virMutexLock(&headerCacheLock);
+
+    if (!headerCache &&
+        !(headerCache = virHashCreate(64, virStorageFileHeaderCacheEntryFree))) {
+        virResetLastError();
+        goto unlock;
+    }
+
+    /* Keep the cache bounded, entries which are still useful will be
+     * added back by the next probe of their image. */
+    if (virHashSize(headerCache) >= VIR_STORAGE_FILE_HEADER_CACHE_MAX)
+        virHashRemoveAll(headerCache);
+
+    if (virHashUpdateEntry(headerCache, name, entry) < 0) {
+        virResetLastError();
+        goto unlock;
+    }
+    entry = NULL;
+
+ unlock:
+    virMutexUnlock(&headerCacheLock);
+ cleanup:
+    virStorageFileHeaderCacheEntryFree(entry, NULL);
+}
+
+
+/*
+ * Read the header of @src, whose unique identifier is @uniqueName, into
+ * @buf. The header cache is used if @src is a local file which has not
+ * changed since it was read as @uid:@gid.
+ *
+ * Returns the length of the header, -1 on error and -2 if reading is
+ * not supported for @src, like virStorageFileRead.
+ */
+static ssize_t
+virStorageFileReadHeader(virStorageSourcePtr src,
+                         const char *uniqueName,
+                         uid_t uid,
+                         gid_t gid,
+                         char **buf)
+{
+    VIR_AUTOFREE(char *) key = NULL;
+    struct stat st;
+    bool cacheable;
+    ssize_t len;
+
+    /* Block devices don't get their timestamps updated on writes. A
+     * header read as one user must not be handed to another one who
+     * may not be allowed to read the file. */
+    cacheable = virStorageSourceGetActualType(src) == VIR_STORAGE_TYPE_FILE &&
+                virStorageFileStat(src, &st) == 0 &&
+                S_ISREG(st.st_mode) &&
+                virAsprintfQuiet(&key, "%u:%u:%s", (unsigned int)uid,
+                                 (unsigned int)gid, uniqueName) >= 0;
+
+    if (cacheable &&
+        (len = virStorageFileHeaderCacheGet(key, &st, buf)) >= 0) {
+        VIR_DEBUG("using cached header of '%s'", src->path);
+        return len;
+    }
+
+    if ((len = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
+        return len;
+
+    if (cacheable)
+        virStorageFileHeaderCacheSet(key, &st, *buf, len);
+
+    return len;
+}
+
+
 /* Recursive workhorse for virStorageFileGetMetadata.  */
 static int
 virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
@@ -4896,8 +5064,7 @@ virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, (void *)1) < 0)
         goto cleanup;
 
-    if ((headerLen = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER,
-                                        &buf)) < 0) {
+    if ((headerLen = virStorageFileReadHeader(src, uniqueName, uid, gid, &buf)) < 0) {
         if (headerLen == -2)
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("storage file reading is not supported for "
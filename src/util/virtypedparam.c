@@ -1350,6 +1350,86 @@ virTypedParamsRemoteFree(virTypedParameterRemotePtr remote_params_val,
 }
 
 
+/* Converts the value of the remote parameter @remote into @param. The
+ * caller is responsible for setting the name of @param. */
+static int
+virTypedParamsDeserializeValue(virTypedParameterPtr param,
+                               virTypedParameterRemoteValuePtr remote)
+{
+    param->type = remote->type;
+    switch (param->type) {
+    case VIR_TYPED_PARAM_INT:
+        param->value.i = remote->remote_typed_param_value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        param->value.ui = remote->remote_typed_param_value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        param->value.l = remote->remote_typed_param_value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        param->value.ul = remote->remote_typed_param_value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        param->value.d = remote->remote_typed_param_value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        param->value.b = remote->remote_typed_param_value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        if (VIR_STRDUP(param->value.s,
+                       remote->remote_typed_param_value.s) < 0)
+            return -1;
+        break;
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                       param->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Converts the value of @param into its remote representation @remote. */
+static int
+virTypedParamsSerializeValue(virTypedParameterRemoteValuePtr remote,
+                             virTypedParameterPtr param)
+{
+    remote->type = param->type;
+    switch (param->type) {
+    case VIR_TYPED_PARAM_INT:
+        remote->remote_typed_param_value.i = param->value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        remote->remote_typed_param_value.ui = param->value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        remote->remote_typed_param_value.l = param->value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        remote->remote_typed_param_value.ul = param->value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        remote->remote_typed_param_value.d = param->value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        remote->remote_typed_param_value.b = param->value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        if (VIR_STRDUP(remote->remote_typed_param_value.s, param->value.s) < 0)
+            return -1;
+        break;
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                       param->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /**
  * virTypedParamsDeserialize:
  * @remote_params: protocol data to be deserialized (obtained from remote side)
@@ -1422,42 +1502,8 @@ virTypedParamsDeserialize(virTypedParameterRemotePtr remote_params,
             goto cleanup;
         }
 
-        param->type = remote_param->value.type;
-        switch (param->type) {
-        case VIR_TYPED_PARAM_INT:
-            param->value.i =
-                remote_param->value.remote_typed_param_value.i;
-            break;
-        case VIR_TYPED_PARAM_UINT:
-            param->value.ui =
-                remote_param->value.remote_typed_param_value.ui;
-            break;
-        case VIR_TYPED_PARAM_LLONG:
-            param->value.l =
-                remote_param->value.remote_typed_param_value.l;
-            break;
-        case VIR_TYPED_PARAM_ULLONG:
-            param->value.ul =
-                remote_param->value.remote_typed_param_value.ul;
-            break;
-        case VIR_TYPED_PARAM_DOUBLE:
-            param->value.d =
-                remote_param->value.remote_typed_param_value.d;
-            break;
-        case VIR_TYPED_PARAM_BOOLEAN:
-            param->value.b =
-                remote_param->value.remote_typed_param_value.b;
-            break;
-        case VIR_TYPED_PARAM_STRING:
-            if (VIR_STRDUP(param->value.s,
-                           remote_param->value.remote_typed_param_value.s) < 0)
-                goto cleanup;
-            break;
-        default:
-            virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
-                           param->type);
+        if (virTypedParamsDeserializeValue(param, &remote_param->value) < 0)
             goto cleanup;
-        }
     }
 
     rv = 0;
@@ -1526,35 +1572,8 @@ virTypedParamsSerialize(virTypedParameterPtr params,
          * depending on the calling side, i.e. server or client */
         if (VIR_STRDUP(val->field, param->field) < 0)
             goto cleanup;
-        val->value.type = param->type;
-        switch (param->type) {
-        case VIR_TYPED_PARAM_INT:
-            val->value.remote_typed_param_value.i = param->value.i;
-            break;
-        case VIR_TYPED_PARAM_UINT:
-            val->value.remote_typed_param_value.ui = param->value.ui;
-            break;
-        case VIR_TYPED_PARAM_LLONG:
-            val->value.remote_typed_param_value.l = param->value.l;
-            break;
-        case VIR_TYPED_PARAM_ULLONG:
-            val->value.remote_typed_param_value.ul = param->value.ul;
-            break;
-        case VIR_TYPED_PARAM_DOUBLE:
-            val->value.remote_typed_param_value.d = param->value.d;
-            break;
-        case VIR_TYPED_PARAM_BOOLEAN:
-            val->value.remote_typed_param_value.b = param->value.b;
-            break;
-        case VIR_TYPED_PARAM_STRING:
-            if (VIR_STRDUP(val->value.remote_typed_param_value.s, param->value.s) < 0)
-                goto cleanup;
-            break;
-        default:
-            virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
-                           param->type);
+        if (virTypedParamsSerializeValue(&val->value, param) < 0)
             goto cleanup;
-        }
         j++;
     }
 
@@ -1567,3 +1586,555 @@ virTypedParamsSerialize(virTypedParameterPtr params,
     virTypedParamsRemoteFree(params_val, nparams);
     return rv;
 }
+
+
+/**
+ * virTypedParamsKeyTableNew:
+ *
+ * Creates an empty table of parameter names used by the compact remote
+ * encoding of typed parameters. All parameters serialized within one
+ * message share the table, so every distinct name is sent only once.
+ *
+ * Returns the new table or NULL on error.
+ */
+virTypedParamsKeyTablePtr
+virTypedParamsKeyTableNew(void)
+{
+    virTypedParamsKeyTablePtr table;
+
+    if (VIR_ALLOC(table) < 0)
+        return NULL;
+
+    if (!(table->index = virHashCreate(64, NULL))) {
+        VIR_FREE(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+void
+virTypedParamsKeyTableFree(virTypedParamsKeyTablePtr table)
+{
+    size_t i;
+
+    if (!table)
+        return;
+
+    for (i = 0; i < table->nkeys; i++)
+        VIR_FREE(table->keys[i]);
+    VIR_FREE(table->keys);
+    virHashFree(table->index);
+    VIR_FREE(table);
+}
+
+
+/**
+ * virTypedParamsKeyTableLookup:
+ * @table: table of parameter names
+ * @name: parameter name
+ * @key: filled with the index of @name within @table
+ *
+ * Looks up @name in @table and adds it if it was not seen before.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+virTypedParamsKeyTableLookup(virTypedParamsKeyTablePtr table,
+                             const char *name,
+                             unsigned int *key)
+{
+    uintptr_t idx;
+    char *tmp = NULL;
+
+    /* Indexes are stored off by one so that a missing entry (NULL) can be
+     * told apart from the first key. */
+    if ((idx = (uintptr_t) virHashLookup(table->index, name))) {
+        *key = idx - 1;
+        return 0;
+    }
+
+    if (VIR_STRDUP(tmp, name) < 0 ||
+        VIR_RESIZE_N(table->keys, table->nkeys_max, table->nkeys, 1) < 0)
+        goto error;
+
+    if (virHashAddEntry(table->index, name,
+                        (void *) (uintptr_t) (table->nkeys + 1)) < 0)
+        goto error;
+
+    table->keys[table->nkeys] = tmp;
+    *key = table->nkeys++;
+    return 0;
+
+ error:
+    VIR_FREE(tmp);
+    return -1;
+}
+
+
+/**
+ * virTypedParamsKeyTableSteal:
+ * @table: table of parameter names
+ * @keys: filled with the array of names
+ * @nkeys: filled with the number of elements in @keys
+ *
+ * Transfers ownership of the collected names to the caller so that they can
+ * be sent along with the compact parameters referring to them. The table
+ * must not be used for serialization afterwards.
+ */
+void
+virTypedParamsKeyTableSteal(virTypedParamsKeyTablePtr table,
+                            char ***keys,
+                            unsigned int *nkeys)
+{
+    *keys = table->keys;
+    *nkeys = table->nkeys;
+    table->keys = NULL;
+    table->nkeys = table->nkeys_max = 0;
+    virHashRemoveAll(table->index);
+}
+
+
+/**
+ * virTypedParamsRemoteCompactFree:
+ * @remote_params_val: array of compact typed parameters
+ * @remote_params_len: number of elements in @remote_params_val
+ *
+ * Frees @remote_params_val including the string values it holds. Names are
+ * owned by the key table and are not freed.
+ */
+void
+virTypedParamsRemoteCompactFree(virTypedParameterRemoteCompactPtr remote_params_val,
+                                unsigned int remote_params_len)
+{
+    size_t i;
+
+    if (!remote_params_val)
+        return;
+
+    for (i = 0; i < remote_params_len; i++) {
+        if (remote_params_val[i].value.type == VIR_TYPED_PARAM_STRING)
+            VIR_FREE(remote_params_val[i].value.remote_typed_param_value.s);
+    }
+    VIR_FREE(remote_params_val);
+}
+
+
+/**
+ * virTypedParamsSerializeCompact:
+ * @params: array of parameters to be serialized and later sent to remote side
+ * @nparams: number of elements in @params
+ * @table: table of parameter names shared by the whole message
+ * @remote_params_val: compact remote representation of @params
+ * @remote_params_len: the final number of elements in @remote_params_val
+ * @flags: bitwise-OR of virTypedParameterFlags
+ *
+ * Same as virTypedParamsSerialize, except that parameter names are stored
+ * in @table and each serialized parameter only refers to its name by index.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamsSerializeCompact(virTypedParameterPtr params,
+                               int nparams,
+                               virTypedParamsKeyTablePtr table,
+                               virTypedParameterRemoteCompactPtr *remote_params_val,
+                               unsigned int *remote_params_len,
+                               unsigned int flags)
+{
+    size_t i;
+    size_t j;
+    int rv = -1;
+    virTypedParameterRemoteCompactPtr params_val;
+
+    if (VIR_ALLOC_N(params_val, nparams) < 0)
+        goto cleanup;
+
+    for (i = 0, j = 0; i < nparams; ++i) {
+        virTypedParameterPtr param = params + i;
+        virTypedParameterRemoteCompactPtr val = params_val + j;
+
+        if (!param->type ||
+            (!(flags & VIR_TYPED_PARAM_STRING_OKAY) &&
+             param->type == VIR_TYPED_PARAM_STRING))
+            continue;
+
+        if (virTypedParamsKeyTableLookup(table, param->field, &val->key) < 0 ||
+            virTypedParamsSerializeValue(&val->value, param) < 0)
+            goto cleanup;
+        j++;
+    }
+
+    *remote_params_val = params_val;
+    *remote_params_len = j;
+    params_val = NULL;
+    rv = 0;
+
+ cleanup:
+    virTypedParamsRemoteCompactFree(params_val, nparams);
+    return rv;
+}
+
+
+/**
+ * virTypedParamsDeserializeCompact:
+ * @remote_params: compact protocol data to be deserialized
+ * @remote_params_len: number of parameters returned in @remote_params
+ * @keys: table of parameter names sent along with @remote_params
+ * @nkeys: number of elements in @keys
+ * @limit: user specified maximum limit to @remote_params_len
+ * @params: pointer which will hold the newly allocated deserialized data
+ * @nparams: number of entries in @params
+ *
+ * Counterpart of virTypedParamsSerializeCompact. Unlike
+ * virTypedParamsDeserialize this always allocates @params.
+ *
+ * Returns 0 on success or -1 in case of an error.
+ */
+int
+virTypedParamsDeserializeCompact(virTypedParameterRemoteCompactPtr remote_params,
+                                 unsigned int remote_params_len,
+                                 char **keys,
+                                 unsigned int nkeys,
+                                 int limit,
+                                 virTypedParameterPtr *params,
+                                 int *nparams)
+{
+    size_t i = 0;
+    int rv = -1;
+
+    *params = NULL;
+    *nparams = 0;
+
+    if (limit && remote_params_len > limit) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many parameters '%u' for limit '%d'"),
+                       remote_params_len, limit);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(*params, remote_params_len) < 0)
+        goto cleanup;
+
+    for (i = 0; i < remote_params_len; ++i) {
+        virTypedParameterPtr param = *params + i;
+        virTypedParameterRemoteCompactPtr remote_param = remote_params + i;
+
+        if (remote_param->key >= nkeys) {
+            virReportError(VIR_ERR_RPC,
+                           _("parameter name index '%u' out of range '%u'"),
+                           remote_param->key, nkeys);
+            goto cleanup;
+        }
+
+        if (virStrcpyStatic(param->field, keys[remote_param->key]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("parameter %s too big for destination"),
+                           keys[remote_param->key]);
+            goto cleanup;
+        }
+
+        if (virTypedParamsDeserializeValue(param, &remote_param->value) < 0)
+            goto cleanup;
+    }
+
+    *nparams = remote_params_len;
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virTypedParamsFree(*params, i);
+        *params = NULL;
+    }
+    return rv;
+}
+
+
+void
+virTypedParamListFree(virTypedParamListPtr list)
+{
+    if (!list)
+        return;
+
+    virTypedParamsFree(list->par, list->npar);
+    virHashFree(list->index);
+    VIR_FREE(list);
+}
+
+
+/**
+ * virTypedParamListEnableIndex:
+ * @list: list of typed parameters
+ *
+ * Makes virTypedParamListGet use a hash table of parameter names rather
+ * than a linear scan. The index covers parameters already stored in @list
+ * and is kept up to date by all subsequent additions.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListEnableIndex(virTypedParamListPtr list)
+{
+    size_t i;
+
+    if (list->index)
+        return 0;
+
+    if (!(list->index = virHashCreate(list->npar + 32, NULL)))
+        return -1;
+
+    for (i = 0; i < list->npar; i++) {
+        if (virHashLookup(list->index, list->par[i].field))
+            continue;
+
+        if (virHashAddEntry(list->index, list->par[i].field,
+                            (void *) (uintptr_t) (i + 1)) < 0) {
+            virHashFree(list->index);
+            list->index = NULL;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * virTypedParamListGet:
+ * @list: list of typed parameters
+ * @name: name of the parameter to find
+ *
+ * Finds the first parameter called @name in @list.
+ *
+ * Returns pointer to the parameter or NULL if it does not exist.
+ */
+virTypedParameterPtr
+virTypedParamListGet(virTypedParamListPtr list,
+                     const char *name)
+{
+    uintptr_t idx;
+
+    if (!list->index)
+        return virTypedParamsGet(list->par, list->npar, name);
+
+    if (!(idx = (uintptr_t) virHashLookup(list->index, name)))
+        return NULL;
+
+    return list->par + idx - 1;
+}
+
+
+/**
+ * virTypedParamListStealParams:
+ * @list: list of typed parameters
+ * @params: filled with the array of parameters
+ *
+ * Transfers ownership of the parameters collected in @list to the caller,
+ * leaving @list empty.
+ *
+ * Returns the number of parameters in @params.
+ */
+size_t
+virTypedParamListStealParams(virTypedParamListPtr list,
+                             virTypedParameterPtr *params)
+{
+    size_t ret = list->npar;
+
+    *params = list->par;
+    list->par = NULL;
+    list->npar = 0;
+    list->par_alloc = 0;
+
+    if (list->index)
+        virHashRemoveAll(list->index);
+
+    return ret;
+}
+
+
+/* Appends a new parameter named according to @namefmt to @list. The
+ * array grows geometrically so that building a list is linear in its
+ * length. The caller is responsible for filling in the value. */
+static virTypedParameterPtr
+virTypedParamListExtend(virTypedParamListPtr list,
+                        const char *namefmt,
+                        va_list ap)
+{
+    virTypedParameterPtr par;
+    int rc;
+
+    if (VIR_RESIZE_N(list->par, list->par_alloc, list->npar, 1) < 0)
+        return NULL;
+
+    par = list->par + list->npar;
+
+    rc = vsnprintf(par->field, VIR_TYPED_PARAM_FIELD_LENGTH, namefmt, ap);
+    if (rc < 0 || rc >= VIR_TYPED_PARAM_FIELD_LENGTH) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Field name '%s' too long"), par->field);
+        memset(par, 0, sizeof(*par));
+        return NULL;
+    }
+
+    if (list->index &&
+        !virHashLookup(list->index, par->field) &&
+        virHashAddEntry(list->index, par->field,
+                        (void *) (uintptr_t) (list->npar + 1)) < 0) {
+        memset(par, 0, sizeof(*par));
+        return NULL;
+    }
+
+    list->npar++;
+    return par;
+}
+
+
+int
+virTypedParamListAddInt(virTypedParamListPtr list,
+                        int value,
+                        const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_INT;
+    par->value.i = value;
+    return 0;
+}
+
+
+int
+virTypedParamListAddUInt(virTypedParamListPtr list,
+                         unsigned int value,
+                         const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_UINT;
+    par->value.ui = value;
+    return 0;
+}
+
+
+int
+virTypedParamListAddLLong(virTypedParamListPtr list,
+                          long long value,
+                          const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_LLONG;
+    par->value.l = value;
+    return 0;
+}
+
+
+int
+virTypedParamListAddULLong(virTypedParamListPtr list,
+                           unsigned long long value,
+                           const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_ULLONG;
+    par->value.ul = value;
+    return 0;
+}
+
+
+int
+virTypedParamListAddString(virTypedParamListPtr list,
+                           const char *value,
+                           const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    /* a failed copy leaves an empty string parameter which is released
+     * along with the list */
+    par->type = VIR_TYPED_PARAM_STRING;
+    if (VIR_STRDUP(par->value.s, value) < 0)
+        return -1;
+    return 0;
+}
+
+
+int
+virTypedParamListAddBoolean(virTypedParamListPtr list,
+                            bool value,
+                            const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_BOOLEAN;
+    par->value.b = value;
+    return 0;
+}
+
+
+int
+virTypedParamListAddDouble(virTypedParamListPtr list,
+                           double value,
+                           const char *namefmt, ...)
+{
+    virTypedParameterPtr par;
+    va_list ap;
+
+    va_start(ap, namefmt);
+    par = virTypedParamListExtend(list, namefmt, ap);
+    va_end(ap);
+
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_DOUBLE;
+    par->value.d = value;
+    return 0;
+}
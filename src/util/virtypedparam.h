@@ -24,6 +24,8 @@
 #include "internal.h"
 #include "virutil.h"
 #include "virenum.h"
+#include "virhash.h"
+#include "virautoclean.h"
 
 /**
  * VIR_TYPED_PARAM_MULTIPLE:
@@ -36,7 +38,7 @@
 verify(!(VIR_TYPED_PARAM_LAST & VIR_TYPED_PARAM_MULTIPLE));
 
 typedef struct _virTypedParameterRemoteValue virTypedParameterRemoteValue;
-typedef struct virTypedParameterRemoteValue *virTypedParameterRemoteValuePtr;
+typedef struct _virTypedParameterRemoteValue *virTypedParameterRemoteValuePtr;
 
 struct _virTypedParameterRemoteValue {
     int type;
@@ -58,6 +60,23 @@ struct _virTypedParameterRemote {
     virTypedParameterRemoteValue value;
 };
 
+typedef struct _virTypedParameterRemoteCompact *virTypedParameterRemoteCompactPtr;
+
+struct _virTypedParameterRemoteCompact {
+    unsigned int key; /* index into the message's table of names */
+    virTypedParameterRemoteValue value;
+};
+
+typedef struct _virTypedParamsKeyTable virTypedParamsKeyTable;
+typedef virTypedParamsKeyTable *virTypedParamsKeyTablePtr;
+
+struct _virTypedParamsKeyTable {
+    char **keys;
+    size_t nkeys;
+    size_t nkeys_max;
+    virHashTablePtr index; /* name -> index into @keys, off by one */
+};
+
 
 int virTypedParamsValidate(virTypedParameterPtr params, int nparams,
                            /* const char *name, int type ... */ ...)
@@ -117,6 +136,84 @@ int virTypedParamsSerialize(virTypedParameterPtr params,
                             unsigned int *remote_params_len,
                             unsigned int flags);
 
+virTypedParamsKeyTablePtr virTypedParamsKeyTableNew(void);
+void virTypedParamsKeyTableFree(virTypedParamsKeyTablePtr table);
+void virTypedParamsKeyTableSteal(virTypedParamsKeyTablePtr table,
+                                 char ***keys,
+                                 unsigned int *nkeys);
+
+void virTypedParamsRemoteCompactFree(virTypedParameterRemoteCompactPtr remote_params_val,
+                                     unsigned int remote_params_len);
+
+int virTypedParamsSerializeCompact(virTypedParameterPtr params,
+                                   int nparams,
+                                   virTypedParamsKeyTablePtr table,
+                                   virTypedParameterRemoteCompactPtr *remote_params_val,
+                                   unsigned int *remote_params_len,
+                                   unsigned int flags);
+
+int virTypedParamsDeserializeCompact(virTypedParameterRemoteCompactPtr remote_params,
+                                     unsigned int remote_params_len,
+                                     char **keys,
+                                     unsigned int nkeys,
+                                     int limit,
+                                     virTypedParameterPtr *params,
+                                     int *nparams);
+
+
+/* Builder for arrays of typed parameters. Unlike virTypedParamsAdd* which
+ * are part of the public API this doesn't reset and dispatch errors on
+ * every call and allows to format the parameter name in place. */
+typedef struct _virTypedParamList virTypedParamList;
+typedef virTypedParamList *virTypedParamListPtr;
+
+struct _virTypedParamList {
+    virTypedParameterPtr par;
+    size_t npar;
+    size_t par_alloc;
+    virHashTablePtr index; /* optional, name -> index into @par, off by one */
+};
+
+void virTypedParamListFree(virTypedParamListPtr list);
+VIR_DEFINE_AUTOPTR_FUNC(virTypedParamList, virTypedParamListFree);
+
+int virTypedParamListEnableIndex(virTypedParamListPtr list)
+    ATTRIBUTE_RETURN_CHECK;
+virTypedParameterPtr virTypedParamListGet(virTypedParamListPtr list,
+                                          const char *name);
+
+size_t virTypedParamListStealParams(virTypedParamListPtr list,
+                                    virTypedParameterPtr *params);
+
+int virTypedParamListAddInt(virTypedParamListPtr list,
+                            int value,
+                            const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+int virTypedParamListAddUInt(virTypedParamListPtr list,
+                             unsigned int value,
+                             const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+int virTypedParamListAddLLong(virTypedParamListPtr list,
+                              long long value,
+                              const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+int virTypedParamListAddULLong(virTypedParamListPtr list,
+                               unsigned long long value,
+                               const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+int virTypedParamListAddString(virTypedParamListPtr list,
+                               const char *value,
+                               const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+int virTypedParamListAddBoolean(virTypedParamListPtr list,
+                                bool value,
+                                const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+int virTypedParamListAddDouble(virTypedParamListPtr list,
+                               double value,
+                               const char *namefmt, ...)
+    ATTRIBUTE_FMT_PRINTF(3, 4) ATTRIBUTE_RETURN_CHECK;
+
 VIR_ENUM_DECL(virTypedParameter);
 
 #define VIR_TYPED_PARAMS_DEBUG(params, nparams) \
@@ -313,6 +313,217 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+
+typedef struct _testFDStreamIOData testFDStreamIOData;
+struct _testFDStreamIOData {
+    char *buf;
+    size_t len;
+    size_t offset;
+    bool finished;
+    bool failFinish;
+};
+
+
+static ssize_t
+testFDStreamIORead(char *buf, size_t len, void *opaque)
+{
+    testFDStreamIOData *data = opaque;
+
+    if (len > data->len - data->offset)
+        len = data->len - data->offset;
+
+    memcpy(buf, data->buf + data->offset, len);
+    data->offset += len;
+    return len;
+}
+
+
+static ssize_t
+testFDStreamIOWrite(const char *buf, size_t len, void *opaque)
+{
+    testFDStreamIOData *data = opaque;
+
+    if (len > data->len - data->offset) {
+        virReportSystemError(ENOSPC, "%s", "write beyond end");
+        return -1;
+    }
+
+    memcpy(data->buf + data->offset, buf, len);
+    data->offset += len;
+    return len;
+}
+
+
+static int
+testFDStreamIOFinish(void *opaque)
+{
+    testFDStreamIOData *data = opaque;
+
+    if (data->failFinish) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", "finish failed");
+        return -1;
+    }
+
+    data->finished = true;
+    return 0;
+}
+
+
+static void
+testFDStreamIOFree(void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static virFDStreamIOCallbacks testFDStreamIO = {
+    .read = testFDStreamIORead,
+    .write = testFDStreamIOWrite,
+    .finish = testFDStreamIOFinish,
+    .free = testFDStreamIOFree,
+};
+
+
+static int testFDStreamIOCallbacksCommon(bool blocking, bool failFinish)
+{
+    int ret = -1;
+    char *pattern = NULL;
+    char *buf = NULL;
+    virStreamPtr st = NULL;
+    size_t i;
+    virConnectPtr conn = NULL;
+    int flags = 0;
+    testFDStreamIOData data = { 0 };
+    size_t offset = 0;
+    int rc;
+
+    if (!blocking)
+        flags |= VIR_STREAM_NONBLOCK;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(pattern, PATTERN_LEN * 10) < 0 ||
+        VIR_ALLOC_N(buf, PATTERN_LEN * 10) < 0)
+        goto cleanup;
+
+    for (i = 0; i < PATTERN_LEN * 10; i++)
+        pattern[i] = i;
+
+    /* Read the pattern through the callbacks */
+    data.buf = pattern;
+    data.len = PATTERN_LEN * 10;
+
+    if (!(st = virStreamNew(conn, flags)) ||
+        virFDStreamOpenIOCallbacks(st, &testFDStreamIO, &data,
+                                   0, O_RDONLY) < 0)
+        goto cleanup;
+
+    while (1) {
+        rc = st->driver->streamRecv(st, buf + offset, PATTERN_LEN);
+        if (rc == -2) {
+            usleep(20 * 1000);
+            continue;
+        }
+        if (rc < 0) {
+            virFilePrintf(stderr, "Failed to read stream: %s\n",
+                          virGetLastErrorMessage());
+            goto cleanup;
+        }
+        if (rc == 0)
+            break;
+        offset += rc;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                      virGetLastErrorMessage());
+        goto cleanup;
+    }
+    virObjectUnref(st);
+    st = NULL;
+
+    if (offset != PATTERN_LEN * 10 ||
+        memcmp(buf, pattern, PATTERN_LEN * 10) != 0) {
+        virFilePrintf(stderr, "Mismatched data read, got %zu bytes\n", offset);
+        goto cleanup;
+    }
+
+    /* And write it back */
+    memset(buf, 0, PATTERN_LEN * 10);
+    memset(&data, 0, sizeof(data));
+    data.buf = buf;
+    data.len = PATTERN_LEN * 10;
+    data.failFinish = failFinish;
+
+    if (!(st = virStreamNew(conn, flags)) ||
+        virFDStreamOpenIOCallbacks(st, &testFDStreamIO, &data,
+                                   0, O_WRONLY) < 0)
+        goto cleanup;
+
+    for (offset = 0; offset < PATTERN_LEN * 10; ) {
+        rc = st->driver->streamSend(st, pattern + offset, PATTERN_LEN);
+        if (rc == -2) {
+            usleep(20 * 1000);
+            continue;
+        }
+        if (rc < 0) {
+            virFilePrintf(stderr, "Failed to write stream: %s\n",
+                          virGetLastErrorMessage());
+            goto cleanup;
+        }
+        offset += rc;
+    }
+
+    rc = st->driver->streamFinish(st);
+    virObjectUnref(st);
+    st = NULL;
+
+    if (failFinish) {
+        if (rc == 0) {
+            virFilePrintf(stderr, "Finishing stream unexpectedly succeeded\n");
+            goto cleanup;
+        }
+        virResetLastError();
+    } else {
+        if (rc != 0) {
+            virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                          virGetLastErrorMessage());
+            goto cleanup;
+        }
+
+        if (!data.finished ||
+            data.offset != PATTERN_LEN * 10 ||
+            memcmp(buf, pattern, PATTERN_LEN * 10) != 0) {
+            virFilePrintf(stderr, "Mismatched data written\n");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(pattern);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static int testFDStreamIOCallbacksBlock(const void *data ATTRIBUTE_UNUSED)
+{
+    return testFDStreamIOCallbacksCommon(true, false);
+}
+static int testFDStreamIOCallbacksNonblock(const void *data ATTRIBUTE_UNUSED)
+{
+    return testFDStreamIOCallbacksCommon(false, false);
+}
+static int testFDStreamIOCallbacksFinishError(const void *data ATTRIBUTE_UNUSED)
+{
+    return testFDStreamIOCallbacksCommon(false, true);
+}
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -334,6 +545,12 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virTestRun("Stream I/O callbacks blocking ", testFDStreamIOCallbacksBlock, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Stream I/O callbacks non-blocking ", testFDStreamIOCallbacksNonblock, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Stream I/O callbacks finish error ", testFDStreamIOCallbacksFinishError, NULL) < 0)
+        ret = -1;
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
@@ -112,6 +112,9 @@ mymain(void)
         = dnsmasqCapsNewFromBuffer("Dnsmasq version 2.63\n--bind-dynamic", DNSMASQ);
     dnsmasqCapsPtr dhcpv6
         = dnsmasqCapsNewFromBuffer("Dnsmasq version 2.64\n--bind-dynamic", DNSMASQ);
+    dnsmasqCapsPtr hostsdir
+        = dnsmasqCapsNewFromBuffer("Dnsmasq version 2.73\n--bind-dynamic\n"
+                                   "--dhcp-hostsdir\n--hostsdir", DNSMASQ);
 
 #define DO_TEST(xname, xcaps) \
     do { \
@@ -147,7 +150,9 @@ mymain(void)
     DO_TEST("dhcp6host-routed-network", dhcpv6);
     DO_TEST("ptr-domains-auto", dhcpv6);
     DO_TEST("dnsmasq-options", dhcpv6);
+    DO_TEST("nat-network-hostsdir", hostsdir);
 
+    virObjectUnref(hostsdir);
     virObjectUnref(dhcpv6);
     virObjectUnref(full);
     virObjectUnref(restricted);
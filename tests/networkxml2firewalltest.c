@@ -46,12 +46,18 @@
 static void
 testCommandDryRun(const char *const*args ATTRIBUTE_UNUSED,
                   const char *const*env ATTRIBUTE_UNUSED,
-                  const char *input ATTRIBUTE_UNUSED,
+                  const char *input,
                   char **output,
                   char **error,
                   int *status,
-                  void *opaque ATTRIBUTE_UNUSED)
+                  void *opaque)
 {
+    virBufferPtr buf = opaque;
+
+    /* Record the ruleset fed to nft */
+    if (input)
+        virBufferAdd(buf, input, -1);
+
     *status = 0;
     ignore_value(VIR_STRDUP_QUIET(*output, ""));
     ignore_value(VIR_STRDUP_QUIET(*error, ""));
@@ -68,7 +74,7 @@ static int testCompareXMLToArgvFiles(const char *xml,
     int ret = -1;
     char *actual;
 
-    virCommandSetDryRun(&buf, testCommandDryRun, NULL);
+    virCommandSetDryRun(&buf, testCommandDryRun, &buf);
 
     if (!(def = virNetworkDefParseFile(xml, NULL)))
         goto cleanup;
@@ -106,6 +112,7 @@ static int testCompareXMLToArgvFiles(const char *xml,
 struct testInfo {
     const char *name;
     const char *baseargs;
+    const char *suffix;
 };
 
 
@@ -119,8 +126,8 @@ testCompareXMLToIPTablesHelper(const void *data)
 
     if (virAsprintf(&xml, "%s/networkxml2firewalldata/%s.xml",
                     abs_srcdir, info->name) < 0 ||
-        virAsprintf(&args, "%s/networkxml2firewalldata/%s-%s.args",
-                    abs_srcdir, info->name, RULESTYPE) < 0)
+        virAsprintf(&args, "%s/networkxml2firewalldata/%s%s",
+                    abs_srcdir, info->name, info->suffix) < 0)
         goto cleanup;
 
     result = testCompareXMLToArgvFiles(xml, args, info->baseargs);
@@ -131,15 +138,6 @@ testCompareXMLToIPTablesHelper(const void *data)
     return result;
 }
 
-static bool
-hasNetfilterTools(void)
-{
-    return virFileIsExecutable(IPTABLES_PATH) &&
-        virFileIsExecutable(IP6TABLES_PATH) &&
-        virFileIsExecutable(EBTABLES_PATH);
-}
-
-
 static int
 mymain(void)
 {
@@ -150,21 +148,26 @@ mymain(void)
 # define DO_TEST(name) \
     do { \
         struct testInfo info = { \
-            name, baseargs, \
+            name, baseargs, "-" RULESTYPE ".args", \
         }; \
         if (virTestRun("Network XML-2-iptables " name, \
                        testCompareXMLToIPTablesHelper, &info) < 0) \
             ret = -1; \
     } while (0)
 
+# define DO_TEST_NFTABLES(name) \
+    do { \
+        struct testInfo info = { \
+            name, "", ".nftables", \
+        }; \
+        if (virTestRun("Network XML-2-nftables " name, \
+                       testCompareXMLToIPTablesHelper, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
     virFirewallSetLockOverride(true);
 
     if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
-        if (!hasNetfilterTools()) {
-            fprintf(stderr, "iptables/ip6tables/ebtables tools not present");
-            return EXIT_AM_SKIP;
-        }
-
         ret = -1;
         goto cleanup;
     }
@@ -185,13 +188,27 @@ mymain(void)
     DO_TEST("nat-many-ips");
     DO_TEST("nat-no-dhcp");
     DO_TEST("nat-ipv6");
+    DO_TEST("nat-forward-dev");
     DO_TEST("route-default");
 
+    if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_NFTABLES) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    DO_TEST_NFTABLES("nat-default");
+    DO_TEST_NFTABLES("nat-tftp");
+    DO_TEST_NFTABLES("nat-many-ips");
+    DO_TEST_NFTABLES("nat-no-dhcp");
+    DO_TEST_NFTABLES("nat-ipv6");
+    DO_TEST_NFTABLES("nat-forward-dev");
+    DO_TEST_NFTABLES("route-default");
+
  cleanup:
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-VIR_TEST_MAIN(mymain)
+VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virfirewallmock.so")
 
 #else /* ! defined (__linux__) */
 
@@ -0,0 +1,332 @@
+/*
+ * nwfiltercapturetest.c: Test capturing packets of nwfilter
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if defined(HAVE_LIBPCAP) && defined(__linux__)
+
+# include <sched.h>
+# include <sys/socket.h>
+# include <netinet/ip.h>
+# include <netinet/udp.h>
+# include <linux/if_ether.h>
+# include <linux/if_packet.h>
+
+# include "nwfilter/nwfilter_capture.h"
+# include "virfile.h"
+# include "virnetdev.h"
+# include "virnetdevveth.h"
+# include "virthread.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* the capture runs on the first interface of a veth pair */
+# define TEST_CAPTURE_IF    "vnet-capt0"
+# define TEST_PEER_IF       "vnet-capt1"
+# define TEST_FILTER        "udp and dst port 67"
+# define TEST_TIMEOUT_MS    (5 * 1000)
+
+typedef struct _testCaptureData testCaptureData;
+typedef testCaptureData *testCaptureDataPtr;
+struct _testCaptureData {
+    virNWFilterCapturePtr capture;
+
+    virMutex lock;
+    virCond cond;
+    size_t npackets;
+    unsigned int dport; /* of the last packet */
+    bool fromVM; /* of the last packet */
+    int err;
+};
+
+
+static int
+testCapturePacket(const unsigned char *packet,
+                  size_t len,
+                  bool fromVM,
+                  void *opaque)
+{
+    testCaptureDataPtr data = opaque;
+    const struct udphdr *udphdr;
+
+    virMutexLock(&data->lock);
+
+    data->npackets++;
+    data->fromVM = fromVM;
+    data->dport = 0;
+    if (len >= ETH_HLEN + sizeof(struct iphdr) + sizeof(*udphdr)) {
+        VIR_WARNINGS_NO_CAST_ALIGN
+        udphdr = (const struct udphdr *)(packet + ETH_HLEN +
+                                         sizeof(struct iphdr));
+        VIR_WARNINGS_RESET
+        data->dport = ntohs(udphdr->dest);
+    }
+
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    return 0;
+}
+
+
+static void
+testCaptureError(int err,
+                 void *opaque)
+{
+    testCaptureDataPtr data = opaque;
+
+    virMutexLock(&data->lock);
+    data->err = err;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static virNWFilterCaptureCallbacks testCaptureCallbacks = {
+    .packet = testCapturePacket,
+    .error = testCaptureError,
+};
+
+
+/* Wait until @npackets were captured or the capture failed */
+static int
+testCaptureWait(testCaptureDataPtr data,
+                size_t npackets)
+{
+    unsigned long long then;
+
+    if (virTimeMillisNow(&then) < 0)
+        return -1;
+    then += TEST_TIMEOUT_MS;
+
+    while (data->npackets < npackets && data->err == 0) {
+        if (virCondWaitUntil(&data->cond, &data->lock, then) < 0) {
+            fprintf(stderr, "timed out waiting for packet %zu\n", npackets);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Send a UDP packet to port @dport out of @ifname */
+static int
+testCaptureSend(const char *ifname,
+                unsigned int dport)
+{
+    unsigned char frame[ETH_ZLEN] = { 0 };
+    struct iphdr *iphdr = (struct iphdr *)(frame + ETH_HLEN);
+    struct udphdr *udphdr = (struct udphdr *)(iphdr + 1);
+    struct sockaddr_ll sll = { 0 };
+    int ifindex;
+    int fd = -1;
+    int ret = -1;
+
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
+        return -1;
+
+    /* broadcast from 52:54:00:00:00:01 */
+    memset(frame, 0xff, ETH_ALEN);
+    frame[ETH_ALEN] = 0x52;
+    frame[ETH_ALEN + 1] = 0x54;
+    frame[ETH_ALEN + 5] = 0x01;
+    frame[2 * ETH_ALEN] = ETH_P_IP >> 8;
+    frame[2 * ETH_ALEN + 1] = ETH_P_IP & 0xff;
+
+    iphdr->version = 4;
+    iphdr->ihl = sizeof(*iphdr) / 4;
+    iphdr->tot_len = htons(sizeof(frame) - ETH_HLEN);
+    iphdr->ttl = 64;
+    iphdr->protocol = IPPROTO_UDP;
+    iphdr->daddr = htonl(INADDR_BROADCAST);
+
+    udphdr->source = htons(68);
+    udphdr->dest = htons(dport);
+    udphdr->len = htons(sizeof(frame) - ETH_HLEN - sizeof(*iphdr));
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = ifindex;
+    sll.sll_halen = ETH_ALEN;
+    memset(sll.sll_addr, 0xff, ETH_ALEN);
+
+    if ((fd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+        fprintf(stderr, "cannot create packet socket: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    if (sendto(fd, frame, sizeof(frame), 0,
+               (struct sockaddr *)&sll, sizeof(sll)) != sizeof(frame)) {
+        fprintf(stderr, "cannot send on %s: %s\n", ifname, strerror(errno));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
+static int
+testCaptureFilter(const void *opaque)
+{
+    testCaptureDataPtr data = (testCaptureDataPtr)opaque;
+    int ret = -1;
+
+    virMutexLock(&data->lock);
+
+    /* packets are captured in order, so the first one would show
+     * if the filter failed */
+    if (testCaptureSend(TEST_PEER_IF, 80) < 0 ||
+        testCaptureSend(TEST_PEER_IF, 67) < 0 ||
+        testCaptureWait(data, 1) < 0)
+        goto cleanup;
+
+    if (data->err != 0 || data->dport != 67 || !data->fromVM) {
+        fprintf(stderr, "unexpected packet: err=%d dport=%u fromVM=%d\n",
+                data->err, data->dport, data->fromVM);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&data->lock);
+    return ret;
+}
+
+
+static int
+testCaptureDirection(const void *opaque)
+{
+    testCaptureDataPtr data = (testCaptureDataPtr)opaque;
+    size_t npackets;
+    int ret = -1;
+
+    virMutexLock(&data->lock);
+
+    npackets = data->npackets;
+
+    if (testCaptureSend(TEST_CAPTURE_IF, 67) < 0 ||
+        testCaptureWait(data, npackets + 1) < 0)
+        goto cleanup;
+
+    if (data->err != 0 || data->dport != 67 || data->fromVM) {
+        fprintf(stderr, "unexpected packet: err=%d dport=%u fromVM=%d\n",
+                data->err, data->dport, data->fromVM);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&data->lock);
+    return ret;
+}
+
+
+static int
+testCaptureDisappear(const void *opaque)
+{
+    testCaptureDataPtr data = (testCaptureDataPtr)opaque;
+    int ret = -1;
+
+    virMutexLock(&data->lock);
+
+    if (virNetDevVethDelete(TEST_CAPTURE_IF) < 0 ||
+        testCaptureWait(data, SIZE_MAX) < 0)
+        goto cleanup;
+
+    if (data->err != ENODEV) {
+        fprintf(stderr, "unexpected error %d\n", data->err);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&data->lock);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    testCaptureData data = { 0 };
+    char *capture_if = (char *)TEST_CAPTURE_IF;
+    char *peer_if = (char *)TEST_PEER_IF;
+    int ret = 0;
+
+    /* a private network namespace keeps the host's interfaces untouched */
+    if (geteuid() != 0 || unshare(CLONE_NEWNET) < 0)
+        return EXIT_AM_SKIP;
+
+    if (virNetDevVethCreate(&capture_if, &peer_if) < 0 ||
+        virNetDevSetOnline(TEST_CAPTURE_IF, true) < 0 ||
+        virNetDevSetOnline(TEST_PEER_IF, true) < 0)
+        return EXIT_AM_SKIP;
+
+    if (virMutexInit(&data.lock) < 0 ||
+        virCondInit(&data.cond) < 0 ||
+        virNWFilterCaptureInit() < 0)
+        return EXIT_FAILURE;
+
+    if (!(data.capture = virNWFilterCaptureNew(TEST_CAPTURE_IF, TEST_FILTER,
+                                               ETH_FRAME_LEN,
+                                               &testCaptureCallbacks,
+                                               &data))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("filter", testCaptureFilter, &data) < 0)
+        ret = -1;
+    if (virTestRun("direction", testCaptureDirection, &data) < 0)
+        ret = -1;
+    if (virTestRun("disappear", testCaptureDisappear, &data) < 0)
+        ret = -1;
+
+ cleanup:
+    virNWFilterCaptureFree(data.capture);
+    virNWFilterCaptureShutdown();
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else /* !(HAVE_LIBPCAP && __linux__) */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !(HAVE_LIBPCAP && __linux__) */
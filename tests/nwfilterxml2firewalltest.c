@@ -367,6 +367,26 @@ static int testSetDefaultParameters(virHashTablePtr vars)
     return 0;
 }
 
+/* The default parameters with 2.2.2.2 in $A replaced by 4.4.4.4 */
+static int testSetUpdateParameters(virHashTablePtr vars)
+{
+    if (testSetOneParameter(vars, "IPSETNAME", "tck_test") < 0 ||
+        testSetOneParameter(vars, "A", "1.1.1.1") ||
+        testSetOneParameter(vars, "A", "4.4.4.4") ||
+        testSetOneParameter(vars, "A", "3.3.3.3") ||
+        testSetOneParameter(vars, "A", "3.3.3.3") ||
+        testSetOneParameter(vars, "B", "80") ||
+        testSetOneParameter(vars, "B", "90") ||
+        testSetOneParameter(vars, "B", "80") ||
+        testSetOneParameter(vars, "B", "80") ||
+        testSetOneParameter(vars, "C", "1080") ||
+        testSetOneParameter(vars, "C", "1090") ||
+        testSetOneParameter(vars, "C", "1100") ||
+        testSetOneParameter(vars, "C", "1110"))
+        return -1;
+    return 0;
+}
+
 static int testCompareXMLToArgvFiles(const char *xml,
                                      const char *cmdline)
 {
@@ -416,6 +436,72 @@ static int testCompareXMLToArgvFiles(const char *xml,
     return ret;
 }
 
+/*
+ * Instantiate the filter with the default parameters, then change the
+ * IP address 2.2.2.2 in $A and check the commands updating the rules in place
+ */
+static int testCompareXMLToUpdateArgvFiles(const char *xml,
+                                           const char *cmdline)
+{
+    char *actualargv = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virHashTablePtr vars = virNWFilterHashTableCreate(0);
+    virHashTablePtr newvars = virNWFilterHashTableCreate(0);
+    virNWFilterInst inst;
+    virNWFilterInst newinst;
+    int ret = -1;
+
+    memset(&inst, 0, sizeof(inst));
+    memset(&newinst, 0, sizeof(newinst));
+
+    virCommandSetDryRun(&buf, NULL, NULL);
+
+    if (!vars || !newvars)
+        goto cleanup;
+
+    if (testSetDefaultParameters(vars) < 0 ||
+        testSetUpdateParameters(newvars) < 0)
+        goto cleanup;
+
+    if (virNWFilterDefToInst(xml, vars, &inst) < 0 ||
+        virNWFilterDefToInst(xml, newvars, &newinst) < 0)
+        goto cleanup;
+
+    if (ebiptables_driver.applyNewRules("vnet0", inst.rules, inst.nrules) < 0 ||
+        ebiptables_driver.tearOldRules("vnet0") < 0)
+        goto cleanup;
+
+    virBufferFreeAndReset(&buf);
+
+    if (ebiptables_driver.updateRules("vnet0",
+                                      newinst.rules, newinst.nrules) != 0) {
+        fprintf(stderr, "Rules were not updated in place\n");
+        goto cleanup;
+    }
+
+    if (virBufferError(&buf))
+        goto cleanup;
+
+    actualargv = virBufferContentAndReset(&buf);
+    virTestClearCommandPath(actualargv);
+
+    if (virTestCompareToFile(actualargv, cmdline) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    ebiptables_driver.allTeardown("vnet0");
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(actualargv);
+    virNWFilterInstReset(&inst);
+    virNWFilterInstReset(&newinst);
+    virHashFree(vars);
+    virHashFree(newvars);
+    return ret;
+}
+
 struct testInfo {
     const char *name;
 };
@@ -443,6 +529,28 @@ testCompareXMLToIPTablesHelper(const void *data)
     return result;
 }
 
+static int
+testCompareXMLToUpdateHelper(const void *data)
+{
+    int result = -1;
+    const struct testInfo *info = data;
+    char *xml = NULL;
+    char *args = NULL;
+
+    if (virAsprintf(&xml, "%s/nwfilterxml2firewalldata/%s.xml",
+                    abs_srcdir, info->name) < 0 ||
+        virAsprintf(&args, "%s/nwfilterxml2firewalldata/%s-update-%s.args",
+                    abs_srcdir, info->name, RULESTYPE) < 0)
+        goto cleanup;
+
+    result = testCompareXMLToUpdateArgvFiles(xml, args);
+
+ cleanup:
+    VIR_FREE(xml);
+    VIR_FREE(args);
+    return result;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -467,6 +575,16 @@ mymain(void)
             ret = -1; \
     } while (0)
 
+# define DO_TEST_UPDATE(name) \
+    do { \
+        static struct testInfo info = { \
+            name, \
+        }; \
+        if (virTestRun("NWFilter XML-2-firewall update " name, \
+                       testCompareXMLToUpdateHelper, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
     virFirewallSetLockOverride(true);
 
     if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
@@ -518,6 +636,9 @@ mymain(void)
     DO_TEST("udplite-ipv6");
     DO_TEST("vlan");
 
+    DO_TEST_UPDATE("iter1");
+    DO_TEST_UPDATE("iter3");
+
  cleanup:
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
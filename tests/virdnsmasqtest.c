@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef __linux__
+
+# include "virdnsmasq.h"
+# include "virfile.h"
+# include "virstring.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/virdnsmasqdir-XXXXXX"
+
+struct testCapsData {
+    const char *buf;
+    bool hostsdir;
+};
+
+static int
+testCapsHostsdir(const void *opaque)
+{
+    const struct testCapsData *data = opaque;
+    dnsmasqCapsPtr caps;
+    int ret = -1;
+
+    if (!(caps = dnsmasqCapsNewFromBuffer(data->buf, DNSMASQ)))
+        return -1;
+
+    if (dnsmasqCapsGet(caps, DNSMASQ_CAPS_HOSTSDIR) != data->hostsdir) {
+        fprintf(stderr, "expected --hostsdir to be %s\n",
+                data->hostsdir ? "present" : "missing");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(caps);
+    return ret;
+}
+
+
+struct testHost {
+    const char *ip;
+    const char *mac;
+    const char *name;
+};
+
+/* Both hosts with DHCP and DNS entries go to @ctx */
+static dnsmasqContext *
+testContextNew(const char *dir,
+               const struct testHost *hosts,
+               size_t nhosts)
+{
+    dnsmasqContext *ctx;
+    size_t i;
+
+    if (!(ctx = dnsmasqContextNew("default", dir)))
+        return NULL;
+
+    for (i = 0; i < nhosts; i++) {
+        virSocketAddr addr;
+
+        if (virSocketAddrParse(&addr, hosts[i].ip, AF_UNSPEC) < 0)
+            goto error;
+
+        if (hosts[i].mac &&
+            dnsmasqAddDhcpHost(ctx, hosts[i].mac, &addr, hosts[i].name,
+                               NULL, false) < 0)
+            goto error;
+
+        if (!hosts[i].mac &&
+            dnsmasqAddHost(ctx, &addr, hosts[i].name) < 0)
+            goto error;
+    }
+
+    return ctx;
+
+ error:
+    dnsmasqContextFree(ctx);
+    return NULL;
+}
+
+
+/* Check the file of the host @ip in the hostsdir @suffix, or that
+ * there is no such file if @content is NULL */
+static int
+testCheckFile(const char *dir,
+              const char *suffix,
+              const char *ip,
+              const char *content)
+{
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOFREE(char *) actual = NULL;
+
+    if (virAsprintf(&path, "%s/default.%s/%s", dir, suffix, ip) < 0)
+        return -1;
+
+    if (!content) {
+        if (virFileExists(path)) {
+            fprintf(stderr, "'%s' should not exist\n", path);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (virFileReadAll(path, 1024, &actual) < 0)
+        return -1;
+
+    if (STRNEQ(actual, content)) {
+        virTestDifference(stderr, content, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testCheckReload(bool reload,
+                bool expected)
+{
+    if (reload != expected) {
+        fprintf(stderr, "dnsmasq should %sbe reloaded\n",
+                expected ? "" : "not ");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static const struct testHost hostsFirst[] = {
+    { "192.168.122.2", "52:54:00:00:00:02", "alpha" },
+    { "192.168.122.3", "52:54:00:00:00:03", "beta" },
+    { "192.168.122.10", NULL, "gamma" },
+};
+
+/* alpha is unchanged, beta is renamed, delta is new, gamma is gone */
+static const struct testHost hostsSecond[] = {
+    { "192.168.122.2", "52:54:00:00:00:02", "alpha" },
+    { "192.168.122.3", "52:54:00:00:00:03", "epsilon" },
+    { "192.168.122.4", "52:54:00:00:00:04", "delta" },
+};
+
+/* only a new host is added to hostsSecond */
+static const struct testHost hostsThird[] = {
+    { "192.168.122.2", "52:54:00:00:00:02", "alpha" },
+    { "192.168.122.3", "52:54:00:00:00:03", "epsilon" },
+    { "192.168.122.4", "52:54:00:00:00:04", "delta" },
+    { "2001:db8::5", NULL, "zeta" },
+};
+
+
+static int
+testSaveHostsDirs(const void *opaque)
+{
+    const char *dir = opaque;
+    dnsmasqContext *first = NULL;
+    dnsmasqContext *second = NULL;
+    dnsmasqContext *third = NULL;
+    VIR_AUTOFREE(char *) stale = NULL;
+    VIR_AUTOFREE(char *) partial = NULL;
+    bool reload;
+    int ret = -1;
+
+    if (!(first = testContextNew(dir, hostsFirst,
+                                 ARRAY_CARDINALITY(hostsFirst))) ||
+        !(second = testContextNew(dir, hostsSecond,
+                                  ARRAY_CARDINALITY(hostsSecond))) ||
+        !(third = testContextNew(dir, hostsThird,
+                                 ARRAY_CARDINALITY(hostsThird))))
+        goto cleanup;
+
+    /* New files are picked up by dnsmasq without a reload */
+    if (dnsmasqSaveHostsDirs(first, NULL, &reload) < 0 ||
+        testCheckReload(reload, false) < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.2",
+                      "52:54:00:00:00:02,192.168.122.2,alpha\n") < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.3",
+                      "52:54:00:00:00:03,192.168.122.3,beta\n") < 0 ||
+        testCheckFile(dir, "addnhostsdir", "192.168.122.10",
+                      "192.168.122.10\tgamma\t\n") < 0)
+        goto cleanup;
+
+    /* Changed and removed hosts need one */
+    if (dnsmasqSaveHostsDirs(second, first, &reload) < 0 ||
+        testCheckReload(reload, true) < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.2",
+                      "52:54:00:00:00:02,192.168.122.2,alpha\n") < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.3",
+                      "52:54:00:00:00:03,192.168.122.3,epsilon\n") < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.4",
+                      "52:54:00:00:00:04,192.168.122.4,delta\n") < 0 ||
+        testCheckFile(dir, "addnhostsdir", "192.168.122.10", NULL) < 0)
+        goto cleanup;
+
+    /* Only the files of new hosts are written */
+    if (virAsprintf(&stale, "%s/default.hostsdir/192.168.122.2", dir) < 0 ||
+        unlink(stale) < 0)
+        goto cleanup;
+
+    if (dnsmasqSaveHostsDirs(third, second, &reload) < 0 ||
+        testCheckReload(reload, false) < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.2", NULL) < 0 ||
+        testCheckFile(dir, "addnhostsdir", "2001:db8::5",
+                      "2001:db8::5\tzeta\t\n") < 0)
+        goto cleanup;
+
+    /* Without the previous context, the files on disk are compared:
+     * the missing one is written, unknown hosts and leftovers of an
+     * interrupted write are removed */
+    VIR_FREE(stale);
+    if (virAsprintf(&stale, "%s/default.hostsdir/192.168.122.99", dir) < 0 ||
+        virAsprintf(&partial, "%s/default.hostsdir/.192.168.122.5.new",
+                    dir) < 0 ||
+        virFileWriteStr(stale, "52:54:00:00:00:99,192.168.122.99\n", 0644) < 0 ||
+        virFileWriteStr(partial, "52:54:00:00:00:05,192.168.122.5\n", 0644) < 0)
+        goto cleanup;
+
+    if (dnsmasqSaveHostsDirs(third, NULL, &reload) < 0 ||
+        testCheckReload(reload, true) < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.2",
+                      "52:54:00:00:00:02,192.168.122.2,alpha\n") < 0 ||
+        testCheckFile(dir, "hostsdir", "192.168.122.99", NULL) < 0 ||
+        testCheckFile(dir, "hostsdir", ".192.168.122.5.new", NULL) < 0)
+        goto cleanup;
+
+    /* Nothing to do if the files on disk are up to date */
+    if (dnsmasqSaveHostsDirs(third, NULL, &reload) < 0 ||
+        testCheckReload(reload, false) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    dnsmasqContextFree(first);
+    dnsmasqContextFree(second);
+    dnsmasqContextFree(third);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virdnsmasqdir");
+        abort();
+    }
+
+# define DO_TEST_CAPS(name, buf, hostsdir) \
+    do { \
+        struct testCapsData data = { buf, hostsdir }; \
+        if (virTestRun("caps " name, testCapsHostsdir, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_CAPS("without hostsdir",
+                 "Dnsmasq version 2.72\n"
+                 "    --dhcp-hostsdir=<path>   Read DHCP host specs "
+                 "from a directory.\n", false);
+    DO_TEST_CAPS("with hostsdir",
+                 "Dnsmasq version 2.73\n"
+                 "    --dhcp-hostsdir=<path>   Read DHCP host specs "
+                 "from a directory.\n"
+                 "    --hostsdir=<path>        Read hosts files "
+                 "from a directory.\n", true);
+    DO_TEST_CAPS("longer option",
+                 "Dnsmasq version 2.73\n"
+                 "    --dhcp-hostsdir=<path>   Read DHCP host specs "
+                 "from a directory.\n"
+                 "    --hostsdir-example=<path>\n", false);
+    DO_TEST_CAPS("only hostsdir",
+                 "Dnsmasq version 2.73\n"
+                 "    --hostsdir=<path>        Read hosts files "
+                 "from a directory.\n", false);
+
+    if (virTestRun("save hostsdirs", testSaveHostsDirs, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif
@@ -200,6 +200,32 @@ testFileCache(const void *opaque)
 }
 
 
+static int
+testFileCachePrefetch(const void *opaque)
+{
+    virFileCachePtr cache = (virFileCachePtr) opaque;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(cache);
+    const char *names[] = { "prefetch1", "prefetch2", "prefetch3",
+                            "prefetch4", "prefetch5", "prefetch1", NULL };
+
+    testPriv->dataSaved = false;
+    testPriv->newData = "ddd\n";
+    testPriv->expectData = "ddd\n";
+
+    if (virFileCachePrefetch(cache, names, 3) < 0) {
+        fprintf(stderr, "Prefetching data failed.\n");
+        return -1;
+    }
+
+    if (!testPriv->dataSaved) {
+        fprintf(stderr, "Expected prefetched data to be saved.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -228,6 +254,13 @@ mymain(void)
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+    if (virTestRun("prefetch", testFileCachePrefetch, cache) < 0)
+        ret = -1;
+
+    /* Prefetched data must be served without creating it again */
+    TEST_RUN("prefetch1", NULL, "ddd\n", false);
+    TEST_RUN("prefetch5", NULL, "ddd\n", false);
+
     virObjectUnref(cache);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -350,6 +350,50 @@ testFileIsSharedFSType(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testFileStamp(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virFileStamp stamp;
+    struct stat sb = { .st_dev = 1, .st_ino = 2, .st_size = 4096 };
+    struct stat changed;
+
+    sb.st_mtime = time(NULL) - 10;
+    sb.st_ctime = time(NULL) - 10;
+
+    if (!virFileStampSet(&stamp, &sb) ||
+        !virFileStampMatch(&stamp, &sb)) {
+        fprintf(stderr, "unchanged file doesn't match\n");
+        return -1;
+    }
+
+#define CHECK_CHANGED(field) \
+    do { \
+        changed = sb; \
+        changed.field++; \
+        if (virFileStampMatch(&stamp, &changed)) { \
+            fprintf(stderr, "change of " #field " not detected\n"); \
+            return -1; \
+        } \
+    } while (0)
+
+    CHECK_CHANGED(st_dev);
+    CHECK_CHANGED(st_ino);
+    CHECK_CHANGED(st_size);
+    CHECK_CHANGED(st_mtime);
+    CHECK_CHANGED(st_ctime);
+
+#undef CHECK_CHANGED
+
+    sb.st_ctime = time(NULL);
+    if (virFileStampSet(&stamp, &sb)) {
+        fprintf(stderr, "recently changed file is cacheable\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -460,6 +504,9 @@ mymain(void)
     DO_TEST_FILE_IS_SHARED_FS_TYPE("mounts3.txt", "/gpfs/data", true);
     DO_TEST_FILE_IS_SHARED_FS_TYPE("mounts3.txt", "/quobyte", true);
 
+    if (virTestRun("file stamp", testFileStamp, NULL) < 0)
+        ret = -1;
+
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
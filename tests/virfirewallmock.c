@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virmock.h"
+#include "virfile.h"
+#include "virstring.h"
+
+static bool (*real_virFileIsExecutable)(const char *file);
+
+/* The firewall commands are never run for real by the tests, so
+ * pretend the tools are installed for the backends to be usable */
+bool
+virFileIsExecutable(const char *file)
+{
+    if (STREQ(file, IPTABLES_PATH) ||
+        STREQ(file, IP6TABLES_PATH) ||
+        STREQ(file, EBTABLES_PATH) ||
+        STREQ(file, NFT_PATH))
+        return true;
+
+    VIR_MOCK_REAL_INIT(virFileIsExecutable);
+
+    return real_virFileIsExecutable(file);
+}
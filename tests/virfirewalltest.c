@@ -1124,6 +1124,435 @@ testFirewallQuery(const void *opaque ATTRIBUTE_UNUSED)
     return ret;
 }
 
+
+static void
+testFirewallBatchHook(const char *const*args,
+                      const char *const*env,
+                      const char *input,
+                      char **output,
+                      char **error,
+                      int *status,
+                      void *opaque)
+{
+    virBufferPtr buf = opaque;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    size_t i;
+
+    if (!input) {
+        testFirewallRollbackHook(args, env, input, output, error,
+                                 status, NULL);
+        return;
+    }
+
+    virBufferAdd(buf, input, -1);
+
+    if (!(lines = virStringSplit(input, "\n", 0))) {
+        *status = 127;
+        return;
+    }
+
+    for (i = 0; lines[i]; i++) {
+        /* Fake failure on the rule with this IP addr, telling
+         * which line failed as the *-restore tools and nft do */
+        if ((STRPREFIX(lines[i], "-A") || STRPREFIX(lines[i], "add rule")) &&
+            strstr(lines[i], " 192.168.122.255 ")) {
+            *status = 1;
+            if (error && STREQ(args[0], NFT_PATH))
+                ignore_value(virAsprintfQuiet(error,
+                                              "/dev/stdin:%zu:1-10: Error: "
+                                              "Could not process rule\n",
+                                              i + 1));
+            else if (error)
+                ignore_value(virAsprintfQuiet(error,
+                                              "%s: line %zu failed\n",
+                                              args[0], i + 1));
+            break;
+        }
+        /* ... and without telling which line failed */
+        if (strstr(lines[i], " 192.168.122.254 ")) {
+            *status = 1;
+            if (error)
+                ignore_value(VIR_STRDUP_QUIET(*error, "something bad happened\n"));
+            break;
+        }
+    }
+}
+
+
+static int
+testFirewallBatchGroups(const void *opaque)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source-host !192.168.122.1 --jump REJECT\n"
+        "COMMIT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*nat\n"
+        "-A POSTROUTING --source 192.168.122.0/24 --jump MASQUERADE\n"
+        "COMMIT\n"
+        EBTABLES_RESTORE_PATH " --noflush\n"
+        "*nat\n"
+        "-N libvirt-J-vnet0\n"
+        "-A libvirt-J-vnet0 --jump ACCEPT\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -A INPUT --match comment --comment 'a comment' --jump ACCEPT\n"
+        IP6TABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 2001:db8::1 --jump ACCEPT\n"
+        "COMMIT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A OUTPUT --jump DROP\n"
+        "COMMIT\n";
+    const struct testFirewallData *data = opaque;
+
+    fwDisabled = data->fwDisabled;
+    if (virFirewallSetBackend(data->tryBackend) < 0)
+        goto cleanup;
+
+    virFirewallSetRestoreOverride(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-A", "POSTROUTING",
+                       "--source", "192.168.122.0/24",
+                       "--jump", "MASQUERADE", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_ETHERNET,
+                       "-t", "nat",
+                       "-N", "libvirt-J-vnet0", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "!192.168.122.1",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_ETHERNET,
+                       "-t", "nat",
+                       "-A", "libvirt-J-vnet0",
+                       "--jump", "ACCEPT", NULL);
+
+    /* Can't be passed to iptables-restore without quoting */
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--match", "comment",
+                       "--comment", "a comment",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV6,
+                       "-A", "INPUT",
+                       "--source-host", "2001:db8::1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--jump", "DROP", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    if (virBufferError(&cmdbuf))
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetRestoreOverride(false);
+    virFirewallFree(fw);
+    return ret;
+}
+
+
+static int
+testFirewallBatchIgnoreFail(const void *opaque)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source-host 192.168.122.255 --jump REJECT\n"
+        "-A INPUT --source-host 192.168.122.2 --jump ACCEPT\n"
+        "-A FORWARD --source-host 192.168.122.255 --jump REJECT\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        IPTABLES_PATH " -A INPUT --source-host 192.168.122.2 --jump ACCEPT\n"
+        IPTABLES_PATH " -A FORWARD --source-host 192.168.122.255 --jump REJECT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*nat\n"
+        "-A POSTROUTING --source-host 192.168.122.254 --jump MASQUERADE\n"
+        "-A POSTROUTING --source-host 192.168.122.3 --jump MASQUERADE\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -t nat -A POSTROUTING --source-host 192.168.122.254 --jump MASQUERADE\n"
+        IPTABLES_PATH " -t nat -A POSTROUTING --source-host 192.168.122.3 --jump MASQUERADE\n";
+    const struct testFirewallData *data = opaque;
+
+    fwDisabled = data->fwDisabled;
+    if (virFirewallSetBackend(data->tryBackend) < 0)
+        goto cleanup;
+
+    virFirewallSetRestoreOverride(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-t", "nat",
+                       "-A", "POSTROUTING",
+                       "--source-host", "192.168.122.254",
+                       "--jump", "MASQUERADE", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-t", "nat",
+                       "-A", "POSTROUTING",
+                       "--source-host", "192.168.122.3",
+                       "--jump", "MASQUERADE", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.2",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "FORWARD",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    if (virBufferError(&cmdbuf))
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetRestoreOverride(false);
+    virFirewallFree(fw);
+    return ret;
+}
+
+
+static int
+testFirewallBatchRollback(const void *opaque)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "COMMIT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.127 --jump REJECT\n"
+        "-A INPUT --source-host 192.168.122.255 --jump REJECT\n"
+        "COMMIT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-D INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "COMMIT\n"
+        IPTABLES_RESTORE_PATH " --noflush\n"
+        "*filter\n"
+        "-D INPUT --source-host 192.168.122.127 --jump REJECT\n"
+        "-D INPUT --source-host 192.168.122.255 --jump REJECT\n"
+        "COMMIT\n";
+    const struct testFirewallData *data = opaque;
+
+    fwDisabled = data->fwDisabled;
+    if (virFirewallSetBackend(data->tryBackend) < 0)
+        goto cleanup;
+
+    virFirewallSetRestoreOverride(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallStartRollback(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.127",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallStartRollback(fw, VIR_FIREWALL_ROLLBACK_INHERIT_PREVIOUS);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.127",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-D", "INPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    if (virFirewallApply(fw) == 0) {
+        fprintf(stderr, "Firewall apply unexpectedly worked\n");
+        goto cleanup;
+    }
+
+    if (virTestOOMActive())
+        goto cleanup;
+
+    if (virBufferError(&cmdbuf))
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetRestoreOverride(false);
+    virFirewallFree(fw);
+    return ret;
+}
+
+static int
+testFirewallNftables(const void *opaque)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        NFT_PATH " -f -\n"
+        "add table ip libvirt_test\n"
+        "add rule ip libvirt_test forward ip saddr 192.168.122.1 accept\n"
+        NFT_PATH " -f -\n"
+        "add rule ip libvirt_test forward ip saddr 192.168.122.255 accept\n"
+        "add rule ip libvirt_test forward ip saddr 192.168.122.2 accept\n"
+        NFT_PATH " add rule ip libvirt_test forward ip saddr 192.168.122.2 accept\n";
+    const struct testFirewallData *data = opaque;
+
+    fwDisabled = data->fwDisabled;
+    if (virFirewallSetBackend(data->tryBackend) < 0)
+        goto cleanup;
+
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "table", "ip", "libvirt_test", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "rule", "ip", "libvirt_test", "forward",
+                       "ip", "saddr", "192.168.122.1", "accept", NULL);
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "rule", "ip", "libvirt_test", "forward",
+                       "ip", "saddr", "192.168.122.255", "accept", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_NFTABLES,
+                       "add", "rule", "ip", "libvirt_test", "forward",
+                       "ip", "saddr", "192.168.122.2", "accept", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    if (virBufferError(&cmdbuf))
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallFree(fw);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1193,6 +1622,10 @@ mymain(void)
     RUN_TEST("many rollback", testFirewallManyRollback);
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
+    RUN_TEST_DIRECT("batch groups", testFirewallBatchGroups);
+    RUN_TEST_DIRECT("batch ignore fail", testFirewallBatchIgnoreFail);
+    RUN_TEST_DIRECT("batch rollback", testFirewallBatchRollback);
+    RUN_TEST_DIRECT("nftables", testFirewallNftables);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virfile.h"
+#include "virleasedb.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virleasedbdir-XXXXXX"
+
+static virLeaseDBEntry testLeases[] = {
+    { .expirytime = 1900000002, .ip = (char *)"192.168.122.197",
+      .mac = (char *)"52:54:00:a4:6f:91", .hostname = (char *)"fedora" },
+    { .expirytime = 1900000001, .ip = (char *)"192.168.122.198",
+      .mac = (char *)"52:54:00:a4:6f:92", .hostname = (char *)"fedora",
+      .clientid = (char *)"01:52:54:00:a4:6f:92" },
+    { .expirytime = 2000000000, .ip = (char *)"2001:1234:dead:beef::2",
+      .mac = (char *)"52:54:00:a4:6f:91", .iaid = (char *)"1221229",
+      .serverDuid = (char *)"00:01:00:01:1d:5f:2e:4c:52:54:00:ab:cd:ef" },
+    { .expirytime = 2000000000, .ip = (char *)"192.168.122.2",
+      .mac = (char *)"52:54:00:11:22:33" },
+};
+
+
+static int
+testLeaseDBCompare(virLeaseDBPtr db,
+                   const virLeaseDBEntry *expected,
+                   size_t nexpected)
+{
+    size_t i;
+
+    if (virLeaseDBGetCount(db) != nexpected) {
+        fprintf(stderr, "expected %zu leases, got %zu\n",
+                nexpected, virLeaseDBGetCount(db));
+        return -1;
+    }
+
+    for (i = 0; i < nexpected; i++) {
+        virLeaseDBEntry entry;
+        int rc = 0;
+
+        if (virLeaseDBGetEntry(db, i, &entry) < 0)
+            return -1;
+
+        if (entry.expirytime != expected[i].expirytime ||
+            STRNEQ_NULLABLE(entry.ip, expected[i].ip) ||
+            STRNEQ_NULLABLE(entry.mac, expected[i].mac) ||
+            STRNEQ_NULLABLE(entry.hostname, expected[i].hostname) ||
+            STRNEQ_NULLABLE(entry.clientid, expected[i].clientid) ||
+            STRNEQ_NULLABLE(entry.iaid, expected[i].iaid) ||
+            STRNEQ_NULLABLE(entry.serverDuid, expected[i].serverDuid)) {
+            fprintf(stderr, "lease %zu differs: %s %s\n",
+                    i, NULLSTR(entry.ip), NULLSTR(entry.mac));
+            rc = -1;
+        }
+
+        virLeaseDBEntryClear(&entry);
+        if (rc < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLeaseDBEmpty(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+
+    if (virAsprintf(&path, "%s/missing.leasedb", scratchdir) < 0 ||
+        !(db = virLeaseDBOpen(path)))
+        return -1;
+
+    if (virLeaseDBGetCount(db) != 0 ||
+        virLeaseDBFindMAC(db, testLeases[0].mac, -1) != -1) {
+        fprintf(stderr, "missing database is not empty\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLeaseDBSave(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+
+    if (virAsprintf(&path, "%s/save.leasedb", scratchdir) < 0 ||
+        virLeaseDBSave(path, testLeases, ARRAY_CARDINALITY(testLeases)) < 0 ||
+        !(db = virLeaseDBOpen(path)))
+        return -1;
+
+    return testLeaseDBCompare(db, testLeases, ARRAY_CARDINALITY(testLeases));
+}
+
+
+static int
+testLeaseDBFind(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+    ssize_t idx;
+
+    if (virAsprintf(&path, "%s/find.leasedb", scratchdir) < 0 ||
+        virLeaseDBSave(path, testLeases, ARRAY_CARDINALITY(testLeases)) < 0 ||
+        !(db = virLeaseDBOpen(path)))
+        return -1;
+
+    /* both leases of the MAC address are found, in order */
+    if ((idx = virLeaseDBFindMAC(db, "52:54:00:A4:6F:91", -1)) != 0 ||
+        (idx = virLeaseDBFindMAC(db, "52:54:00:A4:6F:91", idx)) != 2 ||
+        (idx = virLeaseDBFindMAC(db, "52:54:00:A4:6F:91", idx)) != -1) {
+        fprintf(stderr, "unexpected lease %zd\n", idx);
+        return -1;
+    }
+
+    if ((idx = virLeaseDBFindMAC(db, "52:54:00:11:22:33", -1)) != 3 ||
+        (idx = virLeaseDBFindMAC(db, "52:54:00:00:00:00", -1)) != -1) {
+        fprintf(stderr, "unexpected lease %zd\n", idx);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLeaseDBMany(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+    virLeaseDBEntryPtr leases = NULL;
+    size_t nleases = 1000;
+    ssize_t idx;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(leases, nleases) < 0)
+        return -1;
+
+    for (i = 0; i < nleases; i++) {
+        leases[i].expirytime = 2000000000 + i;
+        if (virAsprintf(&leases[i].ip, "10.0.%zu.%zu", i / 250, i % 250 + 2) < 0 ||
+            virAsprintf(&leases[i].mac, "52:54:00:00:%02zx:%02zx",
+                        i / 256, i % 256) < 0)
+            goto cleanup;
+    }
+
+    if (virAsprintf(&path, "%s/many.leasedb", scratchdir) < 0 ||
+        virLeaseDBSave(path, leases, nleases) < 0 ||
+        !(db = virLeaseDBOpen(path)) ||
+        testLeaseDBCompare(db, leases, nleases) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nleases; i++) {
+        if ((idx = virLeaseDBFindMAC(db, leases[i].mac, -1)) != i ||
+            (idx = virLeaseDBFindMAC(db, leases[i].mac, idx)) != -1) {
+            fprintf(stderr, "unexpected lease %zd for %s\n", idx, leases[i].mac);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virLeaseDBEntryListFree(leases, nleases);
+    return ret;
+}
+
+
+static int
+testLeaseDBReplace(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOPTR(virLeaseDB) olddb = NULL;
+    VIR_AUTOPTR(virLeaseDB) newdb = NULL;
+
+    if (virAsprintf(&path, "%s/replace.leasedb", scratchdir) < 0 ||
+        virLeaseDBSave(path, testLeases, ARRAY_CARDINALITY(testLeases)) < 0 ||
+        !(olddb = virLeaseDBOpen(path)) ||
+        virLeaseDBSave(path, testLeases + 1, 2) < 0 ||
+        !(newdb = virLeaseDBOpen(path)))
+        return -1;
+
+    /* a reader keeps the database it opened */
+    if (testLeaseDBCompare(olddb, testLeases,
+                           ARRAY_CARDINALITY(testLeases)) < 0 ||
+        testLeaseDBCompare(newdb, testLeases + 1, 2) < 0)
+        return -1;
+
+    if (virLeaseDBFindMAC(newdb, testLeases[3].mac, -1) != -1) {
+        fprintf(stderr, "removed lease was found\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLeaseDBInvalid(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOPTR(virLeaseDB) db = NULL;
+
+    if (virAsprintf(&path, "%s/invalid.leasedb", scratchdir) < 0 ||
+        virFileWriteStr(path, "[ { \"ip-address\": \"192.168.122.2\" } ]", 0644) < 0)
+        return -1;
+
+    if ((db = virLeaseDBOpen(path))) {
+        fprintf(stderr, "invalid database was opened\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virleasedbdir");
+        abort();
+    }
+
+#define DO_TEST(name, func) \
+    do { \
+        if (virTestRun(name, func, scratchdir) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST("empty", testLeaseDBEmpty);
+    DO_TEST("save", testLeaseDBSave);
+    DO_TEST("find", testLeaseDBFind);
+    DO_TEST("many", testLeaseDBMany);
+    DO_TEST("replace", testLeaseDBReplace);
+    DO_TEST("invalid", testLeaseDBInvalid);
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
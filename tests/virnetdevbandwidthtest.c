@@ -19,12 +19,21 @@
 #include <config.h>
 
 #include "testutils.h"
-#define LIBVIRT_VIRCOMMANDPRIV_H_ALLOW
-#include "vircommandpriv.h"
-#include "virnetdevbandwidth.h"
-#include "netdev_bandwidth_conf.c"
 
-#define VIR_FROM_THIS VIR_FROM_NONE
+#if defined(__linux__) && defined(HAVE_LIBNL)
+
+# include <linux/if_ether.h>
+# include <linux/pkt_cls.h>
+# include <linux/pkt_sched.h>
+# include <linux/rtnetlink.h>
+# include <netlink/attr.h>
+
+# define LIBVIRT_VIRNETLINKPRIV_H_ALLOW
+# include "virnetlinkpriv.h"
+# include "virnetdevbandwidth.h"
+# include "netdev_bandwidth_conf.c"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
 
 struct testMinimalStruct {
     const char *expected_result;
@@ -39,7 +48,7 @@ struct testSetStruct {
     const bool hierarchical_class;
 };
 
-#define PARSE(xml, var) \
+# define PARSE(xml, var) \
     do { \
         int rc; \
         xmlDocPtr doc; \
@@ -63,6 +72,193 @@ struct testSetStruct {
             goto cleanup; \
     } while (0)
 
+
+static void
+testNetlinkFormatHandle(virBufferPtr buf,
+                        const char *name,
+                        uint32_t handle)
+{
+    if (handle == TC_H_ROOT)
+        virBufferAsprintf(buf, " %s root", name);
+    else if (handle == TC_H_INGRESS)
+        virBufferAsprintf(buf, " %s ingress", name);
+    else if (TC_H_MIN(handle))
+        virBufferAsprintf(buf, " %s %x:%x", name,
+                          TC_H_MAJ(handle) >> 16, TC_H_MIN(handle));
+    else
+        virBufferAsprintf(buf, " %s %x:", name, TC_H_MAJ(handle) >> 16);
+}
+
+
+static void
+testNetlinkFormatHTB(virBufferPtr buf,
+                     struct nlattr *options)
+{
+    struct nlattr *tb[TCA_HTB_MAX + 1];
+    const struct tc_htb_glob *glob;
+    const struct tc_htb_opt *opt;
+
+    if (nla_parse_nested(tb, TCA_HTB_MAX, options, NULL) < 0) {
+        virBufferAddLit(buf, " <invalid>");
+        return;
+    }
+
+    if (tb[TCA_HTB_INIT]) {
+        glob = nla_data(tb[TCA_HTB_INIT]);
+        virBufferAsprintf(buf, " default %x", glob->defcls);
+    }
+
+    if (tb[TCA_HTB_PARMS]) {
+        opt = nla_data(tb[TCA_HTB_PARMS]);
+        virBufferAsprintf(buf, " rate %uBps ceil %uBps buffer %u cbuffer %u"
+                          " quantum %u", opt->rate.rate, opt->ceil.rate,
+                          opt->buffer, opt->cbuffer, opt->quantum);
+    }
+}
+
+
+static void
+testNetlinkFormatU32(virBufferPtr buf,
+                     struct nlattr *options)
+{
+    struct nlattr *tb[TCA_U32_MAX + 1];
+    struct nlattr *police[TCA_POLICE_MAX + 1];
+    const struct tc_police *tbf;
+    const struct tc_u32_sel *sel;
+    size_t i;
+
+    if (nla_parse_nested(tb, TCA_U32_MAX, options, NULL) < 0) {
+        virBufferAddLit(buf, " <invalid>");
+        return;
+    }
+
+    if (tb[TCA_U32_SEL]) {
+        sel = nla_data(tb[TCA_U32_SEL]);
+        for (i = 0; i < sel->nkeys; i++) {
+            virBufferAsprintf(buf, " match %08x/%08x at %d",
+                              ntohl(sel->keys[i].val),
+                              ntohl(sel->keys[i].mask),
+                              sel->keys[i].off);
+        }
+        if (sel->flags & TC_U32_TERMINAL)
+            virBufferAddLit(buf, " terminal");
+    }
+
+    if (tb[TCA_U32_POLICE]) {
+        if (nla_parse_nested(police, TCA_POLICE_MAX,
+                             tb[TCA_U32_POLICE], NULL) < 0 ||
+            !police[TCA_POLICE_TBF]) {
+            virBufferAddLit(buf, " <invalid>");
+            return;
+        }
+
+        tbf = nla_data(police[TCA_POLICE_TBF]);
+        virBufferAsprintf(buf, " police rate %uBps burst %u mtu %u",
+                          tbf->rate.rate, tbf->burst, tbf->mtu);
+        if (tbf->action == TC_ACT_SHOT)
+            virBufferAddLit(buf, " drop");
+        else
+            virBufferAsprintf(buf, " action %d", tbf->action);
+        if (police[TCA_POLICE_RATE])
+            virBufferAsprintf(buf, " rtab %d", nla_len(police[TCA_POLICE_RATE]));
+    }
+
+    if (tb[TCA_U32_CLASSID])
+        testNetlinkFormatHandle(buf, "flowid", nla_get_u32(tb[TCA_U32_CLASSID]));
+}
+
+
+/* Format the traffic control message @msg like a tc command */
+static void
+testNetlinkDryRun(struct nlmsghdr *msg,
+                  int *error,
+                  void *opaque)
+{
+    virBufferPtr buf = opaque;
+    const struct tcmsg *tcm = nlmsg_data(msg);
+    struct nlattr *tb[TCA_MAX + 1];
+    struct nlattr *options;
+    const char *kind = NULL;
+    const char *object = "qdisc";
+    const char *op = "add";
+
+    switch (msg->nlmsg_type) {
+    case RTM_DELTCLASS:
+    case RTM_NEWTCLASS:
+        object = "class";
+        break;
+    case RTM_DELTFILTER:
+    case RTM_NEWTFILTER:
+        object = "filter";
+        break;
+    }
+
+    switch (msg->nlmsg_type) {
+    case RTM_DELQDISC:
+    case RTM_DELTCLASS:
+    case RTM_DELTFILTER:
+        op = "del";
+        /* pretend there is nothing to remove */
+        *error = -ENOENT;
+        break;
+    default:
+        if (!(msg->nlmsg_flags & NLM_F_CREATE))
+            op = "change";
+    }
+
+    virBufferAsprintf(buf, "%s %s dev %d", object, op, tcm->tcm_ifindex);
+
+    if (tcm->tcm_parent)
+        testNetlinkFormatHandle(buf, "parent", tcm->tcm_parent);
+
+    if (STREQ(object, "filter")) {
+        switch (ntohs(TC_H_MIN(tcm->tcm_info))) {
+        case ETH_P_ALL:
+            virBufferAddLit(buf, " protocol all");
+            break;
+        case ETH_P_IP:
+            virBufferAddLit(buf, " protocol ip");
+            break;
+        }
+        virBufferAsprintf(buf, " prio %u handle %x",
+                          TC_H_MAJ(tcm->tcm_info) >> 16, tcm->tcm_handle);
+    } else if (tcm->tcm_handle) {
+        testNetlinkFormatHandle(buf, STREQ(object, "class") ? "classid" : "handle",
+                                tcm->tcm_handle);
+    }
+
+    if (nlmsg_parse(msg, sizeof(*tcm), tb, TCA_MAX, NULL) < 0) {
+        virBufferAddLit(buf, " <invalid>\n");
+        return;
+    }
+
+    if (tb[TCA_KIND]) {
+        kind = nla_get_string(tb[TCA_KIND]);
+        virBufferAsprintf(buf, " %s", kind);
+    }
+
+    if ((options = tb[TCA_OPTIONS])) {
+        if (STREQ_NULLABLE(kind, "htb")) {
+            testNetlinkFormatHTB(buf, options);
+        } else if (STREQ_NULLABLE(kind, "sfq")) {
+            const struct tc_sfq_qopt *opt = nla_data(options);
+
+            virBufferAsprintf(buf, " perturb %d", opt->perturb_period);
+        } else if (STREQ_NULLABLE(kind, "fw")) {
+            struct nlattr *fw[TCA_FW_MAX + 1];
+
+            if (nla_parse_nested(fw, TCA_FW_MAX, options, NULL) == 0 &&
+                fw[TCA_FW_CLASSID])
+                testNetlinkFormatHandle(buf, "flowid",
+                                        nla_get_u32(fw[TCA_FW_CLASSID]));
+        } else if (STREQ_NULLABLE(kind, "u32")) {
+            testNetlinkFormatU32(buf, options);
+        }
+    }
+
+    virBufferAddLit(buf, "\n");
+}
+
 static int
 testVirNetDevBandwidthSet(const void *data)
 {
@@ -78,7 +274,7 @@ testVirNetDevBandwidthSet(const void *data)
     if (!iface)
         iface = "eth0";
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    virNetlinkBatchSetDryRun(testNetlinkDryRun, &buf);
 
     if (virNetDevBandwidthSet(iface, band, info->hierarchical_class, true) < 0)
         goto cleanup;
@@ -102,7 +298,7 @@ testVirNetDevBandwidthSet(const void *data)
 
     ret = 0;
  cleanup:
-    virCommandSetDryRun(NULL, NULL, NULL);
+    virNetlinkBatchSetDryRun(NULL, NULL);
     virNetDevBandwidthFree(band);
     virBufferFreeAndReset(&buf);
     VIR_FREE(actual_cmd);
@@ -114,7 +310,7 @@ mymain(void)
 {
     int ret = 0;
 
-#define DO_TEST_SET(Band, Exp_cmd, ...) \
+# define DO_TEST_SET(Band, Exp_cmd, ...) \
     do { \
         struct testSetStruct data = {.band = Band, \
                                      .exp_cmd = Exp_cmd, \
@@ -133,37 +329,67 @@ mymain(void)
     DO_TEST_SET(("<bandwidth>"
                  "  <inbound average='1024'/>"
                  "</bandwidth>"),
-                (TC " qdisc del dev eth0 root\n"
-                 TC " qdisc del dev eth0 ingress\n"
-                 TC " qdisc add dev eth0 root handle 1: htb default 1\n"
-                 TC " class add dev eth0 parent 1: classid 1:1 htb rate 1024kbps quantum 87\n"
-                 TC " qdisc add dev eth0 parent 1:1 handle 2: sfq perturb 10\n"
-                 TC " filter add dev eth0 parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n"));
+                ("qdisc del dev 1 parent root\n"
+                 "qdisc del dev 1 parent ingress handle ffff: ingress\n"
+                 "qdisc add dev 1 parent root handle 1: htb default 1\n"
+                 "class add dev 1 parent 1: classid 1:1 htb rate 1024000Bps ceil 1024000Bps "
+                 "buffer 40039 cbuffer 40039 quantum 87\n"
+                 "qdisc add dev 1 parent 1:1 handle 2: sfq perturb 10\n"
+                 "filter add dev 1 parent 1: protocol all prio 1 handle 1 fw flowid 0:1\n"));
 
     DO_TEST_SET(("<bandwidth>"
                  "  <outbound average='1024'/>"
                  "</bandwidth>"),
-                (TC " qdisc del dev eth0 root\n"
-                 TC " qdisc del dev eth0 ingress\n"
-                 TC " qdisc add dev eth0 ingress\n"
-                 TC " filter add dev eth0 parent ffff: protocol all u32 match u32 0 0 "
-                 "police rate 1024kbps burst 1024kb mtu 64kb drop flowid :1\n"));
+                ("qdisc del dev 1 parent root\n"
+                 "qdisc del dev 1 parent ingress handle ffff: ingress\n"
+                 "qdisc add dev 1 parent ingress handle ffff: ingress\n"
+                 "filter add dev 1 parent ffff: protocol all prio 0 handle 0 u32 "
+                 "match 00000000/00000000 at 0 terminal "
+                 "police rate 1024000Bps burst 16000000 mtu 65536 drop rtab 1024 "
+                 "flowid 0:1\n"));
 
     DO_TEST_SET(("<bandwidth>"
                  "  <inbound average='1' peak='2' floor='3' burst='4'/>"
                  "  <outbound average='5' peak='6' burst='7'/>"
                  "</bandwidth>"),
-                (TC " qdisc del dev eth0 root\n"
-                 TC " qdisc del dev eth0 ingress\n"
-                 TC " qdisc add dev eth0 root handle 1: htb default 1\n"
-                 TC " class add dev eth0 parent 1: classid 1:1 htb rate 1kbps ceil 2kbps burst 4kb quantum 1\n"
-                 TC " qdisc add dev eth0 parent 1:1 handle 2: sfq perturb 10\n"
-                 TC " filter add dev eth0 parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n"
-                 TC " qdisc add dev eth0 ingress\n"
-                 TC " filter add dev eth0 parent ffff: protocol all u32 match u32 0 0 "
-                 "police rate 5kbps burst 7kb mtu 64kb drop flowid :1\n"));
+                ("qdisc del dev 1 parent root\n"
+                 "qdisc del dev 1 parent ingress handle ffff: ingress\n"
+                 "qdisc add dev 1 parent root handle 1: htb default 1\n"
+                 "class add dev 1 parent 1: classid 1:1 htb rate 1000Bps ceil 2000Bps "
+                 "buffer 64000000 cbuffer 12515625 quantum 1\n"
+                 "qdisc add dev 1 parent 1:1 handle 2: sfq perturb 10\n"
+                 "filter add dev 1 parent 1: protocol all prio 1 handle 1 fw flowid 0:1\n"
+                 "qdisc add dev 1 parent ingress handle ffff: ingress\n"
+                 "filter add dev 1 parent ffff: protocol all prio 0 handle 0 u32 "
+                 "match 00000000/00000000 at 0 terminal "
+                 "police rate 5000Bps burst 22400000 mtu 65536 drop rtab 1024 "
+                 "flowid 0:1\n"));
+
+    DO_TEST_SET(("<bandwidth>"
+                 "  <inbound average='1024' peak='2048'/>"
+                 "</bandwidth>"),
+                ("qdisc del dev 1 parent root\n"
+                 "qdisc del dev 1 parent ingress handle ffff: ingress\n"
+                 "qdisc add dev 1 parent root handle 1: htb default 2\n"
+                 "class add dev 1 parent 1: classid 1:1 htb rate 1024000Bps ceil 2048000Bps "
+                 "buffer 40039 cbuffer 27832 quantum 87\n"
+                 "class add dev 1 parent 1:1 classid 1:2 htb rate 1024000Bps ceil 2048000Bps "
+                 "buffer 40039 cbuffer 27832 quantum 87\n"
+                 "qdisc add dev 1 parent 1:2 handle 2: sfq perturb 10\n"
+                 "filter add dev 1 parent 1: protocol all prio 1 handle 1 fw flowid 0:1\n"),
+                .hierarchical_class = true);
 
     return ret;
 }
 
 VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virnetdevbandwidthmock.so")
+
+#else /* !(__linux__ && HAVE_LIBNL) */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !(__linux__ && HAVE_LIBNL) */
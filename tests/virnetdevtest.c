@@ -24,6 +24,16 @@
 
 # include "virnetdev.h"
 
+# ifdef HAVE_LIBNL
+#  include <linux/rtnetlink.h>
+#  include <netlink/attr.h>
+
+#  define LIBVIRT_VIRNETLINKPRIV_H_ALLOW
+#  include "virnetlinkpriv.h"
+#  define LIBVIRT_VIRNETDEVTAPPRIV_H_ALLOW
+#  include "virnetdevtappriv.h"
+# endif
+
 # define VIR_FROM_THIS VIR_FROM_NONE
 
 struct testVirNetDevGetLinkInfoData {
@@ -62,6 +72,239 @@ testVirNetDevGetLinkInfo(const void *opaque)
     return ret;
 }
 
+# ifdef HAVE_LIBNL
+struct testVirNetDevLinkBatchData {
+    size_t fail;        /* number of the request to fail, starting at 1 */
+    const char *result; /* expected requests */
+    const char *error;  /* expected error message */
+
+    virBuffer buf;
+    size_t nreqs;
+};
+
+
+/* Format the link request @msg like an ip link command */
+static void
+testVirNetDevLinkDryRun(struct nlmsghdr *msg,
+                        int *error,
+                        void *opaque)
+{
+    struct testVirNetDevLinkBatchData *data = opaque;
+    const struct ifinfomsg *ifinfo = nlmsg_data(msg);
+    struct nlattr *tb[IFLA_MAX + 1];
+
+    if (++data->nreqs == data->fail)
+        *error = -EBUSY;
+
+    if (msg->nlmsg_type != RTM_SETLINK ||
+        ifinfo->ifi_index != 0 ||
+        nlmsg_parse(msg, sizeof(*ifinfo), tb, IFLA_MAX, NULL) < 0 ||
+        !tb[IFLA_IFNAME]) {
+        virBufferAddLit(&data->buf, "<invalid>\n");
+        return;
+    }
+
+    virBufferAsprintf(&data->buf, "link set dev %s",
+                      nla_get_string(tb[IFLA_IFNAME]));
+
+    if (tb[IFLA_ADDRESS] && nla_len(tb[IFLA_ADDRESS]) == VIR_MAC_BUFLEN) {
+        virMacAddr mac;
+        char macstr[VIR_MAC_STRING_BUFLEN];
+
+        virMacAddrSetRaw(&mac, nla_data(tb[IFLA_ADDRESS]));
+        virBufferAsprintf(&data->buf, " address %s",
+                          virMacAddrFormat(&mac, macstr));
+    }
+    if (tb[IFLA_MTU])
+        virBufferAsprintf(&data->buf, " mtu %u", nla_get_u32(tb[IFLA_MTU]));
+    if (tb[IFLA_MASTER])
+        virBufferAsprintf(&data->buf, " master %u",
+                          nla_get_u32(tb[IFLA_MASTER]));
+    if (ifinfo->ifi_change & IFF_UP)
+        virBufferAdd(&data->buf, ifinfo->ifi_flags & IFF_UP ? " up" : " down", -1);
+
+    virBufferAddLit(&data->buf, "\n");
+}
+
+
+static int
+testVirNetDevLinkBatch(const void *opaque)
+{
+    struct testVirNetDevLinkBatchData data = *(const struct testVirNetDevLinkBatchData *)opaque;
+    VIR_AUTOPTR(virNetDevLinkBatch) batch = NULL;
+    VIR_AUTOFREE(char *) actual = NULL;
+    virMacAddr mac;
+    int rc;
+    int ret = -1;
+
+    if (virMacAddrParse("fe:54:00:a4:6f:91", &mac) < 0)
+        return -1;
+
+    /* the index of the master is looked up in virnetdevmock */
+    if (!(batch = virNetDevLinkBatchNew()) ||
+        virNetDevLinkBatchSetMAC(batch, "vnet0", &mac) < 0 ||
+        virNetDevLinkBatchSetMTU(batch, "vnet0", 9000) < 0 ||
+        virNetDevLinkBatchSetMaster(batch, "vnet0", "virbr0") < 0 ||
+        virNetDevLinkBatchSetOnline(batch, "vnet0", true) < 0)
+        return -1;
+
+    virNetlinkBatchSetDryRun(testVirNetDevLinkDryRun, &data);
+    rc = virNetDevLinkBatchRun(batch);
+    virNetlinkBatchSetDryRun(NULL, NULL);
+
+    if (!(actual = virBufferContentAndReset(&data.buf)))
+        goto cleanup;
+
+    if (STRNEQ(data.result, actual)) {
+        virTestDifference(stderr, data.result, actual);
+        goto cleanup;
+    }
+
+    if (data.error) {
+        if (rc == 0 || !strstr(virGetLastErrorMessage(), data.error)) {
+            fprintf(stderr, "expected error '%s', got '%s'\n",
+                    data.error, rc < 0 ? virGetLastErrorMessage() : "none");
+            goto cleanup;
+        }
+        virResetLastError();
+    } else if (rc < 0) {
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&data.buf);
+    return ret;
+}
+
+
+struct testVirNetDevTapStatsData {
+    bool stats64;       /* whether to send IFLA_STATS64 too */
+    bool swapped;       /* whether to swap RX/TX fields */
+};
+
+
+/* Feed a link message for @ifname to the snapshot like a dump does */
+static int
+testVirNetDevTapStatsFeed(virNetDevTapStatsSnapshotPtr snapshot,
+                          int type,
+                          const char *ifname,
+                          const struct rtnl_link_stats *stats,
+                          const struct rtnl_link_stats64 *stats64)
+{
+    VIR_AUTOPTR(virNetlinkMsg) msg = NULL;
+    struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+
+    if (!(msg = nlmsg_alloc_simple(type, NLM_F_MULTI)) ||
+        nlmsg_append(msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0 ||
+        nla_put_string(msg, IFLA_IFNAME, ifname) < 0 ||
+        (stats && nla_put(msg, IFLA_STATS, sizeof(*stats), stats) < 0) ||
+        (stats64 && nla_put(msg, IFLA_STATS64, sizeof(*stats64), stats64) < 0)) {
+        fprintf(stderr, "cannot build netlink message\n");
+        return -1;
+    }
+
+    return virNetDevTapStatsSnapshotCallback(nlmsg_hdr(msg), snapshot);
+}
+
+
+static int
+testVirNetDevTapStats(const void *opaque)
+{
+    const struct testVirNetDevTapStatsData *data = opaque;
+    VIR_AUTOPTR(virNetDevTapStatsSnapshot) snapshot = NULL;
+    struct rtnl_link_stats stats = {
+        .rx_packets = 10, .tx_packets = 20,
+        .rx_bytes = 1000, .tx_bytes = 2000,
+        .rx_errors = 1, .tx_errors = 4,
+        .rx_dropped = 2, .tx_dropped = 5,
+        .rx_missed_errors = 3,
+    };
+    /* 32 bit counters wrap, the 64 bit ones have to be preferred */
+    struct rtnl_link_stats64 stats64 = {
+        .rx_packets = 10, .tx_packets = 20,
+        .rx_bytes = 5000000000ULL, .tx_bytes = 6000000000ULL,
+        .rx_errors = 1, .tx_errors = 4,
+        .rx_dropped = 2, .tx_dropped = 5,
+        .rx_missed_errors = 3,
+    };
+    virDomainInterfaceStatsStruct expected = {
+        .rx_bytes = data->stats64 ? 5000000000LL : 1000,
+        .rx_packets = 10,
+        .rx_errs = 1,
+        .rx_drop = 2 + 3,
+        .tx_bytes = data->stats64 ? 6000000000LL : 2000,
+        .tx_packets = 20,
+        .tx_errs = 4,
+        .tx_drop = 5,
+    };
+    virDomainInterfaceStatsStruct actual;
+
+    if (data->swapped) {
+        virDomainInterfaceStatsStruct tmp = expected;
+
+        expected.rx_bytes = tmp.tx_bytes;
+        expected.rx_packets = tmp.tx_packets;
+        expected.rx_errs = tmp.tx_errs;
+        expected.rx_drop = tmp.tx_drop;
+        expected.tx_bytes = tmp.rx_bytes;
+        expected.tx_packets = tmp.rx_packets;
+        expected.tx_errs = tmp.rx_errs;
+        expected.tx_drop = tmp.rx_drop;
+    }
+
+    if (!(snapshot = virNetDevTapStatsSnapshotNewEmpty()))
+        return -1;
+
+    /* only new links are looked at, and only when they have stats */
+    if (testVirNetDevTapStatsFeed(snapshot, RTM_NEWLINK, "vnet0", &stats,
+                                  data->stats64 ? &stats64 : NULL) < 0 ||
+        testVirNetDevTapStatsFeed(snapshot, RTM_DELLINK, "vnet1", &stats,
+                                  NULL) < 0 ||
+        testVirNetDevTapStatsFeed(snapshot, RTM_NEWLINK, "vnet2", NULL,
+                                  NULL) < 0)
+        return -1;
+
+    if (virNetDevTapStatsSnapshotGet(snapshot, "vnet0", &actual,
+                                     data->swapped) < 0)
+        return -1;
+
+    if (actual.rx_bytes != expected.rx_bytes ||
+        actual.rx_packets != expected.rx_packets ||
+        actual.rx_errs != expected.rx_errs ||
+        actual.rx_drop != expected.rx_drop ||
+        actual.tx_bytes != expected.tx_bytes ||
+        actual.tx_packets != expected.tx_packets ||
+        actual.tx_errs != expected.tx_errs ||
+        actual.tx_drop != expected.tx_drop) {
+        fprintf(stderr,
+                "expected rx %lld/%lld/%lld/%lld tx %lld/%lld/%lld/%lld, "
+                "got rx %lld/%lld/%lld/%lld tx %lld/%lld/%lld/%lld\n",
+                expected.rx_bytes, expected.rx_packets,
+                expected.rx_errs, expected.rx_drop,
+                expected.tx_bytes, expected.tx_packets,
+                expected.tx_errs, expected.tx_drop,
+                actual.rx_bytes, actual.rx_packets,
+                actual.rx_errs, actual.rx_drop,
+                actual.tx_bytes, actual.tx_packets,
+                actual.tx_errs, actual.tx_drop);
+        return -1;
+    }
+
+    if (virNetDevTapStatsSnapshotGet(snapshot, "vnet1", &actual,
+                                     data->swapped) == 0 ||
+        virNetDevTapStatsSnapshotGet(snapshot, "vnet2", &actual,
+                                     data->swapped) == 0) {
+        fprintf(stderr, "unexpected stats of vnet1 or vnet2\n");
+        return -1;
+    }
+    virResetLastError();
+
+    return 0;
+}
+# endif /* HAVE_LIBNL */
+
 static int
 mymain(void)
 {
@@ -79,6 +322,41 @@ mymain(void)
     DO_TEST_LINK("lo", VIR_NETDEV_IF_STATE_UNKNOWN, 0);
     DO_TEST_LINK("eth0-broken", VIR_NETDEV_IF_STATE_DOWN, 0);
 
+# ifdef HAVE_LIBNL
+#  define DO_TEST_LINK_BATCH(name, fail, result, error) \
+    do { \
+        struct testVirNetDevLinkBatchData data = { fail, result, error }; \
+        if (virTestRun("Link batch: " name, \
+                       testVirNetDevLinkBatch, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#  define LINK_BATCH_RESULT \
+    "link set dev vnet0 address fe:54:00:a4:6f:91\n" \
+    "link set dev vnet0 mtu 9000\n" \
+    "link set dev vnet0 master 42\n" \
+    "link set dev vnet0 up\n"
+
+    DO_TEST_LINK_BATCH("success", 0, LINK_BATCH_RESULT, NULL);
+    DO_TEST_LINK_BATCH("MTU failure", 2, LINK_BATCH_RESULT,
+                       "Cannot set interface MTU on 'vnet0'");
+    DO_TEST_LINK_BATCH("master failure", 3, LINK_BATCH_RESULT,
+                       "Unable to add bridge virbr0 port vnet0");
+
+#  define DO_TEST_TAP_STATS(name, stats64, swapped) \
+    do { \
+        struct testVirNetDevTapStatsData data = { stats64, swapped }; \
+        if (virTestRun("Tap stats: " name, \
+                       testVirNetDevTapStats, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_TAP_STATS("stats", false, false);
+    DO_TEST_TAP_STATS("stats swapped", false, true);
+    DO_TEST_TAP_STATS("stats64", true, false);
+    DO_TEST_TAP_STATS("stats64 swapped", true, true);
+# endif
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
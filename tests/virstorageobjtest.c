@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virstorageobj.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define POOL_XML(name, uuid) \
+    "<pool type='dir'>" \
+    "  <name>" name "</name>" \
+    "  <uuid>" uuid "</uuid>" \
+    "  <target><path>/pools/" name "</path></target>" \
+    "</pool>"
+#define POOL_UUID "ad3c1b48-ae64-4d8a-b2cd-fab31f35a0a"
+
+
+static virStoragePoolObjPtr
+testPoolAdd(virStoragePoolObjListPtr pools,
+            const char *xml)
+{
+    virStoragePoolDefPtr def;
+    virStoragePoolObjPtr obj;
+
+    if (!(def = virStoragePoolDefParseString(xml)))
+        return NULL;
+
+    if (!(obj = virStoragePoolObjAssignDef(pools, def, false))) {
+        virStoragePoolDefFree(def);
+        return NULL;
+    }
+
+    virStoragePoolObjSetActive(obj, true);
+    virObjectUnlock(obj);
+    return obj;
+}
+
+
+/* The volume @name of @pool has the key "key-@name" and the target
+ * path "/pools/<pool>/@name" */
+static int
+testVolAdd(virStoragePoolObjPtr pool,
+           const char *name)
+{
+    virStorageVolDefPtr voldef;
+    int ret = -1;
+
+    if (VIR_ALLOC(voldef) < 0)
+        return -1;
+
+    voldef->type = VIR_STORAGE_VOL_FILE;
+    if (VIR_STRDUP(voldef->name, name) < 0 ||
+        virAsprintf(&voldef->key, "key-%s", name) < 0 ||
+        virAsprintf(&voldef->target.path, "/pools/%s/%s",
+                    virStoragePoolObjGetDef(pool)->name, name) < 0)
+        goto cleanup;
+
+    virObjectLock(pool);
+    if (virStoragePoolObjAddVol(pool, voldef) == 0)
+        voldef = NULL;
+    else
+        fprintf(stderr, "cannot add volume '%s'\n", name);
+    virObjectUnlock(pool);
+
+    if (!voldef)
+        ret = 0;
+
+ cleanup:
+    virStorageVolDefFree(voldef);
+    return ret;
+}
+
+
+static int
+testVolRemove(virStoragePoolObjPtr pool,
+              const char *name)
+{
+    virStorageVolDefPtr voldef;
+
+    virObjectLock(pool);
+    if ((voldef = virStorageVolDefFindByName(pool, name)))
+        virStoragePoolObjRemoveVol(pool, voldef);
+    virObjectUnlock(pool);
+
+    if (!voldef) {
+        fprintf(stderr, "cannot find volume '%s' to remove\n", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testVolClear(virStoragePoolObjPtr pool)
+{
+    virObjectLock(pool);
+    virStoragePoolObjClearVols(pool);
+    virObjectUnlock(pool);
+}
+
+
+static int
+testCheckFound(virStoragePoolObjPtr obj,
+               virStorageVolDefPtr voldef,
+               const char *how,
+               const char *name,
+               const char *expected)
+{
+    int ret = 0;
+
+    if (!obj != !expected ||
+        (obj && (STRNEQ(virStoragePoolObjGetDef(obj)->name, expected) ||
+                 STRNEQ(voldef->name, name)))) {
+        fprintf(stderr, "volume '%s' by %s: expected in %s, found in %s\n",
+                name, how, NULLSTR(expected),
+                obj ? virStoragePoolObjGetDef(obj)->name : "<null>");
+        ret = -1;
+    }
+
+    virStoragePoolObjEndAPI(&obj);
+    return ret;
+}
+
+
+/* Check that the volume @name of the pool @poolname is found by its name
+ * in @pool and by its key and path in @pools if @expected is the name of
+ * @pool, and not found anywhere if @expected is NULL. */
+static int
+testCheckVol(virStoragePoolObjListPtr pools,
+             virStoragePoolObjPtr pool,
+             const char *name,
+             const char *expected)
+{
+    const char *poolname = virStoragePoolObjGetDef(pool)->name;
+    VIR_AUTOFREE(char *) key = NULL;
+    VIR_AUTOFREE(char *) path = NULL;
+    virStorageVolDefPtr voldef;
+    virStoragePoolObjPtr obj;
+    bool found;
+
+    if (virAsprintf(&key, "key-%s", name) < 0 ||
+        virAsprintf(&path, "/pools/%s/%s", poolname, name) < 0)
+        return -1;
+
+    virObjectLock(pool);
+    found = !!virStorageVolDefFindByName(pool, name);
+    virObjectUnlock(pool);
+
+    if (found != !!expected) {
+        fprintf(stderr, "volume '%s' by name: expected %s\n",
+                name, expected ? "found" : "missing");
+        return -1;
+    }
+
+    obj = virStoragePoolObjListFindVolByKey(pools, key, &voldef);
+    if (testCheckFound(obj, voldef, "key", name, expected) < 0)
+        return -1;
+
+    obj = virStoragePoolObjListFindVolByPath(pools, path, &voldef);
+    if (testCheckFound(obj, voldef, "path", name, expected) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testVolIndex(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolObjListPtr pools;
+    virStoragePoolObjPtr a = NULL;
+    virStoragePoolObjPtr b = NULL;
+    virStorageVolDefPtr voldef;
+    int ret = -1;
+
+    if (!(pools = virStoragePoolObjListNew()))
+        return -1;
+
+    if (!(a = testPoolAdd(pools, POOL_XML("a", POOL_UUID "1"))) ||
+        !(b = testPoolAdd(pools, POOL_XML("b", POOL_UUID "2"))))
+        goto cleanup;
+
+    /* AddVol */
+    if (testVolAdd(a, "v1") < 0 ||
+        testVolAdd(a, "v2") < 0 ||
+        testVolAdd(b, "v3") < 0 ||
+        testVolAdd(b, "shared") < 0 ||
+        testCheckVol(pools, a, "v1", "a") < 0 ||
+        testCheckVol(pools, a, "v2", "a") < 0 ||
+        testCheckVol(pools, b, "v3", "b") < 0 ||
+        testCheckVol(pools, b, "shared", "b") < 0)
+        goto cleanup;
+
+    /* A key in both pools is still found after it's gone from one */
+    if (testVolAdd(a, "shared") < 0 ||
+        testVolRemove(b, "shared") < 0 ||
+        testCheckVol(pools, a, "shared", "a") < 0)
+        goto cleanup;
+
+    /* RemoveVol */
+    if (testVolRemove(a, "v1") < 0 ||
+        testCheckVol(pools, a, "v1", NULL) < 0 ||
+        testCheckVol(pools, a, "v2", "a") < 0)
+        goto cleanup;
+
+    /* ClearVols */
+    testVolClear(a);
+    if (testCheckVol(pools, a, "v2", NULL) < 0 ||
+        testCheckVol(pools, b, "v3", "b") < 0)
+        goto cleanup;
+
+    /* A refresh clears the volumes and adds the current ones */
+    if (testVolAdd(a, "v1") < 0 ||
+        testVolAdd(a, "v2") < 0)
+        goto cleanup;
+
+    testVolClear(a);
+    if (testVolAdd(a, "v2") < 0 ||
+        testVolAdd(a, "v4") < 0 ||
+        testCheckVol(pools, a, "v1", NULL) < 0 ||
+        testCheckVol(pools, a, "v2", "a") < 0 ||
+        testCheckVol(pools, a, "v4", "a") < 0)
+        goto cleanup;
+
+    /* Volumes of inactive pools are not looked up */
+    virObjectLock(b);
+    virStoragePoolObjSetActive(b, false);
+    virObjectUnlock(b);
+    if (virStoragePoolObjListFindVolByKey(pools, "key-v3", &voldef) ||
+        virStoragePoolObjListFindVolByPath(pools, "/pools/b/v3", &voldef)) {
+        fprintf(stderr, "volume of an inactive pool found\n");
+        goto cleanup;
+    }
+
+    /* Nor are volumes of pools removed from the list */
+    virObjectLock(a);
+    virStoragePoolObjRemove(pools, a);
+    virObjectUnlock(a);
+    if (virStoragePoolObjListFindVolByKey(pools, "key-v2", &voldef) ||
+        virStoragePoolObjListFindVolByPath(pools, "/pools/a/v2", &voldef)) {
+        fprintf(stderr, "volume of a removed pool found\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(a);
+    virObjectUnref(b);
+    virObjectUnref(pools);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("volume index", testVolIndex, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
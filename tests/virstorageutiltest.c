@@ -70,6 +70,100 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+enum {
+    TEST_PROBE_CACHE_SIZE = 1 << 0,
+    TEST_PROBE_CACHE_MTIME = 1 << 1,
+    TEST_PROBE_CACHE_CTIME = 1 << 2,
+    TEST_PROBE_CACHE_RECENT = 1 << 3,
+    TEST_PROBE_CACHE_DROP = 1 << 4,
+};
+
+struct testProbeCacheData {
+    const char *path;
+    unsigned int flags; /* what changes between caching and lookup */
+    bool hit;
+};
+
+static int
+testProbeCache(const void *opaque)
+{
+    const struct testProbeCacheData *data = opaque;
+    VIR_AUTOUNREF(virStorageSourcePtr) meta = NULL;
+    VIR_AUTOUNREF(virStorageSourcePtr) cached = NULL;
+    VIR_AUTOUNREF(virStorageSourcePtr) again = NULL;
+    struct stat orig;
+    struct stat sb = {
+        .st_dev = 1,
+        .st_ino = 2,
+        .st_size = 1024 * 1024,
+    };
+    int backingStoreFormat = VIR_STORAGE_FILE_NONE;
+    int rc;
+
+    /* files changed within the last second must not be cached */
+    sb.st_mtime = time(NULL) - 10;
+    sb.st_ctime = time(NULL) - 10;
+    if (data->flags & TEST_PROBE_CACHE_RECENT)
+        sb.st_ctime = time(NULL);
+
+    if (!(meta = virStorageSourceNew()))
+        return -1;
+
+    meta->format = VIR_STORAGE_FILE_QCOW2;
+    if (VIR_STRDUP(meta->backingStoreRaw, "base.qcow2") < 0)
+        return -1;
+
+    if (virStorageBackendProbeCacheSet(data->path, &sb, meta,
+                                       VIR_STORAGE_FILE_RAW) < 0)
+        return -1;
+
+    orig = sb;
+    if (data->flags & TEST_PROBE_CACHE_SIZE)
+        sb.st_size += 512;
+    if (data->flags & TEST_PROBE_CACHE_MTIME)
+        sb.st_mtime++;
+    if (data->flags & TEST_PROBE_CACHE_CTIME)
+        sb.st_ctime++;
+    if (data->flags & TEST_PROBE_CACHE_DROP)
+        virStorageBackendProbeCacheDropPool("/pool");
+
+    if ((rc = virStorageBackendProbeCacheGet(data->path, &sb, &cached,
+                                             &backingStoreFormat)) < 0)
+        return -1;
+
+    if (rc != data->hit) {
+        fprintf(stderr, "expected a cache %s\n", data->hit ? "hit" : "miss");
+        return -1;
+    }
+
+    /* a miss on a changed file drops its entry */
+    if (!data->hit) {
+        if (virStorageBackendProbeCacheGet(data->path, &orig, &again,
+                                           &backingStoreFormat) != 0) {
+            fprintf(stderr, "stale entry is still cached\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (cached == meta ||
+        cached->format != VIR_STORAGE_FILE_QCOW2 ||
+        STRNEQ_NULLABLE(cached->backingStoreRaw, "base.qcow2") ||
+        backingStoreFormat != VIR_STORAGE_FILE_RAW) {
+        fprintf(stderr, "cached metadata doesn't match\n");
+        return -1;
+    }
+
+    if (virStorageBackendProbeCacheGet(data->path, &sb, &again,
+                                       &backingStoreFormat) != 1) {
+        fprintf(stderr, "entry is gone after a hit\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -104,6 +198,26 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+#define DO_TEST_PROBE_CACHE(name, dir, flags, hit) \
+    do { \
+        struct testProbeCacheData data = { dir "/" name ".qcow2", \
+                                           flags, hit }; \
+        if (virTestRun("probe-cache-" name, testProbeCache, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_PROBE_CACHE("hit", "/pool", 0, true);
+    DO_TEST_PROBE_CACHE("size", "/pool", TEST_PROBE_CACHE_SIZE, false);
+    DO_TEST_PROBE_CACHE("mtime", "/pool", TEST_PROBE_CACHE_MTIME, false);
+    DO_TEST_PROBE_CACHE("ctime", "/pool", TEST_PROBE_CACHE_CTIME, false);
+    DO_TEST_PROBE_CACHE("recent", "/pool", TEST_PROBE_CACHE_RECENT, false);
+    DO_TEST_PROBE_CACHE("drop", "/pool", TEST_PROBE_CACHE_DROP, false);
+    DO_TEST_PROBE_CACHE("drop-other", "/pool2", TEST_PROBE_CACHE_DROP, true);
+    DO_TEST_PROBE_CACHE("drop-nested", "/pool/dir", TEST_PROBE_CACHE_DROP,
+                        true);
+
+#undef DO_TEST_PROBE_CACHE
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -200,6 +200,173 @@ testTypedParamsGetStringList(const void *opaque ATTRIBUTE_UNUSED)
     return rv;
 }
 
+#define COMPACT_TEST_RECORDS 500
+#define COMPACT_TEST_DISKS 16
+
+static int
+testTypedParamsSerializeCompact(const void *opaque ATTRIBUTE_UNUSED)
+{
+    static const char *fields[] = { "rd.reqs", "rd.bytes", "wr.reqs",
+                                    "wr.bytes", "path" };
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    virTypedParameterRemoteCompactPtr remote[COMPACT_TEST_RECORDS] = { 0 };
+    unsigned int nremote[COMPACT_TEST_RECORDS] = { 0 };
+    virTypedParamsKeyTablePtr table = NULL;
+    virTypedParameterPtr out = NULL;
+    int nout = 0;
+    char **keys = NULL;
+    unsigned int nkeys = 0;
+    size_t i, j, k;
+    int rv = -1;
+
+    for (i = 0; i < COMPACT_TEST_DISKS; i++) {
+        for (j = 0; j < ARRAY_CARDINALITY(fields); j++) {
+            char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+            snprintf(field, sizeof(field), "block.%zu.%s", i, fields[j]);
+            if (STREQ(fields[j], "path")) {
+                if (virTypedParamsAddString(&params, &nparams, &maxparams,
+                                            field, "/dev/null") < 0)
+                    goto cleanup;
+            } else {
+                if (virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                            field, i * 1000 + j) < 0)
+                    goto cleanup;
+            }
+        }
+    }
+
+    if (!(table = virTypedParamsKeyTableNew()))
+        goto cleanup;
+
+    /* Every record of a bulk stats reply carries the same names */
+    for (i = 0; i < COMPACT_TEST_RECORDS; i++) {
+        if (virTypedParamsSerializeCompact(params, nparams, table,
+                                           &remote[i], &nremote[i],
+                                           VIR_TYPED_PARAM_STRING_OKAY) < 0)
+            goto cleanup;
+    }
+
+    virTypedParamsKeyTableSteal(table, &keys, &nkeys);
+
+    if (nkeys != nparams) {
+        fprintf(stderr, "expected %d distinct names, got %u\n",
+                nparams, nkeys);
+        goto cleanup;
+    }
+
+    for (i = 0; i < COMPACT_TEST_RECORDS; i++) {
+        if (virTypedParamsDeserializeCompact(remote[i], nremote[i],
+                                             keys, nkeys, 0,
+                                             &out, &nout) < 0)
+            goto cleanup;
+
+        if (nout != nparams)
+            goto cleanup;
+
+        for (k = 0; k < nout; k++) {
+            if (STRNEQ(out[k].field, params[k].field) ||
+                out[k].type != params[k].type)
+                goto cleanup;
+
+            if (out[k].type == VIR_TYPED_PARAM_STRING ?
+                STRNEQ(out[k].value.s, params[k].value.s) :
+                out[k].value.ul != params[k].value.ul)
+                goto cleanup;
+        }
+
+        virTypedParamsFree(out, nout);
+        out = NULL;
+    }
+
+    /* A reference outside of the table must be rejected */
+    remote[0][0].key = nkeys;
+    if (virTypedParamsDeserializeCompact(remote[0], nremote[0],
+                                         keys, nkeys, 0,
+                                         &out, &nout) == 0 ||
+        out || nout)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    for (i = 0; i < COMPACT_TEST_RECORDS; i++)
+        virTypedParamsRemoteCompactFree(remote[i], nremote[i]);
+    virStringListFreeCount(keys, nkeys);
+    virTypedParamsKeyTableFree(table);
+    virTypedParamsFree(out, nout);
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+#define LIST_TEST_DISKS 1000
+
+static int
+testTypedParamsList(const void *opaque ATTRIBUTE_UNUSED)
+{
+    VIR_AUTOPTR(virTypedParamList) list = NULL;
+    virTypedParameterPtr par;
+    virTypedParameterPtr params = NULL;
+    size_t nparams = 0;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+    int rv = -1;
+
+    if (VIR_ALLOC(list) < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(list, LIST_TEST_DISKS, "block.count") < 0 ||
+        virTypedParamListEnableIndex(list) < 0)
+        goto cleanup;
+
+    for (i = 0; i < LIST_TEST_DISKS; i++) {
+        if (virTypedParamListAddString(list, "/dev/null",
+                                       "block.%zu.path", i) < 0 ||
+            virTypedParamListAddULLong(list, i * 10,
+                                       "block.%zu.rd.bytes", i) < 0 ||
+            virTypedParamListAddBoolean(list, i % 2, "block.%zu.ok", i) < 0)
+            goto cleanup;
+    }
+
+    /* duplicates are stored, lookups return the first occurrence */
+    if (virTypedParamListAddUInt(list, 0, "block.count") < 0)
+        goto cleanup;
+
+    for (i = 0; i < LIST_TEST_DISKS; i++) {
+        snprintf(field, sizeof(field), "block.%zu.rd.bytes", i);
+        if (!(par = virTypedParamListGet(list, field)) ||
+            par->type != VIR_TYPED_PARAM_ULLONG ||
+            par->value.ul != i * 10) {
+            fprintf(stderr, "lookup of '%s' failed\n", field);
+            goto cleanup;
+        }
+    }
+
+    if (!(par = virTypedParamListGet(list, "block.count")) ||
+        par->value.ui != LIST_TEST_DISKS ||
+        virTypedParamListGet(list, "block.1000.path"))
+        goto cleanup;
+
+    /* names which do not fit into a typed parameter are refused */
+    memset(field, 'x', sizeof(field) - 1);
+    field[sizeof(field) - 1] = '\0';
+    if (virTypedParamListAddInt(list, 0, "%s.x", field) == 0)
+        goto cleanup;
+    virResetLastError();
+
+    nparams = virTypedParamListStealParams(list, &params);
+    if (nparams != LIST_TEST_DISKS * 3 + 2 ||
+        list->npar != 0 || list->par ||
+        virTypedParamListGet(list, "block.count"))
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
 static int
 testTypedParamsValidator(void)
 {
@@ -301,6 +468,13 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("Compact serialization", testTypedParamsSerializeCompact,
+                   NULL) < 0)
+        rv = -1;
+
+    if (virTestRun("Parameter list", testTypedParamsList, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 
 #if defined(HAVE_BSD_NSS)
@@ -78,6 +79,25 @@ sortAddr(leaseAddress *tmpAddress,
 }
 
 
+/* The lease database replaces the status file, which is only left
+ * by networks started before the database was introduced. */
+static bool
+hasLeaseDB(const char *leaseDir,
+           const char *name,
+           size_t namelen)
+{
+    char *path;
+    bool ret;
+
+    if (asprintf(&path, "%s/%.*s.leasedb", leaseDir, (int)namelen, name) < 0)
+        return false;
+
+    ret = access(path, F_OK) == 0;
+    free(path);
+    return ret;
+}
+
+
 /**
  * findLease:
  * @name: domain name to lookup
@@ -112,6 +132,8 @@ findLease(const char *name,
     struct dirent *entry;
     char **leaseFiles = NULL;
     size_t nleaseFiles = 0;
+    char **leaseDBs = NULL;
+    size_t nleaseDBs = 0;
     char **macs = NULL;
     size_t nmacs = 0;
     size_t i;
@@ -137,7 +159,20 @@ findLease(const char *name,
         char *path;
         size_t dlen = strlen(entry->d_name);
 
-        if (dlen >= 7 && !strcmp(entry->d_name + dlen - 7, ".status")) {
+        if (dlen >= 8 && !strcmp(entry->d_name + dlen - 8, ".leasedb")) {
+            char **tmpLease;
+            if (asprintf(&path, "%s/%s", leaseDir, entry->d_name) < 0)
+                goto cleanup;
+
+            tmpLease = realloc(leaseDBs, sizeof(char *) * (nleaseDBs + 1));
+            if (!tmpLease) {
+                free(path);
+                goto cleanup;
+            }
+            leaseDBs = tmpLease;
+            leaseDBs[nleaseDBs++] = path;
+        } else if (dlen >= 7 && !strcmp(entry->d_name + dlen - 7, ".status") &&
+                   !hasLeaseDB(leaseDir, entry->d_name, dlen - 7)) {
             char **tmpLease;
             if (asprintf(&path, "%s/%s", leaseDir, entry->d_name) < 0)
                 goto cleanup;
@@ -179,6 +214,15 @@ findLease(const char *name,
         goto cleanup;
     }
 
+    for (i = 0; i < nleaseDBs; i++) {
+        if (findLeasesDB(leaseDBs[i],
+                         name, macs, nmacs,
+                         af, now,
+                         address, naddress,
+                         found) < 0)
+            goto cleanup;
+    }
+
     for (i = 0; i < nleaseFiles; i++) {
         if (findLeases(leaseFiles[i],
                        name, macs, nmacs,
@@ -198,6 +242,9 @@ findLease(const char *name,
     for (i = 0; i < nleaseFiles; i++)
         free(leaseFiles[i]);
     free(leaseFiles);
+    for (i = 0; i < nleaseDBs; i++)
+        free(leaseDBs[i]);
+    free(leaseDBs);
     for (i = 0; i < nmacs; i++)
         free(macs[i]);
     free(macs);
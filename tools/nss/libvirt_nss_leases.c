@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
@@ -32,6 +35,8 @@
 #include "libvirt_nss_leases.h"
 #include "libvirt_nss.h"
 
+#include "src/util/virleasedbfile.h"
+
 enum {
     FIND_LEASES_STATE_START,
     FIND_LEASES_STATE_LIST,
@@ -430,3 +435,137 @@ findLeases(const char *file,
         close(fd);
     return ret;
 }
+
+
+static int
+findLeasesDBEntry(const virLeaseDBFileHeader *hdr,
+                  const virLeaseDBFileEntry *entry,
+                  const char *name,
+                  int af,
+                  time_t now,
+                  leaseAddress **addrs,
+                  size_t *naddrs,
+                  bool *found)
+{
+    const char *ipaddr = virLeaseDBFileString(hdr, entry->ip);
+
+    if (entry->expirytime < now) {
+        DEBUG("Entry expired at %lld vs now %lld",
+              (long long) entry->expirytime, (long long) now);
+        return 0;
+    }
+
+    if (!ipaddr)
+        return 0;
+
+    *found = true;
+
+    return appendAddr(name, addrs, naddrs, ipaddr, entry->expirytime, af);
+}
+
+
+/**
+ * findLeasesDB:
+ *
+ * Like findLeases(), but looks @name or @macs up in the index of the
+ * lease database @file instead of parsing all leases.
+ */
+int
+findLeasesDB(const char *file,
+             const char *name,
+             char **macs,
+             size_t nmacs,
+             int af,
+             time_t now,
+             leaseAddress **addrs,
+             size_t *naddrs,
+             bool *found)
+{
+    int fd = -1;
+    int ret = -1;
+    struct stat sb;
+    void *data = MAP_FAILED;
+    const virLeaseDBFileHeader *hdr;
+    const virLeaseDBFileEntry *entry;
+    const char *str;
+    uint32_t n;
+    size_t i, j;
+
+    if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+        ERROR("Cannot open %s", file);
+        goto cleanup;
+    }
+
+    if (fstat(fd, &sb) < 0) {
+        ERROR("Cannot stat %s", file);
+        goto cleanup;
+    }
+
+    /* an empty database has no leases */
+    if (sb.st_size == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if ((data = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED,
+                     fd, 0)) == MAP_FAILED) {
+        ERROR("Cannot map %s", file);
+        goto cleanup;
+    }
+
+    if (!(hdr = virLeaseDBFileCheck(data, sb.st_size))) {
+        ERROR("Invalid lease database %s", file);
+        goto cleanup;
+    }
+
+    if (nmacs) {
+        DEBUG("Check %zu macs", nmacs);
+        for (i = 0; i < nmacs; i++) {
+            n = virLeaseDBFileFirst(hdr, VIR_LEASE_DB_INDEX_MAC, macs[i]);
+
+            /* bounded, in case the chain of a damaged database loops */
+            for (j = 0; j < hdr->nentries &&
+                 (entry = virLeaseDBFileEntryGet(hdr, n)); j++) {
+                n = entry->next[VIR_LEASE_DB_INDEX_MAC];
+
+                if (!(str = virLeaseDBFileString(hdr, entry->mac)) ||
+                    strcasecmp(str, macs[i]))
+                    continue;
+
+                if (findLeasesDBEntry(hdr, entry, name, af, now,
+                                      addrs, naddrs, found) < 0)
+                    goto cleanup;
+            }
+        }
+    } else {
+        DEBUG("Check name '%s'", name);
+        n = virLeaseDBFileFirst(hdr, VIR_LEASE_DB_INDEX_HOSTNAME, name);
+
+        for (j = 0; j < hdr->nentries &&
+             (entry = virLeaseDBFileEntryGet(hdr, n)); j++) {
+            n = entry->next[VIR_LEASE_DB_INDEX_HOSTNAME];
+
+            if (!(str = virLeaseDBFileString(hdr, entry->hostname)) ||
+                strcmp(str, name))
+                continue;
+
+            if (findLeasesDBEntry(hdr, entry, name, af, now,
+                                  addrs, naddrs, found) < 0)
+                goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret != 0) {
+        free(*addrs);
+        *addrs = NULL;
+        *naddrs = 0;
+    }
+    if (data != MAP_FAILED)
+        munmap(data, sb.st_size);
+    if (fd != -1)
+        close(fd);
+    return ret;
+}